@@ -261,9 +261,16 @@ typedef struct git_checkout_options {
 	const char *ancestor_label; /**< the name of the common ancestor side of conflicts */
 	const char *our_label; /**< the name of the "our" side of conflicts */
 	const char *their_label; /**< the name of the "their" side of conflicts */
+
+	/** Number of threads that read, filter and write files.  Zero (the
+	 *  default) picks a count based on the number of online CPUs and
+	 *  files to write; one writes every file from the calling thread.
+	 *  (Added in version 2 of the options.)
+	 */
+	unsigned int workers;
 } git_checkout_options;
 
-#define GIT_CHECKOUT_OPTIONS_VERSION 1
+#define GIT_CHECKOUT_OPTIONS_VERSION 2
 #define GIT_CHECKOUT_OPTIONS_INIT {GIT_CHECKOUT_OPTIONS_VERSION}
 
 /**
@@ -173,7 +173,7 @@ typedef struct git_clone_options {
 	void *remote_cb_payload;
 } git_clone_options;
 
-#define GIT_CLONE_OPTIONS_VERSION 1
+#define GIT_CLONE_OPTIONS_VERSION 2
 #define GIT_CLONE_OPTIONS_INIT {GIT_CLONE_OPTIONS_VERSION, {GIT_CHECKOUT_OPTIONS_VERSION, GIT_CHECKOUT_SAFE_CREATE}, GIT_REMOTE_CALLBACKS_INIT}
 
 /**
@@ -136,7 +136,9 @@ typedef enum {
 	GIT_OPT_ENABLE_CACHING,
 	GIT_OPT_GET_CACHED_MEMORY,
 	GIT_OPT_GET_TEMPLATE_PATH,
-	GIT_OPT_SET_TEMPLATE_PATH
+	GIT_OPT_SET_TEMPLATE_PATH,
+	GIT_OPT_GET_INDEX_THREADS,
+	GIT_OPT_SET_INDEX_THREADS
 } git_libgit2_opt_t;
 
 /**
@@ -221,6 +223,20 @@ typedef enum {
  *		>
  *		> - `path` directory of template.
  *
+ *	* opts(GIT_OPT_GET_INDEX_THREADS, unsigned int *threads)
+ *
+ *		> Get the number of threads used to load large index files.
+ *
+ *	* opts(GIT_OPT_SET_INDEX_THREADS, unsigned int threads)
+ *
+ *		> Set the number of threads used to load large index files.
+ *		> Zero (the default) picks a count based on the number of
+ *		> online CPUs and the size of the index; one disables threaded
+ *		> loading.  When writing an index, this also controls how many
+ *		> blocks are recorded in the index entry offset table, and
+ *		> `git_index_add_all` and `git_index_update_all` use as many
+ *		> threads to hash the files they add.
+ *
  * @param option Option key
  * @param ... value to set the option
  * @return 0 on success, <0 on failure
@@ -229,6 +229,64 @@ GIT_EXTERN(int) git_index_caps(const git_index *index);
  */
 GIT_EXTERN(int) git_index_set_caps(git_index *index, int caps);
 
+/**
+ * Get index on-disk version.
+ *
+ * Valid return values are 2, 3, or 4.  If 3 is returned, an index
+ * with version 2 may be written instead, if the extension data in
+ * version 3 is not necessary.
+ *
+ * @param index An existing index object
+ * @return the index version
+ */
+GIT_EXTERN(unsigned int) git_index_version(git_index *index);
+
+/**
+ * Set index on-disk version.
+ *
+ * Valid values are 2, 3, or 4.  If 2 is given, git_index_write may
+ * write an index with version 3 instead, if necessary to accurately
+ * represent the index.  Version 4 compresses the paths of the entries
+ * against each other, which makes the file considerably smaller.
+ *
+ * An index that does not exist on disk yet picks its version from the
+ * `index.version` setting of the owner repository's config.
+ *
+ * @param index An existing index object
+ * @param version The new version number
+ * @return 0 on success, -1 on failure
+ */
+GIT_EXTERN(int) git_index_set_version(git_index *index, unsigned int version);
+
+/**
+ * Check whether the index is written as a split index.
+ *
+ * @param index An existing index object
+ * @return 1 if the index is split, 0 otherwise
+ */
+GIT_EXTERN(int) git_index_is_split(const git_index *index);
+
+/**
+ * Set whether the index is written as a split index.
+ *
+ * A split index only holds the entries that changed since the shared
+ * index ("sharedindex.<sha>", beside the index file) was written, so
+ * writing it after small changes stays cheap for large indexes.  The
+ * shared index is rewritten once more than `splitIndex.maxPercentChange`
+ * percent (20 by default) of the entries would end up in the split index.
+ * Replaced shared indexes are kept for readers of older split indexes
+ * and removed once written before `splitIndex.sharedIndexExpire` (two
+ * weeks ago by default).
+ *
+ * Indexes read from a split index are split.  For an index owned by a
+ * repository, `core.splitIndex` takes precedence when it is set.
+ *
+ * @param index An existing index object
+ * @param split 1 to write a split index, 0 to write a single file
+ * @return 0 on success, -1 on failure
+ */
+GIT_EXTERN(int) git_index_set_split(git_index *index, int split);
+
 /**
  * Update the contents of an existing index object in memory by reading
  * from the hard disk.
@@ -422,6 +480,45 @@ GIT_EXTERN(int) git_index_add(git_index *index, const git_index_entry *source_en
  */
 GIT_EXTERN(int) git_index_entry_stage(const git_index_entry *entry);
 
+/**
+ * Start recording changes to the index in a batch
+ *
+ * Until the batch is committed, `git_index_add`, `git_index_add_bypath`,
+ * `git_index_remove`, `git_index_remove_bypath`, `git_index_conflict_add`
+ * and `git_index_conflict_remove` only record their changes; looking up
+ * entries still finds them as they were before the batch.  Removing an
+ * entry that does not exist is not an error in a batch.
+ *
+ * Committing applies the recorded changes in a single pass over the
+ * entries, which is much faster than making many changes one at a time.
+ * The last change recorded for an entry wins, and removals are applied
+ * before additions, so that a file can take the place of a directory.
+ *
+ * @param index an existing index object
+ * @return 0 or an error code if a batch is already in progress
+ */
+GIT_EXTERN(int) git_index_batch_begin(git_index *index);
+
+/**
+ * Apply the changes recorded since `git_index_batch_begin`
+ *
+ * If a recorded entry cannot be added (because its path is already used
+ * by a directory or the other way around), the changes recorded after it
+ * are discarded and an error is returned.  The batch is over either way.
+ *
+ * @param index an existing index object
+ * @param write nonzero to write the index to disk afterwards
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_index_batch_commit(git_index *index, int write);
+
+/**
+ * Discard the changes recorded since `git_index_batch_begin`
+ *
+ * @param index an existing index object
+ */
+GIT_EXTERN(void) git_index_batch_discard(git_index *index);
+
 /**@}*/
 
 /** @name Workdir Index Entry Functions
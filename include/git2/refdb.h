@@ -55,6 +55,28 @@ GIT_EXTERN(int) git_refdb_open(git_refdb **out, git_repository *repo);
  */
 GIT_EXTERN(int) git_refdb_compress(git_refdb *refdb);
 
+/**
+ * Open a snapshot scope on the given refdb.
+ *
+ * Until the matching `git_refdb_snapshot_end()`, the refdb may answer
+ * lookups of references it has already read from memory, without
+ * checking whether they changed on disk.  Resolving the same references
+ * over and over then costs nothing, but changes made by other processes
+ * in the meantime may not be seen; changes made through this refdb are.
+ * Scopes can be nested.
+ *
+ * @param refdb the reference database
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_refdb_snapshot_begin(git_refdb *refdb);
+
+/**
+ * Close a snapshot scope opened with `git_refdb_snapshot_begin()`.
+ *
+ * @param refdb the reference database
+ */
+GIT_EXTERN(void) git_refdb_snapshot_end(git_refdb *refdb);
+
 /**
  * Close an open reference database.
  *
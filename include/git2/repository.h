@@ -95,11 +95,21 @@ GIT_EXTERN(int) git_repository_discover(
  * * GIT_REPOSITORY_OPEN_BARE - Open repository as a bare repo regardless
  *   of core.bare config, and defer loading config file for faster setup.
  *   Unlike `git_repository_open_bare`, this can follow gitlinks.
+ * * GIT_REPOSITORY_OPEN_LAZY - Do not read the configuration while
+ *   opening.  Whether the repository is bare and where its working
+ *   directory is are worked out from core.bare and core.worktree the
+ *   first time they are asked for.
+ * * GIT_REPOSITORY_OPEN_GITDIR - The path is the repository directory
+ *   itself (e.g. "/src/project/.git" or "/srv/project.git"), so there
+ *   is no search, `.git` files are not followed and an absolute path is
+ *   used as it is given instead of being resolved.
  */
 typedef enum {
 	GIT_REPOSITORY_OPEN_NO_SEARCH = (1 << 0),
 	GIT_REPOSITORY_OPEN_CROSS_FS  = (1 << 1),
 	GIT_REPOSITORY_OPEN_BARE      = (1 << 2),
+	GIT_REPOSITORY_OPEN_LAZY      = (1 << 3),
+	GIT_REPOSITORY_OPEN_GITDIR    = (1 << 4),
 } git_repository_open_flag_t;
 
 /**
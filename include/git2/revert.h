@@ -30,7 +30,7 @@ typedef struct {
 	git_checkout_options checkout_opts;
 } git_revert_options;
 
-#define GIT_REVERT_OPTIONS_VERSION 1
+#define GIT_REVERT_OPTIONS_VERSION 2
 #define GIT_REVERT_OPTIONS_INIT {GIT_REVERT_OPTIONS_VERSION, 0, GIT_MERGE_OPTIONS_INIT, GIT_CHECKOUT_OPTIONS_INIT}
 
 /**
@@ -279,6 +279,10 @@ GIT_EXTERN(int) git_status_foreach_ext(
  * detection, there is no choice but to do a full `git_status_list_new` and
  * scan through looking for the path that you are interested in.
  *
+ * For a plain file this only looks the path up in the HEAD tree and the
+ * index and checks it in the working directory, without scanning the
+ * directory that contains it, so it is cheap to call for a few paths.
+ *
  * @param status_flags Output combination of git_status_t values for file
  * @param repo A repository object
  * @param path The file to retrieve status for relative to the repo workdir
@@ -291,6 +295,26 @@ GIT_EXTERN(int) git_status_file(
 	git_repository *repo,
 	const char *path);
 
+/**
+ * Get file status for a list of files.
+ *
+ * This works like calling `git_status_file` for each of the `paths`, but
+ * reads the index and looks up the HEAD tree only once.
+ *
+ * @param status_flags Array of `count` values that is filled in with the
+ *      combination of git_status_t values for each path
+ * @param repo A repository object
+ * @param paths The files to retrieve status for relative to the repo workdir
+ * @param count The number of paths
+ * @return 0 on success or an error code as returned by `git_status_file`
+ *      for the first path that could not be checked
+ */
+GIT_EXTERN(int) git_status_files(
+	unsigned int *status_flags,
+	git_repository *repo,
+	const char **paths,
+	size_t count);
+
 /**
  * Gather file status information and populate the `git_status_list`.
  *
@@ -28,6 +28,7 @@ GIT_EXTERN(git_filter *) git_filter_lookup(const char *name);
 
 #define GIT_FILTER_CRLF  "crlf"
 #define GIT_FILTER_IDENT "ident"
+#define GIT_FILTER_PROCESS "process"
 
 /**
  * This is priority that the internal CRLF filter will be registered with
@@ -46,6 +47,13 @@ GIT_EXTERN(git_filter *) git_filter_lookup(const char *name);
  */
 #define GIT_FILTER_DRIVER_PRIORITY 200
 
+/**
+ * This is priority that the internal filter that runs the long-running
+ * processes configured with `filter.<driver>.process` will be registered
+ * with
+ */
+#define GIT_FILTER_PROCESS_PRIORITY GIT_FILTER_DRIVER_PRIORITY
+
 /**
  * Create a new empty filter list
  *
@@ -208,6 +216,25 @@ typedef int (*git_filter_apply_fn)(
 	const git_buf *from,
 	const git_filter_source *src);
 
+/**
+ * Callback to filter data a piece at a time
+ *
+ * Specified as `filter.stream`, this is an optional callback that sets
+ * `out` to a new stream that filters the data written to it and writes
+ * the result to `next`.  Closing the stream must close `next`.  Like
+ * `check`, it can return GIT_PASSTHROUGH to indicate that the filter
+ * doesn't want to run.
+ *
+ * Filters without a `stream` callback are given all of the data at once
+ * through their `apply` callback instead.
+ */
+typedef int (*git_filter_stream_fn)(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next);
+
 /**
  * Callback to clean up after filtering has been applied
  *
@@ -227,7 +254,8 @@ typedef void (*git_filter_cleanup_fn)(
  * `git_filter` struct at the start of your data buffer, then cast the
  * `self` pointer to your larger structure when your callback is invoked.
  *
- * `version` should be set to GIT_FILTER_VERSION
+ * `version` should be set to GIT_FILTER_VERSION; filters of version 1
+ * have no `stream` callback.
  *
  * `attributes` is a whitespace-separated list of attribute names to check
  * for this filter (e.g. "eol crlf text").  If the attribute name is bare,
@@ -235,8 +263,9 @@ typedef void (*git_filter_cleanup_fn)(
  * a value (i.e. "name=value"), the attribute must match that value for
  * the filter to be applied.
  *
- * The `initialize`, `shutdown`, `check`, `apply`, and `cleanup` callbacks
- * are all documented above with the respective function pointer typedefs.
+ * The `initialize`, `shutdown`, `check`, `apply`, `cleanup` and `stream`
+ * callbacks are all documented above with the respective function pointer
+ * typedefs.
  */
 struct git_filter {
 	unsigned int           version;
@@ -248,9 +277,10 @@ struct git_filter {
 	git_filter_check_fn    check;
 	git_filter_apply_fn    apply;
 	git_filter_cleanup_fn  cleanup;
+	git_filter_stream_fn   stream;
 };
 
-#define GIT_FILTER_VERSION 1
+#define GIT_FILTER_VERSION 2
 
 /**
  * Register a filter under a given name with a given priority.
@@ -262,9 +292,10 @@ struct git_filter {
  * issued in order of `priority` on smudge (to workdir), and in reverse
  * order of `priority` on clean (to odb).
  *
- * Two filters are preregistered with libgit2:
+ * Three filters are preregistered with libgit2:
  * - GIT_FILTER_CRLF with priority 0
  * - GIT_FILTER_IDENT with priority 100
+ * - GIT_FILTER_PROCESS with priority 200
  *
  * Currently the filter registry is not thread safe, so any registering or
  * deregistering of filters must be done outside of any possible usage of
@@ -56,6 +56,34 @@ struct git_reference_iterator {
 		git_reference_iterator *iter);
 };
 
+/**
+ * A single change of an atomic update of several references, as passed
+ * to the `transaction` function of a backend.
+ */
+typedef struct {
+	/** The name of the reference */
+	const char *name;
+
+	/** The new value of the reference, or NULL to remove it */
+	const git_reference *ref;
+
+	/**
+	 * The type of the value the reference must have for the update to
+	 * go through; GIT_REF_INVALID if it must not exist
+	 */
+	git_ref_t old_type;
+
+	/** The old target, if `old_type` is GIT_REF_OID */
+	git_oid old_id;
+
+	/** The old target, if `old_type` is GIT_REF_SYMBOLIC */
+	const char *old_target;
+
+	/** The signature and message for the reflog entry */
+	const git_signature *who;
+	const char *message;
+} git_refdb_update;
+
 /** An instance for a custom backend */
 struct git_refdb_backend {
 	unsigned int version;
@@ -153,9 +181,30 @@ struct git_refdb_backend {
 	 * Remove a reflog.
 	 */
 	int (*reflog_delete)(git_refdb_backend *backend, const char *name);
+
+	/**
+	 * Apply several updates at once, sorted by reference name.  Either
+	 * all of them go through or none does; GIT_EMODIFIED is returned if
+	 * any reference does not have its expected old value.  A refdb
+	 * implementation may provide this function; if it is not provided,
+	 * committing a `git_transaction` fails.
+	 */
+	int (*transaction)(
+		git_refdb_backend *backend,
+		const git_refdb_update *updates,
+		size_t count);
+
+	/**
+	 * Open and close a snapshot scope, during which references that
+	 * have been read before may be served without checking the storage
+	 * again.  Scopes nest.  A refdb implementation may provide these
+	 * functions; if they are not provided, nothing will be done.
+	 */
+	int (*snapshot_begin)(git_refdb_backend *backend);
+	void (*snapshot_end)(git_refdb_backend *backend);
 };
 
-#define GIT_REFDB_BACKEND_VERSION 1
+#define GIT_REFDB_BACKEND_VERSION 2
 #define GIT_REFDB_BACKEND_INIT {GIT_REFDB_BACKEND_VERSION}
 
 /**
@@ -185,11 +234,38 @@ GIT_EXTERN(int) git_refdb_backend_fs(
 	git_refdb_backend **backend_out,
 	git_repository *repo);
 
+/**
+ * Constructor for the reftable refdb backend
+ *
+ * The references and reflogs of the repository are kept in a stack of
+ * sorted, block-indexed tables in the `libgit2-reftable` directory of
+ * the repository, so that updates only write the references they change.
+ * The tables use a format of libgit2's own, which git cannot read.
+ * Pseudo-references like `FETCH_HEAD` stay in plain files.  The existing
+ * references and reflogs are imported and removed the first time the
+ * backend is created, and `HEAD` is pointed at `refs/heads/.invalid`.
+ * So that git does not mistake the repository for one without references,
+ * `core.repositoryformatversion` is then set to 1 along with the
+ * `extensions.libgit2refstorage` extension, which git refuses.
+ *
+ * This backend is used when the repository is opened if it already has
+ * reftables or `libgit2.refstorage` is set to `reftable`.
+ *
+ * @param backend_out Output pointer to the git_refdb_backend object
+ * @param repo Git repository to access
+ * @return 0 on success, <0 error code on failure
+ */
+GIT_EXTERN(int) git_refdb_backend_reftable(
+	git_refdb_backend **backend_out,
+	git_repository *repo);
+
 /**
  * Sets the custom backend to an existing reference DB
  *
  * The `git_refdb` will take ownership of the `git_refdb_backend` so you
- * should NOT free it after calling this function.
+ * should NOT free it after calling this function.  Backends of a newer
+ * version than `GIT_REFDB_BACKEND_VERSION` are refused; those of
+ * version 1 have no `transaction` or `snapshot` callbacks.
  *
  * @param refdb database to add the backend to
  * @param backend pointer to a git_refdb_backend instance
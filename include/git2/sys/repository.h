@@ -119,6 +119,40 @@ GIT_EXTERN(void) git_repository_set_refdb(git_repository *repo, git_refdb *refdb
  */
 GIT_EXTERN(void) git_repository_set_index(git_repository *repo, git_index *index);
 
+/**
+ * Where the time went while opening and using a repository.
+ *
+ * `open_time` covers finding and validating the repository directory;
+ * each subsystem counts how often it was loaded and the seconds that
+ * took, so a repository opened with `GIT_REPOSITORY_OPEN_LAZY` that only
+ * reads references shows no config, odb or index loads at all.
+ */
+typedef struct {
+	unsigned int version;
+	double open_time;
+	size_t config_loads;
+	double config_time;
+	size_t odb_loads;
+	double odb_time;
+	size_t refdb_loads;
+	double refdb_time;
+	size_t index_loads;
+	double index_time;
+} git_repository_perfdata;
+
+#define GIT_REPOSITORY_PERFDATA_VERSION 1
+#define GIT_REPOSITORY_PERFDATA_INIT {GIT_REPOSITORY_PERFDATA_VERSION,0,0,0,0,0,0,0,0,0}
+
+/**
+ * Get performance data for a repository.
+ *
+ * @param out Structure to be filled with repository performance data
+ * @param repo Repository to read performance data from
+ * @return 0 for success, <0 for error
+ */
+GIT_EXTERN(int) git_repository_get_perfdata(
+	git_repository_perfdata *out, const git_repository *repo);
+
 /** @} */
 GIT_END_DECL
 #endif
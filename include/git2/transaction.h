@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_git_transaction_h__
+#define INCLUDE_git_transaction_h__
+
+#include "common.h"
+#include "types.h"
+#include "oid.h"
+
+/**
+ * @file git2/transaction.h
+ * @brief Git transactional reference routines
+ * @defgroup git_transaction Git transactional reference routines
+ * @ingroup Git
+ * @{
+ */
+GIT_BEGIN_DECL
+
+/**
+ * Create a new transaction object
+ *
+ * A transaction updates several references at once: either every
+ * queued change is applied on commit, or none of them is.
+ *
+ * @param out the resulting transaction
+ * @param repo the repository in which to update references
+ * @return 0 or an error code
+ */
+GIT_EXTERN(int) git_transaction_new(git_transaction **out, git_repository *repo);
+
+/**
+ * Lock a reference
+ *
+ * Remember the current value of the reference (or that it does not
+ * exist yet), so that the transaction fails to commit if somebody
+ * else changes it in the meantime.  A reference must be locked
+ * before its change can be queued.
+ *
+ * @param tx the transaction
+ * @param refname the reference to lock
+ * @return 0, GIT_ELOCKED if the reference is already locked by the
+ * transaction or an error code
+ */
+GIT_EXTERN(int) git_transaction_lock_ref(git_transaction *tx, const char *refname);
+
+/**
+ * Set the target of a reference
+ *
+ * Queue the change of the reference to point to the given object.
+ * The reference must have been locked with `git_transaction_lock_ref`.
+ *
+ * @param tx the transaction
+ * @param refname the reference to update
+ * @param target the object the reference should point to
+ * @param sig the signature for the reflog entry, or NULL to use the
+ * default signature of the repository
+ * @param msg the message for the reflog entry, or NULL
+ * @return 0, GIT_ENOTFOUND if the reference is not locked or an
+ * error code
+ */
+GIT_EXTERN(int) git_transaction_set_target(
+	git_transaction *tx,
+	const char *refname,
+	const git_oid *target,
+	const git_signature *sig,
+	const char *msg);
+
+/**
+ * Set the target of a symbolic reference
+ *
+ * Queue the change of the reference to point to another reference.
+ * The reference must have been locked with `git_transaction_lock_ref`.
+ *
+ * @param tx the transaction
+ * @param refname the reference to update
+ * @param target the name of the reference to point to
+ * @param sig the signature for the reflog entry, or NULL to use the
+ * default signature of the repository
+ * @param msg the message for the reflog entry, or NULL
+ * @return 0, GIT_ENOTFOUND if the reference is not locked or an
+ * error code
+ */
+GIT_EXTERN(int) git_transaction_set_symbolic_target(
+	git_transaction *tx,
+	const char *refname,
+	const char *target,
+	const git_signature *sig,
+	const char *msg);
+
+/**
+ * Remove a reference
+ *
+ * Queue the removal of the reference.  The reference must have been
+ * locked with `git_transaction_lock_ref`.
+ *
+ * @param tx the transaction
+ * @param refname the reference to remove
+ * @return 0, GIT_ENOTFOUND if the reference is not locked or does
+ * not exist or an error code
+ */
+GIT_EXTERN(int) git_transaction_remove(git_transaction *tx, const char *refname);
+
+/**
+ * Commit the changes from the transaction
+ *
+ * Apply all the queued changes at once.  If any of the locked
+ * references changed since it was locked, nothing is written and
+ * GIT_EMODIFIED is returned.  Locked references without a queued
+ * change are left alone.
+ *
+ * The reference database backend must support transactions; the
+ * built-in ones do.
+ *
+ * @param tx the transaction
+ * @return 0, GIT_EMODIFIED or an error code
+ */
+GIT_EXTERN(int) git_transaction_commit(git_transaction *tx);
+
+/**
+ * Free the resources allocated by this transaction
+ *
+ * Changes which have not been committed are discarded.
+ *
+ * @param tx the transaction
+ */
+GIT_EXTERN(void) git_transaction_free(git_transaction *tx);
+
+/** @} */
+GIT_END_DECL
+#endif
@@ -146,6 +146,9 @@ typedef struct git_reflog_entry git_reflog_entry;
 /** Representation of a reference log */
 typedef struct git_reflog git_reflog;
 
+/** Transactional update of several references */
+typedef struct git_transaction git_transaction;
+
 /** Representation of a git note */
 typedef struct git_note git_note;
 
@@ -353,6 +356,19 @@ typedef enum {
 	GIT_SUBMODULE_RECURSE_ONDEMAND = 2,
 } git_submodule_recurse_t;
 
+/**
+ * A stream to write data to a piece at a time, such as the output of a
+ * filter.  `write` may be called any number of times, then `close` once
+ * all of the data has been written, and `free` in any case.
+ */
+typedef struct git_writestream git_writestream;
+
+struct git_writestream {
+	int (*write)(git_writestream *stream, const char *buffer, size_t len);
+	int (*close)(git_writestream *stream);
+	void (*free)(git_writestream *stream);
+};
+
 /** @} */
 GIT_END_DECL
 
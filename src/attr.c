@@ -29,6 +29,7 @@ git_attr_t git_attr_value(const char *attr)
 
 static int collect_attr_files(
 	git_repository *repo,
+	git_attr_session *attr_session,
 	uint32_t flags,
 	const char *path,
 	git_vector *files);
@@ -45,7 +46,8 @@ int git_attr_get(
 	int error;
 	git_attr_path path;
 	git_vector files = GIT_VECTOR_INIT;
-	size_t i, j;
+	size_t i;
+	git_attr_file_iter iter;
 	git_attr_file *file;
 	git_attr_name attr;
 	git_attr_rule *rule;
@@ -57,7 +59,8 @@ int git_attr_get(
 	if (git_attr_path__init(&path, pathname, git_repository_workdir(repo)) < 0)
 		return -1;
 
-	if ((error = collect_attr_files(repo, flags, pathname, &files)) < 0)
+	if ((error = collect_attr_files(
+			repo, NULL, flags, pathname, &files)) < 0)
 		goto cleanup;
 
 	memset(&attr, 0, sizeof(attr));
@@ -66,7 +69,7 @@ int git_attr_get(
 
 	git_vector_foreach(&files, i, file) {
 
-		git_attr_file__foreach_matching_rule(file, &path, j, rule) {
+		git_attr_file__foreach_matching_rule(file, &path, iter, rule) {
 			size_t pos;
 
 			if (!git_vector_bsearch(&pos, &rule->assigns, &attr)) {
@@ -90,9 +93,10 @@ typedef struct {
 	git_attr_assignment *found;
 } attr_get_many_info;
 
-int git_attr_get_many(
+int git_attr_get_many_with_session(
 	const char **values,
 	git_repository *repo,
+	git_attr_session *attr_session,
 	uint32_t flags,
 	const char *pathname,
 	size_t num_attr,
@@ -101,7 +105,8 @@ int git_attr_get_many(
 	int error;
 	git_attr_path path;
 	git_vector files = GIT_VECTOR_INIT;
-	size_t i, j, k;
+	size_t i, k;
+	git_attr_file_iter iter;
 	git_attr_file *file;
 	git_attr_rule *rule;
 	attr_get_many_info *info = NULL;
@@ -115,7 +120,8 @@ int git_attr_get_many(
 	if (git_attr_path__init(&path, pathname, git_repository_workdir(repo)) < 0)
 		return -1;
 
-	if ((error = collect_attr_files(repo, flags, pathname, &files)) < 0)
+	if ((error = collect_attr_files(
+			repo, attr_session, flags, pathname, &files)) < 0)
 		goto cleanup;
 
 	info = git__calloc(num_attr, sizeof(attr_get_many_info));
@@ -123,7 +129,7 @@ int git_attr_get_many(
 
 	git_vector_foreach(&files, i, file) {
 
-		git_attr_file__foreach_matching_rule(file, &path, j, rule) {
+		git_attr_file__foreach_matching_rule(file, &path, iter, rule) {
 
 			for (k = 0; k < num_attr; k++) {
 				size_t pos;
@@ -161,6 +167,18 @@ cleanup:
 	return error;
 }
 
+int git_attr_get_many(
+	const char **values,
+	git_repository *repo,
+	uint32_t flags,
+	const char *pathname,
+	size_t num_attr,
+	const char **names)
+{
+	return git_attr_get_many_with_session(
+		values, repo, NULL, flags, pathname, num_attr, names);
+}
+
 
 int git_attr_foreach(
 	git_repository *repo,
@@ -172,7 +190,8 @@ int git_attr_foreach(
 	int error;
 	git_attr_path path;
 	git_vector files = GIT_VECTOR_INIT;
-	size_t i, j, k;
+	size_t i, k;
+	git_attr_file_iter iter;
 	git_attr_file *file;
 	git_attr_rule *rule;
 	git_attr_assignment *assign;
@@ -183,13 +202,14 @@ int git_attr_foreach(
 	if (git_attr_path__init(&path, pathname, git_repository_workdir(repo)) < 0)
 		return -1;
 
-	if ((error = collect_attr_files(repo, flags, pathname, &files)) < 0 ||
+	if ((error = collect_attr_files(
+			repo, NULL, flags, pathname, &files)) < 0 ||
 		(error = git_strmap_alloc(&seen)) < 0)
 		goto cleanup;
 
 	git_vector_foreach(&files, i, file) {
 
-		git_attr_file__foreach_matching_rule(file, &path, j, rule) {
+		git_attr_file__foreach_matching_rule(file, &path, iter, rule) {
 
 			git_vector_foreach(&rule->assigns, k, assign) {
 				/* skip if higher priority assignment was already seen */
@@ -217,8 +237,73 @@ cleanup:
 	return error;
 }
 
+void git_attr_session__init(git_attr_session *session, git_repository *repo)
+{
+	assert(session && repo);
+
+	memset(session, 0, sizeof(*session));
+	session->key = git_atomic_inc(&repo->attr_session_key);
+	git_buf_init(&session->sysdir, 0);
+	git_buf_init(&session->last_dir, 0);
+	git_vector_init(&session->last_files, 0, NULL);
+}
+
+void git_attr_session__free(git_attr_session *session)
+{
+	if (!session)
+		return;
+
+	release_attr_files(&session->last_files);
+	git_buf_free(&session->sysdir);
+	git_buf_free(&session->last_dir);
+
+	memset(session, 0, sizeof(*session));
+}
+
+static int system_attr_file(
+	git_buf *out,
+	git_attr_session *attr_session)
+{
+	int error;
+
+	if (!attr_session) {
+		error = git_sysdir_find_system_file(out, GIT_ATTR_FILE_SYSTEM);
+
+		if (error == GIT_ENOTFOUND)
+			giterr_clear();
+
+		return error;
+	}
+
+	/* look the system file up once per session */
+	if (!attr_session->init_sysdir) {
+		error = git_sysdir_find_system_file(
+			&attr_session->sysdir, GIT_ATTR_FILE_SYSTEM);
+
+		if (error == GIT_ENOTFOUND)
+			giterr_clear();
+		else if (error)
+			return error;
+
+		attr_session->init_sysdir = 1;
+	}
+
+	if (attr_session->sysdir.size == 0)
+		return GIT_ENOTFOUND;
+
+	/* We can safely provide a git_buf with no allocation (asize == 0) to
+	 * a consumer. This allows them to treat this as a regular `git_buf`,
+	 * but their call to `git_buf_free` will not attempt to free it.
+	 */
+	out->ptr = attr_session->sysdir.ptr;
+	out->size = attr_session->sysdir.size;
+	out->asize = 0;
+	return 0;
+}
+
 static int preload_attr_file(
 	git_repository *repo,
+	git_attr_session *attr_session,
 	git_attr_file_source source,
 	const char *base,
 	const char *file)
@@ -229,19 +314,23 @@ static int preload_attr_file(
 	if (!file)
 		return 0;
 	if (!(error = git_attr_cache__get(
-			&preload, repo, source, base, file, git_attr_file__parse_buffer)))
+			&preload, repo, attr_session, source, base, file,
+			git_attr_file__parse_buffer)))
 		git_attr_file__free(preload);
 
 	return error;
 }
 
-static int attr_setup(git_repository *repo)
+static int attr_setup(git_repository *repo, git_attr_session *attr_session)
 {
 	int error = 0;
 	const char *workdir = git_repository_workdir(repo);
 	git_index *idx = NULL;
 	git_buf sys = GIT_BUF_INIT;
 
+	if (attr_session && attr_session->init_setup)
+		return 0;
+
 	if ((error = git_attr_cache__init(repo)) < 0)
 		return error;
 
@@ -249,39 +338,43 @@ static int attr_setup(git_repository *repo)
 	 * definitions will be available for later file parsing
 	 */
 
-	if (!(error = git_sysdir_find_system_file(&sys, GIT_ATTR_FILE_SYSTEM))) {
+	if (!(error = system_attr_file(&sys, attr_session))) {
 		error = preload_attr_file(
-			repo, GIT_ATTR_FILE__FROM_FILE, NULL, sys.ptr);
+			repo, attr_session, GIT_ATTR_FILE__FROM_FILE, NULL, sys.ptr);
 		git_buf_free(&sys);
 	}
 	if (error < 0) {
-		if (error == GIT_ENOTFOUND) {
-			giterr_clear();
+		if (error == GIT_ENOTFOUND)
 			error = 0;
-		} else
+		else
 			return error;
 	}
 
 	if ((error = preload_attr_file(
-			repo, GIT_ATTR_FILE__FROM_FILE,
+			repo, attr_session, GIT_ATTR_FILE__FROM_FILE,
 			NULL, git_repository_attr_cache(repo)->cfg_attr_file)) < 0)
 		return error;
 
 	if ((error = preload_attr_file(
-			repo, GIT_ATTR_FILE__FROM_FILE,
+			repo, attr_session, GIT_ATTR_FILE__FROM_FILE,
 			git_repository_path(repo), GIT_ATTR_FILE_INREPO)) < 0)
 		return error;
 
 	if (workdir != NULL &&
 		(error = preload_attr_file(
-			repo, GIT_ATTR_FILE__FROM_FILE, workdir, GIT_ATTR_FILE)) < 0)
+			repo, attr_session, GIT_ATTR_FILE__FROM_FILE,
+			workdir, GIT_ATTR_FILE)) < 0)
 		return error;
 
 	if ((error = git_repository_index__weakptr(&idx, repo)) < 0 ||
 		(error = preload_attr_file(
-			repo, GIT_ATTR_FILE__FROM_INDEX, NULL, GIT_ATTR_FILE)) < 0)
+			repo, attr_session, GIT_ATTR_FILE__FROM_INDEX,
+			NULL, GIT_ATTR_FILE)) < 0)
 		return error;
 
+	if (attr_session)
+		attr_session->init_setup = 1;
+
 	return error;
 }
 
@@ -321,6 +414,7 @@ int git_attr_add_macro(
 
 typedef struct {
 	git_repository *repo;
+	git_attr_session *attr_session;
 	uint32_t flags;
 	const char *workdir;
 	git_index *index;
@@ -356,6 +450,7 @@ static int attr_decide_sources(
 
 static int push_attr_file(
 	git_repository *repo,
+	git_attr_session *attr_session,
 	git_vector *list,
 	git_attr_file_source source,
 	const char *base,
@@ -364,8 +459,8 @@ static int push_attr_file(
 	int error = 0;
 	git_attr_file *file = NULL;
 
-	error = git_attr_cache__get(
-		&file, repo, source, base, filename, git_attr_file__parse_buffer);
+	error = git_attr_cache__get(&file, repo, attr_session,
+		source, base, filename, git_attr_file__parse_buffer);
 	if (error < 0)
 		return error;
 
@@ -387,8 +482,8 @@ static int push_one_attr(void *ref, git_buf *path)
 		info->flags, info->workdir != NULL, info->index != NULL, src);
 
 	for (i = 0; !error && i < n_src; ++i)
-		error = push_attr_file(
-			info->repo, info->files, src[i], path->ptr, GIT_ATTR_FILE);
+		error = push_attr_file(info->repo, info->attr_session,
+			info->files, src[i], path->ptr, GIT_ATTR_FILE);
 
 	return error;
 }
@@ -405,18 +500,33 @@ static void release_attr_files(git_vector *files)
 	git_vector_free(files);
 }
 
+static int copy_attr_files(git_vector *out, const git_vector *files)
+{
+	size_t i;
+	git_attr_file *file;
+
+	git_vector_foreach(files, i, file) {
+		if (git_vector_insert(out, file) < 0)
+			return -1;
+		GIT_REFCOUNT_INC(file);
+	}
+
+	return 0;
+}
+
 static int collect_attr_files(
 	git_repository *repo,
+	git_attr_session *attr_session,
 	uint32_t flags,
 	const char *path,
 	git_vector *files)
 {
 	int error;
-	git_buf dir = GIT_BUF_INIT;
+	git_buf dir = GIT_BUF_INIT, sys = GIT_BUF_INIT;
 	const char *workdir = git_repository_workdir(repo);
 	attr_walk_up_info info = { NULL };
 
-	if ((error = attr_setup(repo)) < 0)
+	if ((error = attr_setup(repo, attr_session)) < 0)
 		return error;
 
 	/* Resolve path in a non-bare repo */
@@ -427,6 +537,18 @@ static int collect_attr_files(
 	if (error < 0)
 		goto cleanup;
 
+	/* paths in the same directory share the list of files seen last */
+	if (attr_session && attr_session->last_flags == flags &&
+		attr_session->last_dir.size > 0 &&
+		!strcmp(attr_session->last_dir.ptr, dir.ptr)) {
+		error = copy_attr_files(files, &attr_session->last_files);
+		goto cleanup;
+	}
+
+	if (attr_session &&
+		(error = git_buf_sets(&attr_session->last_dir, dir.ptr)) < 0)
+		goto cleanup;
+
 	/* in precendence order highest to lowest:
 	 * - $GIT_DIR/info/attributes
 	 * - path components with .gitattributes
@@ -435,12 +557,13 @@ static int collect_attr_files(
 	 */
 
 	error = push_attr_file(
-		repo, files, GIT_ATTR_FILE__FROM_FILE,
+		repo, attr_session, files, GIT_ATTR_FILE__FROM_FILE,
 		git_repository_path(repo), GIT_ATTR_FILE_INREPO);
 	if (error < 0)
 		goto cleanup;
 
 	info.repo  = repo;
+	info.attr_session = attr_session;
 	info.flags = flags;
 	info.workdir = workdir;
 	if (git_repository_index__weakptr(&info.index, repo) < 0)
@@ -453,27 +576,40 @@ static int collect_attr_files(
 
 	if (git_repository_attr_cache(repo)->cfg_attr_file != NULL) {
 		error = push_attr_file(
-			repo, files, GIT_ATTR_FILE__FROM_FILE,
+			repo, attr_session, files, GIT_ATTR_FILE__FROM_FILE,
 			NULL, git_repository_attr_cache(repo)->cfg_attr_file);
 		if (error < 0)
 			goto cleanup;
 	}
 
 	if ((flags & GIT_ATTR_CHECK_NO_SYSTEM) == 0) {
-		error = git_sysdir_find_system_file(&dir, GIT_ATTR_FILE_SYSTEM);
+		error = system_attr_file(&sys, attr_session);
+
 		if (!error)
 			error = push_attr_file(
-				repo, files, GIT_ATTR_FILE__FROM_FILE, NULL, dir.ptr);
-		else if (error == GIT_ENOTFOUND) {
-			giterr_clear();
+				repo, attr_session, files, GIT_ATTR_FILE__FROM_FILE,
+				NULL, sys.ptr);
+		else if (error == GIT_ENOTFOUND)
 			error = 0;
-		}
+	}
+
+	if (!error && attr_session) {
+		release_attr_files(&attr_session->last_files);
+		attr_session->last_flags = flags;
+
+		if ((error = copy_attr_files(
+				&attr_session->last_files, files)) < 0)
+			git_buf_clear(&attr_session->last_dir);
 	}
 
  cleanup:
-	if (error < 0)
+	if (error < 0) {
 		release_attr_files(files);
+		if (attr_session)
+			git_buf_clear(&attr_session->last_dir);
+	}
 	git_buf_free(&dir);
+	git_buf_free(&sys);
 
 	return error;
 }
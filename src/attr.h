@@ -10,4 +10,13 @@
 #include "attr_file.h"
 #include "attrcache.h"
 
+extern int git_attr_get_many_with_session(
+	const char **values_out,
+	git_repository *repo,
+	git_attr_session *attr_session,
+	uint32_t flags,
+	const char *path,
+	size_t num_attr,
+	const char **names);
+
 #endif
@@ -6,8 +6,48 @@
 #include "git2/blob.h"
 #include "git2/tree.h"
 #include "index.h"
+#include "array.h"
 #include <ctype.h>
 
+/* files with fewer rules than this are simply scanned */
+#define GIT_ATTR_FILE_MATCHER_MIN_RULES 8
+
+typedef struct {
+	const char *ptr;
+	size_t len;
+} attr_match_key;
+
+typedef git_array_t(uint32_t) attr_rule_indices;
+
+/* keys are case folded, so that core.ignorecase rules can be found too */
+GIT_INLINE(khint_t) attr_match_key_hash(attr_match_key key)
+{
+	khint_t h = 0;
+	size_t i;
+
+	for (i = 0; i < key.len; ++i)
+		h = (h << 5) - h + (khint_t)tolower((unsigned char)key.ptr[i]);
+
+	return h;
+}
+
+#define attr_match_key_equal(a, b) \
+	((a).len == (b).len && !strncasecmp((a).ptr, (b).ptr, (a).len))
+
+__KHASH_TYPE(attrmatch, attr_match_key, attr_rule_indices);
+__KHASH_IMPL(attrmatch, static kh_inline, attr_match_key, attr_rule_indices, 1,
+	attr_match_key_hash, attr_match_key_equal);
+
+typedef khash_t(attrmatch) attr_match_map;
+
+struct git_attr_file_matcher {
+	attr_match_map *basenames;	/* literal patterns without a slash */
+	attr_match_map *extensions;	/* "*.ext" patterns, by ".ext" */
+	attr_match_map *prefixes;	/* path patterns, by leading literal dirs */
+	size_t prefix_depth;		/* most slashes in a prefix key */
+	attr_rule_indices others;	/* rules that have to be tried always */
+};
+
 static void attr_file_free(git_attr_file *file)
 {
 	bool unlock = !git_mutex_lock(&file->lock);
@@ -47,6 +87,29 @@ int git_attr_file__new(
 	return 0;
 }
 
+static void attr_match_map_free(attr_match_map *map)
+{
+	attr_rule_indices indices;
+
+	if (!map)
+		return;
+
+	kh_foreach_value(map, indices, git__free(indices.ptr));
+	kh_destroy(attrmatch, map);
+}
+
+static void attr_file_matcher_free(git_attr_file_matcher *matcher)
+{
+	if (!matcher)
+		return;
+
+	attr_match_map_free(matcher->basenames);
+	attr_match_map_free(matcher->extensions);
+	attr_match_map_free(matcher->prefixes);
+	git_array_clear(matcher->others);
+	git__free(matcher);
+}
+
 int git_attr_file__clear_rules(git_attr_file *file, bool need_lock)
 {
 	unsigned int i;
@@ -61,6 +124,9 @@ int git_attr_file__clear_rules(git_attr_file *file, bool need_lock)
 		git_attr_rule__free(rule);
 	git_vector_free(&file->rules);
 
+	attr_file_matcher_free(file->matcher);
+	file->matcher = NULL;
+
 	if (need_lock)
 		git_mutex_unlock(&file->lock);
 
@@ -106,6 +172,7 @@ int git_attr_file__load(
 	const char *data = NULL;
 	git_attr_file *file;
 	struct stat st;
+	bool nonexistent = false;
 
 	*out = NULL;
 
@@ -116,8 +183,17 @@ int git_attr_file__load(
 	case GIT_ATTR_FILE__FROM_INDEX: {
 		git_oid id;
 
-		if ((error = attr_file_oid_from_index(&id, repo, entry->path)) < 0 ||
-			(error = git_blob_lookup(&blob, repo, &id)) < 0)
+		error = attr_file_oid_from_index(&id, repo, entry->path);
+
+		/* remember missing files, so they are not looked up again */
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			nonexistent = true;
+			error = 0;
+			break;
+		}
+
+		if (error < 0 || (error = git_blob_lookup(&blob, repo, &id)) < 0)
 			return error;
 
 		data = git_blob_rawcontent(blob);
@@ -126,10 +202,17 @@ int git_attr_file__load(
 	case GIT_ATTR_FILE__FROM_FILE: {
 		int fd;
 
-		if (p_stat(entry->fullpath, &st) < 0)
-			return git_path_set_error(errno, entry->fullpath, "stat");
-		if (S_ISDIR(st.st_mode))
-			return GIT_ENOTFOUND;
+		if (p_stat(entry->fullpath, &st) < 0) {
+			if (errno != ENOENT && errno != ENOTDIR)
+				return git_path_set_error(errno, entry->fullpath, "stat");
+
+			nonexistent = true;
+			break;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			nonexistent = true;
+			break;
+		}
 
 		/* For open or read errors, return ENOTFOUND to skip item */
 		/* TODO: issue warning when warning API is available */
@@ -154,6 +237,12 @@ int git_attr_file__load(
 	if ((error = git_attr_file__new(&file, entry, source)) < 0)
 		goto cleanup;
 
+	if (nonexistent) {
+		file->nonexistent = 1;
+		*out = file;
+		goto cleanup;
+	}
+
 	if (parser && (error = parser(repo, file, data)) < 0) {
 		git_attr_file__free(file);
 		goto cleanup;
@@ -185,6 +274,9 @@ int git_attr_file__out_of_date(git_repository *repo, git_attr_file *file)
 		return 0;
 
 	case GIT_ATTR_FILE__FROM_FILE:
+		if (file->nonexistent)
+			return git_path_isfile(file->entry->fullpath);
+
 		return git_futils_filestamp_check(
 			&file->cache_data.stamp, file->entry->fullpath);
 
@@ -192,8 +284,17 @@ int git_attr_file__out_of_date(git_repository *repo, git_attr_file *file)
 		int error;
 		git_oid id;
 
-		if ((error = attr_file_oid_from_index(
-				&id, repo, file->entry->path)) < 0)
+		error = attr_file_oid_from_index(&id, repo, file->entry->path);
+
+		if (file->nonexistent) {
+			if (error == GIT_ENOTFOUND) {
+				giterr_clear();
+				return 0;
+			}
+			return (error < 0) ? error : 1;
+		}
+
+		if (error < 0)
 			return error;
 
 		return (git_oid__cmp(&file->cache_data.oid, &id) != 0);
@@ -263,6 +364,9 @@ int git_attr_file__parse_buffer(
 		}
 	}
 
+	if (!error)
+		error = git_attr_file__compile(attrs);
+
 	git_mutex_unlock(&attrs->lock);
 	git_attr_rule__free(rule);
 
@@ -285,7 +389,7 @@ int git_attr_file__lookup_one(
 	const char *attr,
 	const char **value)
 {
-	size_t i;
+	git_attr_file_iter iter;
 	git_attr_name name;
 	git_attr_rule *rule;
 
@@ -294,7 +398,7 @@ int git_attr_file__lookup_one(
 	name.name = attr;
 	name.name_hash = git_attr_file__name_hash(attr);
 
-	git_attr_file__foreach_matching_rule(file, path, i, rule) {
+	git_attr_file__foreach_matching_rule(file, path, iter, rule) {
 		size_t pos;
 
 		if (!git_vector_bsearch(&pos, &rule->assigns, &name)) {
@@ -393,6 +497,258 @@ bool git_attr_rule__match(
 	return matched;
 }
 
+GIT_INLINE(bool) attr_match_is_wild(char c)
+{
+	return (c == '*' || c == '?' || c == '[' || c == '\\');
+}
+
+static int attr_match_map_add(
+	attr_match_map **map, const char *ptr, size_t len, uint32_t rule)
+{
+	attr_match_key key;
+	khiter_t pos;
+	uint32_t *slot;
+	int rval;
+
+	if (!*map) {
+		*map = kh_init(attrmatch);
+		GITERR_CHECK_ALLOC(*map);
+	}
+
+	key.ptr = ptr;
+	key.len = len;
+
+	pos = kh_put(attrmatch, *map, key, &rval);
+	if (rval < 0) {
+		giterr_set_oom();
+		return -1;
+	}
+	if (rval)
+		git_array_init(kh_val(*map, pos));
+
+	slot = git_array_alloc(kh_val(*map, pos));
+	GITERR_CHECK_ALLOC(slot);
+
+	*slot = rule;
+	return 0;
+}
+
+static int attr_file_matcher_add(
+	git_attr_file_matcher *matcher, git_attr_fnmatch *match, uint32_t rule)
+{
+	const char *pattern = match->pattern, *end, *scan, *slash = NULL;
+	size_t depth = 0;
+	uint32_t *slot;
+
+	/* negative attribute rules match the paths their pattern does not */
+	if ((match->flags & GIT_ATTR_FNMATCH_MATCH_ALL) != 0 ||
+		((match->flags & GIT_ATTR_FNMATCH_NEGATIVE) != 0 &&
+		 (match->flags & GIT_ATTR_FNMATCH_IGNORE) == 0))
+		goto always;
+
+	end = pattern + match->length;
+
+	/* find the literal start of the pattern */
+	for (scan = pattern; scan < end && !attr_match_is_wild(*scan); ++scan) {
+		if (*scan == '/') {
+			slash = scan;
+			depth++;
+		}
+	}
+
+	if ((match->flags & GIT_ATTR_FNMATCH_FULLPATH) == 0) {
+		/* directory ignore rules also look at the first path component */
+		if (scan == end)
+			return attr_match_map_add(
+				&matcher->basenames, pattern, match->length, rule);
+
+		/* "*.ext", but not for directory ignore rules, which match the
+		 * containing path of files as well as the basename
+		 */
+		if (pattern[0] == '*' && pattern[1] == '.' && pattern[2] != '\0' &&
+			!((match->flags & GIT_ATTR_FNMATCH_DIRECTORY) != 0 &&
+			  (match->flags & GIT_ATTR_FNMATCH_IGNORE) != 0)) {
+			for (scan = pattern + 2; scan < end; ++scan)
+				if (*scan == '.' || attr_match_is_wild(*scan))
+					goto always;
+
+			return attr_match_map_add(
+				&matcher->extensions, pattern + 1, match->length - 1, rule);
+		}
+
+		goto always;
+	}
+
+	/* a path pattern matches only below its leading literal directories */
+	if (scan < end) {
+		if (!slash)
+			goto always;
+
+		end = slash;
+		depth--;
+	}
+
+	if (depth > matcher->prefix_depth)
+		matcher->prefix_depth = depth;
+
+	return attr_match_map_add(
+		&matcher->prefixes, pattern, (size_t)(end - pattern), rule);
+
+always:
+	slot = git_array_alloc(matcher->others);
+	GITERR_CHECK_ALLOC(slot);
+
+	*slot = rule;
+	return 0;
+}
+
+int git_attr_file__compile(git_attr_file *file)
+{
+	git_attr_file_matcher *matcher;
+	git_attr_fnmatch *match;
+	size_t i;
+	int error = 0;
+
+	attr_file_matcher_free(file->matcher);
+	file->matcher = NULL;
+
+	if (file->rules.length < GIT_ATTR_FILE_MATCHER_MIN_RULES ||
+		file->rules.length > UINT32_MAX)
+		return 0;
+
+	matcher = git__calloc(1, sizeof(git_attr_file_matcher));
+	GITERR_CHECK_ALLOC(matcher);
+
+	/* attribute rules begin with their git_attr_fnmatch */
+	git_vector_foreach(&file->rules, i, match) {
+		if ((error = attr_file_matcher_add(matcher, match, (uint32_t)i)) < 0)
+			break;
+	}
+
+	if (error < 0)
+		attr_file_matcher_free(matcher);
+	else
+		file->matcher = matcher;
+
+	return error;
+}
+
+static void attr_file_iter_add(
+	git_attr_file_iter *iter, const attr_rule_indices *indices)
+{
+	if (!indices->size || iter->all_left > 0)
+		return;
+
+	/* too many candidate lists, so scan every rule instead */
+	if (iter->lists == GIT_ATTR_FILE_ITER_LISTS) {
+		iter->lists = 0;
+		iter->all_left = iter->file->rules.length;
+		return;
+	}
+
+	iter->list[iter->lists].rules = indices->ptr;
+	iter->list[iter->lists].left = indices->size;
+	iter->lists++;
+}
+
+static void attr_file_iter_probe(
+	git_attr_file_iter *iter, attr_match_map *map, const char *ptr, size_t len)
+{
+	attr_match_key key;
+	khiter_t pos;
+
+	if (!map)
+		return;
+
+	key.ptr = ptr;
+	key.len = len;
+
+	if ((pos = kh_get(attrmatch, map, key)) != kh_end(map))
+		attr_file_iter_add(iter, &kh_val(map, pos));
+}
+
+void git_attr_file__iter_init(
+	git_attr_file_iter *iter, git_attr_file *file, git_attr_path *path)
+{
+	git_attr_file_matcher *matcher = file->matcher;
+	const char *scan, *dot;
+	size_t depth = 0;
+
+	iter->file = file;
+	iter->lists = 0;
+	iter->all_left = 0;
+
+	if (!matcher) {
+		iter->all_left = file->rules.length;
+		return;
+	}
+
+	attr_file_iter_add(iter, &matcher->others);
+
+	attr_file_iter_probe(iter, matcher->basenames,
+		path->basename, strlen(path->basename));
+	if (path->basename != path->path && (scan = strchr(path->path, '/')) != NULL)
+		attr_file_iter_probe(iter, matcher->basenames,
+			path->path, (size_t)(scan - path->path));
+
+	if ((dot = strrchr(path->basename, '.')) != NULL)
+		attr_file_iter_probe(iter, matcher->extensions, dot, strlen(dot));
+
+	if (!matcher->prefixes)
+		return;
+
+	for (scan = path->path; *scan; ++scan) {
+		if (*scan != '/')
+			continue;
+
+		attr_file_iter_probe(iter, matcher->prefixes,
+			path->path, (size_t)(scan - path->path));
+
+		if (++depth > matcher->prefix_depth)
+			return;
+	}
+
+	attr_file_iter_probe(iter, matcher->prefixes,
+		path->path, (size_t)(scan - path->path));
+}
+
+void *git_attr_file__iter_next(git_attr_file_iter *iter)
+{
+	size_t i, best = 0;
+	uint32_t rule = 0;
+	bool found = false;
+
+	if (iter->all_left > 0)
+		return git_vector_get(&iter->file->rules, --iter->all_left);
+
+	/* the candidate lists are merged, highest rule first */
+	for (i = 0; i < iter->lists; ++i) {
+		if (!iter->list[i].left)
+			continue;
+
+		if (!found ||
+			iter->list[i].rules[iter->list[i].left - 1] > rule) {
+			best = i;
+			rule = iter->list[i].rules[iter->list[i].left - 1];
+			found = true;
+		}
+	}
+
+	if (!found)
+		return NULL;
+
+	iter->list[best].left--;
+
+	/* a rule is in a single list, but one list may be probed twice */
+	for (i = 0; i < iter->lists; ++i) {
+		if (iter->list[i].left > 0 &&
+			iter->list[i].rules[iter->list[i].left - 1] == rule)
+			iter->list[i].left--;
+	}
+
+	return git_vector_get(&iter->file->rules, rule);
+}
+
 git_attr_assignment *git_attr_rule__lookup_assignment(
 	git_attr_rule *rule, const char *name)
 {
@@ -75,12 +75,21 @@ typedef struct {
 
 typedef struct git_attr_file_entry git_attr_file_entry;
 
+/*
+ * Index of the rules of a file by the literal parts of their patterns,
+ * so that a lookup only needs to fnmatch the rules that can match.
+ */
+typedef struct git_attr_file_matcher git_attr_file_matcher;
+
 typedef struct {
 	git_refcount rc;
 	git_mutex lock;
 	git_attr_file_entry *entry;
 	git_attr_file_source source;
+	git_atomic session_key;		/* session in which it was last checked */
+	unsigned int nonexistent:1;	/* remembers that there is no file */
 	git_vector rules;			/* vector of <rule*> or <fnmatch*> */
+	git_attr_file_matcher *matcher; /* NULL for short files */
 	git_pool pool;
 	union {
 		git_oid oid;
@@ -106,6 +115,29 @@ typedef struct {
 	int      is_dir;
 } git_attr_path;
 
+/*
+ * An attribute session is a snapshot of the attribute and ignore files
+ * for one operation, like a checkout, status or diff: every file is
+ * checked for changes only once per session, and the files found for
+ * the last directory that was looked up are remembered.
+ *
+ * A session must only be used by one thread at a time.
+ */
+typedef struct {
+	int key;
+	unsigned int init_setup:1,
+		init_sysdir:1;
+	git_buf sysdir;
+	git_buf last_dir;
+	uint32_t last_flags;
+	git_vector last_files;
+} git_attr_session;
+
+extern void git_attr_session__init(
+	git_attr_session *session, git_repository *repo);
+
+extern void git_attr_session__free(git_attr_session *session);
+
 /*
  * git_attr_file API
  */
@@ -142,11 +174,36 @@ int git_attr_file__lookup_one(
 	const char *attr,
 	const char **value);
 
+/*
+ * Iterate from bottom to top over the rules of a file that may match a
+ * path; the caller still has to match each rule that is returned.
+ */
+#define GIT_ATTR_FILE_ITER_LISTS 16
+
+typedef struct {
+	git_attr_file *file;
+	struct {
+		const uint32_t *rules; /* indices in ascending order */
+		size_t left;
+	} list[GIT_ATTR_FILE_ITER_LISTS];
+	size_t lists;
+	size_t all_left; /* when scanning every rule instead */
+} git_attr_file_iter;
+
+extern void git_attr_file__iter_init(
+	git_attr_file_iter *iter, git_attr_file *file, git_attr_path *path);
+
+extern void *git_attr_file__iter_next(git_attr_file_iter *iter);
+
 /* loop over rules in file from bottom to top */
 #define git_attr_file__foreach_matching_rule(file, path, iter, rule)	\
-	git_vector_rforeach(&(file)->rules, (iter), (rule)) \
+	for (git_attr_file__iter_init(&(iter), (file), (path)); \
+		((rule) = git_attr_file__iter_next(&(iter))) != NULL; ) \
 		if (git_attr_rule__match((rule), (path)))
 
+/* build the matcher for the rules of a file; the file must be locked */
+extern int git_attr_file__compile(git_attr_file *file);
+
 uint32_t git_attr_file__name_hash(const char *name);
 
 
@@ -196,6 +196,7 @@ cleanup:
 int git_attr_cache__get(
 	git_attr_file **out,
 	git_repository *repo,
+	git_attr_session *attr_session,
 	git_attr_file_source source,
 	const char *base,
 	const char *filename,
@@ -210,8 +211,13 @@ int git_attr_cache__get(
 			&file, &entry, repo, source, base, filename)) < 0)
 		return error;
 
-	/* load file if we don't have one or if existing one is out of date */
-	if (!file || (error = git_attr_file__out_of_date(repo, file)) > 0)
+	/* load file if we don't have one or if existing one is out of date,
+	 * unless it has already been checked in this session
+	 */
+	if (file && attr_session &&
+		git_atomic_get(&file->session_key) == attr_session->key)
+		/* up to date */;
+	else if (!file || (error = git_attr_file__out_of_date(repo, file)) > 0)
 		error = git_attr_file__load(&updated, repo, entry, source, parser);
 
 	/* if we loaded the file, insert into and/or update cache */
@@ -239,6 +245,15 @@ int git_attr_cache__get(
 		}
 	}
 
+	if (file && attr_session)
+		git_atomic_set(&file->session_key, attr_session->key);
+
+	/* a missing file is cached, but there are no rules to return */
+	if (file && file->nonexistent) {
+		git_attr_file__free(file);
+		file = NULL;
+	}
+
 	*out = file;
 	return error;
 }
@@ -262,7 +277,8 @@ bool git_attr_cache__is_cached(
 
 	entry = git_strmap_value_at(files, pos);
 
-	return entry && (entry->file[source] != NULL);
+	return entry && entry->file[source] != NULL &&
+		!entry->file[source]->nonexistent;
 }
 
 
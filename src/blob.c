@@ -106,6 +106,29 @@ static int write_file_stream(
 	return error;
 }
 
+struct blob_stream {
+	git_writestream parent;
+	git_odb_stream *odb_stream;
+};
+
+static int blob_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	struct blob_stream *stream = (struct blob_stream *)s;
+	return git_odb_stream_write(stream->odb_stream, buffer, len);
+}
+
+static int blob_stream_close(git_writestream *s)
+{
+	GIT_UNUSED(s);
+	return 0;
+}
+
+static void blob_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
+
 static int write_file_filtered(
 	git_oid *id,
 	git_off_t *size,
@@ -113,18 +136,51 @@ static int write_file_filtered(
 	const char *full_path,
 	git_filter_list *fl)
 {
-	int error;
+	int fd, error;
+	size_t filtered_size;
 	git_buf tgt = GIT_BUF_INIT;
+	struct blob_stream stream;
+
+	if ((fd = git_futils_open_ro(full_path)) < 0)
+		return fd;
 
-	error = git_filter_list_apply_to_file(&tgt, fl, NULL, full_path);
+	/* the size of the blob is needed before it can be streamed to the
+	 * odb, so content that is too large to be kept in memory is filtered
+	 * twice: once to measure it and once to write it
+	 */
+	if ((error = git_filter_list__buffer_fd(
+			&tgt, &filtered_size, fl, fd)) < 0)
+		goto done;
 
-	/* Write the file to disk if it was properly filtered */
-	if (!error) {
-		*size = tgt.size;
+	*size = (git_off_t)filtered_size;
 
+	if (error == 1) {
 		error = git_odb_write(id, odb, tgt.ptr, tgt.size, GIT_OBJ_BLOB);
+		goto done;
 	}
 
+	if (p_lseek(fd, 0, SEEK_SET) < 0) {
+		giterr_set(GITERR_OS, "Could not rewind '%s'", full_path);
+		error = -1;
+		goto done;
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	stream.parent.write = blob_stream_write;
+	stream.parent.close = blob_stream_close;
+	stream.parent.free = blob_stream_free;
+
+	if ((error = git_odb_open_wstream(
+			&stream.odb_stream, odb, filtered_size, GIT_OBJ_BLOB)) < 0)
+		goto done;
+
+	if (!(error = git_filter_list__stream_fd(fl, fd, &stream.parent)))
+		error = git_odb_stream_finalize_write(id, stream.odb_stream);
+
+	git_odb_stream_free(stream.odb_stream);
+
+done:
+	p_close(fd);
 	git_buf_free(&tgt);
 	return error;
 }
@@ -213,20 +269,6 @@ int git_blob__create_from_paths(
 
 			git_filter_list_free(fl);
 		}
-
-		/*
-		 * TODO: eventually support streaming filtered files, for files
-		 * which are bigger than a given threshold. This is not a priority
-		 * because applying a filter in streaming mode changes the final
-		 * size of the blob, and without knowing its final size, the blob
-		 * cannot be written in stream mode to the ODB.
-		 *
-		 * The plan is to do streaming writes to a tempfile on disk and then
-		 * opening streaming that file to the ODB, using
-		 * `write_file_stream`.
-		 *
-		 * CAREFULLY DESIGNED APIS YO
-		 */
 	}
 
 done:
@@ -6,6 +6,682 @@
  */
 #include "buf_text.h"
 
+/*
+ * Text scanning kernels.  Every blob that is checked out, added or diffed
+ * is scanned for line endings and binary content, so the scans work on
+ * 16 or 32 bytes at a time where the CPU allows.  SSE2 is always present
+ * on x86-64; AVX2 is used when the CPU reports it at runtime.
+ */
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# define GIT_TEXT_SSE2
+# include <emmintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
+#if defined(GIT_TEXT_SSE2) && \
+	(defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || __GNUC__ > 4 || \
+	 (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define GIT_TEXT_AVX2
+# include <immintrin.h>
+# define GIT_TEXT_AVX2_FN __attribute__((target("avx2")))
+#endif
+
+static git_buf_text_kernel_t text_kernel_supported(void)
+{
+#if defined(GIT_TEXT_AVX2)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return GIT_BUF_TEXT_AVX2;
+#endif
+#if defined(GIT_TEXT_SSE2)
+	return GIT_BUF_TEXT_SSE2;
+#else
+	return GIT_BUF_TEXT_SCALAR;
+#endif
+}
+
+static int text_kernel = -1;
+
+GIT_INLINE(git_buf_text_kernel_t) text_kernel_get(void)
+{
+	if (text_kernel < 0)
+		text_kernel = text_kernel_supported();
+
+	return (git_buf_text_kernel_t)text_kernel;
+}
+
+git_buf_text_kernel_t git_buf_text__use_kernel(git_buf_text_kernel_t kernel)
+{
+	git_buf_text_kernel_t supported = text_kernel_supported();
+
+	text_kernel = (kernel < supported) ? kernel : supported;
+	return (git_buf_text_kernel_t)text_kernel;
+}
+
+/* Counts that the vector kernels add up in byte lanes */
+typedef struct {
+	size_t total, nul, cr, lf, crlf, ctl, ctl_printable;
+} text_counts;
+
+static void text_counts_apply(git_buf_text_stats *stats, text_counts *counts)
+{
+	/* control characters are nonprintable, apart from some whitespace,
+	 * and CR and LF, which are counted separately
+	 */
+	stats->nul += (unsigned int)counts->nul;
+	stats->cr += (unsigned int)counts->cr;
+	stats->lf += (unsigned int)counts->lf;
+	stats->crlf += (unsigned int)counts->crlf;
+	stats->printable += (unsigned int)
+		(counts->total - counts->ctl + counts->ctl_printable);
+	stats->nonprintable += (unsigned int)
+		(counts->ctl - counts->ctl_printable - counts->cr - counts->lf);
+}
+
+static void text_count_scalar(
+	git_buf_text_stats *stats, const char *scan, const char *end)
+{
+	while (scan < end) {
+		unsigned char c = *scan++;
+
+		if (c > 0x1F && c != 0x7F)
+			stats->printable++;
+		else switch (c) {
+			case '\0':
+				stats->nul++;
+				stats->nonprintable++;
+				break;
+			case '\n':
+				stats->lf++;
+				break;
+			case '\r':
+				stats->cr++;
+				if (scan < end && *scan == '\n')
+					stats->crlf++;
+				break;
+			case '\t': case '\f': case '\v': case '\b': case 0x1b: /*ESC*/
+				stats->printable++;
+				break;
+			default:
+				stats->nonprintable++;
+				break;
+			}
+	}
+}
+
+/* Returns -1 on a NUL byte, else the printable and nonprintable counts */
+static int text_binary_scan_scalar(
+	size_t *printable, size_t *nonprintable, const char *scan, const char *end)
+{
+	while (scan < end) {
+		unsigned char c = *scan++;
+
+		if (c > 0x1F && c < 0x7F)
+			(*printable)++;
+		else if (c == '\0')
+			return -1;
+		else if (!git__isspace(c))
+			(*nonprintable)++;
+	}
+
+	return 0;
+}
+
+static size_t text_count_lf_scalar(
+	size_t *crlf, const char *scan, const char *end, char prev)
+{
+	size_t lf = 0;
+
+	for (; scan < end; prev = *scan++) {
+		if (*scan == '\n') {
+			lf++;
+			*crlf += (prev == '\r');
+		}
+	}
+
+	return lf;
+}
+
+static size_t text_crlf_to_lf_scalar(
+	char *out, const char *scan, const char *end)
+{
+	char *start = out;
+
+	while (scan < end) {
+		char c = *scan++;
+
+		/* Do not drop \r unless it is followed by \n */
+		if (c != '\r' || scan == end || *scan != '\n')
+			*out++ = c;
+	}
+
+	return (size_t)(out - start);
+}
+
+static size_t text_lf_to_crlf_scalar(
+	char *out, const char *scan, const char *end, char prev)
+{
+	char *start = out;
+
+	while (scan < end) {
+		char c = *scan++;
+
+		if (c == '\n' && prev != '\r')
+			*out++ = '\r';
+
+		*out++ = prev = c;
+	}
+
+	return (size_t)(out - start);
+}
+
+#if defined(GIT_TEXT_SSE2)
+
+GIT_INLINE(unsigned int) text_ctz(unsigned int mask)
+{
+#if defined(__GNUC__)
+	return (unsigned int)__builtin_ctz(mask);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (unsigned int)index;
+#else
+	unsigned int index = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		index++;
+	}
+	return index;
+#endif
+}
+
+/* Copy a block of `width` bytes, leaving out the bytes set in `drop` */
+GIT_INLINE(char *) text_copy_dropping(
+	char *out, const char *block, size_t width, unsigned int drop)
+{
+	size_t pos = 0, at;
+
+	while (drop) {
+		at = text_ctz(drop);
+		drop &= drop - 1;
+
+		memcpy(out, block + pos, at - pos);
+		out += at - pos;
+		pos = at + 1;
+	}
+
+	memcpy(out, block + pos, width - pos);
+	return out + width - pos;
+}
+
+/* Copy a block of `width` bytes, adding a \r before the bytes in `lfs` */
+GIT_INLINE(char *) text_copy_adding_cr(
+	char *out, const char *block, size_t width, unsigned int lfs, char prev)
+{
+	size_t pos = 0, at;
+
+	while (lfs) {
+		at = text_ctz(lfs);
+		lfs &= lfs - 1;
+
+		memcpy(out, block + pos, at - pos);
+		out += at - pos;
+		pos = at;
+
+		if ((at ? block[at - 1] : prev) != '\r')
+			*out++ = '\r';
+	}
+
+	memcpy(out, block + pos, width - pos);
+	return out + width - pos;
+}
+
+#endif
+
+#ifdef GIT_TEXT_SSE2
+
+GIT_INLINE(size_t) text_sum_sse2(__m128i acc)
+{
+	__m128i sum = _mm_sad_epu8(acc, _mm_setzero_si128());
+	return (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_extract_epi16(sum, 4);
+}
+
+/* true for the bytes of `c` in the range `low` to `low + span` */
+GIT_INLINE(__m128i) text_in_range_sse2(__m128i c, char low, char span)
+{
+	__m128i offset = _mm_sub_epi8(c, _mm_set1_epi8(low));
+	__m128i limit = _mm_set1_epi8(span);
+	return _mm_cmpeq_epi8(_mm_max_epu8(offset, limit), limit);
+}
+
+static void text_count_sse2(
+	git_buf_text_stats *stats, const char *scan, const char *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i v_lf = _mm_set1_epi8('\n'), v_cr = _mm_set1_epi8('\r');
+	const __m128i v_del = _mm_set1_epi8(0x7F), v_esc = _mm_set1_epi8(0x1B);
+	text_counts counts = { 0 };
+
+	/* each block looks one byte ahead for CRLF; lanes count up to 255 */
+	while (end - scan > 16) {
+		size_t blocks = min((size_t)(end - scan - 1) / 16, 255), i;
+		__m128i nul = zero, cr = zero, lf = zero, crlf = zero;
+		__m128i ctl = zero, ctl_printable = zero;
+
+		for (i = 0; i < blocks; ++i, scan += 16) {
+			__m128i c = _mm_loadu_si128((const __m128i *)scan);
+			__m128i next = _mm_loadu_si128((const __m128i *)(scan + 1));
+			__m128i is_cr = _mm_cmpeq_epi8(c, v_cr);
+
+			nul = _mm_sub_epi8(nul, _mm_cmpeq_epi8(c, zero));
+			cr = _mm_sub_epi8(cr, is_cr);
+			lf = _mm_sub_epi8(lf, _mm_cmpeq_epi8(c, v_lf));
+			crlf = _mm_sub_epi8(crlf,
+				_mm_and_si128(is_cr, _mm_cmpeq_epi8(next, v_lf)));
+			ctl = _mm_sub_epi8(ctl, _mm_or_si128(
+				text_in_range_sse2(c, 0, 0x1F), _mm_cmpeq_epi8(c, v_del)));
+
+			/* \b and \t, \v and \f, and ESC */
+			ctl_printable = _mm_sub_epi8(ctl_printable, _mm_or_si128(
+				_mm_or_si128(text_in_range_sse2(c, '\b', 1),
+					text_in_range_sse2(c, '\v', 1)),
+				_mm_cmpeq_epi8(c, v_esc)));
+		}
+
+		counts.total += blocks * 16;
+		counts.nul += text_sum_sse2(nul);
+		counts.cr += text_sum_sse2(cr);
+		counts.lf += text_sum_sse2(lf);
+		counts.crlf += text_sum_sse2(crlf);
+		counts.ctl += text_sum_sse2(ctl);
+		counts.ctl_printable += text_sum_sse2(ctl_printable);
+	}
+
+	text_counts_apply(stats, &counts);
+	text_count_scalar(stats, scan, end);
+}
+
+static int text_binary_scan_sse2(
+	size_t *printable, size_t *nonprintable, const char *scan, const char *end)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	while (end - scan >= 16) {
+		size_t blocks = min((size_t)(end - scan) / 16, 255), i;
+		__m128i text = zero, space = zero;
+
+		for (i = 0; i < blocks; ++i, scan += 16) {
+			__m128i c = _mm_loadu_si128((const __m128i *)scan);
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)))
+				return -1;
+
+			text = _mm_sub_epi8(text, text_in_range_sse2(c, 0x20, 0x5E));
+			space = _mm_sub_epi8(space, text_in_range_sse2(c, '\t', 4));
+		}
+
+		*printable += text_sum_sse2(text);
+		*nonprintable += blocks * 16 - text_sum_sse2(text) - text_sum_sse2(space);
+	}
+
+	return text_binary_scan_scalar(printable, nonprintable, scan, end);
+}
+
+static size_t text_count_lf_sse2(
+	size_t *crlf, const char *scan, const char *end, char prev)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i v_lf = _mm_set1_epi8('\n'), v_cr = _mm_set1_epi8('\r');
+	size_t lf;
+
+	if (scan == end)
+		return 0;
+
+	/* the byte before each block is looked at for the \r of a CRLF */
+	lf = text_count_lf_scalar(crlf, scan, scan + 1, prev);
+	scan++;
+
+	while (end - scan >= 16) {
+		size_t blocks = min((size_t)(end - scan) / 16, 255), i;
+		__m128i lfs = zero, crlfs = zero;
+
+		for (i = 0; i < blocks; ++i, scan += 16) {
+			__m128i c = _mm_loadu_si128((const __m128i *)scan);
+			__m128i before = _mm_loadu_si128((const __m128i *)(scan - 1));
+			__m128i is_lf = _mm_cmpeq_epi8(c, v_lf);
+
+			lfs = _mm_sub_epi8(lfs, is_lf);
+			crlfs = _mm_sub_epi8(crlfs,
+				_mm_and_si128(is_lf, _mm_cmpeq_epi8(before, v_cr)));
+		}
+
+		lf += text_sum_sse2(lfs);
+		*crlf += text_sum_sse2(crlfs);
+	}
+
+	return lf + text_count_lf_scalar(crlf, scan, end, scan[-1]);
+}
+
+static size_t text_crlf_to_lf_sse2(
+	char *out, const char *scan, const char *end)
+{
+	const __m128i v_cr = _mm_set1_epi8('\r'), v_lf = _mm_set1_epi8('\n');
+	char *start = out;
+
+	/* each block looks one byte ahead for the \n of a CRLF */
+	for (; end - scan > 16; scan += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)scan);
+		__m128i next = _mm_loadu_si128((const __m128i *)(scan + 1));
+		unsigned int crlf = (unsigned int)_mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpeq_epi8(c, v_cr), _mm_cmpeq_epi8(next, v_lf)));
+
+		if (!crlf) {
+			_mm_storeu_si128((__m128i *)out, c);
+			out += 16;
+		} else
+			out = text_copy_dropping(out, scan, 16, crlf);
+	}
+
+	return (size_t)(out - start) + text_crlf_to_lf_scalar(out, scan, end);
+}
+
+static size_t text_lf_to_crlf_sse2(
+	char *out, const char *scan, const char *end, char prev)
+{
+	const __m128i v_lf = _mm_set1_epi8('\n');
+	char *start = out;
+
+	for (; end - scan >= 16; scan += 16) {
+		__m128i c = _mm_loadu_si128((const __m128i *)scan);
+		unsigned int lfs =
+			(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(c, v_lf));
+
+		if (!lfs) {
+			_mm_storeu_si128((__m128i *)out, c);
+			out += 16;
+		} else
+			out = text_copy_adding_cr(out, scan, 16, lfs, prev);
+
+		prev = scan[15];
+	}
+
+	return (size_t)(out - start) +
+		text_lf_to_crlf_scalar(out, scan, end, prev);
+}
+
+#endif
+
+#ifdef GIT_TEXT_AVX2
+
+GIT_TEXT_AVX2_FN GIT_INLINE(size_t) text_sum_avx2(__m256i acc)
+{
+	__m256i sum = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+	return (size_t)_mm256_extract_epi16(sum, 0) +
+		(size_t)_mm256_extract_epi16(sum, 4) +
+		(size_t)_mm256_extract_epi16(sum, 8) +
+		(size_t)_mm256_extract_epi16(sum, 12);
+}
+
+GIT_TEXT_AVX2_FN GIT_INLINE(__m256i) text_in_range_avx2(
+	__m256i c, char low, char span)
+{
+	__m256i offset = _mm256_sub_epi8(c, _mm256_set1_epi8(low));
+	__m256i limit = _mm256_set1_epi8(span);
+	return _mm256_cmpeq_epi8(_mm256_max_epu8(offset, limit), limit);
+}
+
+GIT_TEXT_AVX2_FN static void text_count_avx2(
+	git_buf_text_stats *stats, const char *scan, const char *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i v_lf = _mm256_set1_epi8('\n'), v_cr = _mm256_set1_epi8('\r');
+	const __m256i v_del = _mm256_set1_epi8(0x7F), v_esc = _mm256_set1_epi8(0x1B);
+	text_counts counts = { 0 };
+
+	while (end - scan > 32) {
+		size_t blocks = min((size_t)(end - scan - 1) / 32, 255), i;
+		__m256i nul = zero, cr = zero, lf = zero, crlf = zero;
+		__m256i ctl = zero, ctl_printable = zero;
+
+		for (i = 0; i < blocks; ++i, scan += 32) {
+			__m256i c = _mm256_loadu_si256((const __m256i *)scan);
+			__m256i next = _mm256_loadu_si256((const __m256i *)(scan + 1));
+			__m256i is_cr = _mm256_cmpeq_epi8(c, v_cr);
+
+			nul = _mm256_sub_epi8(nul, _mm256_cmpeq_epi8(c, zero));
+			cr = _mm256_sub_epi8(cr, is_cr);
+			lf = _mm256_sub_epi8(lf, _mm256_cmpeq_epi8(c, v_lf));
+			crlf = _mm256_sub_epi8(crlf,
+				_mm256_and_si256(is_cr, _mm256_cmpeq_epi8(next, v_lf)));
+			ctl = _mm256_sub_epi8(ctl, _mm256_or_si256(
+				text_in_range_avx2(c, 0, 0x1F), _mm256_cmpeq_epi8(c, v_del)));
+			ctl_printable = _mm256_sub_epi8(ctl_printable, _mm256_or_si256(
+				_mm256_or_si256(text_in_range_avx2(c, '\b', 1),
+					text_in_range_avx2(c, '\v', 1)),
+				_mm256_cmpeq_epi8(c, v_esc)));
+		}
+
+		counts.total += blocks * 32;
+		counts.nul += text_sum_avx2(nul);
+		counts.cr += text_sum_avx2(cr);
+		counts.lf += text_sum_avx2(lf);
+		counts.crlf += text_sum_avx2(crlf);
+		counts.ctl += text_sum_avx2(ctl);
+		counts.ctl_printable += text_sum_avx2(ctl_printable);
+	}
+
+	text_counts_apply(stats, &counts);
+	text_count_scalar(stats, scan, end);
+}
+
+GIT_TEXT_AVX2_FN static int text_binary_scan_avx2(
+	size_t *printable, size_t *nonprintable, const char *scan, const char *end)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	while (end - scan >= 32) {
+		size_t blocks = min((size_t)(end - scan) / 32, 255), i;
+		__m256i text = zero, space = zero;
+
+		for (i = 0; i < blocks; ++i, scan += 32) {
+			__m256i c = _mm256_loadu_si256((const __m256i *)scan);
+
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, zero)))
+				return -1;
+
+			text = _mm256_sub_epi8(text, text_in_range_avx2(c, 0x20, 0x5E));
+			space = _mm256_sub_epi8(space, text_in_range_avx2(c, '\t', 4));
+		}
+
+		*printable += text_sum_avx2(text);
+		*nonprintable += blocks * 32 - text_sum_avx2(text) - text_sum_avx2(space);
+	}
+
+	return text_binary_scan_scalar(printable, nonprintable, scan, end);
+}
+
+GIT_TEXT_AVX2_FN static size_t text_count_lf_avx2(
+	size_t *crlf, const char *scan, const char *end, char prev)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i v_lf = _mm256_set1_epi8('\n'), v_cr = _mm256_set1_epi8('\r');
+	size_t lf;
+
+	if (scan == end)
+		return 0;
+
+	/* the byte before each block is looked at for the \r of a CRLF */
+	lf = text_count_lf_scalar(crlf, scan, scan + 1, prev);
+	scan++;
+
+	while (end - scan >= 32) {
+		size_t blocks = min((size_t)(end - scan) / 32, 255), i;
+		__m256i lfs = zero, crlfs = zero;
+
+		for (i = 0; i < blocks; ++i, scan += 32) {
+			__m256i c = _mm256_loadu_si256((const __m256i *)scan);
+			__m256i before = _mm256_loadu_si256((const __m256i *)(scan - 1));
+			__m256i is_lf = _mm256_cmpeq_epi8(c, v_lf);
+
+			lfs = _mm256_sub_epi8(lfs, is_lf);
+			crlfs = _mm256_sub_epi8(crlfs,
+				_mm256_and_si256(is_lf, _mm256_cmpeq_epi8(before, v_cr)));
+		}
+
+		lf += text_sum_avx2(lfs);
+		*crlf += text_sum_avx2(crlfs);
+	}
+
+	return lf + text_count_lf_scalar(crlf, scan, end, scan[-1]);
+}
+
+GIT_TEXT_AVX2_FN static size_t text_crlf_to_lf_avx2(
+	char *out, const char *scan, const char *end)
+{
+	const __m256i v_cr = _mm256_set1_epi8('\r'), v_lf = _mm256_set1_epi8('\n');
+	char *start = out;
+
+	for (; end - scan > 32; scan += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)scan);
+		__m256i next = _mm256_loadu_si256((const __m256i *)(scan + 1));
+		unsigned int crlf = (unsigned int)_mm256_movemask_epi8(
+			_mm256_and_si256(_mm256_cmpeq_epi8(c, v_cr),
+				_mm256_cmpeq_epi8(next, v_lf)));
+
+		if (!crlf) {
+			_mm256_storeu_si256((__m256i *)out, c);
+			out += 32;
+		} else
+			out = text_copy_dropping(out, scan, 32, crlf);
+	}
+
+	return (size_t)(out - start) + text_crlf_to_lf_scalar(out, scan, end);
+}
+
+GIT_TEXT_AVX2_FN static size_t text_lf_to_crlf_avx2(
+	char *out, const char *scan, const char *end, char prev)
+{
+	const __m256i v_lf = _mm256_set1_epi8('\n');
+	char *start = out;
+
+	for (; end - scan >= 32; scan += 32) {
+		__m256i c = _mm256_loadu_si256((const __m256i *)scan);
+		unsigned int lfs = (unsigned int)
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, v_lf));
+
+		if (!lfs) {
+			_mm256_storeu_si256((__m256i *)out, c);
+			out += 32;
+		} else
+			out = text_copy_adding_cr(out, scan, 32, lfs, prev);
+
+		prev = scan[31];
+	}
+
+	return (size_t)(out - start) +
+		text_lf_to_crlf_scalar(out, scan, end, prev);
+}
+
+#endif
+
+static void text_count(
+	git_buf_text_stats *stats, const char *scan, const char *end)
+{
+	switch (text_kernel_get()) {
+#ifdef GIT_TEXT_AVX2
+	case GIT_BUF_TEXT_AVX2:
+		text_count_avx2(stats, scan, end);
+		return;
+#endif
+#ifdef GIT_TEXT_SSE2
+	case GIT_BUF_TEXT_SSE2:
+		text_count_sse2(stats, scan, end);
+		return;
+#endif
+	default:
+		text_count_scalar(stats, scan, end);
+		return;
+	}
+}
+
+static int text_binary_scan(
+	size_t *printable, size_t *nonprintable, const char *scan, const char *end)
+{
+	switch (text_kernel_get()) {
+#ifdef GIT_TEXT_AVX2
+	case GIT_BUF_TEXT_AVX2:
+		return text_binary_scan_avx2(printable, nonprintable, scan, end);
+#endif
+#ifdef GIT_TEXT_SSE2
+	case GIT_BUF_TEXT_SSE2:
+		return text_binary_scan_sse2(printable, nonprintable, scan, end);
+#endif
+	default:
+		return text_binary_scan_scalar(printable, nonprintable, scan, end);
+	}
+}
+
+static size_t text_count_lf(
+	size_t *crlf, const char *scan, const char *end)
+{
+	switch (text_kernel_get()) {
+#ifdef GIT_TEXT_AVX2
+	case GIT_BUF_TEXT_AVX2:
+		return text_count_lf_avx2(crlf, scan, end, '\0');
+#endif
+#ifdef GIT_TEXT_SSE2
+	case GIT_BUF_TEXT_SSE2:
+		return text_count_lf_sse2(crlf, scan, end, '\0');
+#endif
+	default:
+		return text_count_lf_scalar(crlf, scan, end, '\0');
+	}
+}
+
+void git_buf_text__count(
+	git_buf_text_stats *stats, const char *ptr, size_t len)
+{
+	memset(stats, 0, sizeof(*stats));
+	text_count(stats, ptr, ptr + len);
+}
+
+size_t git_buf_text__crlf_to_lf(char *out, const char *in, size_t len)
+{
+	switch (text_kernel_get()) {
+#ifdef GIT_TEXT_AVX2
+	case GIT_BUF_TEXT_AVX2:
+		return text_crlf_to_lf_avx2(out, in, in + len);
+#endif
+#ifdef GIT_TEXT_SSE2
+	case GIT_BUF_TEXT_SSE2:
+		return text_crlf_to_lf_sse2(out, in, in + len);
+#endif
+	default:
+		return text_crlf_to_lf_scalar(out, in, in + len);
+	}
+}
+
+size_t git_buf_text__lf_to_crlf(
+	char *out, const char *in, size_t len, char prev)
+{
+	switch (text_kernel_get()) {
+#ifdef GIT_TEXT_AVX2
+	case GIT_BUF_TEXT_AVX2:
+		return text_lf_to_crlf_avx2(out, in, in + len, prev);
+#endif
+#ifdef GIT_TEXT_SSE2
+	case GIT_BUF_TEXT_SSE2:
+		return text_lf_to_crlf_sse2(out, in, in + len, prev);
+#endif
+	default:
+		return text_lf_to_crlf_scalar(out, in, in + len, prev);
+	}
+}
+
 int git_buf_text_puts_escaped(
 	git_buf *buf,
 	const char *string,
@@ -62,43 +738,16 @@ void git_buf_text_unescape(git_buf *buf)
 
 int git_buf_text_crlf_to_lf(git_buf *tgt, const git_buf *src)
 {
-	const char *scan = src->ptr;
-	const char *scan_end = src->ptr + src->size;
-	const char *next = memchr(scan, '\r', src->size);
-	char *out;
-
 	assert(tgt != src);
 
-	if (!next)
+	if (!memchr(src->ptr, '\r', src->size))
 		return git_buf_set(tgt, src->ptr, src->size);
 
 	/* reduce reallocs while in the loop */
 	if (git_buf_grow(tgt, src->size + 1) < 0)
 		return -1;
-	out = tgt->ptr;
-	tgt->size = 0;
-
-	/* Find the next \r and copy whole chunk up to there to tgt */
-	for (; next; scan = next + 1, next = memchr(scan, '\r', scan_end - scan)) {
-		if (next > scan) {
-			size_t copylen = (size_t)(next - scan);
-			memcpy(out, scan, copylen);
-			out += copylen;
-		}
 
-		/* Do not drop \r unless it is followed by \n */
-		if (next + 1 == scan_end || next[1] != '\n')
-			*out++ = '\r';
-	}
-
-	/* Copy remaining input into dest */
-	if (scan < scan_end) {
-		size_t remaining = (size_t)(scan_end - scan);
-		memcpy(out, scan, remaining);
-		out += remaining;
-	}
-
-	tgt->size = (size_t)(out - tgt->ptr);
+	tgt->size = git_buf_text__crlf_to_lf(tgt->ptr, src->ptr, src->size);
 	tgt->ptr[tgt->size] = '\0';
 
 	return 0;
@@ -106,44 +755,28 @@ int git_buf_text_crlf_to_lf(git_buf *tgt, const git_buf *src)
 
 int git_buf_text_lf_to_crlf(git_buf *tgt, const git_buf *src)
 {
-	const char *start = src->ptr;
-	const char *end = start + src->size;
-	const char *scan = start;
-	const char *next = memchr(scan, '\n', src->size);
+	size_t lf, crlf = 0;
 
 	assert(tgt != src);
 
-	if (!next)
-		return git_buf_set(tgt, src->ptr, src->size);
-
-	/* attempt to reduce reallocs while in the loop */
-	if (git_buf_grow(tgt, src->size + (src->size >> 4) + 1) < 0)
-		return -1;
-	tgt->size = 0;
-
-	for (; next; scan = next + 1, next = memchr(scan, '\n', end - scan)) {
-		size_t copylen = next - scan;
-		size_t needsize = tgt->size + copylen + 2 + 1;
+	lf = text_count_lf(&crlf, src->ptr, src->ptr + src->size);
 
-		/* if we find mixed line endings, bail */
-		if (next > start && next[-1] == '\r') {
-			git_buf_free(tgt);
-			return GIT_PASSTHROUGH;
-		}
+	if (!lf)
+		return git_buf_set(tgt, src->ptr, src->size);
 
-		if (tgt->asize < needsize && git_buf_grow(tgt, needsize) < 0)
-			return -1;
+	/* if we find mixed line endings, bail */
+	if (crlf) {
+		git_buf_free(tgt);
+		return GIT_PASSTHROUGH;
+	}
 
-		if (next > scan) {
-			memcpy(tgt->ptr + tgt->size, scan, copylen);
-			tgt->size += copylen;
-		}
+	if (git_buf_grow(tgt, src->size + lf + 1) < 0)
+		return -1;
 
-		tgt->ptr[tgt->size++] = '\r';
-		tgt->ptr[tgt->size++] = '\n';
-	}
+	tgt->size = git_buf_text__lf_to_crlf(tgt->ptr, src->ptr, src->size, '\0');
+	tgt->ptr[tgt->size] = '\0';
 
-	return git_buf_put(tgt, scan, end - scan);
+	return 0;
 }
 
 int git_buf_text_common_prefix(git_buf *buf, const git_strarray *strings)
@@ -180,23 +813,15 @@ bool git_buf_text_is_binary(const git_buf *buf)
 {
 	const char *scan = buf->ptr, *end = buf->ptr + buf->size;
 	git_bom_t bom;
-	int printable = 0, nonprintable = 0;
+	size_t printable = 0, nonprintable = 0;
 
 	scan += git_buf_text_detect_bom(&bom, buf, 0);
 
 	if (bom > GIT_BOM_UTF8)
 		return 1;
 
-	while (scan < end) {
-		unsigned char c = *scan++;
-
-		if (c > 0x1F && c < 0x7F)
-			printable++;
-		else if (c == '\0')
-			return true;
-		else if (!git__isspace(c))
-			nonprintable++;
-	}
+	if (text_binary_scan(&printable, &nonprintable, scan, end) < 0)
+		return true;
 
 	return ((printable >> 7) < nonprintable);
 }
@@ -273,33 +898,7 @@ bool git_buf_text_gather_stats(
 	if (buf->size > 0 && end[-1] == '\032')
 		end--;
 
-	/* Counting loop */
-	while (scan < end) {
-		unsigned char c = *scan++;
-
-		if (c > 0x1F && c != 0x7F)
-			stats->printable++;
-		else switch (c) {
-			case '\0':
-				stats->nul++;
-				stats->nonprintable++;
-				break;
-			case '\n':
-				stats->lf++;
-				break;
-			case '\r':
-				stats->cr++;
-				if (scan < end && *scan == '\n')
-					stats->crlf++;
-				break;
-			case '\t': case '\f': case '\v': case '\b': case 0x1b: /*ESC*/
-				stats->printable++;
-				break;
-			default:
-				stats->nonprintable++;
-				break;
-			}
-	}
+	text_count(stats, scan, end);
 
 	return (stats->nul > 0 ||
 		((stats->printable >> 7) < stats->nonprintable));
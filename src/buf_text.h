@@ -120,4 +120,39 @@ extern int git_buf_text_detect_bom(
 extern bool git_buf_text_gather_stats(
 	git_buf_text_stats *stats, const git_buf *buf, bool skip_bom);
 
+/*
+ * The text scans above use the widest vector instructions that the CPU
+ * supports.  These are the levels that can be selected.
+ */
+typedef enum {
+	GIT_BUF_TEXT_SCALAR = 0,
+	GIT_BUF_TEXT_SSE2 = 1,
+	GIT_BUF_TEXT_AVX2 = 2
+} git_buf_text_kernel_t;
+
+/*
+ * Use at most the given level for text scans (for testing); returns the
+ * level that will actually be used on this CPU.
+ */
+extern git_buf_text_kernel_t git_buf_text__use_kernel(
+	git_buf_text_kernel_t kernel);
+
+/* Count the characters of `len` bytes of text, without BOM handling */
+extern void git_buf_text__count(
+	git_buf_text_stats *stats, const char *ptr, size_t len);
+
+/*
+ * Copy `len` bytes to `out`, dropping every \r that is followed by \n;
+ * returns the number of bytes written.  `out` needs `len` bytes.
+ */
+extern size_t git_buf_text__crlf_to_lf(char *out, const char *in, size_t len);
+
+/*
+ * Copy `len` bytes to `out`, adding a \r before every \n that does not
+ * already follow one; `prev` is the byte before `in`.  Returns the number
+ * of bytes written.  `out` needs room for `len` plus one per \n.
+ */
+extern size_t git_buf_text__lf_to_crlf(
+	char *out, const char *in, size_t len, char prev);
+
 #endif
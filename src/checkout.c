@@ -28,9 +28,19 @@
 #include "buf_text.h"
 #include "merge_file.h"
 #include "path.h"
+#include "sparse.h"
+#include "tree.h"
+#include "tree-cache.h"
+#include "workers.h"
 
 /* See docs/checkout-internals.md for more information */
 
+/* roughly how many files make it worth starting another writer thread */
+#define CHECKOUT_FILES_PER_THREAD 64
+
+/* how many files are written before the index is updated for them */
+#define CHECKOUT_WRITE_BATCH_SIZE 1024
+
 enum {
 	CHECKOUT_ACTION__NONE = 0,
 	CHECKOUT_ACTION__REMOVE = 1,
@@ -40,6 +50,7 @@ enum {
 	CHECKOUT_ACTION__UPDATE_CONFLICT = 16,
 	CHECKOUT_ACTION__MAX = 16,
 	CHECKOUT_ACTION__DEFER_REMOVE = 32,
+	CHECKOUT_ACTION__SKIP_WORKTREE = 64,
 	CHECKOUT_ACTION__REMOVE_AND_UPDATE =
 		(CHECKOUT_ACTION__UPDATE_BLOB | CHECKOUT_ACTION__REMOVE),
 };
@@ -52,9 +63,11 @@ typedef struct {
 	bool opts_free_baseline;
 	char *pfx;
 	git_index *index;
+	git_sparse *sparse;
 	git_pool pool;
 	git_vector removes;
 	git_vector conflicts;
+	git_vector unchanged_trees;
 	git_vector *reuc;
 	git_vector *names;
 	git_buf path;
@@ -65,6 +78,7 @@ typedef struct {
 	bool reload_submodules;
 	size_t total_steps;
 	size_t completed_steps;
+	git_attr_session attr_session;
 } checkout_data;
 
 typedef struct {
@@ -201,6 +215,64 @@ static bool checkout_is_workdir_modified(
 #define CHECKOUT_ACTION_IF(FLAG,YES,NO) \
 	((data->strategy & GIT_CHECKOUT_##FLAG) ? CHECKOUT_ACTION__##YES : CHECKOUT_ACTION__##NO)
 
+static bool checkout_is_skip_worktree(
+	checkout_data *data, const git_diff_delta *delta)
+{
+	const git_index_entry *entry;
+
+	if (!data->index)
+		return false;
+
+	entry = git_index_get_bypath(data->index, delta->old_file.path, 0);
+
+	return entry != NULL &&
+		(entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0;
+}
+
+static bool checkout_is_outside_sparse(checkout_data *data, const git_diff_delta *delta)
+{
+	return data->sparse != NULL &&
+		delta->status != GIT_DELTA_DELETED &&
+		delta->new_file.mode != GIT_FILEMODE_TREE &&
+		!git_sparse__includes(data->sparse, delta->new_file.path);
+}
+
+/* files outside of the sparse checkout are only recorded in the index;
+ * an existing file is removed if it could have been safely updated
+ */
+static void checkout_action_sparse(
+	int *action,
+	checkout_data *data,
+	const git_diff_delta *delta,
+	const git_index_entry *wd)
+{
+	bool remove = false;
+
+	if ((*action & CHECKOUT_ACTION__CONFLICT) != 0 ||
+		!checkout_is_outside_sparse(data, delta))
+		return;
+
+	if (wd != NULL) {
+		if (wd->mode == GIT_FILEMODE_TREE ||
+			strcmp(wd->path, delta->new_file.path) != 0)
+			return;
+
+		if ((*action & CHECKOUT_ACTION__UPDATE_BLOB) != 0)
+			remove = true;
+		else if (delta->status == GIT_DELTA_UNMODIFIED &&
+			!checkout_is_workdir_modified(
+				data, &delta->old_file, &delta->new_file, wd))
+			remove = true;
+		else
+			return;
+	}
+
+	*action = CHECKOUT_ACTION__SKIP_WORKTREE;
+
+	if (remove && (data->strategy & GIT_CHECKOUT_UPDATE_ONLY) == 0)
+		*action |= CHECKOUT_ACTION__REMOVE;
+}
+
 static int checkout_action_common(
 	int *action,
 	checkout_data *data,
@@ -212,6 +284,8 @@ static int checkout_action_common(
 	if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0)
 		*action = (*action & ~CHECKOUT_ACTION__REMOVE);
 
+	checkout_action_sparse(action, data, delta, wd);
+
 	if ((*action & CHECKOUT_ACTION__UPDATE_BLOB) != 0) {
 		if (S_ISGITLINK(delta->new_file.mode))
 			*action = (*action & ~CHECKOUT_ACTION__UPDATE_BLOB) |
@@ -241,6 +315,17 @@ static int checkout_action_no_wd(
 
 	switch (delta->status) {
 	case GIT_DELTA_UNMODIFIED: /* case 12 */
+		if (checkout_is_outside_sparse(data, delta))
+			break;
+
+		/* a file that was outside of the sparse checkout is expected to
+		 * be missing, so it is simply checked out when it comes back in
+		 */
+		if (data->sparse != NULL && checkout_is_skip_worktree(data, delta)) {
+			*action = CHECKOUT_ACTION_IF(SAFE, UPDATE_BLOB, NONE);
+			break;
+		}
+
 		error = checkout_notify(data, GIT_CHECKOUT_NOTIFY_DIRTY, delta, NULL);
 		if (error)
 			return error;
@@ -1192,84 +1277,126 @@ fail:
 	return error;
 }
 
-static int buffer_to_file(
-	struct stat *st,
-	git_buf *buf,
-	const char *path,
-	mode_t dir_mode,
-	int file_open_flags,
-	mode_t file_mode)
+struct checkout_stream {
+	git_writestream base;
+	const char *path;
+	int fd;
+	int open;
+};
+
+static int checkout_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
 {
-	int error;
+	struct checkout_stream *stream = (struct checkout_stream *)s;
+	int ret;
 
-	if ((error = git_futils_mkpath2file(path, dir_mode)) < 0)
-		return error;
+	if ((ret = p_write(stream->fd, buffer, len)) < 0)
+		giterr_set(GITERR_OS, "Could not write to '%s'", stream->path);
 
-	if ((error = git_futils_writebuffer(
-			buf, path, file_open_flags, file_mode)) < 0)
-		return error;
+	return ret;
+}
 
-	if (st != NULL && (error = p_stat(path, st)) < 0)
-		giterr_set(GITERR_OS, "Error statting '%s'", path);
+static int checkout_stream_close(git_writestream *s)
+{
+	struct checkout_stream *stream = (struct checkout_stream *)s;
+	int error;
 
-	else if (GIT_PERMS_IS_EXEC(file_mode) &&
-			(error = p_chmod(path, file_mode)) < 0)
-		giterr_set(GITERR_OS, "Failed to set permissions on '%s'", path);
+	assert(stream && stream->open);
+
+	stream->open = 0;
+	if ((error = p_close(stream->fd)) < 0)
+		giterr_set(GITERR_OS, "Error while closing '%s'", stream->path);
 
 	return error;
 }
 
+static void checkout_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
+
 static int blob_content_to_file(
 	struct stat *st,
 	git_blob *blob,
 	const char *path,
 	const char * hint_path,
 	mode_t entry_filemode,
-	git_checkout_options *opts)
+	git_checkout_options *opts,
+	git_attr_session *attr_session)
 {
-	int error = 0;
+	int flags = opts->file_open_flags, fd, error = 0;
 	mode_t file_mode = opts->file_mode ? opts->file_mode : entry_filemode;
-	git_buf out = GIT_BUF_INIT;
+	struct checkout_stream writer;
 	git_filter_list *fl = NULL;
 
 	if (hint_path == NULL)
 		hint_path = path;
 
-	if (!opts->disable_filters)
-		error = git_filter_list_load(
+	if (flags <= 0)
+		flags = O_CREAT | O_TRUNC | O_WRONLY;
+	if (!file_mode)
+		file_mode = GIT_FILEMODE_BLOB;
+
+	if ((fd = p_open(path, flags, file_mode)) < 0) {
+		giterr_set(GITERR_OS, "Could not open '%s' for writing", path);
+		return fd;
+	}
+
+	if (!opts->disable_filters &&
+		(error = git_filter_list__load_ext(
 			&fl, git_blob_owner(blob), blob, hint_path,
-			GIT_FILTER_TO_WORKTREE, GIT_FILTER_OPT_DEFAULT);
+			GIT_FILTER_TO_WORKTREE, GIT_FILTER_OPT_DEFAULT,
+			attr_session)) < 0) {
+		p_close(fd);
+		return error;
+	}
 
-	if (!error)
-		error = git_filter_list_apply_to_blob(&out, fl, blob);
+	/* the filters write the content straight to the file */
+	memset(&writer, 0, sizeof(struct checkout_stream));
+	writer.base.write = checkout_stream_write;
+	writer.base.close = checkout_stream_close;
+	writer.base.free = checkout_stream_free;
+	writer.path = path;
+	writer.fd = fd;
+	writer.open = 1;
+
+	error = git_filter_list_stream_blob(fl, blob, &writer.base);
+
+	assert(writer.open == 0 || error < 0);
+
+	if (writer.open)
+		p_close(fd);
 
 	git_filter_list_free(fl);
 
-	if (!error) {
-		error = buffer_to_file(
-			st, &out, path, opts->dir_mode, opts->file_open_flags, file_mode);
+	if (error < 0)
+		return error;
 
-		st->st_mode = entry_filemode;
+	if (st != NULL && (error = p_stat(path, st)) < 0) {
+		giterr_set(GITERR_OS, "Error statting '%s'", path);
+		return error;
+	}
 
-		git_buf_free(&out);
+	if (GIT_PERMS_IS_EXEC(file_mode) &&
+		(error = p_chmod(path, file_mode)) < 0) {
+		giterr_set(GITERR_OS, "Failed to set permissions on '%s'", path);
+		return error;
 	}
 
-	return error;
+	st->st_mode = entry_filemode;
+
+	return 0;
 }
 
 static int blob_content_to_link(
 	struct stat *st,
 	git_blob *blob,
 	const char *path,
-	mode_t dir_mode,
 	int can_symlink)
 {
 	git_buf linktarget = GIT_BUF_INIT;
 	int error;
 
-	if ((error = git_futils_mkpath2file(path, dir_mode)) < 0)
-		return error;
-
 	if ((error = git_blob__getbuf(&linktarget, blob)) < 0)
 		return error;
 
@@ -1405,8 +1532,29 @@ static int checkout_safe_for_update_only(const char *path, mode_t expected_mode)
 	return 0;
 }
 
-static int checkout_write_content(
+static int checkout_write_error(checkout_data *data, int error)
+{
+	/* if we try to create the blob and an existing directory blocks it from
+	 * being written, then there must have been a typechange conflict in a
+	 * parent directory - suppress the error and try to continue.
+	 */
+	if ((data->strategy & GIT_CHECKOUT_ALLOW_CONFLICTS) != 0 &&
+		(error == GIT_ENOTFOUND || error == GIT_EEXISTS))
+	{
+		giterr_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+/* Write a blob to a file whose directory already exists.  This touches
+ * nothing but the object database and the file itself, so it may be
+ * called from a file writer thread with that thread's attribute session.
+ */
+static int checkout_write_blob(
 	checkout_data *data,
+	git_attr_session *attr_session,
 	const git_oid *oid,
 	const char *full_path,
 	const char *hint_path,
@@ -1421,57 +1569,32 @@ static int checkout_write_content(
 
 	if (S_ISLNK(mode))
 		error = blob_content_to_link(
-			st, blob, full_path, data->opts.dir_mode, data->can_symlink);
+			st, blob, full_path, data->can_symlink);
 	else
 		error = blob_content_to_file(
-			st, blob, full_path, hint_path, mode, &data->opts);
+			st, blob, full_path, hint_path, mode, &data->opts,
+			attr_session);
 
 	git_blob_free(blob);
 
-	/* if we try to create the blob and an existing directory blocks it from
-	 * being written, then there must have been a typechange conflict in a
-	 * parent directory - suppress the error and try to continue.
-	 */
-	if ((data->strategy & GIT_CHECKOUT_ALLOW_CONFLICTS) != 0 &&
-		(error == GIT_ENOTFOUND || error == GIT_EEXISTS))
-	{
-		giterr_clear();
-		error = 0;
-	}
-
 	return error;
 }
 
-static int checkout_blob(
+static int checkout_write_content(
 	checkout_data *data,
-	const git_diff_file *file)
+	const git_oid *oid,
+	const char *full_path,
+	const char *hint_path,
+	unsigned int mode,
+	struct stat *st)
 {
-	int error = 0;
-	struct stat st;
-
-	git_buf_truncate(&data->path, data->workdir_len);
-	if (git_buf_puts(&data->path, file->path) < 0)
-		return -1;
-
-	if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0) {
-		int rval = checkout_safe_for_update_only(
-			git_buf_cstr(&data->path), file->mode);
-		if (rval <= 0)
-			return rval;
-	}
-
-	error = checkout_write_content(
-		data, &file->id, git_buf_cstr(&data->path), NULL, file->mode, &st);
-
-	/* update the index unless prevented */
-	if (!error && (data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0)
-		error = checkout_update_index(data, file, &st);
+	int error;
 
-	/* update the submodule data if this was a new .gitmodules file */
-	if (!error && strcmp(file->path, ".gitmodules") == 0)
-		data->reload_submodules = true;
+	if ((error = git_futils_mkpath2file(full_path, data->opts.dir_mode)) == 0)
+		error = checkout_write_blob(data, &data->attr_session,
+			oid, full_path, hint_path, mode, st);
 
-	return error;
+	return checkout_write_error(data, error);
 }
 
 static int checkout_remove_the_old(
@@ -1501,6 +1624,7 @@ static int checkout_remove_the_old(
 			report_progress(data, delta->old_file.path);
 
 			if ((actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) == 0 &&
+				(actions[i] & CHECKOUT_ACTION__SKIP_WORKTREE) == 0 &&
 				(data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
 				data->index != NULL)
 			{
@@ -1550,35 +1674,216 @@ static int checkout_deferred_remove(git_repository *repo, const char *path)
 #endif
 }
 
+/*
+ * Blobs are checked out in batches.  The calling thread creates the
+ * directories of the batch in order, then the files are read, filtered
+ * and written by up to `workers` threads, claiming them in order, and
+ * finally the calling thread updates the index and reports progress for
+ * each of them in the order of the diff.
+ */
+typedef struct {
+	const git_diff_file *file;
+	char *path;
+	struct stat st;
+	unsigned int skip:1;
+	git_workers_error error;
+} checkout_write_item;
+
+typedef struct {
+	checkout_data *data;
+	git_array_t(checkout_write_item) items;
+	git_buf last_dir;
+	git_workers workers;
+} checkout_write_batch;
+
+static void checkout_write_batch_work(git_workers *workers, void *payload)
+{
+	checkout_write_batch *batch = payload;
+	checkout_write_item *item;
+	git_attr_session attr_session;
+	size_t i;
+	int error;
+
+	git_attr_session__init(&attr_session, batch->data->repo);
+
+	while (git_workers__next(&i, workers)) {
+		item = git_array_get(batch->items, i);
+
+		if (item->skip)
+			continue;
+
+		if ((error = checkout_write_blob(batch->data, &attr_session,
+				&item->file->id, item->path, item->file->path,
+				item->file->mode, &item->st)) == 0)
+			continue;
+
+		/* a blocked file may be allowed, but then there is nothing to add */
+		if ((error = checkout_write_error(batch->data, error)) == 0)
+			item->skip = 1;
+		else {
+			git_workers__error_keep(&item->error, error);
+			git_workers__stop(workers);
+		}
+	}
+
+	git_attr_session__free(&attr_session);
+}
+
+static void checkout_write_batch_run(checkout_write_batch *batch)
+{
+	unsigned int threads = git_workers__threads(batch->data->opts.workers,
+		batch->items.size, CHECKOUT_FILES_PER_THREAD);
+
+	git_workers__run(&batch->workers, batch->items.size, threads,
+		checkout_write_batch_work, batch);
+}
+
+/* create the directory that `path` goes into, unless it was just made */
+static int checkout_write_batch_mkdir(
+	checkout_write_batch *batch, const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	size_t dir_len = slash ? (size_t)(slash - path) : 0;
+	int error;
+
+	if (dir_len == batch->last_dir.size &&
+		!memcmp(path, batch->last_dir.ptr, dir_len))
+		return 0;
+
+	git_buf_clear(&batch->last_dir);
+
+	if ((error = git_futils_mkpath2file(
+			path, batch->data->opts.dir_mode)) < 0)
+		return error;
+
+	return git_buf_put(&batch->last_dir, path, dir_len);
+}
+
+static int checkout_write_batch_push(
+	checkout_write_batch *batch, const git_diff_file *file)
+{
+	checkout_data *data = batch->data;
+	checkout_write_item *item;
+	int error = 0;
+
+	git_buf_truncate(&data->path, data->workdir_len);
+	if (git_buf_puts(&data->path, file->path) < 0)
+		return -1;
+
+	item = git_array_alloc(batch->items);
+	GITERR_CHECK_ALLOC(item);
+
+	memset(item, 0, sizeof(*item));
+	item->file = file;
+	item->path = git__strdup(data->path.ptr);
+	GITERR_CHECK_ALLOC(item->path);
+
+	if ((data->strategy & GIT_CHECKOUT_UPDATE_ONLY) != 0) {
+		int rval = checkout_safe_for_update_only(item->path, file->mode);
+		if (rval < 0)
+			return rval;
+		item->skip = !rval;
+	}
+
+	if (!item->skip &&
+		(error = checkout_write_batch_mkdir(batch, item->path)) < 0) {
+		/* a blocked directory may be allowed, but leaves nothing to write */
+		if ((error = checkout_write_error(data, error)) < 0)
+			return error;
+		item->skip = 1;
+	}
+
+	return 0;
+}
+
+static void checkout_write_batch_clear(checkout_write_batch *batch)
+{
+	size_t i;
+
+	for (i = 0; i < batch->items.size; ++i) {
+		checkout_write_item *item = git_array_get(batch->items, i);
+
+		git__free(item->path);
+		git_workers__error_free(&item->error);
+	}
+
+	git_array_clear(batch->items);
+}
+
+/* Write the files in the batch, then update the index for them in order. */
+static int checkout_write_batch_flush(checkout_write_batch *batch)
+{
+	checkout_data *data = batch->data;
+	size_t i;
+	int error = 0;
+
+	checkout_write_batch_run(batch);
+
+	for (i = 0; !error && i < batch->items.size; ++i) {
+		checkout_write_item *item = git_array_get(batch->items, i);
+
+		if ((error = git_workers__error_restore(&item->error)) < 0)
+			break;
+
+		/* update the index unless prevented */
+		if (!item->skip &&
+			(data->strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
+			(error = checkout_update_index(data, item->file, &item->st)) < 0)
+			break;
+
+		/* update the submodule data if this was a new .gitmodules file */
+		if (strcmp(item->file->path, ".gitmodules") == 0)
+			data->reload_submodules = true;
+
+		data->completed_steps++;
+		report_progress(data, item->file->path);
+	}
+
+	checkout_write_batch_clear(batch);
+	return error;
+}
+
 static int checkout_create_the_new(
 	unsigned int *actions,
 	checkout_data *data)
 {
 	int error = 0;
 	git_diff_delta *delta;
+	checkout_write_batch batch = { 0 };
 	size_t i;
 
+	batch.data = data;
+
 	git_vector_foreach(&data->diff->deltas, i, delta) {
 		if (actions[i] & CHECKOUT_ACTION__DEFER_REMOVE) {
+			if ((error = checkout_write_batch_flush(&batch)) < 0)
+				break;
+
 			/* this had a blocker directory that should only be removed iff
 			 * all of the contents of the directory were safely removed
 			 */
 			if ((error = checkout_deferred_remove(
 					data->repo, delta->old_file.path)) < 0)
-				return error;
+				break;
 		}
 
 		if (actions[i] & CHECKOUT_ACTION__UPDATE_BLOB) {
-			error = checkout_blob(data, &delta->new_file);
-			if (error < 0)
-				return error;
+			if ((error = checkout_write_batch_push(
+					&batch, &delta->new_file)) < 0)
+				break;
 
-			data->completed_steps++;
-			report_progress(data, delta->new_file.path);
+			if (batch.items.size >= CHECKOUT_WRITE_BATCH_SIZE &&
+				(error = checkout_write_batch_flush(&batch)) < 0)
+				break;
 		}
 	}
 
-	return 0;
+	if (!error)
+		error = checkout_write_batch_flush(&batch);
+
+	checkout_write_batch_clear(&batch);
+	git_buf_free(&batch.last_dir);
+	return error;
 }
 
 static int checkout_create_submodules(
@@ -1618,6 +1923,58 @@ static int checkout_create_submodules(
 	return git_submodule_reload_all(data->repo, 1);
 }
 
+/* mark the entries outside of the sparse checkout as "skip worktree", and
+ * unmark the ones that are in it again
+ */
+static int checkout_update_skip_worktree(
+	unsigned int *actions,
+	checkout_data *data)
+{
+	const git_index_entry *entry;
+	git_index_entry update;
+	git_diff_delta *delta;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(&data->diff->deltas, i, delta) {
+		bool skip = (actions[i] & CHECKOUT_ACTION__SKIP_WORKTREE) != 0;
+
+		if (!skip && (actions[i] &
+			(CHECKOUT_ACTION__UPDATE_BLOB | CHECKOUT_ACTION__REMOVE)) != 0)
+			continue;
+
+		entry = git_index_get_bypath(data->index, delta->new_file.path, 0);
+
+		if (skip) {
+			memset(&update, 0, sizeof(update));
+			update.path = delta->new_file.path;
+			update.mode = delta->new_file.mode;
+			git_oid_cpy(&update.id, &delta->new_file.id);
+
+			if (entry != NULL &&
+				(entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 &&
+				entry->mode == update.mode &&
+				git_oid_equal(&entry->id, &update.id))
+				continue;
+		} else {
+			if (entry == NULL ||
+				(entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) == 0)
+				continue;
+
+			memcpy(&update, entry, sizeof(update));
+		}
+
+		update.flags_extended &= ~GIT_IDXENTRY_SKIP_WORKTREE;
+		if (skip)
+			update.flags_extended |= GIT_IDXENTRY_SKIP_WORKTREE;
+
+		if ((error = git_index_add(data->index, &update)) < 0)
+			break;
+	}
+
+	return error;
+}
+
 static int checkout_lookup_head_tree(git_tree **out, git_repository *repo)
 {
 	int error = 0;
@@ -1965,6 +2322,7 @@ static void checkout_data_clear(checkout_data *data)
 	}
 
 	git_vector_free(&data->removes);
+	git_vector_free(&data->unchanged_trees);
 	git_pool_clear(&data->pool);
 
 	git_vector_free_deep(&data->conflicts);
@@ -1977,6 +2335,11 @@ static void checkout_data_clear(checkout_data *data)
 
 	git_index_free(data->index);
 	data->index = NULL;
+
+	git_sparse__free(data->sparse);
+	data->sparse = NULL;
+
+	git_attr_session__free(&data->attr_session);
 }
 
 static int checkout_data_init(
@@ -2004,10 +2367,15 @@ static int checkout_data_init(
 	GITERR_CHECK_VERSION(
 		proposed, GIT_CHECKOUT_OPTIONS_VERSION, "git_checkout_options");
 
-	if (!proposed)
-		GIT_INIT_STRUCTURE(&data->opts, GIT_CHECKOUT_OPTIONS_VERSION);
-	else
-		memmove(&data->opts, proposed, sizeof(git_checkout_options));
+	GIT_INIT_STRUCTURE(&data->opts, GIT_CHECKOUT_OPTIONS_VERSION);
+
+	if (proposed) {
+		git_checkout__options_read(&data->opts, proposed,
+			sizeof(git_checkout_options), 0, proposed->version);
+		data->opts.version = GIT_CHECKOUT_OPTIONS_VERSION;
+	}
+
+	git_attr_session__init(&data->attr_session, repo);
 
 	if (!data->opts.target_directory)
 		data->opts.target_directory = git_repository_workdir(repo);
@@ -2072,6 +2440,11 @@ static int checkout_data_init(
 			 &data->can_symlink, repo, GIT_CVAR_SYMLINKS)) < 0)
 		goto cleanup;
 
+	/* a sparse checkout only applies to the working directory */
+	if ((!proposed || !proposed->target_directory) &&
+		(error = git_sparse__load(&data->sparse, repo)) < 0)
+		goto cleanup;
+
 	if (!data->opts.baseline) {
 		data->opts_free_baseline = true;
 
@@ -2111,6 +2484,7 @@ static int checkout_data_init(
 
 	if ((error = git_vector_init(&data->removes, 0, git__strcmp_cb)) < 0 ||
 		(error = git_vector_init(&data->conflicts, 0, NULL)) < 0 ||
+		(error = git_vector_init(&data->unchanged_trees, 0, git__strcmp_cb)) < 0 ||
 		(error = git_pool_init(&data->pool, 1, 0)) < 0 ||
 		(error = git_buf_puts(&data->path, data->opts.target_directory)) < 0 ||
 		(error = git_path_to_dir(&data->path)) < 0)
@@ -2125,6 +2499,114 @@ cleanup:
 	return error;
 }
 
+/* Subtrees that are the same in the baseline and the target can only
+ * produce UNMODIFIED deltas, and a safe checkout leaves those alone (it
+ * does not even recreate missing files).  That only holds if nothing
+ * would act on dirty, untracked or ignored items in the subtree either.
+ */
+static bool checkout_can_skip_unchanged_trees(
+	checkout_data *data, git_iterator *target)
+{
+	unsigned int notify = data->opts.notify_cb ? data->opts.notify_flags : 0;
+
+	if ((data->strategy & (GIT_CHECKOUT_FORCE |
+			GIT_CHECKOUT_SAFE_CREATE |
+			GIT_CHECKOUT_REMOVE_UNTRACKED |
+			GIT_CHECKOUT_REMOVE_IGNORED)) != 0)
+		return false;
+
+	if ((notify & (GIT_CHECKOUT_NOTIFY_DIRTY |
+			GIT_CHECKOUT_NOTIFY_UNTRACKED |
+			GIT_CHECKOUT_NOTIFY_IGNORED)) != 0)
+		return false;
+
+	return data->opts.paths.count == 0 &&
+		data->sparse == NULL &&
+		data->opts.baseline != NULL &&
+		data->index != NULL &&
+		data->index->tree != NULL &&
+		!git_index_has_conflicts(data->index) &&
+		!git_iterator_ignore_case(target) &&
+		git_iterator_get_tree(target) != NULL;
+}
+
+/* a subtree is unchanged if both trees and the index's tree cache agree */
+static int checkout_find_unchanged_trees(
+	checkout_data *data, git_buf *path, git_tree *baseline, git_tree *target)
+{
+	int error = 0;
+	size_t i, dirlen = git_buf_len(path);
+	const git_tree_entry *te, *be;
+	const git_tree_cache *tc;
+	git_tree *bsub, *tsub;
+	char *copy;
+
+	for (i = 0; i < git_tree_entrycount(target) && !error; ++i) {
+		te = git_tree_entry_byindex(target, i);
+
+		if (!git_tree_entry__is_tree(te) ||
+			(be = git_tree_entry_byname(baseline, te->filename)) == NULL ||
+			!git_tree_entry__is_tree(be))
+			continue;
+
+		git_buf_truncate(path, dirlen);
+		if (git_buf_put(path, te->filename, te->filename_len) < 0)
+			return -1;
+
+		if (git_oid__cmp(&te->oid, &be->oid) == 0) {
+			tc = git_tree_cache_get(data->index->tree, path->ptr);
+
+			if (tc != NULL && tc->entries >= 0 &&
+				git_oid__cmp(&tc->oid, &te->oid) == 0) {
+				copy = git_pool_strdup(&data->pool, path->ptr);
+				GITERR_CHECK_ALLOC(copy);
+				error = git_vector_insert(&data->unchanged_trees, copy);
+				continue;
+			}
+		}
+
+		bsub = tsub = NULL;
+
+		if ((error = git_tree_lookup(&bsub, data->repo, &be->oid)) >= 0 &&
+			(error = git_tree_lookup(&tsub, data->repo, &te->oid)) >= 0 &&
+			(error = git_buf_putc(path, '/')) >= 0)
+			error = checkout_find_unchanged_trees(data, path, bsub, tsub);
+
+		git_tree_free(bsub);
+		git_tree_free(tsub);
+	}
+
+	git_buf_truncate(path, dirlen);
+	return error;
+}
+
+static int checkout_skip_unchanged_trees(
+	checkout_data *data, git_iterator *baseline, git_iterator *target)
+{
+	int error;
+	git_buf path = GIT_BUF_INIT;
+
+	if (!checkout_can_skip_unchanged_trees(data, target))
+		return 0;
+
+	if ((error = checkout_find_unchanged_trees(data, &path,
+			data->opts.baseline, git_iterator_get_tree(target))) < 0)
+		goto done;
+
+	/* tree order puts "a/" after "a.b", the iterators look paths up by name */
+	git_vector_sort(&data->unchanged_trees);
+
+	git_iterator_skip_trees(baseline, &data->unchanged_trees);
+	git_iterator_skip_trees(target, &data->unchanged_trees);
+
+	if ((error = git_iterator_reset(baseline, data->pfx, data->pfx)) >= 0)
+		error = git_iterator_reset(target, data->pfx, data->pfx);
+
+done:
+	git_buf_free(&path);
+	return error;
+}
+
 int git_checkout_iterator(
 	git_iterator *target,
 	const git_checkout_options *opts)
@@ -2136,6 +2618,7 @@ int git_checkout_iterator(
 	uint32_t *actions = NULL;
 	size_t *counts = NULL;
 	git_iterator_flag_t iterflags = 0;
+	bool batch = false;
 
 	/* initialize structures and options */
 	error = checkout_data_init(&data, target, opts);
@@ -2174,6 +2657,9 @@ int git_checkout_iterator(
 	/* Should not have case insensitivity mismatch */
 	assert(git_iterator_ignore_case(workdir) == git_iterator_ignore_case(baseline));
 
+	if ((error = checkout_skip_unchanged_trees(&data, baseline, target)) < 0)
+		goto cleanup;
+
 	/* Generate baseline-to-target diff which will include an entry for
 	 * every possible update that might need to be made.
 	 */
@@ -2195,6 +2681,13 @@ int git_checkout_iterator(
 
 	report_progress(&data, NULL); /* establish 0 baseline */
 
+	/* record the changes to the index and apply them all at the end */
+	if (data.index != NULL && !data.index->batching) {
+		if ((error = git_index_batch_begin(data.index)) < 0)
+			goto cleanup;
+		batch = true;
+	}
+
 	/* To deal with some order dependencies, perform remaining checkout
 	 * in three passes: removes, then update blobs, then update submodules.
 	 */
@@ -2214,6 +2707,13 @@ int git_checkout_iterator(
 		(error = checkout_create_conflicts(&data)) < 0)
 		goto cleanup;
 
+	if (data.sparse != NULL && data.index != NULL &&
+		data.index != git_iterator_get_index(target) &&
+		(data.strategy & GIT_CHECKOUT_SAFE) != 0 &&
+		(data.strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0 &&
+		(error = checkout_update_skip_worktree(actions, &data)) < 0)
+		goto cleanup;
+
 	if (data.index != git_iterator_get_index(target) &&
 		(error = checkout_extensions_update_index(&data)) < 0)
 		goto cleanup;
@@ -2221,10 +2721,19 @@ int git_checkout_iterator(
 	assert(data.completed_steps == data.total_steps);
 
 cleanup:
+	if (batch) {
+		int commit_error = git_index_batch_commit(data.index, false);
+		if (!error)
+			error = commit_error;
+	}
+
 	if (!error && data.index != NULL &&
 		(data.strategy & GIT_CHECKOUT_DONT_UPDATE_INDEX) == 0)
 		error = git_index_write(data.index);
 
+	if (git_iterator_get_tree(target) != NULL)
+		git_iterator_skip_trees(target, NULL);
+
 	git_diff_free(data.diff);
 	git_iterator_free(workdir);
 	git_iterator_free(baseline);
@@ -2336,9 +2845,41 @@ int git_checkout_head(
 	return git_checkout_tree(repo, NULL, opts);
 }
 
+static size_t checkout_options_size(unsigned int version)
+{
+	return (version == 1) ?
+		GIT_CHECKOUT_OPTIONS_V1_SIZE : sizeof(git_checkout_options);
+}
+
+void git_checkout__options_read(
+	void *out, const void *given, size_t size, size_t offset,
+	unsigned int version)
+{
+	size_t given_end = offset + checkout_options_size(version);
+	size_t end = offset + sizeof(git_checkout_options);
+
+	memcpy(out, given, given_end);
+	memcpy((char *)out + end, (const char *)given + given_end, size - end);
+}
+
+void git_checkout__options_write(
+	void *out, const void *opts, size_t size, size_t offset,
+	unsigned int version)
+{
+	size_t out_end = offset + checkout_options_size(version);
+	size_t end = offset + sizeof(git_checkout_options);
+
+	memcpy(out, opts, out_end);
+	memcpy((char *)out + out_end, (const char *)opts + end, size - end);
+}
+
 int git_checkout_init_options(git_checkout_options *opts, unsigned int version)
 {
-	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
-		opts, version, git_checkout_options, GIT_CHECKOUT_OPTIONS_INIT);
+	git_checkout_options tmpl = GIT_CHECKOUT_OPTIONS_INIT;
+
+	GITERR_CHECK_VERSION(&version, tmpl.version, "git_checkout_options");
+
+	git_checkout__options_write(opts, &tmpl, sizeof(tmpl), 0, version);
+	opts->version = version;
 	return 0;
 }
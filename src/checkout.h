@@ -7,11 +7,32 @@
 #ifndef INCLUDE_checkout_h__
 #define INCLUDE_checkout_h__
 
+#include <stddef.h>
+
 #include "git2/checkout.h"
 #include "iterator.h"
 
 #define GIT_CHECKOUT__NOTIFY_CONFLICT_TREE (1u << 12)
 
+/* Version 1 of the checkout options ends before `workers` */
+#define GIT_CHECKOUT_OPTIONS_V1_SIZE offsetof(git_checkout_options, workers)
+
+/*
+ * Callers built against version 1 of the checkout options pass a smaller
+ * struct, also where it is embedded in other options.  These copy a
+ * struct of `size` bytes that embeds the checkout options at `offset`
+ * from the caller's layout for `version` of them into the current one, or
+ * back; whatever follows the checkout options moves with their size.
+ * Fields the caller's layout does not have are left untouched.
+ */
+extern void git_checkout__options_read(
+	void *out, const void *given, size_t size, size_t offset,
+	unsigned int version);
+
+extern void git_checkout__options_write(
+	void *out, const void *opts, size_t size, size_t offset,
+	unsigned int version);
+
 /**
  * Update the working directory to match the target iterator.  The
  * expected baseline value can be passed in via the checkout options
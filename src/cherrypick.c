@@ -9,6 +9,7 @@
 #include "repository.h"
 #include "filebuf.h"
 #include "merge.h"
+#include "checkout.h"
 #include "vector.h"
 
 #include "git2/types.h"
@@ -70,17 +71,19 @@ static int cherrypick_normalize_opts(
 	const git_cherrypick_options *given,
 	const char *their_label)
 {
+	git_cherrypick_options default_opts = GIT_CHERRYPICK_OPTIONS_INIT;
 	int error = 0;
 	unsigned int default_checkout_strategy = GIT_CHECKOUT_SAFE_CREATE |
 		GIT_CHECKOUT_ALLOW_CONFLICTS;
 
 	GIT_UNUSED(repo);
 
-	if (given != NULL)
-		memcpy(opts, given, sizeof(git_cherrypick_options));
-	else {
-		git_cherrypick_options default_opts = GIT_CHERRYPICK_OPTIONS_INIT;
-		memcpy(opts, &default_opts, sizeof(git_cherrypick_options));
+	memcpy(opts, &default_opts, sizeof(git_cherrypick_options));
+
+	if (given != NULL) {
+		git_checkout__options_read(opts, given, sizeof(git_cherrypick_options),
+			offsetof(git_cherrypick_options, checkout_opts), given->version);
+		opts->version = GIT_CHERRYPICK_OPTIONS_VERSION;
 	}
 
 	if (!opts->checkout_opts.checkout_strategy)
@@ -217,7 +220,12 @@ done:
 int git_cherrypick_init_options(
 	git_cherrypick_options *opts, unsigned int version)
 {
-	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
-		opts, version, git_cherrypick_options, GIT_CHERRYPICK_OPTIONS_INIT);
+	git_cherrypick_options tmpl = GIT_CHERRYPICK_OPTIONS_INIT;
+
+	GITERR_CHECK_VERSION(&version, tmpl.version, "git_cherrypick_options");
+
+	git_checkout__options_write(opts, &tmpl, sizeof(tmpl),
+		offsetof(git_cherrypick_options, checkout_opts), version);
+	opts->version = version;
 	return 0;
 }
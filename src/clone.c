@@ -23,6 +23,7 @@
 #include "path.h"
 #include "repository.h"
 #include "odb.h"
+#include "checkout.h"
 
 static int clone_local_into(git_repository *repo, git_remote *remote, const git_checkout_options *co_opts, const char *branch, int link, const git_signature *signature);
 
@@ -412,10 +413,13 @@ int git_clone(
 
 	assert(out && url && local_path);
 
-	if (_options)
-		memcpy(&options, _options, sizeof(git_clone_options));
+	GITERR_CHECK_VERSION(_options, GIT_CLONE_OPTIONS_VERSION, "git_clone_options");
 
-	GITERR_CHECK_VERSION(&options, GIT_CLONE_OPTIONS_VERSION, "git_clone_options");
+	if (_options) {
+		git_checkout__options_read(&options, _options, sizeof(options),
+			offsetof(git_clone_options, checkout_opts), _options->version);
+		options.version = GIT_CLONE_OPTIONS_VERSION;
+	}
 
 	/* Only clone to a new directory or an empty directory */
 	if (git_path_exists(local_path) && !git_path_is_empty_dir(local_path)) {
@@ -472,8 +476,13 @@ int git_clone(
 
 int git_clone_init_options(git_clone_options *opts, unsigned int version)
 {
-	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
-		opts, version, git_clone_options, GIT_CLONE_OPTIONS_INIT);
+	git_clone_options tmpl = GIT_CLONE_OPTIONS_INIT;
+
+	GITERR_CHECK_VERSION(&version, tmpl.version, "git_clone_options");
+
+	git_checkout__options_write(opts, &tmpl, sizeof(tmpl),
+		offsetof(git_clone_options, checkout_opts), version);
+	opts->version = version;
 	return 0;
 }
 
@@ -76,6 +76,10 @@ static struct map_data _cvar_maps[] = {
 	{"core.precomposeunicode", NULL, 0, GIT_PRECOMPOSE_DEFAULT },
 	{"core.safecrlf", _cvar_map_safecrlf, ARRAY_SIZE(_cvar_map_safecrlf), GIT_SAFE_CRLF_DEFAULT},
 	{"core.logallrefupdates", NULL, 0, GIT_LOGALLREFUPDATES_DEFAULT },
+	{"index.version", _cvar_map_int, 1, GIT_INDEXVERSION_DEFAULT },
+	{"core.splitindex", NULL, 0, GIT_SPLITINDEX_DEFAULT },
+	{"splitindex.maxpercentchange", _cvar_map_int, 1, GIT_SPLITINDEXMAXCHANGE_DEFAULT },
+	{"core.sparsecheckout", NULL, 0, GIT_SPARSECHECKOUT_DEFAULT },
 };
 
 int git_config__cvar(int *out, git_config *config, git_cvar_cached cvar)
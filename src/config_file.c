@@ -16,6 +16,7 @@
 #include "git2/types.h"
 #include "strmap.h"
 #include "array.h"
+#include "global.h"
 
 #include <ctype.h>
 #include <sys/types.h>
@@ -259,6 +260,269 @@ static int refcounted_strmap_alloc(refcounted_strmap **out)
 	return error;
 }
 
+/*
+ * The system, XDG and global files are the same for every repository, so
+ * their parsed contents are kept in a process-wide cache keyed by path.
+ * The values are never modified once parsed, so backends simply share a
+ * reference to them after checking that none of the files (including the
+ * ones pulled in with include.path) changed on disk.
+ */
+typedef struct {
+	char *path;
+	git_futils_filestamp stamp;
+} config_cache_file;
+
+typedef struct {
+	git_atomic refcount;
+	git_config_level_t level;
+	refcounted_strmap *values;
+	git_array_t(config_cache_file) files;
+} config_cache_entry;
+
+struct config_cache {
+	git_mutex lock;
+	git_strmap *entries;
+};
+
+static struct config_cache *git__config_cache = NULL;
+
+static bool config_cache_wanted(git_config_level_t level)
+{
+	return (level == GIT_CONFIG_LEVEL_SYSTEM ||
+		level == GIT_CONFIG_LEVEL_XDG ||
+		level == GIT_CONFIG_LEVEL_GLOBAL);
+}
+
+static void config_cache_entry_free(config_cache_entry *entry)
+{
+	config_cache_file *file;
+	uint32_t i;
+
+	if (!entry || git_atomic_dec(&entry->refcount) != 0)
+		return;
+
+	for (i = 0; i < git_array_size(entry->files); i++) {
+		file = git_array_get(entry->files, i);
+		git__free(file->path);
+	}
+	git_array_clear(entry->files);
+
+	refcounted_strmap_free(entry->values);
+	git__free(entry);
+}
+
+static void config_cache_shutdown(void)
+{
+	struct config_cache *cache;
+	config_cache_entry *entry;
+
+	if ((cache = git__swap(git__config_cache, NULL)) == NULL)
+		return;
+
+	git_strmap_foreach_value(cache->entries, entry, {
+		config_cache_entry_free(entry);
+	});
+
+	git_strmap_free(cache->entries);
+	git_mutex_free(&cache->lock);
+	git__free(cache);
+}
+
+static struct config_cache *config_cache_get(void)
+{
+	struct config_cache *cache;
+
+	if ((cache = git__config_cache) != NULL)
+		return cache;
+
+	if ((cache = git__calloc(1, sizeof(struct config_cache))) == NULL)
+		return NULL;
+
+	if (git_strmap_alloc(&cache->entries) < 0) {
+		git__free(cache);
+		return NULL;
+	}
+
+	if (git_mutex_init(&cache->lock) < 0) {
+		giterr_set(GITERR_OS, "Failed to initialize config cache lock");
+		git_strmap_free(cache->entries);
+		git__free(cache);
+		return NULL;
+	}
+
+	if (git__compare_and_swap(&git__config_cache, NULL, cache) != NULL) {
+		git_strmap_free(cache->entries);
+		git_mutex_free(&cache->lock);
+		git__free(cache);
+		return git__config_cache;
+	}
+
+	git__on_shutdown(config_cache_shutdown);
+	return cache;
+}
+
+static config_cache_entry *config_cache_take(
+	struct config_cache *cache, const char *path)
+{
+	config_cache_entry *entry = NULL;
+	khiter_t pos;
+
+	if (git_mutex_lock(&cache->lock) < 0)
+		return NULL;
+
+	pos = git_strmap_lookup_index(cache->entries, path);
+	if (git_strmap_valid_index(cache->entries, pos)) {
+		entry = git_strmap_value_at(cache->entries, pos);
+		git_atomic_inc(&entry->refcount);
+	}
+
+	git_mutex_unlock(&cache->lock);
+	return entry;
+}
+
+static bool config_cache_stamp_matches(
+	const git_futils_filestamp *stamp, const struct stat *st)
+{
+	return stamp->mtime == (git_time_t)st->st_mtime &&
+		stamp->size == (git_off_t)st->st_size &&
+		stamp->ino == (unsigned int)st->st_ino;
+}
+
+/*
+ * Give the backend the cached values for its file if every file they were
+ * parsed from is unchanged.  Returns 1 on a hit and 0 on a miss.
+ */
+static int config_cache_load(diskfile_backend *b)
+{
+	struct config_cache *cache;
+	config_cache_entry *entry;
+	config_cache_file *file;
+	struct reader *reader;
+	struct stat st;
+	uint32_t i;
+	int hit = 1;
+
+	if (!config_cache_wanted(b->level) || (cache = git__config_cache) == NULL)
+		return 0;
+
+	if ((entry = config_cache_take(cache, b->file_path)) == NULL)
+		return 0;
+
+	if (entry->level != b->level)
+		hit = 0;
+
+	for (i = 0; hit && i < git_array_size(entry->files); i++) {
+		file = git_array_get(entry->files, i);
+
+		if (p_stat(file->path, &st) < 0 ||
+			!config_cache_stamp_matches(&file->stamp, &st))
+			hit = 0;
+	}
+
+	for (i = 0; hit && i < git_array_size(entry->files); i++) {
+		file = git_array_get(entry->files, i);
+
+		if ((reader = git_array_alloc(b->readers)) == NULL) {
+			hit = -1;
+			break;
+		}
+		memset(reader, 0, sizeof(struct reader));
+
+		if ((reader->file_path = git__strdup(file->path)) == NULL) {
+			hit = -1;
+			break;
+		}
+
+		reader->file_mtime = (time_t)file->stamp.mtime;
+		reader->file_size = (size_t)file->stamp.size;
+		git_buf_init(&reader->buffer, 0);
+	}
+
+	if (hit > 0) {
+		git_atomic_inc(&entry->values->refcount);
+		b->header.values = entry->values;
+	} else {
+		for (i = 0; i < git_array_size(b->readers); i++) {
+			reader = git_array_get(b->readers, i);
+			git__free(reader->file_path);
+		}
+		git_array_clear(b->readers);
+	}
+
+	config_cache_entry_free(entry);
+	return hit;
+}
+
+/*
+ * Remember the values that were just parsed for the backend.  Files that
+ * changed while they were read, or so recently that a further change
+ * could go unnoticed with the same size and timestamp, are not cached.
+ */
+static int config_cache_store(diskfile_backend *b)
+{
+	struct config_cache *cache;
+	config_cache_entry *entry, *old = NULL;
+	config_cache_file *file;
+	struct reader *reader;
+	struct stat st;
+	time_t now = time(NULL);
+	uint32_t i;
+	int error;
+
+	if (!config_cache_wanted(b->level) || (cache = config_cache_get()) == NULL)
+		return 0;
+
+	entry = git__calloc(1, sizeof(config_cache_entry));
+	GITERR_CHECK_ALLOC(entry);
+
+	git_atomic_set(&entry->refcount, 1);
+	entry->level = b->level;
+
+	for (i = 0; i < git_array_size(b->readers); i++) {
+		reader = git_array_get(b->readers, i);
+
+		if (p_stat(reader->file_path, &st) < 0 ||
+			reader->file_mtime != st.st_mtime ||
+			reader->file_size != (size_t)st.st_size ||
+			st.st_mtime >= now) {
+			config_cache_entry_free(entry);
+			return 0;
+		}
+
+		if ((file = git_array_alloc(entry->files)) == NULL ||
+			(file->path = git__strdup(reader->file_path)) == NULL) {
+			config_cache_entry_free(entry);
+			return -1;
+		}
+
+		git_futils_filestamp_set_from_stat(&file->stamp, &st);
+	}
+
+	git_atomic_inc(&b->header.values->refcount);
+	entry->values = b->header.values;
+
+	file = git_array_get(entry->files, 0);
+
+	if (git_mutex_lock(&cache->lock) < 0) {
+		config_cache_entry_free(entry);
+		return 0;
+	}
+
+	git_strmap_insert2(cache->entries, file->path, entry, old, error);
+
+	git_mutex_unlock(&cache->lock);
+
+	config_cache_entry_free(old);
+
+	if (error < 0) {
+		config_cache_entry_free(entry);
+		giterr_set_oom();
+		return -1;
+	}
+
+	return 0;
+}
+
 static int config_open(git_config_backend *cfg, git_config_level_t level)
 {
 	int res;
@@ -267,10 +531,14 @@ static int config_open(git_config_backend *cfg, git_config_level_t level)
 
 	b->level = level;
 
+	git_array_init(b->readers);
+
+	if ((res = config_cache_load(b)) != 0)
+		return (res < 0) ? res : 0;
+
 	if ((res = refcounted_strmap_alloc(&b->header.values)) < 0)
 		return res;
 
-	git_array_init(b->readers);
 	reader = git_array_alloc(b->readers);
 	if (!reader) {
 		refcounted_strmap_free(b->header.values);
@@ -292,7 +560,8 @@ static int config_open(git_config_backend *cfg, git_config_level_t level)
 	if (res < 0 || (res = config_parse(b->header.values->values, b, reader, level, 0)) < 0) {
 		refcounted_strmap_free(b->header.values);
 		b->header.values = NULL;
-	}
+	} else
+		res = config_cache_store(b);
 
 	reader = git_array_get(b->readers, 0);
 	git_buf_free(&reader->buffer);
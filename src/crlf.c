@@ -334,6 +334,240 @@ static int crlf_apply(
 		return crlf_apply_to_odb(*payload, to, from, src);
 }
 
+/*
+ * Streaming conversion, for content too large to be examined as a whole:
+ * the decision to convert is made from the first part of the data.
+ */
+enum {
+	CRLF_STREAM_TO_LF = 1,
+	CRLF_STREAM_TO_CRLF = 2,
+};
+
+struct crlf_stream {
+	git_filter_lookahead parent;
+	struct crlf_attrs *ca;
+	const git_filter_source *src;
+	int mode;
+	int check_safe_crlf;
+	int last_cr;
+	unsigned int cr, lf, crlf;
+	git_buf out;
+};
+
+static int crlf_stream_convert_all(
+	git_filter_lookahead *la, git_buf *to, const git_buf *from)
+{
+	struct crlf_stream *stream = (struct crlf_stream *)la;
+
+	if (git_filter_source_mode(stream->src) == GIT_FILTER_SMUDGE)
+		return crlf_apply_to_workdir(stream->ca, to, from);
+	else
+		return crlf_apply_to_odb(stream->ca, to, from, stream->src);
+}
+
+static int crlf_stream_start_workdir(
+	struct crlf_stream *stream, const git_buf *head)
+{
+	const char *workdir_ending;
+
+	if (git_buf_text_is_binary(head))
+		return GIT_PASSTHROUGH;
+
+	if ((workdir_ending = line_ending(stream->ca)) == NULL)
+		return -1;
+
+	if (strcmp(workdir_ending, "\r\n") != 0)
+		return GIT_PASSTHROUGH;
+
+	/* leave files that already have mixed line endings alone; binary
+	 * content was ruled out above, so the head holds no NUL bytes */
+	if (strstr(head->ptr, "\r\n") != NULL)
+		return GIT_PASSTHROUGH;
+
+	stream->mode = CRLF_STREAM_TO_CRLF;
+	return 0;
+}
+
+static int crlf_stream_start_odb(
+	struct crlf_stream *stream, const git_buf *head)
+{
+	struct crlf_attrs *ca = stream->ca;
+	git_buf_text_stats stats;
+
+	stream->mode = CRLF_STREAM_TO_LF;
+
+	if (ca->crlf_action != GIT_CRLF_AUTO && ca->crlf_action != GIT_CRLF_GUESS)
+		return 0;
+
+	if (git_buf_text_gather_stats(&stats, head, false))
+		return GIT_PASSTHROUGH;
+
+	/* a CR at the very end may be followed by a LF in the next chunk */
+	if (head->size && head->ptr[head->size - 1] == '\r')
+		stats.cr--;
+
+	if (stats.cr != stats.crlf) {
+		if (ca->safe_crlf == GIT_SAFE_CRLF_FAIL) {
+			giterr_set(
+				GITERR_FILTER, "LF would be replaced by CRLF in '%s'",
+				git_filter_source_path(stream->src));
+			return -1;
+		}
+
+		return GIT_PASSTHROUGH;
+	}
+
+	if (ca->crlf_action == GIT_CRLF_GUESS && has_cr_in_index(stream->src))
+		return GIT_PASSTHROUGH;
+
+	stream->check_safe_crlf = (ca->safe_crlf == GIT_SAFE_CRLF_FAIL);
+	return 0;
+}
+
+static int crlf_stream_start(git_filter_lookahead *la, const git_buf *head)
+{
+	struct crlf_stream *stream = (struct crlf_stream *)la;
+
+	if (git_filter_source_mode(stream->src) == GIT_FILTER_SMUDGE)
+		return crlf_stream_start_workdir(stream, head);
+	else
+		return crlf_stream_start_odb(stream, head);
+}
+
+static size_t crlf_stream_to_lf(
+	struct crlf_stream *stream, char *out, const char *in, size_t len)
+{
+	char *start = out;
+	git_buf_text_stats stats;
+
+	/* Do not drop \r unless it is followed by \n */
+	if (stream->last_cr) {
+		stream->last_cr = 0;
+
+		if (in[0] == '\n')
+			stream->crlf++;
+		else
+			*out++ = '\r';
+	}
+
+	if (stream->check_safe_crlf) {
+		git_buf_text__count(&stats, in, len);
+		stream->cr += stats.cr;
+		stream->lf += stats.lf;
+		stream->crlf += stats.crlf;
+	}
+
+	/* a \r at the end of the chunk waits for the next one */
+	if (in[len - 1] == '\r') {
+		stream->last_cr = 1;
+		len--;
+	}
+
+	return (size_t)(out - start) + git_buf_text__crlf_to_lf(out, in, len);
+}
+
+static size_t crlf_stream_to_crlf(
+	struct crlf_stream *stream, char *out, const char *in, size_t len)
+{
+	size_t outlen = git_buf_text__lf_to_crlf(
+		out, in, len, stream->last_cr ? '\r' : '\0');
+
+	stream->last_cr = (in[len - 1] == '\r');
+	return outlen;
+}
+
+static int crlf_stream_convert(
+	git_filter_lookahead *la, const char *buffer, size_t len)
+{
+	struct crlf_stream *stream = (struct crlf_stream *)la;
+	size_t chunk, outlen;
+	int error = 0;
+
+	while (len > 0 && !error) {
+		chunk = min(len, GIT_FILTER_STREAM_CHUNK);
+
+		git_buf_clear(&stream->out);
+		if (git_buf_grow(&stream->out, chunk * 2 + 1) < 0)
+			return -1;
+
+		if (stream->mode == CRLF_STREAM_TO_LF)
+			outlen = crlf_stream_to_lf(
+				stream, stream->out.ptr, buffer, chunk);
+		else
+			outlen = crlf_stream_to_crlf(
+				stream, stream->out.ptr, buffer, chunk);
+
+		if (outlen > 0)
+			error = la->next->write(la->next, stream->out.ptr, outlen);
+
+		buffer += chunk;
+		len -= chunk;
+	}
+
+	return error;
+}
+
+static int crlf_stream_finish(git_filter_lookahead *la)
+{
+	struct crlf_stream *stream = (struct crlf_stream *)la;
+
+	if (stream->mode != CRLF_STREAM_TO_LF)
+		return 0;
+
+	if (stream->check_safe_crlf && stream->cr > 0 &&
+		(stream->cr != stream->crlf || stream->lf != stream->crlf)) {
+		giterr_set(
+			GITERR_FILTER, "LF would be replaced by CRLF in '%s'",
+			git_filter_source_path(stream->src));
+		return -1;
+	}
+
+	if (stream->last_cr)
+		return la->next->write(la->next, "\r", 1);
+
+	return 0;
+}
+
+static void crlf_stream_free(git_filter_lookahead *la)
+{
+	struct crlf_stream *stream = (struct crlf_stream *)la;
+
+	git_buf_free(&stream->out);
+	git__free(stream);
+}
+
+static int crlf_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	struct crlf_stream *stream;
+
+	/* initialize payload in case `check` was bypassed */
+	if (!*payload) {
+		int error = crlf_check(self, payload, src, NULL);
+		if (error < 0)
+			return error;
+	}
+
+	stream = git__calloc(1, sizeof(struct crlf_stream));
+	GITERR_CHECK_ALLOC(stream);
+
+	git_filter_lookahead_init(&stream->parent, next);
+	stream->parent.convert_all = crlf_stream_convert_all;
+	stream->parent.start = crlf_stream_start;
+	stream->parent.convert = crlf_stream_convert;
+	stream->parent.finish = crlf_stream_finish;
+	stream->parent.free = crlf_stream_free;
+	stream->ca = *payload;
+	stream->src = src;
+
+	*out = (git_writestream *)stream;
+	return 0;
+}
+
 static void crlf_cleanup(
 	git_filter *self,
 	void       *payload)
@@ -352,6 +586,7 @@ git_filter *git_crlf_filter_new(void)
 	f->f.shutdown = git_filter_free;
 	f->f.check    = crlf_check;
 	f->f.apply    = crlf_apply;
+	f->f.stream   = crlf_stream;
 	f->f.cleanup  = crlf_cleanup;
 
 	return (git_filter *)f;
@@ -369,6 +369,7 @@ static git_diff *diff_list_alloc(
 	diff->old_src = old_iter->type;
 	diff->new_src = new_iter->type;
 	memcpy(&diff->opts, &dflt, sizeof(diff->opts));
+	git_attr_session__init(&diff->attrsession, repo);
 
 	if (git_vector_init(&diff->deltas, 0, git_diff_delta__cmp) < 0 ||
 		git_pool_init(&diff->pool, 1, 0) < 0) {
@@ -434,7 +435,7 @@ static int diff_list_apply_options(
 	/* Don't set GIT_DIFFCAPS_USE_DEV - compile time option in core git */
 
 	/* Set GIT_DIFFCAPS_TRUST_NANOSECS on a platform basis */
-	diff->diffcaps = diff->diffcaps | GIT_DIFFCAPS_TRUST_NANOSECS;
+	diff->diffcaps = diff->diffcaps | GIT_DIFFCAPS__PLATFORM;
 
 	/* If not given explicit `opts`, check `diff.xyz` configs */
 	if (!opts) {
@@ -509,6 +510,7 @@ static void diff_list_free(git_diff *diff)
 
 	git_pathspec__vfree(&diff->pathspec);
 	git_pool_clear(&diff->pool);
+	git_attr_session__free(&diff->attrsession);
 
 	git__memzero(diff, sizeof(*diff));
 	git__free(diff);
@@ -598,9 +600,10 @@ int git_diff__oid_for_entry(
 		giterr_set(GITERR_OS, "File size overflow (for 32-bits) on '%s'",
 			entry.path);
 		error = -1;
-	} else if (!(error = git_filter_list_load(
+	} else if (!(error = git_filter_list__load_ext(
 		&fl, diff->repo, NULL, entry.path,
-		GIT_FILTER_TO_ODB, GIT_FILTER_OPT_ALLOW_UNSAFE)))
+		GIT_FILTER_TO_ODB, GIT_FILTER_OPT_ALLOW_UNSAFE,
+		&diff->attrsession)))
 	{
 		int fd = git_futils_open_ro(full_path.ptr);
 		if (fd < 0)
@@ -630,13 +633,6 @@ int git_diff__oid_for_entry(
 	return error;
 }
 
-static bool diff_time_eq(
-	const git_index_time *a, const git_index_time *b, bool use_nanos)
-{
-	return a->seconds == b->seconds &&
-		(!use_nanos || a->nanoseconds == b->nanoseconds);
-}
-
 typedef struct {
 	git_repository *repo;
 	git_iterator *old_iter;
@@ -785,9 +781,9 @@ static int maybe_modified(
 			modified_uncertain =
 				(oitem->file_size <= 0 && nitem->file_size > 0);
 		}
-		else if (!diff_time_eq(&oitem->mtime, &nitem->mtime, use_nanos) ||
+		else if (!git_diff__time_eq(&oitem->mtime, &nitem->mtime, use_nanos) ||
 			(use_ctime &&
-			 !diff_time_eq(&oitem->ctime, &nitem->ctime, use_nanos)) ||
+			 !git_diff__time_eq(&oitem->ctime, &nitem->ctime, use_nanos)) ||
 			oitem->ino != nitem->ino ||
 			oitem->uid != nitem->uid ||
 			oitem->gid != nitem->gid)
@@ -997,11 +993,40 @@ static int handle_unmatched_new_item(
 	return git_iterator_advance(&info->nitem, info->new_iter);
 }
 
+static int handle_skip_worktree_item(
+	git_diff *diff, diff_in_progress *info)
+{
+	const git_index_entry *oitem = info->oitem;
+	const char *matched_pathspec;
+	int error = 0;
+
+	if (git_pathspec__match(
+			&diff->pathspec, oitem->path,
+			DIFF_FLAG_IS_SET(diff, GIT_DIFF_DISABLE_PATHSPEC_MATCH),
+			DIFF_FLAG_IS_SET(diff, GIT_DIFF_IGNORE_CASE),
+			&matched_pathspec, NULL))
+		error = diff_delta__from_two(
+			diff, GIT_DELTA_UNMODIFIED, oitem, oitem->mode,
+			oitem, oitem->mode, NULL, matched_pathspec);
+
+	if (!error)
+		error = git_iterator_advance(&info->oitem, info->old_iter);
+
+	return error;
+}
+
 static int handle_unmatched_old_item(
 	git_diff *diff, diff_in_progress *info)
 {
-	int error = diff_delta__from_one(diff, GIT_DELTA_DELETED, info->oitem);
-	if (error != 0)
+	int error;
+
+	/* "skip worktree" entries are not expected in the working directory */
+	if ((info->oitem->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 &&
+		info->new_iter->type == GIT_ITERATOR_TYPE_WORKDIR)
+		return handle_skip_worktree_item(diff, info);
+
+	if ((error = diff_delta__from_one(
+			diff, GIT_DELTA_DELETED, info->oitem)) != 0)
 		return error;
 
 	/* if we are generating TYPECHANGE records then check for that
@@ -1044,6 +1069,77 @@ static int handle_matched_item(
 	return error;
 }
 
+/*
+ * The old side of a tree to index diff hands us its subtrees, which we
+ * skip over wholesale when the index's tree cache says the index has the
+ * same tree at that path, and expand otherwise.
+ */
+static int handle_old_tree(git_diff *diff, diff_in_progress *info)
+{
+	git_index *index = git_iterator_get_index(info->new_iter);
+	const git_tree_cache *cache = NULL;
+	git_buf dir = GIT_BUF_INIT;
+	int error;
+
+	if (index != NULL)
+		cache = git_tree_cache_get(index->tree, info->oitem->path);
+
+	if (cache == NULL || cache->entries < 0 ||
+		!git_oid_equal(&cache->oid, &info->oitem->id))
+		return git_iterator_advance_into_or_over(
+			&info->oitem, info->old_iter);
+
+	/* the tree path is about to be overwritten by the iterator */
+	if ((error = git_buf_sets(&dir, info->oitem->path)) < 0)
+		return error;
+
+	if ((error = git_iterator_advance(&info->oitem, info->old_iter)) < 0 &&
+		error != GIT_ITEROVER)
+		goto done;
+	error = 0;
+
+	while (!error && info->nitem &&
+		diff->pfxcomp(info->nitem->path, dir.ptr) == 0)
+		error = git_iterator_advance(&info->nitem, info->new_iter);
+
+done:
+	git_buf_free(&dir);
+	return error;
+}
+
+/*
+ * "Skip worktree" entries are reported as unmodified whatever is in the
+ * working directory, so when diffing the index to the working directory
+ * the workdir iterator leaves their paths out without stat'ing them.
+ */
+static int diff_skip_worktree_files(
+	git_vector *out, git_iterator *old_iter, git_iterator *new_iter)
+{
+	git_index *index = git_iterator_get_index(old_iter);
+	const git_index_entry *entry;
+	size_t i, count;
+
+	if (!index || new_iter->type != GIT_ITERATOR_TYPE_WORKDIR)
+		return 0;
+
+	if (git_vector_init(out, 0, git_iterator_ignore_case(new_iter) ?
+			git__strcasecmp_cb : git__strcmp_cb) < 0)
+		return -1;
+
+	count = git_index_entrycount(index);
+
+	for (i = 0; i < count; ++i) {
+		entry = git_index_get_byindex(index, i);
+
+		if ((entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0 &&
+			git_vector_insert(out, (char *)entry->path) < 0)
+			return -1;
+	}
+
+	git_vector_sort(out);
+	return 0;
+}
+
 int git_diff__from_iterators(
 	git_diff **diff_ptr,
 	git_repository *repo,
@@ -1054,6 +1150,8 @@ int git_diff__from_iterators(
 	int error = 0;
 	diff_in_progress info;
 	git_diff *diff;
+	git_pathspec_prefixes prefixes = { GIT_VECTOR_INIT };
+	git_vector skip_worktree = GIT_VECTOR_INIT;
 
 	*diff_ptr = NULL;
 
@@ -1075,6 +1173,27 @@ int git_diff__from_iterators(
 	if ((error = diff_list_apply_options(diff, opts)) < 0)
 		goto cleanup;
 
+	/* skip parts of the trees that the pathspec cannot match */
+	if ((error = git_pathspec__prefixes_init(&prefixes, &diff->pathspec,
+			DIFF_FLAG_IS_SET(diff, GIT_DIFF_IGNORE_CASE))) < 0)
+		goto cleanup;
+
+	if ((error = diff_skip_worktree_files(
+			&skip_worktree, old_iter, new_iter)) < 0)
+		goto cleanup;
+
+	if (prefixes.prefixes.length > 0 || skip_worktree.length > 0) {
+		git_iterator_set_prefixes(old_iter, &prefixes);
+		git_iterator_set_prefixes(new_iter, &prefixes);
+
+		if (skip_worktree.length > 0)
+			git_iterator_skip_files(new_iter, &skip_worktree);
+
+		if ((error = git_iterator_reset(old_iter, NULL, NULL)) < 0 ||
+			(error = git_iterator_reset(new_iter, NULL, NULL)) < 0)
+			goto cleanup;
+	}
+
 	if ((error = git_iterator_current(&info.oitem, old_iter)) < 0 &&
 		error != GIT_ITEROVER)
 		goto cleanup;
@@ -1088,8 +1207,13 @@ int git_diff__from_iterators(
 		int cmp = info.oitem ?
 			(info.nitem ? diff->entrycomp(info.oitem, info.nitem) : -1) : 1;
 
+		/* old subtrees come unexpanded only when we can skip them */
+		if (cmp <= 0 && info.oitem->mode == GIT_FILEMODE_TREE &&
+			git_iterator_type(old_iter) == GIT_ITERATOR_TYPE_TREE)
+			error = handle_old_tree(diff, &info);
+
 		/* create DELETED records for old items not matched in new */
-		if (cmp < 0)
+		else if (cmp < 0)
 			error = handle_unmatched_old_item(diff, &info);
 
 		/* create ADDED, TRACKED, or IGNORED records for new items not
@@ -1112,6 +1236,13 @@ int git_diff__from_iterators(
 	diff->perf.stat_calls += old_iter->stat_calls + new_iter->stat_calls;
 
 cleanup:
+	git_iterator_set_prefixes(old_iter, NULL);
+	git_iterator_set_prefixes(new_iter, NULL);
+	if (skip_worktree.length > 0)
+		git_iterator_skip_files(new_iter, NULL);
+	git_pathspec__prefixes_free(&prefixes);
+	git_vector_free(&skip_worktree);
+
 	if (!error)
 		*diff_ptr = diff;
 	else
@@ -1176,6 +1307,7 @@ int git_diff_tree_to_index(
 {
 	int error = 0;
 	bool index_ignore_case = false;
+	git_iterator_flag_t tree_flags = GIT_ITERATOR_DONT_IGNORE_CASE;
 
 	assert(diff && repo);
 
@@ -1184,9 +1316,13 @@ int git_diff_tree_to_index(
 
 	index_ignore_case = index->ignore_case;
 
+	/* let subtrees that the index has cached as unchanged be skipped */
+	if (index->tree != NULL && (!opts || !(opts->flags &
+			(GIT_DIFF_INCLUDE_UNMODIFIED | GIT_DIFF_IGNORE_CASE))))
+		tree_flags |= GIT_ITERATOR_INCLUDE_TREES | GIT_ITERATOR_DONT_AUTOEXPAND;
+
 	DIFF_FROM_ITERATORS(
-		git_iterator_for_tree(
-			&a, old_tree, GIT_ITERATOR_DONT_IGNORE_CASE, pfx, pfx),
+		git_iterator_for_tree(&a, old_tree, tree_flags, pfx, pfx),
 		git_iterator_for_index(
 			&b, index, GIT_ITERATOR_DONT_IGNORE_CASE, pfx, pfx)
 	);
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "ewah.h"
+
+/*
+ * A serialized bitmap is its size in bits, the number of 64-bit words
+ * that follow, the words themselves and the position of the last marker
+ * word, all in network byte order.
+ *
+ * The words are runs of marker words each followed by literal words.  A
+ * marker holds the value of a run of identical words in bit 0, the length
+ * of that run in the next 32 bits, and the number of literal words that
+ * come after it in the remaining 31 bits.
+ */
+#define EWAH_RUN_MAX 0xffffffffu
+#define EWAH_LITERALS_MAX 0x7fffffffu
+
+#define EWAH_HEADER_SIZE 8
+#define EWAH_FOOTER_SIZE 4
+
+GIT_INLINE(void) put_uint32(char *out, uint32_t value)
+{
+	value = htonl(value);
+	memcpy(out, &value, sizeof(value));
+}
+
+GIT_INLINE(uint32_t) get_uint32(const char *buffer)
+{
+	uint32_t value;
+	memcpy(&value, buffer, sizeof(value));
+	return ntohl(value);
+}
+
+GIT_INLINE(void) put_word(char *out, uint64_t word)
+{
+	put_uint32(out, (uint32_t)(word >> 32));
+	put_uint32(out + 4, (uint32_t)word);
+}
+
+GIT_INLINE(uint64_t) get_word(const char *buffer)
+{
+	return ((uint64_t)get_uint32(buffer) << 32) | get_uint32(buffer + 4);
+}
+
+int git_ewah_serialize(git_buf *out, const uint32_t *bits, size_t nr)
+{
+	size_t bit_size = nr ? (size_t)bits[nr - 1] + 1 : 0;
+	size_t nwords = (bit_size + 63) / 64, word = 0, i = 0;
+	size_t start = git_buf_len(out), words = 0, marker = 0;
+	char value[8] = {0};
+
+	put_uint32(value, (uint32_t)bit_size);
+	if (git_buf_put(out, value, 8) < 0)
+		return -1;
+
+	/* an empty bitmap still has its (empty) marker word */
+	do {
+		size_t run, literals = 0, marker_offset = git_buf_len(out);
+		size_t next = (i < nr) ? bits[i] / 64 : nwords;
+
+		run = next - word;
+		if (run > EWAH_RUN_MAX)
+			run = EWAH_RUN_MAX;
+		word += run;
+
+		marker = words++;
+		if (git_buf_put(out, value, 8) < 0)
+			return -1;
+
+		while (i < nr && bits[i] / 64 == word && literals < EWAH_LITERALS_MAX) {
+			uint64_t literal = 0;
+
+			for (; i < nr && bits[i] / 64 == word; ++i)
+				literal |= (uint64_t)1 << (bits[i] % 64);
+
+			put_word(value, literal);
+			if (git_buf_put(out, value, 8) < 0)
+				return -1;
+
+			literals++;
+			words++;
+			word++;
+		}
+
+		put_word(out->ptr + marker_offset,
+			((uint64_t)literals << 33) | ((uint64_t)run << 1));
+	} while (word < nwords);
+
+	put_uint32(out->ptr + start + 4, (uint32_t)words);
+
+	put_uint32(value, (uint32_t)marker);
+	return git_buf_put(out, value, 4);
+}
+
+GIT_INLINE(int) add_bit(git_ewah_bits *out, uint64_t bit, uint32_t bit_size)
+{
+	uint32_t *pos;
+
+	if (bit >= bit_size)
+		return -1;
+
+	pos = git_array_alloc(*out);
+	if (!pos)
+		return -1;
+
+	*pos = (uint32_t)bit;
+	return 0;
+}
+
+size_t git_ewah_deserialize(
+	git_ewah_bits *out, const char *buffer, size_t buffer_size)
+{
+	uint32_t bit_size;
+	size_t nwords, size, i = 0;
+	uint64_t pos = 0;
+
+	if (buffer_size < EWAH_HEADER_SIZE + EWAH_FOOTER_SIZE)
+		return 0;
+
+	bit_size = get_uint32(buffer);
+	nwords = get_uint32(buffer + 4);
+
+	if (nwords > (buffer_size - EWAH_HEADER_SIZE - EWAH_FOOTER_SIZE) / 8)
+		return 0;
+
+	size = EWAH_HEADER_SIZE + nwords * 8 + EWAH_FOOTER_SIZE;
+	buffer += EWAH_HEADER_SIZE;
+
+	while (i < nwords) {
+		uint64_t marker = get_word(buffer + i++ * 8), run, literals, b;
+
+		run = (marker >> 1) & EWAH_RUN_MAX;
+		literals = marker >> 33;
+
+		if (marker & 1) {
+			for (b = 0; b < run * 64; ++b)
+				if (add_bit(out, pos + b, bit_size) < 0)
+					return 0;
+		}
+		pos += run * 64;
+
+		if (literals > nwords - i)
+			return 0;
+
+		for (; literals > 0; --literals, pos += 64) {
+			uint64_t literal = get_word(buffer + i++ * 8);
+
+			for (b = 0; literal; ++b, literal >>= 1)
+				if ((literal & 1) && add_bit(out, pos + b, bit_size) < 0)
+					return 0;
+		}
+	}
+
+	return size;
+}
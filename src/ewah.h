@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_ewah_h__
+#define INCLUDE_ewah_h__
+
+#include "common.h"
+#include "array.h"
+#include "buffer.h"
+
+/*
+ * Reading and writing of EWAH compressed bitmaps, as git stores them in
+ * its index extensions.  Bitmaps are handled as the ascending list of the
+ * positions of their set bits.
+ */
+typedef git_array_t(uint32_t) git_ewah_bits;
+
+/* Append the bitmap with the `nr` ascending set `bits` to `out` */
+extern int git_ewah_serialize(git_buf *out, const uint32_t *bits, size_t nr);
+
+/*
+ * Parse the bitmap at the start of `buffer`, appending its set bits to
+ * `out`.  Returns the number of bytes the bitmap takes, or 0 if it is
+ * not valid.
+ */
+extern size_t git_ewah_deserialize(
+	git_ewah_bits *out, const char *buffer, size_t buffer_size);
+
+#endif
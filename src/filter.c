@@ -14,8 +14,9 @@
 #include "git2/sys/filter.h"
 #include "git2/config.h"
 #include "blob.h"
-#include "attr_file.h"
+#include "attr.h"
 #include "array.h"
+#include "filter_process.h"
 
 struct git_filter_source {
 	git_repository *repo;
@@ -108,6 +109,7 @@ static int filter_registry_initialize(void)
 	{
 		git_filter *crlf = git_crlf_filter_new();
 		git_filter *ident = git_ident_filter_new();
+		git_filter *process = git_filter_process_filter_new();
 
 		if (crlf && git_filter_register(
 				GIT_FILTER_CRLF, crlf, GIT_FILTER_CRLF_PRIORITY) < 0)
@@ -115,8 +117,11 @@ static int filter_registry_initialize(void)
 		if (ident && git_filter_register(
 				GIT_FILTER_IDENT, ident, GIT_FILTER_IDENT_PRIORITY) < 0)
 			ident = NULL;
+		if (process && git_filter_register(
+				GIT_FILTER_PROCESS, process, GIT_FILTER_PROCESS_PRIORITY) < 0)
+			process = NULL;
 
-		if (!crlf || !ident)
+		if (!crlf || !ident || !process)
 			return -1;
 	}
 
@@ -230,6 +235,8 @@ int git_filter_register(
 	size_t nattr = 0, nmatch = 0;
 	git_buf attrs = GIT_BUF_INIT;
 
+	GITERR_CHECK_VERSION(filter, GIT_FILTER_VERSION, "git_filter");
+
 	if (filter_registry_initialize() < 0)
 		return -1;
 
@@ -271,7 +278,8 @@ int git_filter_unregister(const char *name)
 	git_filter_def *fdef;
 
 	/* cannot unregister default filters */
-	if (!strcmp(GIT_FILTER_CRLF, name) || !strcmp(GIT_FILTER_IDENT, name)) {
+	if (!strcmp(GIT_FILTER_CRLF, name) || !strcmp(GIT_FILTER_IDENT, name) ||
+		!strcmp(GIT_FILTER_PROCESS, name)) {
 		giterr_set(GITERR_FILTER, "Cannot unregister filter '%s'", name);
 		return -1;
 	}
@@ -385,15 +393,19 @@ static int filter_list_new(
 }
 
 static int filter_list_check_attributes(
-	const char ***out, git_filter_def *fdef, const git_filter_source *src)
+	const char ***out,
+	git_attr_session *attr_session,
+	git_filter_def *fdef,
+	const git_filter_source *src)
 {
 	int error;
 	size_t i;
 	const char **strs = git__calloc(fdef->nattrs, sizeof(const char *));
 	GITERR_CHECK_ALLOC(strs);
 
-	error = git_attr_get_many(
-		strs, src->repo, 0, src->path, fdef->nattrs, fdef->attrs);
+	error = git_attr_get_many_with_session(
+		strs, src->repo, attr_session, 0, src->path,
+		fdef->nattrs, fdef->attrs);
 
 	/* if no values were found but no matches are needed, it's okay! */
 	if (error == GIT_ENOTFOUND && !fdef->nmatches) {
@@ -439,13 +451,14 @@ int git_filter_list_new(
 	return filter_list_new(out, &src);
 }
 
-int git_filter_list_load(
+int git_filter_list__load_ext(
 	git_filter_list **filters,
 	git_repository *repo,
 	git_blob *blob, /* can be NULL */
 	const char *path,
 	git_filter_mode_t mode,
-	uint32_t options)
+	uint32_t options,
+	git_attr_session *attr_session)
 {
 	int error = 0;
 	git_filter_list *fl = NULL;
@@ -472,7 +485,8 @@ int git_filter_list_load(
 			continue;
 
 		if (fdef->nattrs > 0) {
-			error = filter_list_check_attributes(&values, fdef, &src);
+			error = filter_list_check_attributes(
+				&values, attr_session, fdef, &src);
 			if (error == GIT_ENOTFOUND) {
 				error = 0;
 				continue;
@@ -514,6 +528,18 @@ int git_filter_list_load(
 	return error;
 }
 
+int git_filter_list_load(
+	git_filter_list **filters,
+	git_repository *repo,
+	git_blob *blob, /* can be NULL */
+	const char *path,
+	git_filter_mode_t mode,
+	uint32_t options)
+{
+	return git_filter_list__load_ext(
+		filters, repo, blob, path, mode, options, NULL);
+}
+
 void git_filter_list_free(git_filter_list *fl)
 {
 	uint32_t i;
@@ -583,96 +609,215 @@ static int filter_list_out_buffer_from_raw(
 	return 0;
 }
 
-int git_filter_list_apply_to_data(
-	git_buf *tgt, git_filter_list *fl, git_buf *src)
+/*
+ * Filtering runs the data through a chain of streams, one for each filter,
+ * into the target stream.  Filters that cannot stream are wrapped in a
+ * proxy stream that collects all of the data and hands it to their
+ * `apply` callback when it is closed.
+ */
+typedef struct {
+	git_writestream parent;
+	git_filter *filter;
+	const git_filter_source *source;
+	void **payload;
+	git_buf input;
+	git_writestream *target;
+} proxy_stream;
+
+static int proxy_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
 {
-	int error = 0;
-	uint32_t i;
-	git_buf *dbuffer[2], local = GIT_BUF_INIT;
-	unsigned int si = 0;
+	proxy_stream *proxy = (proxy_stream *)s;
+	return git_buf_put(&proxy->input, buffer, len);
+}
 
-	git_buf_sanitize(tgt);
-	git_buf_sanitize(src);
+static int proxy_stream_close(git_writestream *s)
+{
+	proxy_stream *proxy = (proxy_stream *)s;
+	git_buf output = GIT_BUF_INIT, *result = &output;
+	int error;
 
-	if (!fl)
-		return filter_list_out_buffer_from_raw(tgt, src->ptr, src->size);
+	git_buf_sanitize(&proxy->input);
 
-	dbuffer[0] = src;
-	dbuffer[1] = tgt;
+	error = proxy->filter->apply(
+		proxy->filter, proxy->payload, &output, &proxy->input, proxy->source);
 
-	/* if `src` buffer is reallocable, then use it, otherwise copy it */
-	if (!git_buf_is_allocated(src)) {
-		if (git_buf_set(&local, src->ptr, src->size) < 0)
-			return -1;
-		dbuffer[0] = &local;
+	/* PASSTHROUGH means filter decided not to process the buffer */
+	if (error == GIT_PASSTHROUGH) {
+		result = &proxy->input;
+		error = 0;
 	}
 
-	for (i = 0; i < git_array_size(fl->filters); ++i) {
-		unsigned int di = 1 - si;
-		uint32_t fidx = (fl->source.mode == GIT_FILTER_TO_WORKTREE) ?
-			i : git_array_size(fl->filters) - 1 - i;
-		git_filter_entry *fe = git_array_get(fl->filters, fidx);
+	if (!error && result->size > 0)
+		error = proxy->target->write(proxy->target, result->ptr, result->size);
 
-		dbuffer[di]->size = 0;
+	if (!error)
+		error = proxy->target->close(proxy->target);
 
-		/* Apply the filter from dbuffer[src] to the other buffer;
-		 * if the filtering is canceled by the user mid-filter,
-		 * we skip to the next filter without changing the source
-		 * of the double buffering (so that the text goes through
-		 * cleanly).
-		 */
+	git_buf_free(&output);
+	return error;
+}
 
-		error = fe->filter->apply(
-			fe->filter, &fe->payload, dbuffer[di], dbuffer[si], &fl->source);
+static void proxy_stream_free(git_writestream *s)
+{
+	proxy_stream *proxy = (proxy_stream *)s;
 
-		if (error == GIT_PASSTHROUGH) {
-			/* PASSTHROUGH means filter decided not to process the buffer */
-			error = 0;
-		} else if (!error) {
-			git_buf_sanitize(dbuffer[di]); /* force NUL termination */
-			si = di; /* swap buffers */
-		} else {
-			tgt->size = 0;
-			goto cleanup;
-		}
+	git_buf_free(&proxy->input);
+	git__free(proxy);
+}
+
+static int proxy_stream_init(
+	git_writestream **out,
+	git_filter *filter,
+	void **payload,
+	const git_filter_source *source,
+	git_writestream *target)
+{
+	proxy_stream *proxy = git__calloc(1, sizeof(proxy_stream));
+	GITERR_CHECK_ALLOC(proxy);
+
+	proxy->parent.write = proxy_stream_write;
+	proxy->parent.close = proxy_stream_close;
+	proxy->parent.free = proxy_stream_free;
+	proxy->filter = filter;
+	proxy->payload = payload;
+	proxy->source = source;
+	proxy->target = target;
+
+	*out = (git_writestream *)proxy;
+	return 0;
+}
+
+static void stream_list_free(git_vector *streams)
+{
+	git_writestream *stream;
+	size_t i;
+
+	git_vector_foreach(streams, i, stream)
+		stream->free(stream);
+	git_vector_free(streams);
+}
+
+static int stream_list_init(
+	git_writestream **out,
+	git_vector *streams,
+	git_filter_list *filters,
+	git_writestream *target)
+{
+	git_writestream *last_stream = target;
+	size_t i, count = git_filter_list_length(filters);
+	int error;
+
+	/* create the streams last to first, so that each one knows its next */
+	for (i = 0; i < count; ++i) {
+		size_t fidx = (filters->source.mode == GIT_FILTER_TO_WORKTREE) ?
+			count - 1 - i : i;
+		git_filter_entry *fe = git_array_get(filters->filters, fidx);
+		git_writestream *filter_stream;
+
+		if (fe->filter->version > 1 && fe->filter->stream)
+			error = fe->filter->stream(&filter_stream, fe->filter,
+				&fe->payload, &filters->source, last_stream);
+		else if (fe->filter->apply)
+			error = proxy_stream_init(&filter_stream, fe->filter,
+				&fe->payload, &filters->source, last_stream);
+		else
+			continue;
+
+		if (error == GIT_PASSTHROUGH)
+			continue;
+
+		if (error < 0 ||
+			(error = git_vector_insert(streams, filter_stream)) < 0)
+			return error;
+
+		last_stream = filter_stream;
 	}
 
-	/* Ensure that the output ends up in dbuffer[1] (i.e. the dest) */
-	if (si != 1)
-		git_buf_swap(dbuffer[0], dbuffer[1]);
+	*out = last_stream;
+	return 0;
+}
 
-cleanup:
-	git_buf_free(&local); /* don't leak if we allocated locally */
+int git_filter_list__stream_fd(
+	git_filter_list *filters, git_file fd, git_writestream *target)
+{
+	git_vector streams = GIT_VECTOR_INIT;
+	git_writestream *stream_start;
+	char *buffer;
+	ssize_t read_len;
+	int error;
+
+	buffer = git__malloc(GIT_FILTER_STREAM_CHUNK);
+	GITERR_CHECK_ALLOC(buffer);
+
+	if ((error = stream_list_init(
+			&stream_start, &streams, filters, target)) < 0)
+		goto done;
+
+	while ((read_len = p_read(fd, buffer, GIT_FILTER_STREAM_CHUNK)) > 0) {
+		if ((error = stream_start->write(
+				stream_start, buffer, (size_t)read_len)) < 0)
+			goto done;
+	}
 
+	if (read_len < 0) {
+		giterr_set(GITERR_OS, "Failed to read file for filtering");
+		error = -1;
+	} else
+		error = stream_start->close(stream_start);
+
+done:
+	stream_list_free(&streams);
+	git__free(buffer);
 	return error;
 }
 
-int git_filter_list_apply_to_file(
-	git_buf *out,
+int git_filter_list_stream_file(
 	git_filter_list *filters,
 	git_repository *repo,
-	const char *path)
+	const char *path,
+	git_writestream *target)
 {
-	int error;
 	const char *base = repo ? git_repository_workdir(repo) : NULL;
-	git_buf abspath = GIT_BUF_INIT, raw = GIT_BUF_INIT;
+	git_buf abspath = GIT_BUF_INIT;
+	int fd = -1, error;
 
-	if (!(error = git_path_join_unrooted(&abspath, path, base, NULL)) &&
-		!(error = git_futils_readbuffer(&raw, abspath.ptr)))
-	{
-		error = git_filter_list_apply_to_data(out, filters, &raw);
+	if ((error = git_path_join_unrooted(&abspath, path, base, NULL)) < 0 ||
+		(error = fd = git_futils_open_ro(abspath.ptr)) < 0)
+		goto done;
 
-		git_buf_free(&raw);
-	}
+	error = git_filter_list__stream_fd(filters, fd, target);
+	p_close(fd);
 
+done:
 	git_buf_free(&abspath);
 	return error;
 }
 
-int git_filter_list_apply_to_blob(
-	git_buf *out,
+int git_filter_list_stream_data(
 	git_filter_list *filters,
-	git_blob *blob)
+	git_buf *data,
+	git_writestream *target)
+{
+	git_vector streams = GIT_VECTOR_INIT;
+	git_writestream *stream_start;
+	int error;
+
+	git_buf_sanitize(data);
+
+	if (!(error = stream_list_init(
+			&stream_start, &streams, filters, target)) &&
+		!(error = stream_start->write(stream_start, data->ptr, data->size)))
+		error = stream_start->close(stream_start);
+
+	stream_list_free(&streams);
+	return error;
+}
+
+int git_filter_list_stream_blob(
+	git_filter_list *filters,
+	git_blob *blob,
+	git_writestream *target)
 {
 	git_buf in = GIT_BUF_INIT;
 	git_off_t rawsize = git_blob_rawsize(blob);
@@ -689,5 +834,238 @@ int git_filter_list_apply_to_blob(
 	if (filters)
 		git_oid_cpy(&filters->source.oid, git_blob_id(blob));
 
-	return git_filter_list_apply_to_data(out, filters, &in);
+	return git_filter_list_stream_data(filters, &in, target);
+}
+
+/* a stream that collects everything written to it in a buffer */
+typedef struct {
+	git_writestream parent;
+	git_buf *target;
+	size_t limit;
+	size_t total;
+} buf_stream;
+
+static int buf_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	buf_stream *bs = (buf_stream *)s;
+
+	bs->total += len;
+
+	/* past the limit, only keep count */
+	if (bs->limit && bs->total > bs->limit) {
+		git_buf_free(bs->target);
+		return 0;
+	}
+
+	return git_buf_put(bs->target, buffer, len);
+}
+
+static int buf_stream_close(git_writestream *s)
+{
+	GIT_UNUSED(s);
+	return 0;
+}
+
+static void buf_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
+
+static void buf_stream_init(buf_stream *bs, git_buf *target, size_t limit)
+{
+	memset(bs, 0, sizeof(*bs));
+
+	bs->parent.write = buf_stream_write;
+	bs->parent.close = buf_stream_close;
+	bs->parent.free = buf_stream_free;
+	bs->target = target;
+	bs->limit = limit;
+
+	/* `target` may point to data that it does not own */
+	if (git_buf_is_allocated(target))
+		git_buf_clear(target);
+	else
+		git_buf_init(target, 0);
+}
+
+int git_filter_list__buffer_fd(
+	git_buf *out, size_t *size, git_filter_list *filters, git_file fd)
+{
+	buf_stream writer;
+	int error;
+
+	buf_stream_init(&writer, out, GIT_FILTER_STREAM_LOOKAHEAD);
+
+	if ((error = git_filter_list__stream_fd(filters, fd, &writer.parent)) < 0)
+		return error;
+
+	*size = writer.total;
+	return (writer.total <= GIT_FILTER_STREAM_LOOKAHEAD) ? 1 : 0;
+}
+
+int git_filter_list_apply_to_data(
+	git_buf *tgt, git_filter_list *filters, git_buf *src)
+{
+	buf_stream writer;
+	int error;
+
+	git_buf_sanitize(tgt);
+	git_buf_sanitize(src);
+
+	if (!filters)
+		return filter_list_out_buffer_from_raw(tgt, src->ptr, src->size);
+
+	buf_stream_init(&writer, tgt, 0);
+
+	if ((error = git_filter_list_stream_data(
+			filters, src, &writer.parent)) < 0)
+		tgt->size = 0;
+
+	git_buf_sanitize(tgt);
+	return error;
+}
+
+int git_filter_list_apply_to_file(
+	git_buf *out,
+	git_filter_list *filters,
+	git_repository *repo,
+	const char *path)
+{
+	buf_stream writer;
+	int error;
+
+	buf_stream_init(&writer, out, 0);
+
+	if ((error = git_filter_list_stream_file(
+			filters, repo, path, &writer.parent)) < 0)
+		out->size = 0;
+
+	git_buf_sanitize(out);
+	return error;
+}
+
+int git_filter_list_apply_to_blob(
+	git_buf *out,
+	git_filter_list *filters,
+	git_blob *blob)
+{
+	buf_stream writer;
+	int error;
+
+	buf_stream_init(&writer, out, 0);
+
+	if ((error = git_filter_list_stream_blob(
+			filters, blob, &writer.parent)) < 0)
+		out->size = 0;
+
+	git_buf_sanitize(out);
+	return error;
+}
+
+/*
+ * Streams of the built-in filters, which decide how to convert their data
+ * by looking at all of it.
+ */
+static void lookahead_give_up_head(git_filter_lookahead *la)
+{
+	git_buf_free(&la->head);
+}
+
+static int lookahead_convert(
+	git_filter_lookahead *la, const char *buffer, size_t len)
+{
+	if (!len)
+		return 0;
+
+	if (la->passthrough)
+		return la->next->write(la->next, buffer, len);
+
+	return la->convert(la, buffer, len);
+}
+
+static int lookahead_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	git_filter_lookahead *la = (git_filter_lookahead *)s;
+	size_t wanted;
+	int error;
+
+	if (la->streaming)
+		return lookahead_convert(la, buffer, len);
+
+	/* take just enough to know that the data does not fit */
+	wanted = GIT_FILTER_STREAM_LOOKAHEAD + 1 - la->head.size;
+	if (wanted > len)
+		wanted = len;
+
+	if (git_buf_put(&la->head, buffer, wanted) < 0)
+		return -1;
+
+	if (la->head.size <= GIT_FILTER_STREAM_LOOKAHEAD)
+		return 0;
+
+	la->streaming = 1;
+
+	if ((error = la->start(la, &la->head)) == GIT_PASSTHROUGH) {
+		la->passthrough = 1;
+		error = 0;
+	}
+
+	if (!error)
+		error = lookahead_convert(la, la->head.ptr, la->head.size);
+
+	lookahead_give_up_head(la);
+
+	if (!error)
+		error = lookahead_convert(la, buffer + wanted, len - wanted);
+
+	return error;
+}
+
+static int lookahead_close(git_writestream *s)
+{
+	git_filter_lookahead *la = (git_filter_lookahead *)s;
+	git_buf output = GIT_BUF_INIT, *result = &output;
+	int error = 0;
+
+	if (!la->streaming) {
+		git_buf_sanitize(&la->head);
+
+		if ((error = la->convert_all(la, &output, &la->head)) ==
+				GIT_PASSTHROUGH) {
+			result = &la->head;
+			error = 0;
+		}
+
+		if (!error && result->size > 0)
+			error = la->next->write(la->next, result->ptr, result->size);
+
+		git_buf_free(&output);
+	}
+	else if (!la->passthrough && la->finish)
+		error = la->finish(la);
+
+	if (!error)
+		error = la->next->close(la->next);
+
+	return error;
+}
+
+static void lookahead_free(git_writestream *s)
+{
+	git_filter_lookahead *la = (git_filter_lookahead *)s;
+
+	git_buf_free(&la->head);
+	la->free(la);
+}
+
+void git_filter_lookahead_init(
+	git_filter_lookahead *la, git_writestream *next)
+{
+	la->parent.write = lookahead_write;
+	la->parent.close = lookahead_close;
+	la->parent.free = lookahead_free;
+	la->next = next;
+	git_buf_init(&la->head, 0);
 }
@@ -8,6 +8,9 @@
 #define INCLUDE_filter_h__
 
 #include "common.h"
+#include "buffer.h"
+#include "posix.h"
+#include "attr_file.h"
 #include "git2/filter.h"
 
 /* Amount of file to examine for NUL byte when checking binary-ness */
@@ -23,8 +26,73 @@ typedef enum {
 	GIT_CRLF_AUTO,
 } git_crlf_t;
 
+/* Size of the chunks that files are read in when they are filtered */
+#define GIT_FILTER_STREAM_CHUNK (64 * 1024)
+
+/*
+ * Amount of data that the built-in filters buffer before they start to
+ * convert, so that small files are handled exactly as a whole and large
+ * ones are judged by their beginning.
+ */
+#define GIT_FILTER_STREAM_LOOKAHEAD (1024 * 1024)
+
 extern void git_filter_free(git_filter *filter);
 
+/*
+ * Load the filters for a path like `git_filter_list_load`, looking up
+ * attributes through `attr_session` (may be NULL) so that attribute
+ * files are only checked once for a whole operation.
+ */
+extern int git_filter_list__load_ext(
+	git_filter_list **filters,
+	git_repository *repo,
+	git_blob *blob, /* can be NULL */
+	const char *path,
+	git_filter_mode_t mode,
+	uint32_t options,
+	git_attr_session *attr_session);
+
+/*
+ * Stream the contents of `fd` through the filters into `target`.
+ */
+extern int git_filter_list__stream_fd(
+	git_filter_list *filters, git_file fd, git_writestream *target);
+
+/*
+ * Filter the contents of `fd` into `out` as long as the result is no
+ * larger than GIT_FILTER_STREAM_LOOKAHEAD.  Returns 1 when the output was
+ * buffered, 0 when it was too large, in which case only `size` is set.
+ */
+extern int git_filter_list__buffer_fd(
+	git_buf *out, size_t *size, git_filter_list *filters, git_file fd);
+
+/*
+ * A write stream for filters that need to see the beginning of their
+ * input before they know how to convert it.  Input that fits in the
+ * lookahead is given to `convert_all` in one piece; for longer input
+ * `start` is called with the first part, then everything is passed to
+ * `convert` in chunks and `finish` is called at the end.  `start` and
+ * `convert_all` may return GIT_PASSTHROUGH to leave the data untouched.
+ */
+typedef struct git_filter_lookahead git_filter_lookahead;
+
+struct git_filter_lookahead {
+	git_writestream parent;
+	git_writestream *next;
+	git_buf head;
+	int streaming;
+	int passthrough;
+
+	int (*convert_all)(git_filter_lookahead *la, git_buf *to, const git_buf *from);
+	int (*start)(git_filter_lookahead *la, const git_buf *head);
+	int (*convert)(git_filter_lookahead *la, const char *buffer, size_t len);
+	int (*finish)(git_filter_lookahead *la);
+	void (*free)(git_filter_lookahead *la);
+};
+
+extern void git_filter_lookahead_init(
+	git_filter_lookahead *la, git_writestream *next);
+
 /*
  * Available filters
  */
@@ -0,0 +1,663 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "git2/attr.h"
+#include "git2/config.h"
+#include "git2/sys/filter.h"
+
+#include "common.h"
+#include "filter.h"
+#include "filter_process.h"
+#include "process.h"
+#include "repository.h"
+#include "vector.h"
+
+/*
+ * A filter driver configured with `filter.<driver>.process` is a long
+ * running program that is started once and then asked to clean or smudge
+ * one file after another, using the pkt-line protocol of core Git's
+ * long-running filter processes (version 2).
+ */
+
+#define PKT_HEADER_LEN 4
+#define PKT_MAX_LEN 65520
+#define PKT_MAX_DATA (PKT_MAX_LEN - PKT_HEADER_LEN)
+
+enum {
+	FILTER_PROCESS_CLEAN  = (1u << 0),
+	FILTER_PROCESS_SMUDGE = (1u << 1),
+};
+
+typedef struct {
+	git_refcount rc;
+	char *name;
+	char *command;
+	git_process *process;
+	unsigned int capabilities;
+	int broken;
+	git_mutex lock;
+} filter_process;
+
+struct git_filter_process_registry {
+	git_mutex lock;
+	git_vector processes;
+};
+
+typedef struct {
+	filter_process *fp;
+	int required;
+} filter_process_payload;
+
+static int pkt_write_line(git_buf *buf, const char *format, ...)
+{
+	git_buf line = GIT_BUF_INIT;
+	va_list ap;
+	int error;
+
+	va_start(ap, format);
+	error = git_buf_vprintf(&line, format, ap);
+	va_end(ap);
+
+	if (!error && line.size + 1 > PKT_MAX_DATA) {
+		giterr_set(GITERR_FILTER, "Line is too long for a packet");
+		error = -1;
+	}
+
+	if (!error)
+		error = git_buf_printf(buf, "%04x%s\n",
+			(unsigned int)(line.size + 1 + PKT_HEADER_LEN), line.ptr);
+
+	git_buf_free(&line);
+	return error;
+}
+
+static int pkt_write_flush(git_buf *buf)
+{
+	return git_buf_put(buf, "0000", PKT_HEADER_LEN);
+}
+
+static int pkt_send_content(filter_process *fp, const git_buf *content)
+{
+	char header[PKT_HEADER_LEN + 1];
+	const char *scan = content->ptr, *end = content->ptr + content->size;
+	size_t len;
+	int error = 0;
+
+	while (scan < end && !error) {
+		len = min((size_t)(end - scan), PKT_MAX_DATA);
+		p_snprintf(header, sizeof(header), "%04x",
+			(unsigned int)(len + PKT_HEADER_LEN));
+
+		if (!(error = git_process_write(fp->process, header, PKT_HEADER_LEN)))
+			error = git_process_write(fp->process, scan, len);
+
+		scan += len;
+	}
+
+	if (!error)
+		error = git_process_write(fp->process, "0000", PKT_HEADER_LEN);
+
+	return error;
+}
+
+static int pkt_read_exact(filter_process *fp, char *buf, size_t len)
+{
+	ssize_t read_len;
+
+	while (len > 0) {
+		if ((read_len = git_process_read(fp->process, buf, len)) < 0)
+			return -1;
+
+		if (read_len == 0) {
+			giterr_set(GITERR_FILTER,
+				"Filter process '%s' exited unexpectedly", fp->command);
+			return -1;
+		}
+
+		buf += read_len;
+		len -= (size_t)read_len;
+	}
+
+	return 0;
+}
+
+/* Read a packet and append it to `out`; a flush packet sets `flush` */
+static int pkt_read(git_buf *out, int *flush, filter_process *fp)
+{
+	char header[PKT_HEADER_LEN];
+	size_t len = 0, i;
+	int digit;
+
+	if (pkt_read_exact(fp, header, PKT_HEADER_LEN) < 0)
+		return -1;
+
+	for (i = 0; i < PKT_HEADER_LEN; ++i) {
+		if ((digit = git__fromhex(header[i])) < 0)
+			goto invalid;
+		len = (len << 4) | (size_t)digit;
+	}
+
+	*flush = (len == 0);
+	if (*flush)
+		return 0;
+
+	if (len <= PKT_HEADER_LEN)
+		goto invalid;
+
+	len -= PKT_HEADER_LEN;
+
+	if (git_buf_grow(out, out->size + len + 1) < 0 ||
+		pkt_read_exact(fp, out->ptr + out->size, len) < 0)
+		return -1;
+
+	out->size += len;
+	out->ptr[out->size] = '\0';
+	return 0;
+
+invalid:
+	giterr_set(GITERR_FILTER,
+		"Invalid packet from filter process '%s'", fp->command);
+	return -1;
+}
+
+static int pkt_read_line(git_buf *line, int *flush, filter_process *fp)
+{
+	git_buf_clear(line);
+
+	if (pkt_read(line, flush, fp) < 0)
+		return -1;
+
+	git_buf_rtrim(line);
+	return 0;
+}
+
+/* Read a list of `key=value` lines up to a flush, keeping the status */
+static int read_status(git_buf *status, filter_process *fp)
+{
+	git_buf line = GIT_BUF_INIT;
+	int flush = 0, error = 0;
+
+	while (!flush && !(error = pkt_read_line(&line, &flush, fp))) {
+		if (!flush && !git__prefixcmp(line.ptr, "status="))
+			error = git_buf_sets(status, line.ptr + strlen("status="));
+	}
+
+	git_buf_free(&line);
+	return error;
+}
+
+static void filter_process_stop(filter_process *fp)
+{
+	git_process_free(fp->process);
+	fp->process = NULL;
+}
+
+static int filter_process_handshake(filter_process *fp)
+{
+	git_buf buf = GIT_BUF_INIT, line = GIT_BUF_INIT;
+	int flush = 0, version = 0, error;
+
+	if ((error = pkt_write_line(&buf, "git-filter-client")) < 0 ||
+		(error = pkt_write_line(&buf, "version=2")) < 0 ||
+		(error = pkt_write_flush(&buf)) < 0 ||
+		(error = git_process_write(fp->process, buf.ptr, buf.size)) < 0 ||
+		(error = pkt_read_line(&line, &flush, fp)) < 0)
+		goto done;
+
+	if (flush || strcmp(line.ptr, "git-filter-server") != 0) {
+		giterr_set(GITERR_FILTER,
+			"Filter process '%s' is not a filter server", fp->command);
+		error = -1;
+		goto done;
+	}
+
+	while (!(error = pkt_read_line(&line, &flush, fp)) && !flush) {
+		if (!strcmp(line.ptr, "version=2"))
+			version = 2;
+	}
+
+	if (error < 0)
+		goto done;
+
+	if (version != 2) {
+		giterr_set(GITERR_FILTER,
+			"Filter process '%s' does not speak protocol version 2",
+			fp->command);
+		error = -1;
+		goto done;
+	}
+
+	git_buf_clear(&buf);
+
+	if ((error = pkt_write_line(&buf, "capability=clean")) < 0 ||
+		(error = pkt_write_line(&buf, "capability=smudge")) < 0 ||
+		(error = pkt_write_flush(&buf)) < 0 ||
+		(error = git_process_write(fp->process, buf.ptr, buf.size)) < 0)
+		goto done;
+
+	while (!(error = pkt_read_line(&line, &flush, fp)) && !flush) {
+		if (!strcmp(line.ptr, "capability=clean"))
+			fp->capabilities |= FILTER_PROCESS_CLEAN;
+		else if (!strcmp(line.ptr, "capability=smudge"))
+			fp->capabilities |= FILTER_PROCESS_SMUDGE;
+	}
+
+done:
+	git_buf_free(&buf);
+	git_buf_free(&line);
+	return error;
+}
+
+static int filter_process_start(filter_process *fp, git_repository *repo)
+{
+	const char *workdir = git_repository_workdir(repo);
+	int error;
+
+	if ((error = git_process_new(&fp->process, fp->command, workdir)) < 0 ||
+		(error = filter_process_handshake(fp)) < 0) {
+		filter_process_stop(fp);
+		fp->broken = 1;
+	}
+
+	return error;
+}
+
+static void filter_process_free(filter_process *fp)
+{
+	if (!fp)
+		return;
+
+	/* the process exits when it reads the end of its input */
+	filter_process_stop(fp);
+
+	git_mutex_free(&fp->lock);
+	git__free(fp->name);
+	git__free(fp->command);
+	git__free(fp);
+}
+
+static filter_process *filter_process_new(const char *name, const char *command)
+{
+	filter_process *fp = git__calloc(1, sizeof(filter_process));
+	if (!fp)
+		return NULL;
+
+	if (git_mutex_init(&fp->lock) < 0 ||
+		(fp->name = git__strdup(name)) == NULL ||
+		(fp->command = git__strdup(command)) == NULL) {
+		filter_process_free(fp);
+		return NULL;
+	}
+
+	/* the reference of the registry */
+	GIT_REFCOUNT_INC(fp);
+	return fp;
+}
+
+/* Filter lists hold the process too, so it outlives a configuration change */
+static void filter_process_release(filter_process *fp)
+{
+	if (fp)
+		GIT_REFCOUNT_DEC(fp, filter_process_free);
+}
+
+void git_filter_process_registry_free(git_filter_process_registry *reg)
+{
+	filter_process *fp;
+	size_t i;
+
+	if (!reg)
+		return;
+
+	git_vector_foreach(&reg->processes, i, fp)
+		filter_process_release(fp);
+
+	git_vector_free(&reg->processes);
+	git_mutex_free(&reg->lock);
+	git__free(reg);
+}
+
+static git_filter_process_registry *filter_process_registry_new(void)
+{
+	git_filter_process_registry *reg =
+		git__calloc(1, sizeof(git_filter_process_registry));
+	if (!reg)
+		return NULL;
+
+	if (git_mutex_init(&reg->lock) < 0 ||
+		git_vector_init(&reg->processes, 0, NULL) < 0) {
+		git_filter_process_registry_free(reg);
+		return NULL;
+	}
+
+	return reg;
+}
+
+static git_filter_process_registry *filter_process_registry(
+	git_repository *repo)
+{
+	if (!repo->filter_processes) {
+		git_filter_process_registry *reg = filter_process_registry_new();
+		reg = git__compare_and_swap(&repo->filter_processes, NULL, reg);
+
+		if (reg != NULL) /* if we race, free losing allocation */
+			git_filter_process_registry_free(reg);
+	}
+
+	if (!repo->filter_processes)
+		giterr_set(GITERR_REPOSITORY,
+			"Unable to create filter process registry");
+
+	return repo->filter_processes;
+}
+
+/* Find the running process for a driver, starting it on first use */
+static int filter_process_lookup(
+	filter_process **out,
+	git_repository *repo,
+	const char *name,
+	const char *command)
+{
+	git_filter_process_registry *reg;
+	filter_process *fp = NULL;
+	size_t i;
+	int error = 0;
+
+	if ((reg = filter_process_registry(repo)) == NULL)
+		return -1;
+
+	if (git_mutex_lock(&reg->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock filter process registry");
+		return -1;
+	}
+
+	git_vector_foreach(&reg->processes, i, fp) {
+		if (!strcmp(fp->name, name))
+			break;
+		fp = NULL;
+	}
+
+	/* the configuration changed since the process was started */
+	if (fp && strcmp(fp->command, command) != 0) {
+		git_vector_remove(&reg->processes, i);
+		filter_process_release(fp);
+		fp = NULL;
+	}
+
+	if (!fp) {
+		if ((fp = filter_process_new(name, command)) == NULL ||
+			git_vector_insert(&reg->processes, fp) < 0) {
+			filter_process_release(fp);
+			fp = NULL;
+			error = -1;
+		} else
+			error = filter_process_start(fp, repo);
+	} else {
+		git_mutex_lock(&fp->lock);
+		if (fp->broken) {
+			giterr_set(GITERR_FILTER,
+				"Filter process '%s' is not running", fp->command);
+			error = -1;
+		}
+		git_mutex_unlock(&fp->lock);
+	}
+
+	if (!error)
+		GIT_REFCOUNT_INC(fp);
+
+	git_mutex_unlock(&reg->lock);
+
+	*out = error < 0 ? NULL : fp;
+	return error;
+}
+
+static int filter_process_config(
+	git_buf *command, int *required, git_repository *repo, const char *name)
+{
+	git_config *cfg;
+	git_buf key = GIT_BUF_INIT;
+	const char *value;
+	int error;
+
+	*required = 0;
+
+	if ((error = git_repository_config__weakptr(&cfg, repo)) < 0 ||
+		(error = git_buf_printf(&key, "filter.%s.process", name)) < 0)
+		goto done;
+
+	if ((error = git_config_get_string(&value, cfg, key.ptr)) < 0 ||
+		(error = git_buf_sets(command, value)) < 0)
+		goto done;
+
+	git_buf_clear(&key);
+	if ((error = git_buf_printf(&key, "filter.%s.required", name)) < 0)
+		goto done;
+
+	if ((error = git_config_get_bool(required, cfg, key.ptr)) == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	}
+
+done:
+	git_buf_free(&key);
+	return error;
+}
+
+static unsigned int filter_process_capability(const git_filter_source *src)
+{
+	return (git_filter_source_mode(src) == GIT_FILTER_SMUDGE) ?
+		FILTER_PROCESS_SMUDGE : FILTER_PROCESS_CLEAN;
+}
+
+static int filter_process_check(
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	const char **attr_values)
+{
+	git_repository *repo = git_filter_source_repo(src);
+	const char *name = attr_values ? attr_values[0] : NULL;
+	git_buf command = GIT_BUF_INIT;
+	filter_process_payload *fpp;
+	filter_process *fp;
+	unsigned int capabilities;
+	int required, error;
+
+	GIT_UNUSED(self);
+
+	if (!repo || !GIT_ATTR_HAS_VALUE(name))
+		return GIT_PASSTHROUGH;
+
+	if ((error = filter_process_config(
+			&command, &required, repo, name)) == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = GIT_PASSTHROUGH;
+	}
+
+	if (!error)
+		error = filter_process_lookup(&fp, repo, name, command.ptr);
+
+	git_buf_free(&command);
+
+	/* a driver that is not required may be missing */
+	if (error < 0 && error != GIT_PASSTHROUGH && !required) {
+		giterr_clear();
+		error = GIT_PASSTHROUGH;
+	}
+
+	if (error < 0)
+		return error;
+
+	/* filter_process_failed drops capabilities while holding the lock */
+	if (git_mutex_lock(&fp->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock filter process");
+		filter_process_release(fp);
+		return -1;
+	}
+
+	capabilities = fp->capabilities;
+	git_mutex_unlock(&fp->lock);
+
+	if (!(capabilities & filter_process_capability(src))) {
+		filter_process_release(fp);
+		return GIT_PASSTHROUGH;
+	}
+
+	if ((fpp = git__malloc(sizeof(filter_process_payload))) == NULL) {
+		filter_process_release(fp);
+		return -1;
+	}
+
+	fpp->fp = fp;
+	fpp->required = required;
+
+	*payload = fpp;
+	return 0;
+}
+
+static int filter_process_failed(
+	filter_process *fp, const git_buf *status, const git_filter_source *src)
+{
+	/* the process does not want to do this again in this session */
+	if (!strcmp(status->ptr, "abort"))
+		fp->capabilities &= ~filter_process_capability(src);
+
+	giterr_set(GITERR_FILTER, "Filter process '%s' failed to %s '%s'",
+		fp->command,
+		git_filter_source_mode(src) == GIT_FILTER_SMUDGE ? "smudge" : "clean",
+		git_filter_source_path(src));
+	return -1;
+}
+
+static int filter_process_run(
+	filter_process *fp,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *src)
+{
+	const git_oid *id = git_filter_source_id(src);
+	git_buf request = GIT_BUF_INIT, status = GIT_BUF_INIT;
+	int flush = 0, error;
+
+	if (fp->broken || !fp->process) {
+		giterr_set(GITERR_FILTER,
+			"Filter process '%s' is not running", fp->command);
+		return -1;
+	}
+
+	if (!(fp->capabilities & filter_process_capability(src)))
+		return filter_process_failed(fp, &status, src);
+
+	if ((error = pkt_write_line(&request, "command=%s",
+			git_filter_source_mode(src) == GIT_FILTER_SMUDGE ?
+			"smudge" : "clean")) < 0 ||
+		(error = pkt_write_line(&request, "pathname=%s",
+			git_filter_source_path(src))) < 0)
+		goto done;
+
+	if (id && !git_oid_iszero(id)) {
+		char oid[GIT_OID_HEXSZ + 1];
+		git_oid_tostr(oid, sizeof(oid), id);
+
+		if ((error = pkt_write_line(&request, "blob=%s", oid)) < 0)
+			goto done;
+	}
+
+	if ((error = pkt_write_flush(&request)) < 0)
+		goto done;
+
+	/* the whole request is sent before the response is read */
+	if ((error = git_process_write(
+			fp->process, request.ptr, request.size)) < 0 ||
+		(error = pkt_send_content(fp, from)) < 0 ||
+		(error = read_status(&status, fp)) < 0)
+		goto broken;
+
+	if (strcmp(status.ptr, "success") != 0) {
+		error = filter_process_failed(fp, &status, src);
+		goto done;
+	}
+
+	git_buf_clear(to);
+
+	while (!(error = pkt_read(to, &flush, fp)) && !flush)
+		/* read content */;
+
+	/* an empty list leaves the status as it was */
+	if (error < 0 || (error = read_status(&status, fp)) < 0)
+		goto broken;
+
+	if (strcmp(status.ptr, "success") != 0)
+		error = filter_process_failed(fp, &status, src);
+
+	goto done;
+
+broken:
+	filter_process_stop(fp);
+	fp->broken = 1;
+
+done:
+	git_buf_free(&request);
+	git_buf_free(&status);
+	return error;
+}
+
+static int filter_process_apply(
+	git_filter *self,
+	void **payload,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *src)
+{
+	filter_process_payload *fpp = *payload;
+	int error;
+
+	GIT_UNUSED(self);
+
+	if (git_mutex_lock(&fpp->fp->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock filter process");
+		return -1;
+	}
+
+	error = filter_process_run(fpp->fp, to, from, src);
+
+	git_mutex_unlock(&fpp->fp->lock);
+
+	if (error < 0 && !fpp->required) {
+		giterr_clear();
+		error = GIT_PASSTHROUGH;
+	}
+
+	return error;
+}
+
+static void filter_process_cleanup(git_filter *self, void *payload)
+{
+	filter_process_payload *fpp = payload;
+
+	GIT_UNUSED(self);
+
+	if (fpp)
+		filter_process_release(fpp->fp);
+	git__free(fpp);
+}
+
+git_filter *git_filter_process_filter_new(void)
+{
+	git_filter *f = git__calloc(1, sizeof(git_filter));
+	if (!f)
+		return NULL;
+
+	f->version = GIT_FILTER_VERSION;
+	f->attributes = "filter";
+	f->shutdown = git_filter_free;
+	f->check    = filter_process_check;
+	f->apply    = filter_process_apply;
+	f->cleanup  = filter_process_cleanup;
+
+	return f;
+}
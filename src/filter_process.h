@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_filter_process_h__
+#define INCLUDE_filter_process_h__
+
+#include "common.h"
+#include "git2/filter.h"
+
+/*
+ * The filter processes that a repository has started for the drivers
+ * named by `filter.<driver>.process`; they are stopped when the
+ * repository is freed.
+ */
+typedef struct git_filter_process_registry git_filter_process_registry;
+
+extern void git_filter_process_registry_free(git_filter_process_registry *reg);
+
+extern git_filter *git_filter_process_filter_new(void);
+
+#endif
@@ -112,6 +112,190 @@ static int ident_apply(
 		return ident_remove_id(to, from);
 }
 
+/*
+ * Streaming replacement for content too large to be examined as a whole.
+ * The first "$Id" and whatever follows it up to the next '$' are held back
+ * until it is known whether they form a keyword.
+ */
+enum {
+	IDENT_STREAM_SEARCH = 0,
+	IDENT_STREAM_DOLLAR,
+	IDENT_STREAM_DOLLAR_I,
+	IDENT_STREAM_IN_ID,
+	IDENT_STREAM_DONE,
+};
+
+struct ident_stream {
+	git_filter_lookahead parent;
+	git_filter *filter;
+	const git_filter_source *src;
+	int state;
+	git_buf held;
+};
+
+static int ident_stream_convert_all(
+	git_filter_lookahead *la, git_buf *to, const git_buf *from)
+{
+	struct ident_stream *stream = (struct ident_stream *)la;
+	return ident_apply(stream->filter, NULL, to, from, stream->src);
+}
+
+static int ident_stream_start(git_filter_lookahead *la, const git_buf *head)
+{
+	struct ident_stream *stream = (struct ident_stream *)la;
+
+	/* Don't filter binary files */
+	if (git_buf_text_is_binary(head))
+		return GIT_PASSTHROUGH;
+
+	if (git_filter_source_mode(stream->src) == GIT_FILTER_SMUDGE &&
+		!git_filter_source_id(stream->src))
+		return GIT_PASSTHROUGH;
+
+	return 0;
+}
+
+static int ident_stream_release(struct ident_stream *stream)
+{
+	int error = 0;
+
+	if (stream->held.size > 0)
+		error = stream->parent.next->write(
+			stream->parent.next, stream->held.ptr, stream->held.size);
+
+	git_buf_clear(&stream->held);
+	return error;
+}
+
+static int ident_stream_replace(struct ident_stream *stream)
+{
+	git_writestream *next = stream->parent.next;
+	char oid[GIT_OID_HEXSZ+1];
+
+	git_buf_clear(&stream->held);
+
+	if (git_filter_source_mode(stream->src) != GIT_FILTER_SMUDGE)
+		return next->write(next, "$Id$", 4);
+
+	git_oid_tostr(oid, sizeof(oid), git_filter_source_id(stream->src));
+
+	if (git_buf_put(&stream->held, "$Id: ", 5) < 0 ||
+		git_buf_put(&stream->held, oid, GIT_OID_HEXSZ) < 0 ||
+		git_buf_putc(&stream->held, '$') < 0)
+		return -1;
+
+	return ident_stream_release(stream);
+}
+
+static int ident_stream_convert(
+	git_filter_lookahead *la, const char *buffer, size_t len)
+{
+	struct ident_stream *stream = (struct ident_stream *)la;
+	const char *end = buffer + len, *found;
+	int error = 0;
+
+	while (buffer < end && !error) {
+		switch (stream->state) {
+		case IDENT_STREAM_SEARCH:
+			if ((found = memchr(buffer, '$', end - buffer)) == NULL)
+				found = end;
+
+			if (found > buffer)
+				error = la->next->write(
+					la->next, buffer, (size_t)(found - buffer));
+
+			if (found < end) {
+				error = error ? error : git_buf_putc(&stream->held, '$');
+				stream->state = IDENT_STREAM_DOLLAR;
+				found++;
+			}
+
+			buffer = found;
+			break;
+
+		case IDENT_STREAM_DOLLAR:
+		case IDENT_STREAM_DOLLAR_I:
+			if (*buffer != (stream->state == IDENT_STREAM_DOLLAR ? 'I' : 'd')) {
+				/* not a keyword; look at this byte again */
+				error = ident_stream_release(stream);
+				stream->state = IDENT_STREAM_SEARCH;
+				break;
+			}
+
+			error = git_buf_putc(&stream->held, *buffer++);
+			stream->state++;
+			break;
+
+		case IDENT_STREAM_IN_ID:
+			if ((found = memchr(buffer, '$', end - buffer)) == NULL) {
+				error = git_buf_put(
+					&stream->held, buffer, (size_t)(end - buffer));
+				buffer = end;
+
+				/* a keyword this long is not going to be closed */
+				if (!error &&
+					stream->held.size > GIT_FILTER_STREAM_LOOKAHEAD) {
+					error = ident_stream_release(stream);
+					stream->state = IDENT_STREAM_DONE;
+				}
+				break;
+			}
+
+			error = ident_stream_replace(stream);
+			stream->state = IDENT_STREAM_DONE;
+			buffer = found + 1;
+			break;
+
+		default:
+			error = la->next->write(la->next, buffer, (size_t)(end - buffer));
+			buffer = end;
+			break;
+		}
+	}
+
+	return error;
+}
+
+static int ident_stream_finish(git_filter_lookahead *la)
+{
+	return ident_stream_release((struct ident_stream *)la);
+}
+
+static void ident_stream_free(git_filter_lookahead *la)
+{
+	struct ident_stream *stream = (struct ident_stream *)la;
+
+	git_buf_free(&stream->held);
+	git__free(stream);
+}
+
+static int ident_stream(
+	git_writestream **out,
+	git_filter *self,
+	void **payload,
+	const git_filter_source *src,
+	git_writestream *next)
+{
+	struct ident_stream *stream;
+
+	GIT_UNUSED(payload);
+
+	stream = git__calloc(1, sizeof(struct ident_stream));
+	GITERR_CHECK_ALLOC(stream);
+
+	git_filter_lookahead_init(&stream->parent, next);
+	stream->parent.convert_all = ident_stream_convert_all;
+	stream->parent.start = ident_stream_start;
+	stream->parent.convert = ident_stream_convert;
+	stream->parent.finish = ident_stream_finish;
+	stream->parent.free = ident_stream_free;
+	stream->filter = self;
+	stream->src = src;
+
+	*out = (git_writestream *)stream;
+	return 0;
+}
+
 git_filter *git_ident_filter_new(void)
 {
 	git_filter *f = git__calloc(1, sizeof(git_filter));
@@ -120,6 +304,7 @@ git_filter *git_ident_filter_new(void)
 	f->attributes = "+ident"; /* apply to files with ident attribute set */
 	f->shutdown = git_filter_free;
 	f->apply    = ident_apply;
+	f->stream   = ident_stream;
 
 	return f;
 }
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_idxmap_h__
+#define INCLUDE_idxmap_h__
+
+#include <ctype.h>
+#include "common.h"
+
+#define kmalloc git__malloc
+#define kcalloc git__calloc
+#define krealloc git__realloc
+#define kfree git__free
+#include "khash.h"
+
+/*
+ * Maps from a path and a stage to a value, used by the index to look up
+ * its entries (and the directories that contain them) by name.  The keys
+ * do not own their path, which need not be NUL terminated.
+ */
+typedef struct {
+	const char *path;
+	size_t path_len;
+	int stage;
+} git_idxmap_key;
+
+__KHASH_TYPE(idx, git_idxmap_key, void *);
+__KHASH_TYPE(idxicase, git_idxmap_key, void *);
+
+typedef khash_t(idx) git_idxmap;
+typedef khash_t(idxicase) git_idxmap_icase;
+typedef khiter_t git_idxmap_iter;
+
+/* the X31 string hash, case folded so both map kinds can share it */
+GIT_INLINE(khint_t) git_idxmap_hash(git_idxmap_key key)
+{
+	khint_t h = (khint_t)key.stage;
+	size_t i;
+
+	for (i = 0; i < key.path_len; ++i)
+		h = (h << 5) - h + (khint_t)tolower((unsigned char)key.path[i]);
+
+	return h;
+}
+
+#define git_idxmap_equal(a, b) \
+	((a).stage == (b).stage && (a).path_len == (b).path_len && \
+	 !memcmp((a).path, (b).path, (a).path_len))
+
+#define git_idxmap_icase_equal(a, b) \
+	((a).stage == (b).stage && (a).path_len == (b).path_len && \
+	 !strncasecmp((a).path, (b).path, (a).path_len))
+
+#define GIT__USE_IDXMAP \
+	__KHASH_IMPL(idx, static kh_inline, git_idxmap_key, void *, 1, \
+		git_idxmap_hash, git_idxmap_equal)
+
+#define GIT__USE_IDXMAP_ICASE \
+	__KHASH_IMPL(idxicase, static kh_inline, git_idxmap_key, void *, 1, \
+		git_idxmap_hash, git_idxmap_icase_equal)
+
+#endif
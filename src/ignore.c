@@ -62,6 +62,9 @@ static int parse_ignore_file(
 		}
 	}
 
+	if (!error)
+		error = git_attr_file__compile(attrs);
+
 	git_mutex_unlock(&attrs->lock);
 	git__free(match);
 
@@ -78,7 +81,7 @@ static int push_ignore_file(
 	git_attr_file *file = NULL;
 
 	error = git_attr_cache__get(
-		&file, ignores->repo, GIT_ATTR_FILE__FROM_FILE,
+		&file, ignores->repo, NULL, GIT_ATTR_FILE__FROM_FILE,
 		base, filename, parse_ignore_file);
 	if (error < 0)
 		return error;
@@ -106,7 +109,8 @@ static int get_internal_ignores(git_attr_file **out, git_repository *repo)
 		return error;
 
 	error = git_attr_cache__get(
-		out, repo, GIT_ATTR_FILE__IN_MEMORY, NULL, GIT_IGNORE_INTERNAL, NULL);
+		out, repo, NULL, GIT_ATTR_FILE__IN_MEMORY, NULL, GIT_IGNORE_INTERNAL,
+		NULL);
 
 	/* if internal rules list is empty, insert default rules */
 	if (!error && !(*out)->rules.length)
@@ -250,10 +254,12 @@ void git_ignore__free(git_ignores *ignores)
 static bool ignore_lookup_in_rules(
 	int *ignored, git_attr_file *file, git_attr_path *path)
 {
-	size_t j;
+	git_attr_file_iter iter;
 	git_attr_fnmatch *match;
 
-	git_vector_rforeach(&file->rules, j, match) {
+	git_attr_file__iter_init(&iter, file, path);
+
+	while ((match = git_attr_file__iter_next(&iter)) != NULL) {
 		if (git_attr_fnmatch__match(match, path)) {
 			*ignored = ((match->flags & GIT_ATTR_FNMATCH_NEGATIVE) == 0) ?
 				GIT_IGNORE_TRUE : GIT_IGNORE_FALSE;
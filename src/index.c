@@ -17,6 +17,9 @@
 #include "pathspec.h"
 #include "ignore.h"
 #include "blob.h"
+#include "pool.h"
+#include "varint.h"
+#include "workers.h"
 
 #include "git2/odb.h"
 #include "git2/oid.h"
@@ -35,14 +38,48 @@ static const size_t INDEX_HEADER_SIZE = 12;
 
 static const unsigned int INDEX_VERSION_NUMBER = 2;
 static const unsigned int INDEX_VERSION_NUMBER_EXT = 3;
+static const unsigned int INDEX_VERSION_NUMBER_COMP = 4;
+
+#define INDEX_VERSION_NUMBER_LB 2
+#define INDEX_VERSION_NUMBER_UB 4
+#define INDEX_VERSION_NUMBER_DEFAULT 2
 
 static const unsigned int INDEX_HEADER_SIG = 0x44495243;
 static const char INDEX_EXT_TREECACHE_SIG[] = {'T', 'R', 'E', 'E'};
 static const char INDEX_EXT_UNMERGED_SIG[] = {'R', 'E', 'U', 'C'};
 static const char INDEX_EXT_CONFLICT_NAME_SIG[] = {'N', 'A', 'M', 'E'};
+static const char INDEX_EXT_END_OF_ENTRIES_SIG[] = {'E', 'O', 'I', 'E'};
+static const char INDEX_EXT_ENTRY_OFFSETS_SIG[] = {'I', 'E', 'O', 'T'};
+static const char INDEX_EXT_LINK_SIG[] = {'l', 'i', 'n', 'k'};
+
+static const size_t INDEX_EXT_HEADER_SIZE = 8;
+static const size_t INDEX_EOIE_SIZE = 4 + GIT_OID_RAWSZ;
+static const uint32_t INDEX_IEOT_VERSION = 1;
+
+/* roughly how many entries make it worth spinning up another thread */
+#define INDEX_ENTRIES_PER_THREAD 10000
+
+/* likewise for files to hash when adding them to the index */
+#define INDEX_FILES_PER_THREAD 64
+
+/* how many files add_all and update_all hash before adding them */
+#define INDEX_ADD_BATCH_SIZE 4096
+
+/* size of the pages entries read from disk are carved out of */
+#define INDEX_ARENA_PAGE_SIZE (64 * 1024)
+
+/* How long a replaced shared index is kept for readers of older split
+ * indexes, like git's default "2.weeks.ago" */
+#define INDEX_SHARED_EXPIRE_DEFAULT (14 * 24 * 60 * 60)
+
+/* number of threads used to load the index; 0 picks automatically */
+unsigned int git_index__threads = 0;
 
 #define INDEX_OWNER(idx) ((git_repository *)(GIT_REFCOUNT_OWNER(idx)))
 
+GIT__USE_IDXMAP
+GIT__USE_IDXMAP_ICASE
+
 struct index_header {
 	uint32_t signature;
 	uint32_t version;
@@ -97,9 +134,16 @@ struct entry_srch_key {
 struct entry_internal {
 	git_index_entry entry;
 	size_t pathlen;
+	unsigned int in_arena:1;
+	unsigned int removing:1; /* dropped when a batch is committed */
 	char path[GIT_FLEX_ARRAY];
 };
 
+struct index_entry_block {
+	uint32_t offset;
+	uint32_t nr;
+};
+
 struct reuc_entry_internal {
 	git_index_reuc_entry entry;
 	size_t pathlen;
@@ -107,15 +151,17 @@ struct reuc_entry_internal {
 };
 
 /* local declarations */
+static int index_error_invalid(const char *message);
 static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size);
 static int read_header(struct index_header *dest, const void *buffer);
 
 static int parse_index(git_index *index, const char *buffer, size_t buffer_size);
-static bool is_index_extended(git_index *index);
-static int write_index(git_index *index, git_filebuf *file);
+static int index_read_split(git_index *index);
+static int write_index(git_index *index);
 
 static void index_entry_free(git_index_entry *entry);
 static void index_entry_reuc_free(git_index_reuc_entry *reuc);
+static void index_split_link_free(struct index_split_link *link);
 
 int git_index_entry_srch(const void *key, const void *array_member)
 {
@@ -292,8 +338,33 @@ static void index_entry_reuc_free(git_index_reuc_entry *reuc)
 
 static void index_entry_free(git_index_entry *entry)
 {
+	if (!entry)
+		return;
+
 	memset(&entry->id, 0, sizeof(entry->id));
-	git__free(entry);
+
+	/* entries read from disk are released along with their arena */
+	if (!((struct entry_internal *)entry)->in_arena)
+		git__free(entry);
+}
+
+static git_pool *index_arena_new(void)
+{
+	git_pool *arena = git__calloc(1, sizeof(git_pool));
+
+	if (arena != NULL)
+		git_pool_init(arena, 1, INDEX_ARENA_PAGE_SIZE);
+
+	return arena;
+}
+
+static void index_arena_free(git_pool *arena)
+{
+	if (!arena)
+		return;
+
+	git_pool_clear(arena);
+	git__free(arena);
 }
 
 unsigned int git_index__create_mode(unsigned int mode)
@@ -365,8 +436,227 @@ GIT_INLINE(int) index_find(
 		out, &index->entries, index->entries_search, path, path_len, stage);
 }
 
+GIT_INLINE(git_idxmap_key) index_map_key(
+	const char *path, size_t path_len, int stage)
+{
+	git_idxmap_key key;
+	key.path = path;
+	key.path_len = path_len;
+	key.stage = stage;
+	return key;
+}
+
+/* The maps of a case insensitive index fold the case of their keys */
+static void **index_map_get(git_index *index, git_idxmap *map, git_idxmap_key key)
+{
+	khiter_t pos;
+
+	if (index->ignore_case) {
+		git_idxmap_icase *imap = (git_idxmap_icase *)map;
+		pos = kh_get(idxicase, imap, key);
+		return (pos != kh_end(imap)) ? &kh_val(imap, pos) : NULL;
+	}
+
+	pos = kh_get(idx, map, key);
+	return (pos != kh_end(map)) ? &kh_val(map, pos) : NULL;
+}
+
+static void **index_map_put(git_index *index, git_idxmap *map, git_idxmap_key key)
+{
+	khiter_t pos;
+	int rval;
+
+	if (index->ignore_case) {
+		git_idxmap_icase *imap = (git_idxmap_icase *)map;
+		pos = kh_put(idxicase, imap, key, &rval);
+		if (rval < 0)
+			return NULL;
+		if (rval > 0)
+			kh_val(imap, pos) = NULL;
+		return &kh_val(imap, pos);
+	}
+
+	pos = kh_put(idx, map, key, &rval);
+	if (rval < 0)
+		return NULL;
+	if (rval > 0)
+		kh_val(map, pos) = NULL;
+	return &kh_val(map, pos);
+}
+
+static void index_map_del(git_index *index, git_idxmap *map, git_idxmap_key key)
+{
+	khiter_t pos;
+
+	if (index->ignore_case) {
+		git_idxmap_icase *imap = (git_idxmap_icase *)map;
+		if ((pos = kh_get(idxicase, imap, key)) != kh_end(imap))
+			kh_del(idxicase, imap, pos);
+	} else if ((pos = kh_get(idx, map, key)) != kh_end(map))
+		kh_del(idx, map, pos);
+}
+
+static git_idxmap *index_map_alloc(git_index *index, size_t size)
+{
+	git_idxmap *map;
+
+	if (index->ignore_case) {
+		git_idxmap_icase *imap = kh_init(idxicase);
+		if (imap)
+			kh_resize(idxicase, imap, (khint_t)size);
+		map = (git_idxmap *)imap;
+	} else if ((map = kh_init(idx)) != NULL)
+		kh_resize(idx, map, (khint_t)size);
+
+	if (!map)
+		giterr_set_oom();
+	return map;
+}
+
+static void index_map_destroy(git_index *index, git_idxmap *map)
+{
+	if (index->ignore_case)
+		kh_destroy(idxicase, (git_idxmap_icase *)map);
+	else
+		kh_destroy(idx, map);
+}
+
+/* call with locked index; the maps are rebuilt on demand */
+static void index_map_free(git_index *index)
+{
+	if (!index->entries_map)
+		return;
+
+	index_map_destroy(index, index->entries_map);
+	index_map_destroy(index, index->dirs_map);
+	index->entries_map = index->dirs_map = NULL;
+
+	git_pool_clear(&index->dir_names);
+}
+
+/* Adjust the number of entries below each of the parent directories of
+ * `entry` by `delta`.  Directories are only ever added to the map, and
+ * remain there with a count of zero once they become empty.
+ */
+static int index_map_count_dirs(
+	git_index *index, const git_index_entry *entry, size_t path_len, int delta)
+{
+	int stage = GIT_IDXENTRY_STAGE(entry);
+	void **count;
+
+	while (path_len-- > 0) {
+		if (entry->path[path_len] != '/')
+			continue;
+
+		count = index_map_get(index, index->dirs_map,
+			index_map_key(entry->path, path_len, stage));
+
+		if (!count) {
+			char *name = git_pool_strndup(
+				&index->dir_names, entry->path, path_len);
+
+			if (!name || !(count = index_map_put(index, index->dirs_map,
+					index_map_key(name, path_len, stage)))) {
+				giterr_set_oom();
+				return -1;
+			}
+		}
+
+		*count = (void *)((uintptr_t)*count + delta);
+	}
+
+	return 0;
+}
+
+/* call with locked index */
+static int index_map_add(git_index *index, git_index_entry *entry)
+{
+	size_t path_len = ((struct entry_internal *)entry)->pathlen;
+	void **slot = index_map_put(index, index->entries_map,
+		index_map_key(entry->path, path_len, GIT_IDXENTRY_STAGE(entry)));
+
+	if (!slot) {
+		giterr_set_oom();
+		return -1;
+	}
+
+	*slot = entry;
+	return index_map_count_dirs(index, entry, path_len, 1);
+}
+
+/* call with locked index */
+static void index_map_remove(git_index *index, git_index_entry *entry)
+{
+	size_t path_len = ((struct entry_internal *)entry)->pathlen;
+	git_idxmap_key key =
+		index_map_key(entry->path, path_len, GIT_IDXENTRY_STAGE(entry));
+	void **slot = index_map_get(index, index->entries_map, key);
+
+	if (!slot || *slot != entry)
+		return;
+
+	index_map_del(index, index->entries_map, key);
+	index_map_count_dirs(index, entry, path_len, -1);
+}
+
+/* call with locked index */
+static int index_map_build(git_index *index)
+{
+	size_t i;
+
+	if (index->entries_map)
+		return 0;
+
+	if (git_pool_init(&index->dir_names, 1, 0) < 0 ||
+		(index->entries_map =
+			index_map_alloc(index, index->entries.length)) == NULL ||
+		(index->dirs_map = index_map_alloc(index, 0)) == NULL)
+		goto on_error;
+
+	for (i = 0; i < index->entries.length; ++i) {
+		if (index_map_add(index, index->entries.contents[i]) < 0)
+			goto on_error;
+	}
+
+	return 0;
+
+on_error:
+	if (index->entries_map)
+		index_map_destroy(index, index->entries_map);
+	if (index->dirs_map)
+		index_map_destroy(index, index->dirs_map);
+	index->entries_map = index->dirs_map = NULL;
+
+	git_pool_clear(&index->dir_names);
+	return -1;
+}
+
+/* call with locked index and built maps; `entries` need not be sorted */
+static git_index_entry *index_map_find(
+	git_index *index, const char *path, size_t path_len, int stage)
+{
+	void **slot = index_map_get(index, index->entries_map,
+		index_map_key(path, path_len, stage));
+
+	return slot ? *slot : NULL;
+}
+
+/* call with locked index; the number of entries at `stage` below `dir` */
+static size_t index_map_dir_count(
+	git_index *index, const char *dir, size_t dir_len, int stage)
+{
+	void **count = index_map_get(index, index->dirs_map,
+		index_map_key(dir, dir_len, stage));
+
+	return count ? (size_t)(uintptr_t)*count : 0;
+}
+
 void git_index__set_ignore_case(git_index *index, bool ignore_case)
 {
+	/* the maps hash and compare paths according to the old setting */
+	if ((bool)index->ignore_case != ignore_case)
+		index_map_free(index);
+
 	index->ignore_case = ignore_case;
 
 	if (ignore_case) {
@@ -418,13 +708,19 @@ int git_index_open(git_index **index_out, const char *index_path)
 	if (git_vector_init(&index->entries, 32, git_index_entry_cmp) < 0 ||
 		git_vector_init(&index->names, 8, conflict_name_cmp) < 0 ||
 		git_vector_init(&index->reuc, 8, reuc_cmp) < 0 ||
-		git_vector_init(&index->deleted, 8, git_index_entry_cmp) < 0)
+		git_vector_init(&index->deleted, 8, git_index_entry_cmp) < 0 ||
+		git_vector_init(&index->arenas, 1, NULL) < 0 ||
+		git_vector_init(&index->deleted_arenas, 1, NULL) < 0 ||
+		git_vector_init(&index->batch, 0, git_index_entry_cmp) < 0)
 		goto fail;
 
 	index->entries_cmp_path = git__strcmp_cb;
 	index->entries_search = git_index_entry_srch;
 	index->entries_search_path = index_entry_srch_path;
 	index->reuc_search = reuc_srch;
+	index->version = INDEX_VERSION_NUMBER_DEFAULT;
+	index->split_max_change = GIT_SPLITINDEXMAXCHANGE_DEFAULT;
+	index->split_shared_expire = INDEX_SHARED_EXPIRE_DEFAULT;
 
 	if (index_path != NULL && (error = git_index_read(index, true)) < 0)
 		goto fail;
@@ -451,11 +747,17 @@ static void index_free(git_index *index)
 	 */
 	assert(!git_atomic_get(&index->readers));
 
+	git_index_batch_discard(index);
 	git_index_clear(index);
+	git_index_free(index->shared);
+	index_split_link_free(index->link);
 	git_vector_free(&index->entries);
 	git_vector_free(&index->names);
 	git_vector_free(&index->reuc);
 	git_vector_free(&index->deleted);
+	git_vector_free(&index->arenas);
+	git_vector_free(&index->deleted_arenas);
+	git_vector_free(&index->batch);
 
 	git__free(index->index_file_path);
 	git_mutex_free(&index->lock);
@@ -478,7 +780,8 @@ static void index_free_deleted(git_index *index)
 	int readers = (int)git_atomic_get(&index->readers);
 	size_t i;
 
-	if (readers > 0 || !index->deleted.length)
+	if (readers > 0 ||
+		(!index->deleted.length && !index->deleted_arenas.length))
 		return;
 
 	for (i = 0; i < index->deleted.length; ++i) {
@@ -487,6 +790,26 @@ static void index_free_deleted(git_index *index)
 	}
 
 	git_vector_clear(&index->deleted);
+
+	for (i = 0; i < index->deleted_arenas.length; ++i)
+		index_arena_free(index->deleted_arenas.contents[i]);
+
+	git_vector_clear(&index->deleted_arenas);
+}
+
+/* call with locked index, after all entries have been removed */
+static int index_release_arenas(git_index *index)
+{
+	size_t i;
+
+	for (i = 0; i < index->arenas.length; ++i) {
+		if (git_vector_insert(
+				&index->deleted_arenas, index->arenas.contents[i]) < 0)
+			return -1;
+	}
+
+	git_vector_clear(&index->arenas);
+	return 0;
 }
 
 /* call with locked index */
@@ -495,9 +818,13 @@ static int index_remove_entry(git_index *index, size_t pos)
 	int error = 0;
 	git_index_entry *entry = git_vector_get(&index->entries, pos);
 
-	if (entry != NULL)
+	if (entry != NULL) {
 		git_tree_cache_invalidate_path(index->tree, entry->path);
 
+		if (index->entries_map)
+			index_map_remove(index, entry);
+	}
+
 	error = git_vector_remove(&index->entries, pos);
 
 	if (!error) {
@@ -525,8 +852,13 @@ int git_index_clear(git_index *index)
 		return -1;
 	}
 
+	index_map_free(index);
+
 	while (!error && index->entries.length > 0)
 		error = index_remove_entry(index, index->entries.length - 1);
+
+	if (!error)
+		error = index_release_arenas(index);
 	index_free_deleted(index);
 
 	git_index_reuc_clear(index);
@@ -547,11 +879,11 @@ static int create_index_error(int error, const char *msg)
 
 int git_index_set_caps(git_index *index, int caps)
 {
-	unsigned int old_ignore_case;
+	unsigned int ignore_case;
 
 	assert(index);
 
-	old_ignore_case = index->ignore_case;
+	ignore_case = index->ignore_case;
 
 	if (caps == GIT_INDEXCAP_FROM_OWNER) {
 		git_repository *repo = INDEX_OWNER(index);
@@ -562,20 +894,26 @@ int git_index_set_caps(git_index *index, int caps)
 				-1, "Cannot access repository to set index caps");
 
 		if (!git_repository__cvar(&val, repo, GIT_CVAR_IGNORECASE))
-			index->ignore_case = (val != 0);
+			ignore_case = (val != 0);
 		if (!git_repository__cvar(&val, repo, GIT_CVAR_FILEMODE))
 			index->distrust_filemode = (val == 0);
 		if (!git_repository__cvar(&val, repo, GIT_CVAR_SYMLINKS))
 			index->no_symlinks = (val == 0);
+
+		/* a new index takes its format from the config */
+		if (!index->on_disk &&
+			!git_repository__cvar(&val, repo, GIT_CVAR_INDEXVERSION) &&
+			val >= INDEX_VERSION_NUMBER_LB && val <= INDEX_VERSION_NUMBER_UB)
+			index->version = (unsigned int)val;
 	}
 	else {
-		index->ignore_case = ((caps & GIT_INDEXCAP_IGNORE_CASE) != 0);
+		ignore_case = ((caps & GIT_INDEXCAP_IGNORE_CASE) != 0);
 		index->distrust_filemode = ((caps & GIT_INDEXCAP_NO_FILEMODE) != 0);
 		index->no_symlinks = ((caps & GIT_INDEXCAP_NO_SYMLINKS) != 0);
 	}
 
-	if (old_ignore_case != index->ignore_case) {
-		git_index__set_ignore_case(index, (bool)index->ignore_case);
+	if (ignore_case != index->ignore_case) {
+		git_index__set_ignore_case(index, (bool)ignore_case);
 	}
 
 	return 0;
@@ -588,10 +926,73 @@ int git_index_caps(const git_index *index)
 			(index->no_symlinks ? GIT_INDEXCAP_NO_SYMLINKS : 0));
 }
 
+unsigned int git_index_version(git_index *index)
+{
+	assert(index);
+
+	return index->version;
+}
+
+int git_index_set_version(git_index *index, unsigned int version)
+{
+	assert(index);
+
+	if (version < INDEX_VERSION_NUMBER_LB ||
+		version > INDEX_VERSION_NUMBER_UB) {
+		giterr_set(GITERR_INDEX, "Invalid version number");
+		return -1;
+	}
+
+	index->version = version;
+
+	return 0;
+}
+
+int git_index_is_split(const git_index *index)
+{
+	assert(index);
+
+	return index->split;
+}
+
+int git_index_set_split(git_index *index, int split)
+{
+	assert(index);
+
+	index->split = (split != 0);
+
+	return 0;
+}
+
+static int index_map(git_map *out, const char *path)
+{
+	git_file fd;
+	git_off_t len;
+	int error;
+
+	if ((fd = git_futils_open_ro(path)) < 0)
+		return fd;
+
+	len = git_futils_filesize(fd);
+
+	if (len < 0)
+		error = -1;
+	else if (!git__is_sizet(len)) {
+		giterr_set(GITERR_INDEX, "Index file '%s' too large to map", path);
+		error = -1;
+	} else if ((size_t)len < INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
+		error = index_error_invalid("insufficient buffer space");
+	else
+		error = git_futils_mmap_ro(out, fd, 0, (size_t)len);
+
+	p_close(fd);
+	return error;
+}
+
 int git_index_read(git_index *index, int force)
 {
 	int error = 0, updated;
-	git_buf buffer = GIT_BUF_INIT;
+	git_map map;
 	git_futils_filestamp stamp = index->stamp;
 
 	if (!index->index_file_path)
@@ -617,19 +1018,24 @@ int git_index_read(git_index *index, int force)
 	if (!updated && !force)
 		return 0;
 
-	error = git_futils_readbuffer(&buffer, index->index_file_path);
-	if (error < 0)
+	if ((error = index_map(&map, index->index_file_path)) < 0)
 		return error;
 
 	error = git_index_clear(index);
 
 	if (!error)
-		error = parse_index(index, buffer.ptr, buffer.size);
+		error = parse_index(index, map.data, map.len);
+
+	if (!error)
+		error = index_read_split(index);
 
 	if (!error)
 		git_futils_filestamp_set(&index->stamp, &stamp);
 
-	git_buf_free(&buffer);
+	index_split_link_free(index->link);
+	index->link = NULL;
+
+	git_futils_mmap_free(&map);
 	return error;
 }
 
@@ -647,7 +1053,6 @@ int git_index__changed_relative_to(
 
 int git_index_write(git_index *index)
 {
-	git_filebuf file = GIT_FILEBUF_INIT;
 	int error;
 
 	if (!index->index_file_path)
@@ -658,20 +1063,7 @@ int git_index_write(git_index *index)
 		return -1;
 	git_vector_sort(&index->reuc);
 
-	if ((error = git_filebuf_open(
-		&file, index->index_file_path, GIT_FILEBUF_HASH_CONTENTS, GIT_INDEX_FILE_MODE)) < 0) {
-		if (error == GIT_ELOCKED)
-			giterr_set(GITERR_INDEX, "The index is locked. This might be due to a concurrent or crashed process");
-
-		return error;
-	}
-
-	if ((error = write_index(index, &file)) < 0) {
-		git_filebuf_cleanup(&file);
-		return error;
-	}
-
-	if ((error = git_filebuf_commit(&file)) < 0)
+	if ((error = write_index(index)) < 0)
 		return error;
 
 	if (git_futils_filestamp_check(&index->stamp, index->index_file_path) < 0)
@@ -728,16 +1120,28 @@ const git_index_entry *git_index_get_byindex(
 const git_index_entry *git_index_get_bypath(
 	git_index *index, const char *path, int stage)
 {
-	size_t pos;
+	git_index_entry *entry = NULL;
 
 	assert(index);
 
-	if (index_find(&pos, index, path, 0, stage, true) < 0) {
-		giterr_set(GITERR_INDEX, "Index does not contain %s", path);
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock index");
+		return NULL;
+	}
+
+	if (index_map_build(index) < 0) {
+		git_mutex_unlock(&index->lock);
 		return NULL;
 	}
 
-	return git_index_get_byindex(index, pos);
+	entry = index_map_find(index, path, strlen(path), stage);
+
+	git_mutex_unlock(&index->lock);
+
+	if (!entry)
+		giterr_set(GITERR_INDEX, "Index does not contain %s", path);
+
+	return entry;
 }
 
 void git_index_entry__init_from_stat(
@@ -864,96 +1268,110 @@ static int index_entry_dup(git_index_entry **out, const git_index_entry *src)
 	return 0;
 }
 
-static int has_file_name(git_index *index,
-	 const git_index_entry *entry, size_t pos, int ok_to_replace)
+/* call with locked index; removes the entries at `stage` below `dir` */
+static int index_remove_dir_entries(
+	git_index *index, const char *dir, size_t dir_len, int stage)
 {
-	int retval = 0;
-	size_t len = strlen(entry->path);
-	int stage = GIT_IDXENTRY_STAGE(entry);
-	const char *name = entry->path;
+	git_buf pfx = GIT_BUF_INIT;
+	git_index_entry *entry;
+	size_t pos;
+	int error;
 
-	while (pos < index->entries.length) {
-		struct entry_internal *p = index->entries.contents[pos++];
+	if ((error = git_buf_put(&pfx, dir, dir_len)) < 0 ||
+		(error = git_buf_putc(&pfx, '/')) < 0)
+		return error;
 
-		if (len >= p->pathlen)
-			break;
-		if (memcmp(name, p->path, len))
-			break;
-		if (GIT_IDXENTRY_STAGE(&p->entry) != stage)
-			continue;
-		if (p->path[len] != '/')
-			continue;
-		retval = -1;
-		if (!ok_to_replace)
-			break;
+	index_find(&pos, index, pfx.ptr, pfx.size, GIT_INDEX_STAGE_ANY, false);
 
-		if (index_remove_entry(index, --pos) < 0)
+	while (!error && (entry = git_vector_get(&index->entries, pos)) != NULL) {
+		if ((index->ignore_case ?
+				strncasecmp(entry->path, pfx.ptr, pfx.size) :
+				strncmp(entry->path, pfx.ptr, pfx.size)) != 0)
 			break;
+
+		if (GIT_IDXENTRY_STAGE(entry) != stage)
+			++pos;
+		else
+			error = index_remove_entry(index, pos);
 	}
-	return retval;
+
+	git_buf_free(&pfx);
+	return error;
+}
+
+/*
+ * Do we have other files with pathnames that have the name we're
+ * trying to add as their directory?  Returns 1 if we do, 0 if we
+ * don't, or an error code.
+ */
+static int has_file_name(git_index *index,
+	 const git_index_entry *entry, size_t path_len, int ok_to_replace)
+{
+	int error, stage = GIT_IDXENTRY_STAGE(entry);
+
+	if (!index_map_dir_count(index, entry->path, path_len, stage))
+		return 0;
+
+	if (ok_to_replace &&
+		(error = index_remove_dir_entries(
+			index, entry->path, path_len, stage)) < 0)
+		return error;
+
+	return 1;
 }
 
 /*
  * Do we have another file with a pathname that is a proper
- * subset of the name we're trying to add?
+ * subset of the name we're trying to add?  Returns 1 if we do, 0 if
+ * we don't, or an error code.
  */
 static int has_dir_name(git_index *index,
-		const git_index_entry *entry, int ok_to_replace)
+		const git_index_entry *entry, size_t path_len, int ok_to_replace)
 {
 	int retval = 0;
 	int stage = GIT_IDXENTRY_STAGE(entry);
 	const char *name = entry->path;
-	const char *slash = name + strlen(name);
-
-	for (;;) {
-		size_t len, pos;
-
-		for (;;) {
-			if (*--slash == '/')
-				break;
-			if (slash <= entry->path)
-				return retval;
-		}
-		len = slash - name;
+	size_t len = path_len;
 
-		if (!index_find(&pos, index, name, len, stage, false)) {
-			retval = -1;
-			if (!ok_to_replace)
-				break;
+	while (len-- > 0) {
+		size_t pos;
 
-			if (index_remove_entry(index, pos) < 0)
-				break;
+		if (name[len] != '/')
 			continue;
-		}
 
 		/*
-		 * Trivial optimization: if we find an entry that
-		 * already matches the sub-directory, then we know
-		 * we're ok, and we can exit.
+		 * Trivial optimization: if the parent already holds other
+		 * entries then it is a directory, and so are all of its own
+		 * parents, so we're ok and we can exit.
 		 */
-		for (; pos < index->entries.length; ++pos) {
-			struct entry_internal *p = index->entries.contents[pos];
+		if (index_map_dir_count(index, name, len, stage) > 0)
+			break;
 
-			if (p->pathlen <= len ||
-			    p->path[len] != '/' ||
-			    memcmp(p->path, name, len))
-				break; /* not our subdirectory */
+		if (!index_map_find(index, name, len, stage))
+			continue;
 
-			if (GIT_IDXENTRY_STAGE(&p->entry) == stage)
-				return retval;
-		}
+		retval = 1;
+		if (!ok_to_replace ||
+			index_find(&pos, index, name, len, stage, false) < 0)
+			break;
+
+		if (index_remove_entry(index, pos) < 0)
+			return -1;
 	}
 
 	return retval;
 }
 
 static int check_file_directory_collision(git_index *index,
-		git_index_entry *entry, size_t pos, int ok_to_replace)
+		git_index_entry *entry, size_t path_len, int ok_to_replace)
 {
-	int retval = has_file_name(index, entry, pos, ok_to_replace);
-	retval = retval + has_dir_name(index, entry, ok_to_replace);
+	int has_file, has_dir;
+
+	if ((has_file = has_file_name(index, entry, path_len, ok_to_replace)) < 0 ||
+		(has_dir = has_dir_name(index, entry, path_len, ok_to_replace)) < 0)
+		return -1;
 
-	if (retval) {
+	if (has_file || has_dir) {
 		giterr_set(GITERR_INDEX,
 			"'%s' appears as both a file and a directory", entry->path);
 		return -1;
@@ -962,16 +1380,258 @@ static int check_file_directory_collision(git_index *index,
 	return 0;
 }
 
-static int index_no_dups(void **old, void *new)
+/*
+ * A batch records its changes in `index->batch` and applies them when it
+ * is committed: the changes are sorted (stably, so the last change to an
+ * entry wins), the ones to existing entries are made in place, and the
+ * new entries are merged with the others in a single pass.
+ */
+
+/* call with locked index; takes ownership of `entry` */
+static int index_batch_push(git_index *index, git_index_entry *entry)
 {
-	const git_index_entry *entry = new;
-	GIT_UNUSED(old);
-	giterr_set(GITERR_INDEX, "'%s' appears multiple times at stage %d",
-		entry->path, GIT_IDXENTRY_STAGE(entry));
-	return GIT_EEXISTS;
-}
+	int error = git_vector_insert(&index->batch, entry);
 
-/* index_insert takes ownership of the new entry - if it can't insert
+	if (error < 0)
+		index_entry_free(entry);
+
+	return error;
+}
+
+/* call with locked index */
+static int index_batch_remove(git_index *index, const char *path, int stage)
+{
+	git_index_entry *entry = index_entry_alloc(path);
+	GITERR_CHECK_ALLOC(entry);
+
+	GIT_IDXENTRY_STAGE_SET(entry, stage);
+	((struct entry_internal *)entry)->removing = 1;
+
+	return index_batch_push(index, entry);
+}
+
+static void index_batch_clear(git_index *index)
+{
+	size_t i;
+
+	for (i = 0; i < index->batch.length; ++i)
+		index_entry_free(git__swap(index->batch.contents[i], NULL));
+
+	git_vector_clear(&index->batch);
+}
+
+/* call with locked index; keeps only the last change to each entry */
+static void index_batch_sort(git_index *index)
+{
+	git_vector *batch = &index->batch;
+	git_index_entry *entry;
+	size_t i, kept = 0;
+
+	git_vector_set_cmp(batch, index->entries._cmp);
+	git_vector_sort(batch);
+
+	for (i = 0; i < batch->length; ++i) {
+		entry = batch->contents[i];
+
+		if (i + 1 < batch->length &&
+			batch->_cmp(entry, batch->contents[i + 1]) == 0)
+			index_entry_free(entry);
+		else
+			batch->contents[kept++] = entry;
+	}
+
+	batch->length = kept;
+}
+
+/* call with locked index and built maps; makes the changes to existing
+ * entries, marking the ones to remove, then collects the new entries (in
+ * order) into `added`.  Removals come first, so that an entry can replace
+ * a directory that the batch removes.  After an error, the remaining
+ * changes are dropped.
+ */
+static int index_batch_apply(
+	git_index *index, git_vector *added, size_t *removed)
+{
+	git_index_entry *entry, *existing;
+	size_t i, path_len;
+	int error = 0;
+
+	for (i = 0; i < index->batch.length; ++i) {
+		entry = index->batch.contents[i];
+		path_len = ((struct entry_internal *)entry)->pathlen;
+
+		existing = index_map_find(
+			index, entry->path, path_len, GIT_IDXENTRY_STAGE(entry));
+
+		if (((struct entry_internal *)entry)->removing) {
+			if (existing) {
+				((struct entry_internal *)existing)->removing = 1;
+				index_map_remove(index, existing);
+				git_tree_cache_invalidate_path(index->tree, existing->path);
+				(*removed)++;
+			}
+		}
+		else if (existing) {
+			entry->mode = index_merge_mode(index, existing, entry->mode);
+
+			if (existing->mode != entry->mode ||
+				!git_oid_equal(&existing->id, &entry->id))
+				git_tree_cache_invalidate_path(index->tree, entry->path);
+
+			index_entry_cpy(existing, entry);
+		}
+		else
+			continue;
+
+		index_entry_free(git__swap(index->batch.contents[i], NULL));
+	}
+
+	for (i = 0; i < index->batch.length; ++i) {
+		if ((entry = git__swap(index->batch.contents[i], NULL)) == NULL)
+			continue;
+
+		if (error < 0) {
+			index_entry_free(entry);
+			continue;
+		}
+
+		path_len = ((struct entry_internal *)entry)->pathlen;
+
+		if ((error = check_file_directory_collision(
+				index, entry, path_len, 1)) < 0 ||
+			(error = git_vector_insert(added, entry)) < 0)
+			index_entry_free(entry);
+		else if ((error = index_map_add(index, entry)) < 0) {
+			git_vector_pop(added);
+			index_entry_free(entry);
+		}
+		else
+			git_tree_cache_invalidate_path(index->tree, entry->path);
+	}
+
+	git_vector_clear(&index->batch);
+	return error;
+}
+
+/* call with locked index and sorted entries; merges the new entries into
+ * them, leaving out the ones marked for removal */
+static int index_batch_merge(git_index *index, git_vector *added)
+{
+	git_vector merged = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	size_t i = 0, j = 0;
+	int error = 0;
+
+	/* without room for the merge, back out of the whole batch */
+	if (git_vector_init(&merged, index->entries.length + added->length,
+			index->entries._cmp) < 0) {
+		git_vector_foreach(&index->entries, i, entry)
+			((struct entry_internal *)entry)->removing = 0;
+		git_vector_foreach(added, j, entry)
+			index_entry_free(entry);
+
+		index_map_free(index);
+		return -1;
+	}
+
+	while (i < index->entries.length || j < added->length) {
+		entry = git_vector_get(&index->entries, i);
+
+		if (entry && ((struct entry_internal *)entry)->removing) {
+			((struct entry_internal *)entry)->removing = 0;
+			++i;
+
+			if (git_atomic_get(&index->readers) == 0)
+				index_entry_free(entry);
+			else if (git_vector_insert(&index->deleted, entry) < 0)
+				error = -1;
+		}
+		else if (entry && (j == added->length ||
+				index->entries._cmp(entry, added->contents[j]) < 0)) {
+			merged.contents[merged.length++] = entry;
+			++i;
+		}
+		else
+			merged.contents[merged.length++] = added->contents[j++];
+	}
+
+	git_vector_swap(&index->entries, &merged);
+	git_vector_set_sorted(&index->entries, 1);
+	git_vector_free(&merged);
+
+	return error;
+}
+
+int git_index_batch_begin(git_index *index)
+{
+	assert(index);
+
+	if (index->batching) {
+		giterr_set(GITERR_INDEX, "A batch of index changes is already in progress");
+		return -1;
+	}
+
+	index->batching = 1;
+	return 0;
+}
+
+int git_index_batch_commit(git_index *index, int write)
+{
+	git_vector added = GIT_VECTOR_INIT;
+	size_t removed = 0;
+	int error, merge_error = 0;
+
+	assert(index);
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		return -1;
+	}
+
+	index->batching = 0;
+
+	if ((error = index_sort_if_needed(index, false)) < 0 ||
+		(error = index_map_build(index)) < 0 ||
+		(error = git_vector_init(
+			&added, index->batch.length, index->entries._cmp)) < 0)
+		index_batch_clear(index);
+	else {
+		index_batch_sort(index);
+		error = index_batch_apply(index, &added, &removed);
+
+		/* whatever was applied must make it into the entries */
+		if (added.length > 0 || removed > 0)
+			merge_error = index_batch_merge(index, &added);
+	}
+
+	git_mutex_unlock(&index->lock);
+	git_vector_free(&added);
+
+	if (!error)
+		error = merge_error;
+
+	if (!error && write)
+		error = git_index_write(index);
+
+	return error;
+}
+
+void git_index_batch_discard(git_index *index)
+{
+	assert(index);
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		return;
+	}
+
+	index->batching = 0;
+	index_batch_clear(index);
+
+	git_mutex_unlock(&index->lock);
+}
+
+/* index_insert takes ownership of the new entry - if it can't insert
  * it, then it will return an error **and also free the entry**.  When
  * it replaces an existing entry, it will update the entry_ptr with the
  * actual entry in the index (and free the passed in one).
@@ -980,7 +1640,7 @@ static int index_insert(
 	git_index *index, git_index_entry **entry_ptr, int replace)
 {
 	int error = 0;
-	size_t path_length, position;
+	size_t path_length;
 	git_index_entry *existing = NULL, *entry;
 
 	assert(index && entry_ptr);
@@ -1002,18 +1662,28 @@ static int index_insert(
 		return -1;
 	}
 
-	git_vector_sort(&index->entries);
+	/* in a batch, the entry is added when the batch is committed */
+	if (index->batching) {
+		error = index_batch_push(index, entry);
+		if (error < 0)
+			*entry_ptr = NULL;
+		git_mutex_unlock(&index->lock);
+		return error;
+	}
+
+	if ((error = index_map_build(index)) < 0)
+		goto done;
 
 	/* look if an entry with this path already exists */
-	if (!index_find(
-			&position, index, entry->path, 0, GIT_IDXENTRY_STAGE(entry), false)) {
-		existing = index->entries.contents[position];
-		/* update filemode to existing values if stat is not trusted */
+	existing = index_map_find(
+		index, entry->path, path_length, GIT_IDXENTRY_STAGE(entry));
+
+	/* update filemode to existing values if stat is not trusted */
+	if (existing)
 		entry->mode = index_merge_mode(index, existing, entry->mode);
-	}
 
 	/* look for tree / blob name collisions, removing conflicts if requested */
-	error = check_file_directory_collision(index, entry, position, replace);
+	error = check_file_directory_collision(index, entry, path_length, replace);
 	if (error < 0)
 		/* skip changes */;
 
@@ -1021,19 +1691,41 @@ static int index_insert(
 	 * and return it in place of the passed in one.
 	 */
 	else if (existing) {
-		if (replace)
+		if (replace) {
+			/* only changed content makes the cached trees stale */
+			if (existing->mode != entry->mode ||
+				!git_oid_equal(&existing->id, &entry->id))
+				git_tree_cache_invalidate_path(index->tree, entry->path);
+
 			index_entry_cpy(existing, entry);
+		}
 		index_entry_free(entry);
 		*entry_ptr = entry = existing;
 	}
 	else {
-		/* if replace is not requested or no existing entry exists, insert
-		 * at the sorted position.  (Since we re-sort after each insert to
-		 * check for dups, this is actually cheaper in the long run.)
+		/* otherwise append the new entry, leaving the sort to whoever
+		 * next needs the entries in order, so that adding many entries
+		 * only sorts them once.  Entries that are added in order keep
+		 * the vector sorted.
 		 */
-		error = git_vector_insert_sorted(&index->entries, entry, index_no_dups);
+		git_index_entry *last = git_vector_last(&index->entries);
+		bool sorted = git_vector_is_sorted(&index->entries) &&
+			(!last || index->entries._cmp(last, entry) < 0);
+
+		if ((error = git_vector_insert(&index->entries, entry)) < 0)
+			goto done;
+
+		if ((error = index_map_add(index, entry)) < 0) {
+			git_vector_pop(&index->entries);
+			index_map_free(index);
+			goto done;
+		}
+
+		git_vector_set_sorted(&index->entries, sorted);
+		git_tree_cache_invalidate_path(index->tree, entry->path);
 	}
 
+done:
 	if (error < 0) {
 		index_entry_free(*entry_ptr);
 		*entry_ptr = NULL;
@@ -1085,7 +1777,6 @@ int git_index_add_bypath(git_index *index, const char *path)
 	if ((ret = index_conflict_to_reuc(index, path)) < 0 && ret != GIT_ENOTFOUND)
 		return ret;
 
-	git_tree_cache_invalidate_path(index->tree, entry->path);
 	return 0;
 }
 
@@ -1129,7 +1820,6 @@ int git_index_add(git_index *index, const git_index_entry *source_entry)
 		(ret = index_insert(index, &entry, 1)) < 0)
 		return ret;
 
-	git_tree_cache_invalidate_path(index->tree, entry->path);
 	return 0;
 }
 
@@ -1143,7 +1833,12 @@ int git_index_remove(git_index *index, const char *path, int stage)
 		return -1;
 	}
 
-	if (index_find(&position, index, path, 0, stage, false) < 0) {
+	if (index->batching)
+		error = index_batch_remove(index, path, stage);
+	else if ((error = index_map_build(index)) < 0)
+		/* error already set */;
+	else if (!index_map_find(index, path, strlen(path), stage) ||
+		index_find(&position, index, path, 0, stage, false) < 0) {
 		giterr_set(
 			GITERR_INDEX, "Index does not contain %s at stage %d", path, stage);
 		error = GIT_ENOTFOUND;
@@ -1329,8 +2024,8 @@ int git_index_conflict_get(
 	git_index *index,
 	const char *path)
 {
-	size_t pos;
-	int len = 0;
+	size_t path_len;
+	int error = 0;
 
 	assert(ancestor_out && our_out && their_out && index && path);
 
@@ -1338,23 +2033,48 @@ int git_index_conflict_get(
 	*our_out = NULL;
 	*their_out = NULL;
 
-	if (git_index_find(&pos, index, path) < 0)
-		return GIT_ENOTFOUND;
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock index");
+		return -1;
+	}
 
-	if ((len = index_conflict__get_byindex(
-		ancestor_out, our_out, their_out, index, pos)) < 0)
-		return len;
-	else if (len == 0)
-		return GIT_ENOTFOUND;
+	if ((error = index_map_build(index)) < 0)
+		goto done;
 
-	return 0;
+	path_len = strlen(path);
+	*ancestor_out = index_map_find(index, path, path_len, 1);
+	*our_out = index_map_find(index, path, path_len, 2);
+	*their_out = index_map_find(index, path, path_len, 3);
+
+	if (!*ancestor_out && !*our_out && !*their_out) {
+		if (!index_map_find(index, path, path_len, 0))
+			giterr_set(GITERR_INDEX, "Index does not contain %s", path);
+		error = GIT_ENOTFOUND;
+	}
+
+done:
+	git_mutex_unlock(&index->lock);
+	return error;
 }
 
 static int index_conflict_remove(git_index *index, const char *path)
 {
 	size_t pos = 0;
 	git_index_entry *conflict_entry;
-	int error = 0;
+	int error = 0, stage;
+
+	if (path != NULL && index->batching) {
+		if (git_mutex_lock(&index->lock) < 0) {
+			giterr_set(GITERR_OS, "Unable to lock index");
+			return -1;
+		}
+
+		for (stage = 1; !error && stage <= 3; ++stage)
+			error = index_batch_remove(index, path, stage);
+
+		git_mutex_unlock(&index->lock);
+		return error;
+	}
 
 	if (path != NULL && git_index_find(&pos, index, path) < 0)
 		return GIT_ENOTFOUND;
@@ -1763,70 +2483,224 @@ static int read_conflict_names(git_index *index, const char *buffer, size_t size
 	return 0;
 }
 
+static void index_split_link_free(struct index_split_link *link)
+{
+	if (link == NULL)
+		return;
+
+	git_array_clear(link->deleted);
+	git_array_clear(link->replaced);
+	git__free(link);
+}
+
+static int read_split_link(git_index *index, const char *buffer, size_t size)
+{
+	struct index_split_link *link;
+	size_t len;
+
+	if (size < GIT_OID_RAWSZ || index->link != NULL)
+		return -1;
+
+	link = git__calloc(1, sizeof(struct index_split_link));
+	GITERR_CHECK_ALLOC(link);
+
+	index->link = link;
+
+	git_oid_fromraw(&link->shared_id, (const unsigned char *)buffer);
+	buffer += GIT_OID_RAWSZ;
+	size -= GIT_OID_RAWSZ;
+
+	/* the bitmaps are left out when nothing was deleted or replaced */
+	if (size == 0)
+		return 0;
+
+	if ((len = git_ewah_deserialize(&link->deleted, buffer, size)) == 0)
+		return -1;
+
+	buffer += len;
+	size -= len;
+
+	if ((len = git_ewah_deserialize(&link->replaced, buffer, size)) != size)
+		return -1;
+
+	return 0;
+}
+
+/* Allocate an entry with room for a path of `pathlen` bytes, which the
+ * caller fills in.
+ */
+static struct entry_internal *index_entry_alloc_arena(
+	git_pool *arena, size_t pathlen)
+{
+	struct entry_internal *entry;
+	size_t alloc_size = sizeof(struct entry_internal) + pathlen + 1;
+
+	if (alloc_size > UINT32_MAX ||
+		(entry = git_pool_mallocz(arena, (uint32_t)alloc_size)) == NULL)
+		return NULL;
+
+	entry->pathlen = pathlen;
+	entry->in_arena = 1;
+	entry->entry.path = entry->path;
+
+	return entry;
+}
+
+/* Read a single entry.  In version 4 indexes, the path is stored as the
+ * number of bytes to drop from the end of the previous entry's path
+ * followed by the bytes to append to it; `last` is the previous entry
+ * of the block being read, if any.
+ */
 static size_t read_entry(
-	git_index_entry **out, const void *buffer, size_t buffer_size)
+	git_index_entry **out,
+	git_pool *arena,
+	unsigned int version,
+	const git_index_entry *last,
+	const void *buffer,
+	size_t buffer_size)
 {
 	size_t path_length, entry_size;
 	uint16_t flags_raw;
 	const char *path_ptr;
-	const struct entry_short *source = buffer;
+	struct entry_long source;
 	git_index_entry entry = {{0}};
+	struct entry_internal *internal;
+	size_t prefix_len = 0, suffix_len, varint_len;
 
 	if (INDEX_FOOTER_SIZE + minimal_entry_size > buffer_size)
 		return 0;
 
-	entry.ctime.seconds = (git_time_t)ntohl(source->ctime.seconds);
-	entry.ctime.nanoseconds = ntohl(source->ctime.nanoseconds);
-	entry.mtime.seconds = (git_time_t)ntohl(source->mtime.seconds);
-	entry.mtime.nanoseconds = ntohl(source->mtime.nanoseconds);
-	entry.dev = ntohl(source->dev);
-	entry.ino = ntohl(source->ino);
-	entry.mode = ntohl(source->mode);
-	entry.uid = ntohl(source->uid);
-	entry.gid = ntohl(source->gid);
-	entry.file_size = ntohl(source->file_size);
-	git_oid_cpy(&entry.id, &source->oid);
-	entry.flags = ntohs(source->flags);
+	/* version 4 entries are not padded, so they may be unaligned; the
+	 * short and long entries are the same up to their flags */
+	memcpy(&source, buffer, offsetof(struct entry_short, path));
+
+	entry.ctime.seconds = (git_time_t)ntohl(source.ctime.seconds);
+	entry.ctime.nanoseconds = ntohl(source.ctime.nanoseconds);
+	entry.mtime.seconds = (git_time_t)ntohl(source.mtime.seconds);
+	entry.mtime.nanoseconds = ntohl(source.mtime.nanoseconds);
+	entry.dev = ntohl(source.dev);
+	entry.ino = ntohl(source.ino);
+	entry.mode = ntohl(source.mode);
+	entry.uid = ntohl(source.uid);
+	entry.gid = ntohl(source.gid);
+	entry.file_size = ntohl(source.file_size);
+	git_oid_cpy(&entry.id, &source.oid);
+	entry.flags = ntohs(source.flags);
 
 	if (entry.flags & GIT_IDXENTRY_EXTENDED) {
-		const struct entry_long *source_l = (const struct entry_long *)source;
-		path_ptr = source_l->path;
+		if (INDEX_FOOTER_SIZE + offsetof(struct entry_long, path) > buffer_size)
+			return 0;
 
-		flags_raw = ntohs(source_l->flags_extended);
+		memcpy(&flags_raw, (const char *)buffer +
+			offsetof(struct entry_long, flags_extended), 2);
+		flags_raw = ntohs(flags_raw);
 		memcpy(&entry.flags_extended, &flags_raw, 2);
+
+		path_ptr = (const char *)buffer + offsetof(struct entry_long, path);
 	} else
-		path_ptr = source->path;
+		path_ptr = (const char *)buffer + offsetof(struct entry_short, path);
+
+	if (version < INDEX_VERSION_NUMBER_COMP) {
+		path_length = entry.flags & GIT_IDXENTRY_NAMEMASK;
+
+		/* if this is a very long string, we must find its
+		 * real length without overflowing */
+		if (path_length == 0xFFF) {
+			const char *path_end;
+
+			path_end = memchr(path_ptr, '\0', buffer_size);
+			if (path_end == NULL)
+				return 0;
 
-	path_length = entry.flags & GIT_IDXENTRY_NAMEMASK;
+			path_length = path_end - path_ptr;
+		}
+
+		if (entry.flags & GIT_IDXENTRY_EXTENDED)
+			entry_size = long_entry_size(path_length);
+		else
+			entry_size = short_entry_size(path_length);
 
-	/* if this is a very long string, we must find its
-	 * real length without overflowing */
-	if (path_length == 0xFFF) {
+		suffix_len = path_length;
+	} else {
+		size_t header_len = path_ptr - (const char *)buffer, strip_len;
 		const char *path_end;
 
-		path_end = memchr(path_ptr, '\0', buffer_size);
+		if (header_len >= buffer_size)
+			return 0;
+
+		strip_len = (size_t)git_decode_varint((const unsigned char *)path_ptr,
+			buffer_size - header_len, &varint_len);
+
+		if (varint_len == 0)
+			return 0;
+
+		/* the first entry of a block has nothing to be relative to */
+		if (last != NULL) {
+			size_t last_len = ((const struct entry_internal *)last)->pathlen;
+
+			if (strip_len > last_len)
+				return 0;
+
+			prefix_len = last_len - strip_len;
+		}
+
+		path_ptr += varint_len;
+		path_end = memchr(path_ptr, '\0', buffer_size - header_len - varint_len);
 		if (path_end == NULL)
 			return 0;
 
-		path_length = path_end - path_ptr;
+		suffix_len = path_end - path_ptr;
+		path_length = prefix_len + suffix_len;
+		entry_size = header_len + varint_len + suffix_len + 1;
 	}
 
-	if (entry.flags & GIT_IDXENTRY_EXTENDED)
-		entry_size = long_entry_size(path_length);
-	else
-		entry_size = short_entry_size(path_length);
-
 	if (INDEX_FOOTER_SIZE + entry_size > buffer_size)
 		return 0;
 
-	entry.path = (char *)path_ptr;
-
-	if (index_entry_dup(out, &entry) < 0)
+	if ((internal = index_entry_alloc_arena(arena, path_length)) == NULL)
 		return 0;
 
+	if (prefix_len)
+		memcpy(internal->path, last->path, prefix_len);
+	memcpy(internal->path + prefix_len, path_ptr, suffix_len);
+
+	*out = (git_index_entry *)internal;
+	index_entry_cpy(*out, &entry);
+
 	return entry_size;
 }
 
+/* Read `nr` consecutive entries starting at `*offset`.  This does not set
+ * an error message, as it may run on a thread other than the caller's.
+ */
+static int read_entries(
+	git_index_entry **out,
+	size_t nr,
+	git_pool *arena,
+	unsigned int version,
+	const char *buffer,
+	size_t buffer_size,
+	size_t *offset)
+{
+	size_t i, entry_size;
+
+	for (i = 0; i < nr; ++i) {
+		if (*offset >= buffer_size)
+			return -1;
+
+		entry_size = read_entry(&out[i], arena, version, i ? out[i - 1] : NULL,
+			buffer + *offset, buffer_size - *offset);
+
+		/* 0 bytes read means an object corruption */
+		if (entry_size == 0)
+			return -1;
+
+		*offset += entry_size;
+	}
+
+	return 0;
+}
+
 static int read_header(struct index_header *dest, const void *buffer)
 {
 	const struct index_header *source = buffer;
@@ -1836,8 +2710,8 @@ static int read_header(struct index_header *dest, const void *buffer)
 		return index_error_invalid("incorrect header signature");
 
 	dest->version = ntohl(source->version);
-	if (dest->version != INDEX_VERSION_NUMBER_EXT &&
-		dest->version != INDEX_VERSION_NUMBER)
+	if (dest->version < INDEX_VERSION_NUMBER_LB ||
+		dest->version > INDEX_VERSION_NUMBER_UB)
 		return index_error_invalid("incorrect header version");
 
 	dest->entry_count = ntohl(source->entry_count);
@@ -1846,14 +2720,12 @@ static int read_header(struct index_header *dest, const void *buffer)
 
 static size_t read_extension(git_index *index, const char *buffer, size_t buffer_size)
 {
-	const struct index_extension *source;
 	struct index_extension dest;
 	size_t total_size;
 
-	source = (const struct index_extension *)(buffer);
-
-	memcpy(dest.signature, source->signature, 4);
-	dest.extension_size = ntohl(source->extension_size);
+	/* extensions are not aligned, least of all after version 4 entries */
+	memcpy(&dest, buffer, sizeof(struct index_extension));
+	dest.extension_size = ntohl(dest.extension_size);
 
 	total_size = dest.extension_size + sizeof(struct index_extension);
 
@@ -1862,8 +2734,12 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 		buffer_size - total_size < INDEX_FOOTER_SIZE)
 		return 0;
 
+	if (memcmp(dest.signature, INDEX_EXT_LINK_SIG, 4) == 0) {
+		if (read_split_link(index, buffer + 8, dest.extension_size) < 0)
+			return 0;
+	}
 	/* optional extension */
-	if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
+	else if (dest.signature[0] >= 'A' && dest.signature[0] <= 'Z') {
 		/* tree cache */
 		if (memcmp(dest.signature, INDEX_EXT_TREECACHE_SIG, 4) == 0) {
 			if (git_tree_cache_read(&index->tree, buffer + 8, dest.extension_size) < 0)
@@ -1886,116 +2762,605 @@ static size_t read_extension(git_index *index, const char *buffer, size_t buffer
 	return total_size;
 }
 
-static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+/* Parse all the extensions between `offset` and the footer */
+static int read_extensions(
+	git_index *index, const char *buffer, size_t buffer_size, size_t offset)
 {
-	int error = 0;
-	unsigned int i;
-	struct index_header header = { 0 };
-	git_oid checksum_calculated, checksum_expected;
+	while (offset < buffer_size && buffer_size - offset > INDEX_FOOTER_SIZE) {
+		size_t extension_size =
+			read_extension(index, buffer + offset, buffer_size - offset);
 
-#define seek_forward(_increase) { \
-	if (_increase >= buffer_size) { \
-		error = index_error_invalid("ran out of data while parsing"); \
-		goto done; } \
-	buffer += _increase; \
-	buffer_size -= _increase;\
-}
+		/* see if we have read any bytes from the extension */
+		if (extension_size == 0)
+			return -1;
 
-	if (buffer_size < INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
-		return index_error_invalid("insufficient buffer space");
+		offset += extension_size;
+	}
 
-	/* Precalculate the SHA1 of the files's contents -- we'll match it to
-	 * the provided SHA1 in the footer */
-	git_hash_buf(&checksum_calculated, buffer, buffer_size - INDEX_FOOTER_SIZE);
+	return (offset + INDEX_FOOTER_SIZE == buffer_size) ? 0 : -1;
+}
 
-	/* Parse header */
-	if ((error = read_header(&header, buffer)) < 0)
-		return error;
+GIT_INLINE(uint32_t) read_uint32(const char *buffer)
+{
+	uint32_t value;
+	memcpy(&value, buffer, sizeof(value));
+	return ntohl(value);
+}
+
+/* Look for the end of index entries extension.  It is always the last
+ * extension, so we can find it without walking the entries; returns the
+ * offset of the first extension or 0 if there is no (valid) EOIE.
+ */
+static size_t read_end_of_entries(const char *buffer, size_t buffer_size)
+{
+	const char *eoie;
+	size_t eoie_pos, offset, pos;
+	git_hash_ctx ctx;
+	git_oid expected, actual;
+
+	if (buffer_size < INDEX_HEADER_SIZE + INDEX_EXT_HEADER_SIZE +
+		INDEX_EOIE_SIZE + INDEX_FOOTER_SIZE)
+		return 0;
+
+	eoie_pos = buffer_size - INDEX_FOOTER_SIZE -
+		INDEX_EOIE_SIZE - INDEX_EXT_HEADER_SIZE;
+	eoie = buffer + eoie_pos;
+
+	if (memcmp(eoie, INDEX_EXT_END_OF_ENTRIES_SIG, 4) != 0 ||
+		read_uint32(eoie + 4) != INDEX_EOIE_SIZE)
+		return 0;
+
+	offset = read_uint32(eoie + INDEX_EXT_HEADER_SIZE);
+
+	if (offset < INDEX_HEADER_SIZE || offset > eoie_pos)
+		return 0;
+
+	/* The EOIE carries a hash of the headers of all the extensions in
+	 * front of it; only trust the offset if they match up.
+	 */
+	if (git_hash_ctx_init(&ctx) < 0) {
+		giterr_clear();
+		return 0;
+	}
+
+	for (pos = offset; eoie_pos - pos >= INDEX_EXT_HEADER_SIZE; ) {
+		size_t extension_size = read_uint32(buffer + pos + 4);
+
+		git_hash_update(&ctx, buffer + pos, INDEX_EXT_HEADER_SIZE);
+
+		if (extension_size > eoie_pos - pos - INDEX_EXT_HEADER_SIZE)
+			break;
+
+		pos += INDEX_EXT_HEADER_SIZE + extension_size;
+	}
+
+	git_hash_final(&actual, &ctx);
+	git_hash_ctx_cleanup(&ctx);
+
+	git_oid_fromraw(&expected,
+		(const unsigned char *)eoie + INDEX_EXT_HEADER_SIZE + 4);
+
+	if (pos != eoie_pos || git_oid__cmp(&expected, &actual) != 0)
+		return 0;
+
+	return offset;
+}
+
+/* Read the index entry offset table, which (when present) is the first
+ * extension.  `out` is left NULL if there is no usable table.
+ */
+static int read_entry_offsets(
+	struct index_entry_block **out,
+	size_t *out_nr,
+	const char *buffer,
+	size_t buffer_size,
+	size_t ext_offset,
+	size_t entry_count)
+{
+	const char *ext = buffer + ext_offset;
+	struct index_entry_block *blocks;
+	size_t extension_size, i, nr, total = 0;
+
+	*out = NULL;
+	*out_nr = 0;
+
+	if (buffer_size - ext_offset < INDEX_EXT_HEADER_SIZE + INDEX_FOOTER_SIZE ||
+		memcmp(ext, INDEX_EXT_ENTRY_OFFSETS_SIG, 4) != 0)
+		return 0;
+
+	extension_size = read_uint32(ext + 4);
+
+	if (extension_size < 4 || (extension_size - 4) % 8 != 0 ||
+		extension_size > buffer_size - ext_offset -
+			INDEX_EXT_HEADER_SIZE - INDEX_FOOTER_SIZE ||
+		read_uint32(ext + INDEX_EXT_HEADER_SIZE) != INDEX_IEOT_VERSION)
+		return 0;
+
+	if ((nr = (extension_size - 4) / 8) == 0)
+		return 0;
+
+	blocks = git__calloc(nr, sizeof(struct index_entry_block));
+	GITERR_CHECK_ALLOC(blocks);
+
+	ext += INDEX_EXT_HEADER_SIZE + 4;
+
+	for (i = 0; i < nr; ++i, ext += 8) {
+		blocks[i].offset = read_uint32(ext);
+		blocks[i].nr = read_uint32(ext + 4);
+		total += blocks[i].nr;
+
+		/* blocks must tile the entries in order */
+		if (!blocks[i].nr || blocks[i].offset >= ext_offset ||
+			(i == 0 && blocks[i].offset != INDEX_HEADER_SIZE) ||
+			(i > 0 && blocks[i].offset <= blocks[i - 1].offset))
+			break;
+	}
+
+	if (i < nr || total != entry_count) {
+		git__free(blocks);
+		return 0;
+	}
+
+	*out = blocks;
+	*out_nr = nr;
+	return 0;
+}
+
+typedef struct index_read_job {
+	git_thread thread;
+	void *(*fn)(void *);
+	unsigned int started:1;
+
+	git_index *index;
+	const char *buffer;
+	size_t buffer_size;
+
+	size_t offset;  /* where the job starts reading */
+	size_t end;     /* where the job should stop reading, 0 if unknown */
+
+	git_index_entry **entries;
+	size_t nr;
+	git_pool *arena;
+	unsigned int version;
+
+	git_oid checksum;
+	int error;
+} index_read_job;
+
+static void *index_read_entries_job(void *payload)
+{
+	index_read_job *job = payload;
+
+	job->error = read_entries(job->entries, job->nr, job->arena,
+		job->version, job->buffer, job->buffer_size, &job->offset);
+
+	if (!job->error && job->end && job->offset != job->end)
+		job->error = -1;
 
-	seek_forward(INDEX_HEADER_SIZE);
+	return NULL;
+}
+
+/* Calculate the checksum of the file and, if we know where they
+ * begin, parse the extensions.
+ */
+static void *index_read_tail_job(void *payload)
+{
+	index_read_job *job = payload;
+
+	job->error = git_hash_buf(&job->checksum,
+		job->buffer, job->buffer_size - INDEX_FOOTER_SIZE);
+
+	if (!job->error && job->offset)
+		job->error = read_extensions(
+			job->index, job->buffer, job->buffer_size, job->offset);
+
+	return NULL;
+}
+
+static void index_read_job_start(index_read_job *job, bool threaded)
+{
+#ifdef GIT_THREADS
+	if (threaded && !git_thread_create(&job->thread, NULL, job->fn, job)) {
+		job->started = 1;
+		return;
+	}
+#else
+	GIT_UNUSED(threaded);
+#endif
+
+	/* no threads to be had; just do the work inline */
+	job->fn(job);
+}
+
+static void index_read_job_finish(index_read_job *job)
+{
+#ifdef GIT_THREADS
+	if (job->started)
+		git_thread_join(&job->thread, NULL);
+#endif
+	job->started = 0;
+}
+
+static int parse_index(git_index *index, const char *buffer, size_t buffer_size)
+{
+	int error = 0;
+	size_t i, ext_offset, blocks_nr = 0, jobs_nr = 1, entry_pos = 0;
+	unsigned int threads;
+	struct index_header header = { 0 };
+	struct index_entry_block *blocks = NULL;
+	index_read_job tail, *jobs = NULL;
+	git_oid checksum_expected;
+
+	if (buffer_size < INDEX_HEADER_SIZE + INDEX_FOOTER_SIZE)
+		return index_error_invalid("insufficient buffer space");
+
+	/* Parse header */
+	if ((error = read_header(&header, buffer)) < 0)
+		return error;
+
+	if (header.entry_count >
+		(buffer_size - INDEX_HEADER_SIZE) / minimal_entry_size)
+		return index_error_invalid("header entries exceed index size");
+
+	/* The EOIE and IEOT extensions tell us where the extensions start and
+	 * how the entries are split into blocks, so that they can all be
+	 * parsed at the same time.
+	 */
+	ext_offset = read_end_of_entries(buffer, buffer_size);
+	threads = git_workers__threads(git_index__threads,
+		header.entry_count, INDEX_ENTRIES_PER_THREAD);
+
+	if (threads > 1 && ext_offset &&
+		(error = read_entry_offsets(&blocks, &blocks_nr,
+			buffer, buffer_size, ext_offset, header.entry_count)) < 0)
+		return error;
+
+	if (blocks_nr > 1)
+		jobs_nr = (threads < blocks_nr) ? threads : blocks_nr;
+
+	jobs = git__calloc(jobs_nr, sizeof(index_read_job));
+	if (!jobs) {
+		git__free(blocks);
+		return -1;
+	}
 
 	if (git_mutex_lock(&index->lock) < 0) {
 		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		git__free(blocks);
+		git__free(jobs);
 		return -1;
 	}
 
 	assert(!index->entries.length);
 
-	/* Parse all the entries */
-	for (i = 0; i < header.entry_count && buffer_size > INDEX_FOOTER_SIZE; ++i) {
-		git_index_entry *entry;
-		size_t entry_size = read_entry(&entry, buffer, buffer_size);
+	if ((error = git_vector_resize_to(
+			&index->entries, header.entry_count)) < 0)
+		goto done;
 
-		/* 0 bytes read means an object corruption */
-		if (entry_size == 0) {
-			error = index_error_invalid("invalid entry");
-			goto done;
-		}
+	memset(&tail, 0, sizeof(tail));
+	tail.fn = index_read_tail_job;
+	tail.index = index;
+	tail.buffer = buffer;
+	tail.buffer_size = buffer_size;
+	tail.offset = (threads > 1) ? ext_offset : 0;
 
-		if ((error = git_vector_insert(&index->entries, entry)) < 0) {
-			index_entry_free(entry);
-			goto done;
+	for (i = 0; i < jobs_nr; ++i) {
+		index_read_job *job = &jobs[i];
+
+		job->fn = index_read_entries_job;
+		job->version = header.version;
+		job->buffer = buffer;
+		job->buffer_size = buffer_size;
+		job->entries = (git_index_entry **)index->entries.contents + entry_pos;
+
+		if (blocks) {
+			size_t first = i * blocks_nr / jobs_nr;
+			size_t last = (i + 1) * blocks_nr / jobs_nr, b;
+
+			for (b = first; b < last; ++b)
+				job->nr += blocks[b].nr;
+
+			job->offset = blocks[first].offset;
+			job->end = (last < blocks_nr) ? blocks[last].offset : ext_offset;
+		} else {
+			job->nr = header.entry_count;
+			job->offset = INDEX_HEADER_SIZE;
+			job->end = ext_offset;
 		}
 
-		seek_forward(entry_size);
-	}
+		entry_pos += job->nr;
 
-	if (i != header.entry_count) {
-		error = index_error_invalid("header entries changed while parsing");
-		goto done;
+		if ((job->arena = index_arena_new()) == NULL ||
+			(error = git_vector_insert(&index->arenas, job->arena)) < 0) {
+			index_arena_free(job->arena);
+			error = -1;
+			goto done;
+		}
 	}
 
-	/* There's still space for some extensions! */
-	while (buffer_size > INDEX_FOOTER_SIZE) {
-		size_t extension_size;
+	/* The main thread takes the first block of entries itself */
+	index_read_job_start(&tail, threads > 1);
+	for (i = 1; i < jobs_nr; ++i)
+		index_read_job_start(&jobs[i], true);
+	index_read_job_start(&jobs[0], false);
 
-		extension_size = read_extension(index, buffer, buffer_size);
+	index_read_job_finish(&tail);
+	for (i = 1; i < jobs_nr; ++i)
+		index_read_job_finish(&jobs[i]);
 
-		/* see if we have read any bytes from the extension */
-		if (extension_size == 0) {
-			error = index_error_invalid("extension is truncated");
+	for (i = 0; i < jobs_nr; ++i) {
+		if (jobs[i].error < 0) {
+			error = index_error_invalid("invalid entry");
 			goto done;
 		}
-
-		seek_forward(extension_size);
 	}
 
-	if (buffer_size != INDEX_FOOTER_SIZE) {
-		error = index_error_invalid(
-			"buffer size does not match index footer size");
+	if (tail.error < 0 || (!tail.offset &&
+		read_extensions(index, buffer, buffer_size, jobs[jobs_nr - 1].offset) < 0)) {
+		error = index_error_invalid("extension is truncated");
 		goto done;
 	}
 
 	/* 160-bit SHA-1 over the content of the index file before this checksum. */
-	git_oid_fromraw(&checksum_expected, (const unsigned char *)buffer);
+	git_oid_fromraw(&checksum_expected,
+		(const unsigned char *)buffer + buffer_size - INDEX_FOOTER_SIZE);
 
-	if (git_oid__cmp(&checksum_calculated, &checksum_expected) != 0) {
+	if (git_oid__cmp(&tail.checksum, &checksum_expected) != 0) {
 		error = index_error_invalid(
 			"calculated checksum does not match expected");
 		goto done;
 	}
 
-#undef seek_forward
-
 	/* Entries are stored case-sensitively on disk, so re-sort now if
 	 * in-memory index is supposed to be case-insensitive
 	 */
+	index->version = header.version;
+
+	/* a split index is only sorted once it is merged with its base */
+	if (!index->link) {
+		git_vector_set_sorted(&index->entries, !index->ignore_case);
+		error = index_sort_if_needed(index, false);
+	}
+
+done:
+	/* entries live in the arenas, which are released on clear */
+	if (error < 0)
+		git_vector_clear(&index->entries);
+
+	git_mutex_unlock(&index->lock);
+
+	git__free(blocks);
+	git__free(jobs);
+	return error;
+}
+
+static int index_shared_path(git_buf *out, git_index *index, const git_oid *id)
+{
+	char hex[GIT_OID_HEXSZ + 1];
+
+	if (git_path_dirname_r(out, index->index_file_path) < 0 ||
+		git_buf_joinpath(out, out->ptr, GIT_INDEX_SHARED_FILE) < 0)
+		return -1;
+
+	if (id) {
+		git_oid_tostr(hex, sizeof(hex), id);
+		git_buf_putc(out, '.');
+		git_buf_puts(out, hex);
+	}
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+/* Read the shared index named `id` from beside the index */
+static int index_load_shared(git_index *index, const git_oid *id)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_index *shared = NULL;
+	git_map map;
+	git_oid checksum;
+	int error;
+
+	if ((error = index_shared_path(&path, index, id)) < 0)
+		return error;
+
+	if ((error = index_map(&map, path.ptr)) < 0) {
+		git_buf_free(&path);
+		return error;
+	}
+
+	/* shared indexes are named after their checksum */
+	git_oid_fromraw(&checksum,
+		(const unsigned char *)map.data + map.len - INDEX_FOOTER_SIZE);
+
+	if (git_oid__cmp(&checksum, id) != 0)
+		error = index_error_invalid("shared index does not match its name");
+	else if ((error = git_index_new(&shared)) == 0 &&
+		(error = parse_index(shared, map.data, map.len)) == 0 &&
+		shared->link != NULL)
+		error = index_error_invalid("shared index is split itself");
+
+	git_futils_mmap_free(&map);
+	git_buf_free(&path);
+
+	if (error < 0) {
+		git_index_free(shared);
+		return error;
+	}
+
+	git_index_free(index->shared);
+	index->shared = shared;
+	git_oid_cpy(&index->shared_id, id);
+
+	return 0;
+}
+
+static git_index_entry *index_entry_copy_arena(
+	git_pool *arena, const git_index_entry *src, const git_index_entry *path)
+{
+	struct entry_internal *entry;
+	size_t pathlen = ((const struct entry_internal *)path)->pathlen;
+
+	if ((entry = index_entry_alloc_arena(arena, pathlen)) == NULL)
+		return NULL;
+
+	memcpy(entry->path, path->path, pathlen);
+	index_entry_cpy(&entry->entry, src);
+
+	entry->entry.flags &= ~GIT_IDXENTRY_NAMEMASK;
+	entry->entry.flags |= (pathlen < GIT_IDXENTRY_NAMEMASK) ?
+		(uint16_t)pathlen : GIT_IDXENTRY_NAMEMASK;
+
+	return &entry->entry;
+}
+
+static int index_merge_add(git_vector *merged, git_index_entry *entry)
+{
+	if (!((struct entry_internal *)entry)->pathlen)
+		return index_error_invalid("split index entry without a path");
+
+	return git_vector_insert(merged, entry);
+}
+
+/* Apply the deletions and replacements of the link extension to the
+ * entries of the shared index, and add the entries of the split index
+ * that come after the replacements.  Call with locked index.
+ */
+static int index_merge_shared(git_index *index, struct index_split_link *link)
+{
+	git_vector merged = GIT_VECTOR_INIT, *base = &index->shared->entries;
+	git_index_entry **split = (git_index_entry **)index->entries.contents;
+	size_t split_nr = index->entries.length, replaced_nr, i, d = 0, r = 0, a;
+	git_pool *arena;
+	int cmp = 1, error = -1;
+
+	replaced_nr = git_array_size(link->replaced);
+
+	if (replaced_nr > split_nr)
+		return index_error_invalid("link extension replaces missing entries");
+
+	if ((arena = index_arena_new()) == NULL)
+		return -1;
+
+	if (git_vector_insert(&index->arenas, arena) < 0) {
+		index_arena_free(arena);
+		return -1;
+	}
+
+	if (git_vector_init(&merged,
+			base->length + split_nr - replaced_nr, index->entries._cmp) < 0)
+		return -1;
+
+	a = replaced_nr;
+
+	for (i = 0; i < base->length; ++i) {
+		git_index_entry *entry = base->contents[i], *src = entry;
+		bool deleted = (d < git_array_size(link->deleted) &&
+			*git_array_get(link->deleted, d) == i);
+
+		if (deleted)
+			d++;
+
+		cmp = 1;
+
+		if (r < replaced_nr && *git_array_get(link->replaced, r) == i) {
+			src = split[r++];
+
+			if (((struct entry_internal *)src)->pathlen != 0) {
+				error = index_error_invalid("replacing entry has a path");
+				goto done;
+			}
+		}
+
+		if (deleted)
+			continue;
+
+		/* entries new to the split index go in front of the shared
+		 * ones that sort after them, and override those at their path */
+		while (a < split_nr && (cmp = git_index_entry_cmp(split[a], entry)) <= 0) {
+			if ((error = index_merge_add(&merged, split[a++])) < 0)
+				goto done;
+			if (cmp == 0)
+				break;
+		}
+
+		if (cmp == 0)
+			continue;
+
+		if ((src = index_entry_copy_arena(arena, src, entry)) == NULL ||
+			git_vector_insert(&merged, src) < 0) {
+			error = -1;
+			goto done;
+		}
+	}
+
+	if (d < git_array_size(link->deleted) || r < replaced_nr) {
+		error = index_error_invalid("link extension refers to missing entries");
+		goto done;
+	}
+
+	while (a < split_nr) {
+		if ((error = index_merge_add(&merged, split[a++])) < 0)
+			goto done;
+	}
+
+	git_vector_swap(&index->entries, &merged);
+
+	/* the split entries were sorted on disk; this only has to deal with
+	 * case-insensitive indexes */
 	git_vector_set_sorted(&index->entries, !index->ignore_case);
 	error = index_sort_if_needed(index, false);
 
 done:
+	git_vector_free(&merged);
+	return error;
+}
+
+/* Finish reading a split index, or forget about the shared index of an
+ * index that is not split (anymore).
+ */
+static int index_read_split(git_index *index)
+{
+	struct index_split_link *link = index->link;
+	int error;
+
+	if (link == NULL) {
+		git_index_free(index->shared);
+		index->shared = NULL;
+		return 0;
+	}
+
+	index->split = 1;
+
+	if ((!index->shared || git_oid__cmp(&index->shared_id, &link->shared_id)) &&
+		(error = index_load_shared(index, &link->shared_id)) < 0)
+		goto fail;
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		error = -1;
+		goto fail;
+	}
+
+	error = index_merge_shared(index, link);
+
 	git_mutex_unlock(&index->lock);
+
+	if (!error)
+		return 0;
+
+fail:
+	git_vector_clear(&index->entries);
 	return error;
 }
 
-static bool is_index_extended(git_index *index)
+static bool is_index_extended(git_vector *entries)
 {
 	size_t i, extended;
 	git_index_entry *entry;
 
 	extended = 0;
 
-	git_vector_foreach(&index->entries, i, entry) {
+	git_vector_foreach(entries, i, entry) {
 		entry->flags &= ~GIT_IDXENTRY_EXTENDED;
 		if (entry->flags_extended & GIT_IDXENTRY_EXTENDED_FLAGS) {
 			extended++;
@@ -2006,16 +3371,41 @@ static bool is_index_extended(git_index *index)
 	return (extended > 0);
 }
 
-static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
+/* Write a single entry with the first `path_len` bytes of its path
+ * (split indexes leave out the paths of the entries that replace shared
+ * ones).  For version 4, the path is written relative to `last`, the
+ * path of the previously written entry, whose length is `last_len`; when
+ * `last` is NULL nothing is shared with it and its whole length is
+ * stripped.
+ */
+static int write_disk_entry(
+	size_t *written,
+	git_filebuf *file,
+	git_index_entry *entry,
+	size_t path_len,
+	unsigned int version,
+	const char *last,
+	size_t last_len)
 {
 	void *mem = NULL;
-	struct entry_short *ondisk;
-	size_t path_len, disk_size;
+	struct entry_long ondisk;
+	size_t disk_size, header_size, common = 0, varint_len = 0;
+	uint16_t flags;
 	char *path;
 
-	path_len = ((struct entry_internal *)entry)->pathlen;
+	header_size = (entry->flags & GIT_IDXENTRY_EXTENDED) ?
+		offsetof(struct entry_long, path) :
+		offsetof(struct entry_short, path);
 
-	if (entry->flags & GIT_IDXENTRY_EXTENDED)
+	if (version >= INDEX_VERSION_NUMBER_COMP) {
+		if (last != NULL)
+			while (common < path_len && common < last_len &&
+				last[common] == entry->path[common])
+				common++;
+
+		varint_len = git_encode_varint(NULL, 0, last_len - common);
+		disk_size = header_size + varint_len + (path_len - common) + 1;
+	} else if (entry->flags & GIT_IDXENTRY_EXTENDED)
 		disk_size = long_entry_size(path_len);
 	else
 		disk_size = short_entry_size(path_len);
@@ -2023,9 +3413,8 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	if (git_filebuf_reserve(file, &mem, disk_size) < 0)
 		return -1;
 
-	ondisk = (struct entry_short *)mem;
-
-	memset(ondisk, 0x0, disk_size);
+	memset(mem, 0x0, disk_size);
+	memset(&ondisk, 0x0, sizeof(ondisk));
 
 	/**
 	 * Yes, we have to truncate.
@@ -2037,325 +3426,1221 @@ static int write_disk_entry(git_filebuf *file, git_index_entry *entry)
 	 *
 	 * In 2038 I will be either too dead or too rich to care about this
 	 */
-	ondisk->ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
-	ondisk->mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
-	ondisk->ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
-	ondisk->mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
-	ondisk->dev = htonl(entry->dev);
-	ondisk->ino = htonl(entry->ino);
-	ondisk->mode = htonl(entry->mode);
-	ondisk->uid = htonl(entry->uid);
-	ondisk->gid = htonl(entry->gid);
-	ondisk->file_size = htonl((uint32_t)entry->file_size);
-
-	git_oid_cpy(&ondisk->oid, &entry->id);
-
-	ondisk->flags = htons(entry->flags);
-
-	if (entry->flags & GIT_IDXENTRY_EXTENDED) {
-		struct entry_long *ondisk_ext;
-		ondisk_ext = (struct entry_long *)ondisk;
-		ondisk_ext->flags_extended = htons(entry->flags_extended);
-		path = ondisk_ext->path;
+	ondisk.ctime.seconds = htonl((uint32_t)entry->ctime.seconds);
+	ondisk.mtime.seconds = htonl((uint32_t)entry->mtime.seconds);
+	ondisk.ctime.nanoseconds = htonl(entry->ctime.nanoseconds);
+	ondisk.mtime.nanoseconds = htonl(entry->mtime.nanoseconds);
+	ondisk.dev = htonl(entry->dev);
+	ondisk.ino = htonl(entry->ino);
+	ondisk.mode = htonl(entry->mode);
+	ondisk.uid = htonl(entry->uid);
+	ondisk.gid = htonl(entry->gid);
+	ondisk.file_size = htonl((uint32_t)entry->file_size);
+
+	git_oid_cpy(&ondisk.oid, &entry->id);
+
+	flags = entry->flags & ~GIT_IDXENTRY_NAMEMASK;
+	flags |= (path_len < GIT_IDXENTRY_NAMEMASK) ?
+		(uint16_t)path_len : GIT_IDXENTRY_NAMEMASK;
+	ondisk.flags = htons(flags);
+
+	if (entry->flags & GIT_IDXENTRY_EXTENDED)
+		ondisk.flags_extended = htons(entry->flags_extended);
+
+	/* version 4 entries are not padded, so `mem` may be unaligned */
+	memcpy(mem, &ondisk, header_size);
+	path = (char *)mem + header_size;
+
+	if (varint_len) {
+		git_encode_varint((unsigned char *)path, varint_len, last_len - common);
+		path += varint_len;
 	}
-	else
-		path = ondisk->path;
 
-	memcpy(path, entry->path, path_len);
+	memcpy(path, entry->path + common, path_len - common);
+
+	*written = disk_size;
+	return 0;
+}
+
+/* Number of blocks to record in the entry offset table, or 0 for none */
+static size_t index_entry_blocks(size_t entry_count)
+{
+	size_t blocks;
+
+	if (git_index__threads == 1)
+		return 0;
+
+	if (!git_index__threads) {
+		size_t cpus = (size_t)git_online_cpus();
+
+		blocks = entry_count / INDEX_ENTRIES_PER_THREAD;
+		if (blocks > cpus)
+			blocks = cpus;
+	} else {
+		blocks = git_index__threads;
+		if (blocks > entry_count)
+			blocks = entry_count;
+	}
+
+	return (blocks > 1) ? blocks : 0;
+}
+
+/* Write `entries`, the first `stripped` of them without their paths,
+ * recording the offset of every `block_size` entries in `offsets` (when
+ * given) and the offset just past the last entry in `end_offset`.
+ */
+static int write_entries(
+	size_t *end_offset,
+	git_buf *offsets,
+	git_filebuf *file,
+	git_vector *entries,
+	size_t stripped,
+	unsigned int version,
+	size_t block_size)
+{
+	int error = 0;
+	size_t i, written, path_len, offset = INDEX_HEADER_SIZE, last_len = 0;
+	git_index_entry *entry;
+	const char *last = NULL;
+
+	git_vector_foreach(entries, i, entry) {
+		if (block_size && (i % block_size) == 0) {
+			size_t nr = entries->length - i;
+			uint32_t block[2];
+
+			block[0] = htonl((uint32_t)offset);
+			block[1] = htonl((uint32_t)(nr < block_size ? nr : block_size));
+
+			if ((error = git_buf_put(offsets, (char *)block, sizeof(block))) < 0)
+				break;
+
+			/* blocks must be readable on their own, so nothing
+			 * is shared with the entry before them */
+			last = NULL;
+		}
+
+		path_len = (i < stripped) ? 0 : ((struct entry_internal *)entry)->pathlen;
+
+		if ((error = write_disk_entry(&written, file, entry, path_len,
+				version, last, last_len)) < 0)
+			break;
+
+		offset += written;
+		last = entry->path;
+		last_len = path_len;
+	}
+
+	*end_offset = offset;
+
+	return error;
+}
+
+/* Extension headers are also fed to `ext_hash` (when given) so that
+ * the EOIE extension can vouch for them.
+ */
+static int write_extension(
+	git_filebuf *file,
+	git_hash_ctx *ext_hash,
+	struct index_extension *header,
+	git_buf *data)
+{
+	struct index_extension ondisk;
+	int error = 0;
+
+	memset(&ondisk, 0x0, sizeof(struct index_extension));
+	memcpy(&ondisk, header, 4);
+	ondisk.extension_size = htonl(header->extension_size);
+
+	if (ext_hash != NULL &&
+		(error = git_hash_update(ext_hash, &ondisk, sizeof(ondisk))) < 0)
+		return error;
+
+	if ((error = git_filebuf_write(file, &ondisk, sizeof(struct index_extension))) == 0)
+		error = git_filebuf_write(file, data->ptr, data->size);
+
+	return error;
+}
+
+static int create_name_extension_data(git_buf *name_buf, git_index_name_entry *conflict_name)
+{
+	int error = 0;
+
+	if (conflict_name->ancestor == NULL)
+		error = git_buf_put(name_buf, "\0", 1);
+	else
+		error = git_buf_put(name_buf, conflict_name->ancestor, strlen(conflict_name->ancestor) + 1);
+
+	if (error != 0)
+		goto on_error;
+
+	if (conflict_name->ours == NULL)
+		error = git_buf_put(name_buf, "\0", 1);
+	else
+		error = git_buf_put(name_buf, conflict_name->ours, strlen(conflict_name->ours) + 1);
+
+	if (error != 0)
+		goto on_error;
+
+	if (conflict_name->theirs == NULL)
+		error = git_buf_put(name_buf, "\0", 1);
+	else
+		error = git_buf_put(name_buf, conflict_name->theirs, strlen(conflict_name->theirs) + 1);
+
+on_error:
+	return error;
+}
+
+static int write_tree_extension(
+	git_index *index, git_filebuf *file, git_hash_ctx *ext_hash)
+{
+	git_buf tree_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	int error;
+
+	if ((error = git_tree_cache_write(&tree_buf, index->tree)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_TREECACHE_SIG, 4);
+	extension.extension_size = (uint32_t)tree_buf.size;
+
+	error = write_extension(file, ext_hash, &extension, &tree_buf);
+
+done:
+	git_buf_free(&tree_buf);
+	return error;
+}
+
+static int write_name_extension(
+	git_index *index, git_filebuf *file, git_hash_ctx *ext_hash)
+{
+	git_buf name_buf = GIT_BUF_INIT;
+	git_vector *out = &index->names;
+	git_index_name_entry *conflict_name;
+	struct index_extension extension;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(out, i, conflict_name) {
+		if ((error = create_name_extension_data(&name_buf, conflict_name)) < 0)
+			goto done;
+	}
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4);
+	extension.extension_size = (uint32_t)name_buf.size;
+
+	error = write_extension(file, ext_hash, &extension, &name_buf);
+
+	git_buf_free(&name_buf);
+
+done:
+	return error;
+}
+
+static int create_reuc_extension_data(git_buf *reuc_buf, git_index_reuc_entry *reuc)
+{
+	int i;
+	int error = 0;
+
+	if ((error = git_buf_put(reuc_buf, reuc->path, strlen(reuc->path) + 1)) < 0)
+		return error;
+
+	for (i = 0; i < 3; i++) {
+		if ((error = git_buf_printf(reuc_buf, "%o", reuc->mode[i])) < 0 ||
+			(error = git_buf_put(reuc_buf, "\0", 1)) < 0)
+			return error;
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (reuc->mode[i] && (error = git_buf_put(reuc_buf, (char *)&reuc->oid[i].id, GIT_OID_RAWSZ)) < 0)
+			return error;
+	}
+
+	return 0;
+}
+
+static int write_reuc_extension(
+	git_index *index, git_filebuf *file, git_hash_ctx *ext_hash)
+{
+	git_buf reuc_buf = GIT_BUF_INIT;
+	git_vector *out = &index->reuc;
+	git_index_reuc_entry *reuc;
+	struct index_extension extension;
+	size_t i;
+	int error = 0;
+
+	git_vector_foreach(out, i, reuc) {
+		if ((error = create_reuc_extension_data(&reuc_buf, reuc)) < 0)
+			goto done;
+	}
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_UNMERGED_SIG, 4);
+	extension.extension_size = (uint32_t)reuc_buf.size;
+
+	error = write_extension(file, ext_hash, &extension, &reuc_buf);
+
+	git_buf_free(&reuc_buf);
+
+done:
+	return error;
+}
+
+static int write_entry_offsets_extension(
+	git_filebuf *file, git_hash_ctx *ext_hash, git_buf *offsets)
+{
+	git_buf ieot_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	uint32_t version = htonl(INDEX_IEOT_VERSION);
+	int error;
+
+	if ((error = git_buf_put(&ieot_buf, (char *)&version, sizeof(version))) < 0 ||
+		(error = git_buf_put(&ieot_buf, offsets->ptr, offsets->size)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_ENTRY_OFFSETS_SIG, 4);
+	extension.extension_size = (uint32_t)ieot_buf.size;
+
+	error = write_extension(file, ext_hash, &extension, &ieot_buf);
+
+done:
+	git_buf_free(&ieot_buf);
+	return error;
+}
+
+static int write_end_of_entries_extension(
+	git_filebuf *file, git_hash_ctx *ext_hash, size_t end_offset)
+{
+	git_buf eoie_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	uint32_t offset = htonl((uint32_t)end_offset);
+	git_oid ext_id;
+	int error;
+
+	if ((error = git_hash_final(&ext_id, ext_hash)) < 0 ||
+		(error = git_buf_put(&eoie_buf, (char *)&offset, sizeof(offset))) < 0 ||
+		(error = git_buf_put(&eoie_buf, (char *)ext_id.id, GIT_OID_RAWSZ)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_END_OF_ENTRIES_SIG, 4);
+	extension.extension_size = (uint32_t)eoie_buf.size;
+
+	/* the EOIE itself is not part of the hash it carries */
+	error = write_extension(file, NULL, &extension, &eoie_buf);
+
+done:
+	git_buf_free(&eoie_buf);
+	return error;
+}
+
+static int write_link_extension(
+	git_filebuf *file,
+	git_hash_ctx *ext_hash,
+	const git_oid *shared_id,
+	git_ewah_bits *deleted,
+	git_ewah_bits *replaced)
+{
+	git_buf link_buf = GIT_BUF_INIT;
+	struct index_extension extension;
+	int error;
+
+	if ((error = git_buf_put(&link_buf, (char *)shared_id->id, GIT_OID_RAWSZ)) < 0 ||
+		(error = git_ewah_serialize(&link_buf, deleted->ptr, deleted->size)) < 0 ||
+		(error = git_ewah_serialize(&link_buf, replaced->ptr, replaced->size)) < 0)
+		goto done;
+
+	memset(&extension, 0x0, sizeof(struct index_extension));
+	memcpy(&extension.signature, INDEX_EXT_LINK_SIG, 4);
+	extension.extension_size = (uint32_t)link_buf.size;
+
+	error = write_extension(file, ext_hash, &extension, &link_buf);
+
+done:
+	git_buf_free(&link_buf);
+	return error;
+}
+
+/* The "link" extension of a split index being written */
+struct index_split_write {
+	const git_oid *shared_id;
+	git_ewah_bits deleted;
+	git_ewah_bits replaced;
+};
+
+/* Write `entries` and the extensions of `index` to `file`, and the final
+ * checksum of the file to `checksum`.  For a split index, `split` names
+ * the shared index and its entries that the first `stripped` entries
+ * replace.
+ */
+static int write_index_file(
+	git_oid *checksum,
+	git_index *index,
+	git_filebuf *file,
+	git_vector *entries,
+	size_t stripped,
+	struct index_split_write *split)
+{
+	struct index_header header;
+	bool is_extended;
+	uint32_t index_version_number;
+	git_buf offsets = GIT_BUF_INIT;
+	git_hash_ctx ext_hash_ctx, *ext_hash = NULL;
+	size_t blocks, end_offset;
+	int error = -1;
+
+	assert(index && file && entries);
+
+	is_extended = is_index_extended(entries);
+
+	if (index->version >= INDEX_VERSION_NUMBER_COMP)
+		index_version_number = index->version;
+	else
+		index_version_number = is_extended ?
+			INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER;
+
+	header.signature = htonl(INDEX_HEADER_SIG);
+	header.version = htonl(index_version_number);
+	header.entry_count = htonl((uint32_t)entries->length);
+
+	/* large indexes record where the blocks of entries and the
+	 * extensions begin, so that readers can load them in parallel
+	 */
+	if ((blocks = index_entry_blocks(entries->length)) > 0) {
+		if (git_hash_ctx_init(&ext_hash_ctx) < 0)
+			return -1;
+		ext_hash = &ext_hash_ctx;
+	}
+
+	if (git_filebuf_write(file, &header, sizeof(struct index_header)) < 0)
+		goto done;
+
+	if (write_entries(&end_offset, &offsets, file, entries, stripped,
+			index_version_number, blocks ?
+			(entries->length + blocks - 1) / blocks : 0) < 0)
+		goto done;
+
+	/* the offset table goes first, so readers find it right away */
+	if (ext_hash && write_entry_offsets_extension(file, ext_hash, &offsets) < 0)
+		goto done;
+
+	/* a split index is useless without its link to the shared index */
+	if (split && write_link_extension(file, ext_hash,
+			split->shared_id, &split->deleted, &split->replaced) < 0)
+		goto done;
+
+	/* write the tree cache extension */
+	if (index->tree != NULL && write_tree_extension(index, file, ext_hash) < 0)
+		goto done;
+
+	/* write the rename conflict extension */
+	if (index->names.length > 0 && write_name_extension(index, file, ext_hash) < 0)
+		goto done;
+
+	/* write the reuc extension */
+	if (index->reuc.length > 0 && write_reuc_extension(index, file, ext_hash) < 0)
+		goto done;
+
+	/* the end of index entries extension must be the last one */
+	if (ext_hash && write_end_of_entries_extension(file, ext_hash, end_offset) < 0)
+		goto done;
+
+	/* get out the hash for all the contents we've appended to the file */
+	git_filebuf_hash(checksum, file);
+
+	/* write it at the end of the file */
+	error = git_filebuf_write(file, checksum->id, GIT_OID_RAWSZ);
+
+done:
+	if (ext_hash) {
+		git_hash_ctx_cleanup(ext_hash);
+	}
+	git_buf_free(&offsets);
+	return error;
+}
+
+/* Whether (and how eagerly) `index` is to be written as a split index;
+ * the config of the owner repository takes precedence when it is set.
+ */
+static bool index_split_enabled(unsigned int *max_change, git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	bool split = index->split;
+	int val;
+
+	*max_change = index->split_max_change;
+
+	if (repo == NULL)
+		return split;
+
+	if (!git_repository__cvar(&val, repo, GIT_CVAR_SPLITINDEX) &&
+		val != GIT_SPLITINDEX_UNSET)
+		split = (val != 0);
+
+	if (!git_repository__cvar(&val, repo, GIT_CVAR_SPLITINDEXMAXCHANGE) &&
+		val >= 0 && val <= 100)
+		*max_change = (unsigned int)val;
+
+	return split;
+}
+
+/* The shared indexes last written before this time may be removed; the
+ * config of the owner repository takes precedence when it is set.
+ */
+static git_time_t index_shared_expiry(git_index *index)
+{
+	git_repository *repo = INDEX_OWNER(index);
+	git_config *cfg;
+	const char *value;
+	git_time_t expiry;
+
+	if (repo != NULL &&
+		!git_repository_config__weakptr(&cfg, repo) &&
+		!git_config_get_string(&value, cfg, "splitIndex.sharedIndexExpire") &&
+		!git__date_parse(&expiry, value))
+		return expiry;
+
+	giterr_clear();
+	return (git_time_t)time(NULL) - index->split_shared_expire;
+}
+
+struct index_shared_expire_data {
+	const char *current;
+	git_time_t expiry;
+};
+
+static int index_shared_expire_cb(void *payload, git_buf *path)
+{
+	struct index_shared_expire_data *data = payload;
+	const char *name = path->ptr + git_path_basename_offset(path);
+	struct stat st;
+
+	if (git__prefixcmp(name, GIT_INDEX_SHARED_FILE ".") != 0 ||
+		!strcmp(name, data->current))
+		return 0;
+
+	/* whatever cannot be removed now may be removed the next time */
+	if (!p_stat(path->ptr, &st) && (git_time_t)st.st_mtime <= data->expiry)
+		p_unlink(path->ptr);
+
+	return 0;
+}
+
+/* Remove the shared indexes other than the current one that have not
+ * been written since their expiry.  Readers of an older split index may
+ * still need the more recent ones.
+ */
+static void index_expire_shared(git_index *index)
+{
+	struct index_shared_expire_data data;
+	git_buf dir = GIT_BUF_INIT, current = GIT_BUF_INIT;
+
+	if (index_shared_path(&current, index, &index->shared_id) < 0 ||
+		git_path_dirname_r(&dir, index->index_file_path) < 0)
+		goto done;
+
+	data.current = current.ptr + git_path_basename_offset(&current);
+	data.expiry = index_shared_expiry(index);
+
+	git_path_direach(&dir, 0, index_shared_expire_cb, &data);
+
+done:
+	giterr_clear();
+	git_buf_free(&dir);
+	git_buf_free(&current);
+}
+
+static int index_filebuf_open(git_filebuf *file, const char *path)
+{
+	int error = git_filebuf_open(
+		file, path, GIT_FILEBUF_HASH_CONTENTS, GIT_INDEX_FILE_MODE);
+
+	if (error == GIT_ELOCKED)
+		giterr_set(GITERR_INDEX, "The index is locked. This might be due to a concurrent or crashed process");
+
+	return error;
+}
+
+/* Only the stat data, id and flags that make it to disk matter here;
+ * the paths are known to be the same.
+ */
+static bool index_entry_unchanged(
+	const git_index_entry *a, const git_index_entry *b)
+{
+	return (a->ctime.seconds == b->ctime.seconds &&
+		a->ctime.nanoseconds == b->ctime.nanoseconds &&
+		a->mtime.seconds == b->mtime.seconds &&
+		a->mtime.nanoseconds == b->mtime.nanoseconds &&
+		a->dev == b->dev &&
+		a->ino == b->ino &&
+		a->mode == b->mode &&
+		a->uid == b->uid &&
+		a->gid == b->gid &&
+		a->file_size == b->file_size &&
+		git_oid_equal(&a->id, &b->id) &&
+		!((a->flags ^ b->flags) &
+			~(GIT_IDXENTRY_NAMEMASK | GIT_IDXENTRY_EXTENDED)) &&
+		!((a->flags_extended ^ b->flags_extended) &
+			GIT_IDXENTRY_EXTENDED_FLAGS));
+}
+
+/* Write `entries` as the new shared index, which takes the place of the
+ * current one in memory.
+ */
+static int write_shared_index(git_index *index, git_vector *entries)
+{
+	git_index *shared = NULL;
+	git_pool *arena;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_index_entry *entry, *copy;
+	git_oid checksum;
+	size_t i;
+	int error;
+
+	if ((error = git_index_new(&shared)) < 0)
+		return error;
+
+	shared->version = index->version;
+
+	if ((arena = index_arena_new()) == NULL ||
+		git_vector_insert(&shared->arenas, arena) < 0) {
+		index_arena_free(arena);
+		error = -1;
+		goto done;
+	}
+
+	if ((error = git_vector_resize_to(&shared->entries, entries->length)) < 0)
+		goto done;
+
+	git_vector_foreach(entries, i, entry) {
+		if ((copy = index_entry_copy_arena(arena, entry, entry)) == NULL) {
+			error = -1;
+			goto done;
+		}
+
+		shared->entries.contents[i] = copy;
+	}
+
+	git_vector_set_sorted(&shared->entries, true);
+
+	if ((error = index_shared_path(&path, index, NULL)) < 0 ||
+		(error = index_filebuf_open(&file, path.ptr)) < 0)
+		goto done;
+
+	if ((error = write_index_file(
+			&checksum, shared, &file, &shared->entries, 0, NULL)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto done;
+	}
+
+	/* shared indexes are named after their checksum */
+	git_buf_clear(&path);
+
+	if ((error = index_shared_path(&path, index, &checksum)) < 0 ||
+		(error = git_filebuf_commit_at(&file, path.ptr)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto done;
+	}
+
+	git_index_free(index->shared);
+	index->shared = shared;
+	git_oid_cpy(&index->shared_id, &checksum);
+	shared = NULL;
+
+done:
+	git_index_free(shared);
+	git_buf_free(&path);
+	return error;
+}
+
+/* Write the entries that differ from the shared index, along with the
+ * bitmaps of the shared entries they replace and of those that are gone.
+ * The shared index itself is rewritten when there is none yet or when
+ * more than `max_change` percent of the entries would end up in the
+ * split index.  Call with locked index.
+ */
+static int write_split_index(
+	git_index *index, git_vector *entries, unsigned int max_change)
+{
+	struct index_split_write split = { NULL, GIT_ARRAY_INIT, GIT_ARRAY_INIT };
+	git_vector changed = GIT_VECTOR_INIT, added = GIT_VECTOR_INIT;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	git_buf path = GIT_BUF_INIT;
+	git_oid checksum;
+	bool rewrite = (index->shared == NULL);
+	git_index_entry *entry;
+	size_t i = 0, j = 0;
+	uint32_t *bit;
+	int error = 0;
+
+	/* the shared index may have been removed behind our back */
+	if (!rewrite) {
+		if ((error = index_shared_path(&path, index, &index->shared_id)) < 0)
+			goto done;
+
+		rewrite = !git_path_exists(path.ptr);
+	}
+
+	while (!rewrite && (i < index->shared->entries.length || j < entries->length)) {
+		git_vector *base = &index->shared->entries;
+		git_index_entry *b = (i < base->length) ? base->contents[i] : NULL;
+		git_index_entry *e = (j < entries->length) ? entries->contents[j] : NULL;
+		int cmp = !b ? 1 : !e ? -1 : git_index_entry_cmp(b, e);
+
+		if (cmp < 0) {
+			if ((bit = git_array_alloc(split.deleted)) == NULL)
+				goto oom;
+			*bit = (uint32_t)i++;
+		} else if (cmp > 0) {
+			if (git_vector_insert(&added, e) < 0)
+				goto oom;
+			j++;
+		} else {
+			if (!index_entry_unchanged(b, e)) {
+				if ((bit = git_array_alloc(split.replaced)) == NULL ||
+					git_vector_insert(&changed, e) < 0)
+					goto oom;
+				*bit = (uint32_t)i;
+			}
+			i++;
+			j++;
+		}
+	}
+
+	if (!rewrite)
+		rewrite = ((changed.length + added.length) * 100 >
+			(size_t)max_change * entries->length);
+
+	if (rewrite) {
+		git_vector_clear(&changed);
+		git_vector_clear(&added);
+		git_array_clear(split.deleted);
+		git_array_clear(split.replaced);
+
+		if ((error = write_shared_index(index, entries)) < 0)
+			goto done;
+	}
+
+	/* the replacements come first, in the order of the shared entries
+	 * they replace, followed by the new entries */
+	git_vector_foreach(&added, i, entry) {
+		if (git_vector_insert(&changed, entry) < 0)
+			goto oom;
+	}
+
+	split.shared_id = &index->shared_id;
+
+	if ((error = index_filebuf_open(&file, index->index_file_path)) < 0)
+		goto done;
+
+	if ((error = write_index_file(&checksum, index, &file, &changed,
+			git_array_size(split.replaced), &split)) < 0 ||
+		(error = git_filebuf_commit(&file)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto done;
+	}
+
+	if (rewrite)
+		index_expire_shared(index);
+
+	goto done;
+
+oom:
+	error = -1;
+
+done:
+	git_vector_free(&changed);
+	git_vector_free(&added);
+	git_array_clear(split.deleted);
+	git_array_clear(split.replaced);
+	git_buf_free(&path);
+	return error;
+}
+
+static int write_index(git_index *index)
+{
+	git_vector case_sorted = GIT_VECTOR_INIT, *entries;
+	git_filebuf file = GIT_FILEBUF_INIT;
+	unsigned int max_change;
+	git_oid checksum;
+	int error;
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Failed to lock index");
+		return -1;
+	}
+
+	/* If index->entries is sorted case-insensitively, then we need
+	 * to re-sort it case-sensitively before writing */
+	if (index->ignore_case) {
+		if ((error = git_vector_dup(
+				&case_sorted, &index->entries, git_index_entry_cmp)) < 0)
+			goto done;
+
+		git_vector_sort(&case_sorted);
+		entries = &case_sorted;
+	} else {
+		entries = &index->entries;
+	}
+
+	if (index_split_enabled(&max_change, index)) {
+		error = write_split_index(index, entries, max_change);
+		goto done;
+	}
+
+	if ((error = index_filebuf_open(&file, index->index_file_path)) < 0)
+		goto done;
+
+	if ((error = write_index_file(&checksum, index, &file, entries, 0, NULL)) < 0 ||
+		(error = git_filebuf_commit(&file)) < 0) {
+		git_filebuf_cleanup(&file);
+		goto done;
+	}
+
+	/* the index is whole again */
+	git_index_free(index->shared);
+	index->shared = NULL;
+
+done:
+	git_mutex_unlock(&index->lock);
+	git_vector_free(&case_sorted);
+	return error;
+}
+
+int git_index_entry_stage(const git_index_entry *entry)
+{
+	return GIT_IDXENTRY_STAGE(entry);
+}
+
+/*
+ * Reading a tree into the index walks the tree alongside the current
+ * entries (in case-sensitive order, which is the order of the tree), so
+ * that the entries that do not change are kept, stat data and all, and
+ * subtrees that the tree cache knows to be unchanged are not even read.
+ */
+typedef struct read_tree_data {
+	git_repository *repo;
+	git_vector *old_entries;
+	size_t old_pos;
+	git_vector new_entries;
+	git_vector added;
+	git_vector removed;
+	git_buf path;
+} read_tree_data;
+
+GIT_INLINE(const git_index_entry *) read_tree_old_entry(
+	read_tree_data *data, size_t pos)
+{
+	return git_vector_get(data->old_entries, pos);
+}
+
+/* drop the old entries that sort before `path` */
+static int read_tree_drop_before(read_tree_data *data, const char *path)
+{
+	git_index_entry *old;
+
+	while ((old = git_vector_get(data->old_entries, data->old_pos)) != NULL &&
+		strcmp(old->path, path) < 0) {
+		if (git_vector_insert(&data->removed, old) < 0)
+			return -1;
+		data->old_pos++;
+	}
 
 	return 0;
 }
 
-static int write_entries(git_index *index, git_filebuf *file)
+static int read_tree_file(read_tree_data *data, const git_tree_entry *te)
 {
-	int error = 0;
-	size_t i;
-	git_vector case_sorted, *entries;
-	git_index_entry *entry;
+	const char *path = data->path.ptr;
+	git_index_entry *old, *entry = NULL;
 
-	if (git_mutex_lock(&index->lock) < 0) {
-		giterr_set(GITERR_OS, "Failed to lock index");
+	if (read_tree_drop_before(data, path) < 0)
 		return -1;
-	}
 
-	/* If index->entries is sorted case-insensitively, then we need
-	 * to re-sort it case-sensitively before writing */
-	if (index->ignore_case) {
-		git_vector_dup(&case_sorted, &index->entries, git_index_entry_cmp);
-		git_vector_sort(&case_sorted);
-		entries = &case_sorted;
-	} else {
-		entries = &index->entries;
+	/* keep the stage 0 entry if it is unchanged, and drop the rest */
+	while ((old = git_vector_get(data->old_entries, data->old_pos)) != NULL &&
+		!strcmp(old->path, path)) {
+		if (entry == NULL && GIT_IDXENTRY_STAGE(old) == 0 &&
+			old->mode == te->attr && git_oid_equal(&old->id, &te->oid)) {
+			old->flags_extended &= ~GIT_IDXENTRY_INTENT_TO_ADD;
+			entry = old;
+		} else if (git_vector_insert(&data->removed, old) < 0)
+			return -1;
+
+		data->old_pos++;
 	}
 
-	git_vector_foreach(entries, i, entry)
-		if ((error = write_disk_entry(file, entry)) < 0)
-			break;
+	if (entry == NULL) {
+		entry = index_entry_alloc(path);
+		GITERR_CHECK_ALLOC(entry);
 
-	git_mutex_unlock(&index->lock);
+		entry->mode = te->attr;
+		entry->id = te->oid;
 
-	if (index->ignore_case)
-		git_vector_free(&case_sorted);
+		if (data->path.size < GIT_IDXENTRY_NAMEMASK)
+			entry->flags = data->path.size & GIT_IDXENTRY_NAMEMASK;
+		else
+			entry->flags = GIT_IDXENTRY_NAMEMASK;
 
-	return error;
+		if (git_vector_insert(&data->added, entry) < 0) {
+			index_entry_free(entry);
+			return -1;
+		}
+	}
+
+	return git_vector_insert(&data->new_entries, entry);
 }
 
-static int write_extension(git_filebuf *file, struct index_extension *header, git_buf *data)
+/* whether the `count` old entries from the current one are all of the
+ * ones in the directory `dir` (which ends in a slash) */
+static bool read_tree_old_dir_is(
+	read_tree_data *data, const char *dir, size_t dirlen, size_t count)
 {
-	struct index_extension ondisk;
-	int error = 0;
+	size_t end = data->old_pos + count;
+	const git_index_entry *last, *next;
 
-	memset(&ondisk, 0x0, sizeof(struct index_extension));
-	memcpy(&ondisk, header, 4);
-	ondisk.extension_size = htonl(header->extension_size);
+	if (count == 0 || end > data->old_entries->length)
+		return false;
 
-	if ((error = git_filebuf_write(file, &ondisk, sizeof(struct index_extension))) == 0)
-		error = git_filebuf_write(file, data->ptr, data->size);
+	last = read_tree_old_entry(data, end - 1);
+	next = read_tree_old_entry(data, end);
 
-	return error;
+	return !strncmp(read_tree_old_entry(data, data->old_pos)->path, dir, dirlen) &&
+		!strncmp(last->path, dir, dirlen) &&
+		(next == NULL || strncmp(next->path, dir, dirlen) != 0);
 }
 
-static int create_name_extension_data(git_buf *name_buf, git_index_name_entry *conflict_name)
+static int read_tree_dir(
+	read_tree_data *data, const git_tree *tree, git_tree_cache *cache);
+
+static int read_tree_subdir(
+	read_tree_data *data, const git_tree_entry *te, git_tree_cache *cache,
+	git_tree_cache **old_children, size_t old_count)
 {
-	int error = 0;
+	git_tree_cache *child;
+	git_tree *subtree;
+	size_t i;
+	int error;
 
-	if (conflict_name->ancestor == NULL)
-		error = git_buf_put(name_buf, "\0", 1);
-	else
-		error = git_buf_put(name_buf, conflict_name->ancestor, strlen(conflict_name->ancestor) + 1);
+	if (read_tree_drop_before(data, data->path.ptr) < 0 ||
+		git_tree_cache_reuse_child(&child, cache,
+			old_children, old_count, te->filename, te->filename_len) < 0)
+		return -1;
 
-	if (error != 0)
-		goto on_error;
+	/* an unchanged subtree keeps all of its entries, and its cache */
+	if (child->entries >= 0 && git_oid_equal(&child->oid, &te->oid) &&
+		read_tree_old_dir_is(data,
+			data->path.ptr, data->path.size, (size_t)child->entries)) {
+		for (i = 0; i < (size_t)child->entries; ++i) {
+			if (git_vector_insert(&data->new_entries,
+					data->old_entries->contents[data->old_pos++]) < 0)
+				return -1;
+		}
 
-	if (conflict_name->ours == NULL)
-		error = git_buf_put(name_buf, "\0", 1);
-	else
-		error = git_buf_put(name_buf, conflict_name->ours, strlen(conflict_name->ours) + 1);
+		return 0;
+	}
 
-	if (error != 0)
-		goto on_error;
+	if ((error = git_tree_lookup(&subtree, data->repo, &te->oid)) < 0)
+		return error;
 
-	if (conflict_name->theirs == NULL)
-		error = git_buf_put(name_buf, "\0", 1);
-	else
-		error = git_buf_put(name_buf, conflict_name->theirs, strlen(conflict_name->theirs) + 1);
+	error = read_tree_dir(data, subtree, child);
 
-on_error:
+	git_tree_free(subtree);
 	return error;
 }
 
-static int write_name_extension(git_index *index, git_filebuf *file)
+static int read_tree_dir(
+	read_tree_data *data, const git_tree *tree, git_tree_cache *cache)
 {
-	git_buf name_buf = GIT_BUF_INIT;
-	git_vector *out = &index->names;
-	git_index_name_entry *conflict_name;
-	struct index_extension extension;
-	size_t i;
+	size_t i, count = git_tree_entrycount(tree), dirlen = data->path.size;
+	git_tree_cache **old_children = cache->children;
+	size_t old_count = cache->children_count;
 	int error = 0;
 
-	git_vector_foreach(out, i, conflict_name) {
-		if ((error = create_name_extension_data(&name_buf, conflict_name)) < 0)
-			goto done;
-	}
+	cache->entries = -1;
+	cache->children = NULL;
+	cache->children_count = 0;
 
-	memset(&extension, 0x0, sizeof(struct index_extension));
-	memcpy(&extension.signature, INDEX_EXT_CONFLICT_NAME_SIG, 4);
-	extension.extension_size = (uint32_t)name_buf.size;
+	for (i = 0; !error && i < count; ++i) {
+		const git_tree_entry *te = git_tree_entry_byindex(tree, i);
 
-	error = write_extension(file, &extension, &name_buf);
+		git_buf_truncate(&data->path, dirlen);
+		git_buf_put(&data->path, te->filename, te->filename_len);
 
-	git_buf_free(&name_buf);
+		if (git_tree_entry__is_tree(te)) {
+			git_buf_putc(&data->path, '/');
 
-done:
-	return error;
-}
+			if (git_buf_oom(&data->path))
+				error = -1;
+			else
+				error = read_tree_subdir(data, te, cache, old_children, old_count);
+		} else {
+			error = git_buf_oom(&data->path) ? -1 : read_tree_file(data, te);
+		}
+	}
 
-static int create_reuc_extension_data(git_buf *reuc_buf, git_index_reuc_entry *reuc)
-{
-	int i;
-	int error = 0;
+	git_buf_truncate(&data->path, dirlen);
 
-	if ((error = git_buf_put(reuc_buf, reuc->path, strlen(reuc->path) + 1)) < 0)
+	for (i = 0; i < old_count; ++i)
+		git_tree_cache_free(old_children[i]);
+	git__free(old_children);
+
+	if (error < 0)
 		return error;
 
-	for (i = 0; i < 3; i++) {
-		if ((error = git_buf_printf(reuc_buf, "%o", reuc->mode[i])) < 0 ||
-			(error = git_buf_put(reuc_buf, "\0", 1)) < 0)
-			return error;
-	}
+	/* the index is about to hold exactly this tree */
+	git_oid_cpy(&cache->oid, git_tree_id(tree));
+	cache->entries = 0;
 
-	for (i = 0; i < 3; i++) {
-		if (reuc->mode[i] && (error = git_buf_put(reuc_buf, (char *)&reuc->oid[i].id, GIT_OID_RAWSZ)) < 0)
-			return error;
-	}
+	for (i = 0; i < cache->children_count; ++i)
+		cache->entries += cache->children[i]->entries;
+	for (i = 0; i < count; ++i)
+		if (!git_tree_entry__is_tree(git_tree_entry_byindex(tree, i)))
+			cache->entries++;
 
 	return 0;
 }
 
-static int write_reuc_extension(git_index *index, git_filebuf *file)
+int git_index_read_tree(git_index *index, const git_tree *tree)
 {
-	git_buf reuc_buf = GIT_BUF_INIT;
-	git_vector *out = &index->reuc;
-	git_index_reuc_entry *reuc;
-	struct index_extension extension;
-	size_t i;
 	int error = 0;
+	git_vector case_sorted = GIT_VECTOR_INIT;
+	git_index_entry *entry;
+	read_tree_data data;
+	size_t i;
 
-	git_vector_foreach(out, i, reuc) {
-		if ((error = create_reuc_extension_data(&reuc_buf, reuc)) < 0)
+	assert(index && tree);
+
+	memset(&data, 0, sizeof(data));
+	data.repo = git_tree_owner(tree);
+
+	if (index_sort_if_needed(index, true) < 0)
+		return -1;
+
+	if (git_mutex_lock(&index->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to acquire index lock");
+		return -1;
+	}
+
+	/* the tree is in case-sensitive order, so the entries must be too */
+	if (index->ignore_case) {
+		if ((error = git_vector_dup(
+				&case_sorted, &index->entries, git_index_entry_cmp)) < 0)
 			goto done;
+
+		git_vector_sort(&case_sorted);
+		data.old_entries = &case_sorted;
+	} else {
+		data.old_entries = &index->entries;
 	}
 
-	memset(&extension, 0x0, sizeof(struct index_extension));
-	memcpy(&extension.signature, INDEX_EXT_UNMERGED_SIG, 4);
-	extension.extension_size = (uint32_t)reuc_buf.size;
+	if ((error = git_vector_init(&data.new_entries,
+			index->entries.length, index->entries._cmp)) < 0 ||
+		(error = git_vector_init(&data.added, 0, NULL)) < 0 ||
+		(error = git_vector_init(&data.removed, 0, NULL)) < 0)
+		goto done;
 
-	error = write_extension(file, &extension, &reuc_buf);
+	if (index->tree == NULL &&
+		(error = git_tree_cache_new(&index->tree, "", 0, NULL)) < 0)
+		goto done;
 
-	git_buf_free(&reuc_buf);
+	if ((error = read_tree_dir(&data, tree, index->tree)) < 0) {
+		/* the cache now describes neither the old nor the new entries */
+		git_tree_cache_free(index->tree);
+		index->tree = NULL;
 
-done:
-	return error;
-}
+		git_vector_foreach(&data.added, i, entry)
+			index_entry_free(entry);
+		goto done;
+	}
 
-static int write_index(git_index *index, git_filebuf *file)
-{
-	git_oid hash_final;
-	struct index_header header;
-	bool is_extended;
-	uint32_t index_version_number;
+	/* any entry that is left sorts after every path in the tree */
+	while (data.old_pos < data.old_entries->length) {
+		if ((error = git_vector_insert(&data.removed,
+				data.old_entries->contents[data.old_pos++])) < 0)
+			goto done;
+	}
 
-	assert(index && file);
+	git_vector_foreach(&data.removed, i, entry) {
+		if (index->entries_map)
+			index_map_remove(index, entry);
 
-	is_extended = is_index_extended(index);
-	index_version_number = is_extended ? INDEX_VERSION_NUMBER_EXT : INDEX_VERSION_NUMBER;
+		if (git_atomic_get(&index->readers) > 0)
+			git_vector_insert(&index->deleted, entry);
+		else
+			index_entry_free(entry);
+	}
 
-	header.signature = htonl(INDEX_HEADER_SIG);
-	header.version = htonl(index_version_number);
-	header.entry_count = htonl((uint32_t)index->entries.length);
+	git_vector_foreach(&data.added, i, entry) {
+		if (index->entries_map && index_map_add(index, entry) < 0) {
+			index_map_free(index);
+			giterr_clear();
+		}
+	}
 
-	if (git_filebuf_write(file, &header, sizeof(struct index_header)) < 0)
-		return -1;
+	git_vector_swap(&data.new_entries, &index->entries);
 
-	if (write_entries(index, file) < 0)
-		return -1;
+	/* the entries were added in case-sensitive order */
+	git_vector_set_sorted(&index->entries, !index->ignore_case);
+	git_vector_sort(&index->entries);
 
-	/* TODO: write tree cache extension */
+	git_index_reuc_clear(index);
+	git_index_name_clear(index);
 
-	/* write the rename conflict extension */
-	if (index->names.length > 0 && write_name_extension(index, file) < 0)
-		return -1;
+	git_futils_filestamp_set(&index->stamp, NULL);
 
-	/* write the reuc extension */
-	if (index->reuc.length > 0 && write_reuc_extension(index, file) < 0)
-		return -1;
+done:
+	git_mutex_unlock(&index->lock);
 
-	/* get out the hash for all the contents we've appended to the file */
-	git_filebuf_hash(&hash_final, file);
+	git_vector_free(&case_sorted);
+	git_vector_free(&data.new_entries);
+	git_vector_free(&data.added);
+	git_vector_free(&data.removed);
+	git_buf_free(&data.path);
 
-	/* write it at the end of the file */
-	return git_filebuf_write(file, hash_final.id, GIT_OID_RAWSZ);
+	return error;
 }
 
-int git_index_entry_stage(const git_index_entry *entry)
+git_repository *git_index_owner(const git_index *index)
 {
-	return GIT_IDXENTRY_STAGE(entry);
+	return INDEX_OWNER(index);
 }
 
-typedef struct read_tree_data {
-	git_vector *old_entries;
-	git_vector *new_entries;
-	git_vector_cmp entry_cmp;
-} read_tree_data;
+/*
+ * Files that add_all and update_all want in the index are collected into
+ * a batch, whose files are then read, filtered, hashed and written to the
+ * object database by a few threads at once.  The resulting entries are
+ * added to the index in the order the files were found.
+ */
+typedef struct {
+	char *path;             /* file to hash if there is no entry yet */
+	git_index_entry *entry; /* entry to add, whose id is to be filled */
+	git_workers_error error;
+} index_add_item;
+
+typedef struct {
+	git_index *index;
+	git_array_t(index_add_item) items;
+	git_workers workers;
+} index_add_batch;
 
-static int read_tree_cb(
-	const char *root, const git_tree_entry *tentry, void *payload)
+static void index_add_batch_work(git_workers *workers, void *payload)
 {
-	read_tree_data *data = payload;
-	git_index_entry *entry = NULL, *old_entry;
-	git_buf path = GIT_BUF_INIT;
-	size_t pos;
+	index_add_batch *batch = payload;
+	git_repository *repo = INDEX_OWNER(batch->index);
+	index_add_item *item;
+	size_t i;
+	int error;
 
-	if (git_tree_entry__is_tree(tentry))
-		return 0;
+	while (git_workers__next(&i, workers)) {
+		item = git_array_get(batch->items, i);
 
-	if (git_buf_joinpath(&path, root, tentry->filename) < 0)
-		return -1;
+		if (item->entry)
+			error = git_blob_create_fromworkdir(
+				&item->entry->id, repo, item->entry->path);
+		else
+			error = index_entry_init(&item->entry, batch->index, item->path);
 
-	entry = index_entry_alloc(path.ptr);
-	GITERR_CHECK_ALLOC(entry);
+		if (error >= 0)
+			continue;
 
-	entry->mode = tentry->attr;
-	entry->id = tentry->oid;
+		git_workers__error_keep(&item->error, error);
 
-	/* look for corresponding old entry and copy data to new entry */
-	if (data->old_entries != NULL &&
-		!index_find_in_entries(
-			&pos, data->old_entries, data->entry_cmp, path.ptr, 0, 0) &&
-		(old_entry = git_vector_get(data->old_entries, pos)) != NULL &&
-		entry->mode == old_entry->mode &&
-		git_oid_equal(&entry->id, &old_entry->id))
-	{
-		index_entry_cpy(entry, old_entry);
-		entry->flags_extended = 0;
+		/* a file that has gone is no reason to stop */
+		if (error != GIT_ENOTFOUND)
+			git_workers__stop(workers);
 	}
+}
 
-	if (path.size < GIT_IDXENTRY_NAMEMASK)
-		entry->flags = path.size & GIT_IDXENTRY_NAMEMASK;
-	else
-		entry->flags = GIT_IDXENTRY_NAMEMASK;
+static void index_add_batch_hash(index_add_batch *batch)
+{
+	unsigned int threads = git_workers__threads(git_index__threads,
+		batch->items.size, INDEX_FILES_PER_THREAD);
 
-	git_buf_free(&path);
+	git_workers__run(&batch->workers, batch->items.size, threads,
+		index_add_batch_work, batch);
+}
 
-	if (git_vector_insert(data->new_entries, entry) < 0) {
-		index_entry_free(entry);
-		return -1;
-	}
+static int index_add_batch_push(
+	index_add_batch *batch, const char *path, const git_index_entry *entry)
+{
+	index_add_item *item = git_array_alloc(batch->items);
+	GITERR_CHECK_ALLOC(item);
+
+	memset(item, 0, sizeof(*item));
 
+	if (entry)
+		return index_entry_dup(&item->entry, entry);
+
+	item->path = git__strdup(path);
+	GITERR_CHECK_ALLOC(item->path);
 	return 0;
 }
 
-int git_index_read_tree(git_index *index, const git_tree *tree)
+static void index_add_batch_clear(index_add_batch *batch)
+{
+	size_t i;
+
+	for (i = 0; i < batch->items.size; ++i) {
+		index_add_item *item = git_array_get(batch->items, i);
+
+		git__free(item->path);
+		git_workers__error_free(&item->error);
+		index_entry_free(item->entry);
+	}
+
+	git_array_clear(batch->items);
+}
+
+/* Hash the files in the batch, then add them to the index in order.
+ * Files that have gone are removed from the index if `remove_missing`.
+ */
+static int index_add_batch_flush(index_add_batch *batch, bool remove_missing)
 {
+	git_index *index = batch->index;
+	size_t i;
 	int error = 0;
-	git_vector entries = GIT_VECTOR_INIT;
-	read_tree_data data;
 
-	git_vector_set_cmp(&entries, index->entries._cmp); /* match sort */
+	index_add_batch_hash(batch);
 
-	data.old_entries = &index->entries;
-	data.new_entries = &entries;
-	data.entry_cmp   = index->entries_search;
+	for (i = 0; !error && i < batch->items.size; ++i) {
+		index_add_item *item = git_array_get(batch->items, i);
+		const char *path;
 
-	if (index_sort_if_needed(index, true) < 0)
-		return -1;
+		if (item->error.error == GIT_ENOTFOUND && remove_missing) {
+			if ((error = git_index_remove_bypath(index, item->path)) < 0)
+				break;
+			continue;
+		}
 
-	error = git_tree_walk(tree, GIT_TREEWALK_POST, read_tree_cb, &data);
+		if ((error = git_workers__error_restore(&item->error)) < 0)
+			break;
 
-	if (!error) {
-		git_vector_sort(&entries);
+		/* index_insert takes the entry, even if it fails */
+		if ((error = index_insert(index, &item->entry, 1)) < 0) {
+			item->entry = NULL;
+			break;
+		}
 
-		if ((error = git_index_clear(index)) < 0)
-			/* well, this isn't good */;
-		else if (git_mutex_lock(&index->lock) < 0) {
-			giterr_set(GITERR_OS, "Unable to acquire index lock");
-			error = -1;
-		} else {
-			git_vector_swap(&entries, &index->entries);
-			git_mutex_unlock(&index->lock);
+		path = item->entry->path;
+		item->entry = NULL;
+
+		/* add implies conflict resolved, move conflict entries to REUC */
+		if ((error = index_conflict_to_reuc(index, path)) < 0) {
+			if (error != GIT_ENOTFOUND)
+				break;
+			giterr_clear();
+			error = 0;
 		}
 	}
 
-	git_vector_free(&entries);
-
+	index_add_batch_clear(batch);
 	return error;
 }
 
-git_repository *git_index_owner(const git_index *index)
-{
-	return INDEX_OWNER(index);
-}
-
 int git_index_add_all(
 	git_index *index,
 	const git_strarray *paths,
@@ -2367,16 +4652,17 @@ int git_index_add_all(
 	git_repository *repo;
 	git_iterator *wditer = NULL;
 	const git_index_entry *wd = NULL;
-	git_index_entry *entry;
 	git_pathspec ps;
 	const char *match;
 	size_t existing;
 	bool no_fnmatch = (flags & GIT_INDEX_ADD_DISABLE_PATHSPEC_MATCH) != 0;
 	int ignorecase;
-	git_oid blobid;
+	index_add_batch batch = { 0 };
 
 	assert(index);
 
+	batch.index = index;
+
 	if (INDEX_OWNER(index) == NULL)
 		return create_index_error(-1,
 			"Could not add paths to index. "
@@ -2430,34 +4716,26 @@ int git_index_add_all(
 		 * match to the file in the index and skip this work if it is?
 		 */
 
-		/* write the blob to disk and get the oid */
-		if ((error = git_blob_create_fromworkdir(&blobid, repo, wd->path)) < 0)
-			break;
-
-		/* make the new entry to insert */
-		if ((error = index_entry_dup(&entry, wd)) < 0)
+		if ((error = index_add_batch_push(&batch, NULL, wd)) < 0)
 			break;
 
-		entry->id = blobid;
-
-		/* add working directory item to index */
-		if ((error = index_insert(index, &entry, 1)) < 0)
+		if (batch.items.size >= INDEX_ADD_BATCH_SIZE &&
+			(error = index_add_batch_flush(&batch, false)) < 0)
 			break;
-
-		git_tree_cache_invalidate_path(index->tree, wd->path);
-
-		/* add implies conflict resolved, move conflict entries to REUC */
-		if ((error = index_conflict_to_reuc(index, wd->path)) < 0) {
-			if (error != GIT_ENOTFOUND)
-				break;
-			giterr_clear();
-		}
 	}
 
 	if (error == GIT_ITEROVER)
 		error = 0;
 
+	/* the files found before any failure still get added */
+	if (batch.items.size > 0) {
+		int flush_error = index_add_batch_flush(&batch, false);
+		if (!error)
+			error = flush_error;
+	}
+
 cleanup:
+	index_add_batch_clear(&batch);
 	git_iterator_free(wditer);
 	git_pathspec__clear(&ps);
 
@@ -2482,9 +4760,12 @@ static int index_apply_to_all(
 	git_pathspec ps;
 	const char *match;
 	git_buf path = GIT_BUF_INIT;
+	index_add_batch batch = { 0 };
 
 	assert(index);
 
+	batch.index = index;
+
 	if ((error = git_pathspec__init(&ps, paths)) < 0)
 		return error;
 
@@ -2517,16 +4798,15 @@ static int index_apply_to_all(
 		case INDEX_ACTION_NONE:
 			break;
 		case INDEX_ACTION_UPDATE:
-			error = git_index_add_bypath(index, path.ptr);
-
-			if (error == GIT_ENOTFOUND) {
-				giterr_clear();
-
-				error = git_index_remove_bypath(index, path.ptr);
+			/* the files are hashed together once all of them are known,
+			 * which leaves the entries alone while they are walked; the
+			 * stages of a conflict only need to be hashed once
+			 */
+			if (batch.items.size > 0 && !index->entries_cmp_path(
+					git_array_last(batch.items)->path, path.ptr))
+				break;
 
-				if (!error) /* back up foreach if we removed this */
-					i--;
-			}
+			error = index_add_batch_push(&batch, path.ptr, NULL);
 			break;
 		case INDEX_ACTION_REMOVE:
 			if (!(error = git_index_remove_bypath(index, path.ptr)))
@@ -2539,6 +4819,13 @@ static int index_apply_to_all(
 		}
 	}
 
+	/* the updates made before any failure still take effect */
+	if (batch.items.size > 0) {
+		int flush_error = index_add_batch_flush(&batch, true);
+		if (!error)
+			error = flush_error;
+	}
+
 	git_buf_free(&path);
 	git_pathspec__clear(&ps);
 
@@ -11,11 +11,22 @@
 #include "filebuf.h"
 #include "vector.h"
 #include "tree-cache.h"
+#include "ewah.h"
+#include "idxmap.h"
+#include "pool.h"
 #include "git2/odb.h"
 #include "git2/index.h"
 
 #define GIT_INDEX_FILE "index"
 #define GIT_INDEX_FILE_MODE 0666
+#define GIT_INDEX_SHARED_FILE "sharedindex"
+
+/* The "link" extension of a split index, while it is being read */
+struct index_split_link {
+	git_oid shared_id;
+	git_ewah_bits deleted;
+	git_ewah_bits replaced;
+};
 
 struct git_index {
 	git_refcount rc;
@@ -25,14 +36,35 @@ struct git_index {
 
 	git_vector entries;
 
+	/* lookup of the entries, and of how many sit below each directory, by
+	 * path and stage; built on demand and kept in sync with `entries` */
+	git_idxmap *entries_map;
+	git_idxmap *dirs_map;
+	git_pool dir_names;
+
 	git_mutex  lock;    /* lock held while entries is being changed */
 	git_vector deleted; /* deleted entries if readers > 0 */
 	git_atomic readers; /* number of active iterators */
 
+	git_vector arenas;         /* pools holding entries read from disk */
+	git_vector deleted_arenas; /* arenas released while readers > 0 */
+
+	unsigned int version;
+
+	git_index *shared;      /* entries of the shared index, when split */
+	git_oid shared_id;      /* checksum naming the shared index file */
+	struct index_split_link *link;
+	unsigned int split_max_change; /* percentage that triggers a rewrite */
+	git_time_t split_shared_expire; /* seconds a replaced shared index stays */
+
 	unsigned int on_disk:1;
 	unsigned int ignore_case:1;
 	unsigned int distrust_filemode:1;
 	unsigned int no_symlinks:1;
+	unsigned int split:1;
+	unsigned int batching:1;
+
+	git_vector batch; /* changes recorded since `git_index_batch_begin` */
 
 	git_tree_cache *tree;
 
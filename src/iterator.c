@@ -201,6 +201,7 @@ typedef struct {
 	bool path_has_filename;
 	bool entry_is_current;
 	int (*strncomp)(const char *a, const char *b, size_t sz);
+	const git_vector *skipped_trees;
 } tree_iterator;
 
 static char *tree_iterator__current_filename(
@@ -332,9 +333,36 @@ GIT_INLINE(bool) tree_iterator__at_tree(tree_iterator *ti)
 			ti->head->entries[ti->head->current]->tree != NULL);
 }
 
+/* is the entry in the directory being expanded wanted by the pathspec
+ * and not one of the subtrees that the caller asked to skip?
+ */
+static bool tree_iterator__wanted(tree_iterator *ti, const git_tree_entry *te)
+{
+	size_t dirlen = ti->path.size;
+	bool wanted = true;
+
+	if (!ti->base.prefixes &&
+		(!ti->skipped_trees || !git_tree_entry__is_tree(te)))
+		return true;
+
+	if (git_buf_put(&ti->path, te->filename, te->filename_len) < 0)
+		return true;
+
+	if (ti->base.prefixes)
+		wanted = git_pathspec__prefixes_match(
+			ti->base.prefixes, ti->path.ptr, ti->path.size);
+
+	if (wanted && ti->skipped_trees && git_tree_entry__is_tree(te))
+		wanted = (git_vector_bsearch(
+			NULL, (git_vector *)ti->skipped_trees, ti->path.ptr) < 0);
+
+	git_buf_truncate(&ti->path, dirlen);
+
+	return wanted;
+}
+
 static int tree_iterator__push_frame(tree_iterator *ti)
 {
-	int error = 0;
 	tree_iterator_frame *head = ti->head, *tf = NULL;
 	size_t i, n_entries = 0;
 
@@ -348,28 +376,40 @@ static int tree_iterator__push_frame(tree_iterator *ti)
 		n_entries * sizeof(tree_iterator_entry *), 1);
 	GITERR_CHECK_ALLOC(tf);
 
-	tf->n_entries = n_entries;
-
-	tf->up     = head;
-	head->down = tf;
-	ti->head   = tf;
-
 	for (i = head->current, n_entries = 0; i < head->next; ++i) {
 		git_tree *tree = head->entries[i]->tree;
 		size_t j, max_j = git_tree_entrycount(tree);
 
 		for (j = 0; j < max_j; ++j) {
-			tree_iterator_entry *entry = git_pool_malloc(&ti->pool, 1);
+			const git_tree_entry *te = git_tree_entry_byindex(tree, j);
+			tree_iterator_entry *entry;
+
+			if (!tree_iterator__wanted(ti, te))
+				continue;
+
+			entry = git_pool_malloc(&ti->pool, 1);
 			GITERR_CHECK_ALLOC(entry);
 
 			entry->parent = head->entries[i];
-			entry->te     = git_tree_entry_byindex(tree, j);
+			entry->te     = te;
 			entry->tree   = NULL;
 
 			tf->entries[n_entries++] = entry;
 		}
 	}
 
+	/* a subtree with nothing wanted is treated as if it was empty */
+	if (!n_entries && head->up != NULL) {
+		git__free(tf);
+		return GIT_ENOTFOUND;
+	}
+
+	tf->n_entries = n_entries;
+
+	tf->up     = head;
+	head->down = tf;
+	ti->head   = tf;
+
 	/* if ignore_case, sort entries case insensitively */
 	if (iterator__ignore_case(ti))
 		git__tsort_r(
@@ -392,14 +432,7 @@ static int tree_iterator__push_frame(tree_iterator *ti)
 
 	ti->path_has_filename = ti->entry_is_current = false;
 
-	if ((error = tree_iterator__set_next(ti, tf)) < 0)
-		return error;
-
-	/* autoexpand as needed */
-	if (!iterator__include_trees(ti) && tree_iterator__at_tree(ti))
-		return tree_iterator__push_frame(ti);
-
-	return 0;
+	return tree_iterator__set_next(ti, tf);
 }
 
 static bool tree_iterator__pop_frame(tree_iterator *ti, bool final)
@@ -435,6 +468,37 @@ static void tree_iterator__pop_all(tree_iterator *ti, bool to_end, bool final)
 	}
 }
 
+/* move past the current item and everything below it */
+static int tree_iterator__advance_over(tree_iterator *ti)
+{
+	tree_iterator_frame *tf = ti->head;
+
+	if (ti->path_has_filename) {
+		git_buf_rtruncate_at_char(&ti->path, '/');
+		ti->path_has_filename = ti->entry_is_current = false;
+	}
+
+	/* scan forward and up, advancing in frame or popping frame when done */
+	while (!tree_iterator__move_to_next(ti, tf) &&
+		   tree_iterator__pop_frame(ti, false))
+		tf = ti->head;
+
+	/* find next and load trees */
+	return tree_iterator__set_next(ti, tf);
+}
+
+/* autoexpand trees until reaching an item that is to be returned */
+static int tree_iterator__expand(tree_iterator *ti)
+{
+	int error = 0;
+
+	while (!error && !iterator__include_trees(ti) && tree_iterator__at_tree(ti))
+		if ((error = tree_iterator__push_frame(ti)) == GIT_ENOTFOUND)
+			error = tree_iterator__advance_over(ti);
+
+	return error;
+}
+
 static int tree_iterator__update_entry(tree_iterator *ti)
 {
 	tree_iterator_frame *tf;
@@ -496,8 +560,9 @@ static int tree_iterator__advance_into(
 
 	iterator__clear_entry(entry);
 
-	if (tree_iterator__at_tree(ti))
-		error = tree_iterator__push_frame(ti);
+	if (tree_iterator__at_tree(ti) &&
+		!(error = tree_iterator__push_frame(ti)))
+		error = tree_iterator__expand(ti);
 
 	if (!error && entry)
 		error = tree_iterator__current(entry, self);
@@ -521,26 +586,18 @@ static int tree_iterator__advance(
 		return tree_iterator__current(entry, self);
 
 	if (iterator__do_autoexpand(ti) && iterator__include_trees(ti) &&
-		tree_iterator__at_tree(ti))
-		return tree_iterator__advance_into(entry, self);
+		tree_iterator__at_tree(ti)) {
+		error = tree_iterator__advance_into(entry, self);
 
-	if (ti->path_has_filename) {
-		git_buf_rtruncate_at_char(&ti->path, '/');
-		ti->path_has_filename = ti->entry_is_current = false;
+		/* step over trees that hold nothing wanted */
+		if (error != GIT_ENOTFOUND)
+			return error;
 	}
 
-	/* scan forward and up, advancing in frame or popping frame when done */
-	while (!tree_iterator__move_to_next(ti, tf) &&
-		   tree_iterator__pop_frame(ti, false))
-		tf = ti->head;
-
-	/* find next and load trees */
-	if ((error = tree_iterator__set_next(ti, tf)) < 0)
-		return error;
-
 	/* deal with include_trees / auto_expand as needed */
-	if (!iterator__include_trees(ti) && tree_iterator__at_tree(ti))
-		return tree_iterator__advance_into(entry, self);
+	if ((error = tree_iterator__advance_over(ti)) < 0 ||
+		(error = tree_iterator__expand(ti)) < 0)
+		return error;
 
 	return tree_iterator__current(entry, self);
 }
@@ -554,6 +611,7 @@ static int tree_iterator__seek(git_iterator *self, const char *prefix)
 static int tree_iterator__reset(
 	git_iterator *self, const char *start, const char *end)
 {
+	int error;
 	tree_iterator *ti = (tree_iterator *)self;
 
 	tree_iterator__pop_all(ti, false, false);
@@ -561,7 +619,11 @@ static int tree_iterator__reset(
 	if (iterator__reset_range(self, start, end) < 0)
 		return -1;
 
-	return tree_iterator__push_frame(ti); /* re-expand root tree */
+	/* re-expand root tree */
+	if ((error = tree_iterator__push_frame(ti)) < 0)
+		return error;
+
+	return tree_iterator__expand(ti);
 }
 
 static int tree_iterator__at_end(git_iterator *self)
@@ -628,7 +690,8 @@ int git_iterator_for_tree(
 
 	if ((error = git_pool_init(&ti->pool, sizeof(tree_iterator_entry),0)) < 0 ||
 		(error = tree_iterator__create_root_frame(ti, tree)) < 0 ||
-		(error = tree_iterator__push_frame(ti)) < 0) /* expand root now */
+		(error = tree_iterator__push_frame(ti)) < 0 || /* expand root now */
+		(error = tree_iterator__expand(ti)) < 0)
 		goto fail;
 
 	*iter = (git_iterator *)ti;
@@ -666,13 +729,50 @@ static const git_index_entry *index_iterator__index_entry(index_iterator *ii)
 	return ie;
 }
 
+/* jump over a run of entries that the pathspec prefixes rule out */
+static bool index_iterator__skip_pruned(
+	index_iterator *ii, const git_index_entry *ie)
+{
+	const git_pathspec_prefixes *prefixes = ii->base.prefixes;
+	const char *next;
+	size_t pos;
+
+	/* the tree items that are made up from the paths are not pruned */
+	if (!prefixes || iterator__include_trees(ii) ||
+		git_pathspec__prefixes_match(prefixes, ie->path, strlen(ie->path)))
+		return false;
+
+	if (prefixes->ignore_case != iterator__ignore_case(ii))
+		next = NULL;
+	else if ((next = git_pathspec__prefixes_next(prefixes, ie->path)) == NULL) {
+		ii->current = git_vector_length(&ii->entries);
+		return true;
+	}
+
+	if (next != NULL) {
+		git_index_snapshot_find(
+			&pos, &ii->entries, ii->entry_srch, next, 0, 0);
+
+		if (pos > ii->current) {
+			ii->current = pos;
+			return true;
+		}
+	}
+
+	ii->current++;
+	return true;
+}
+
 static const git_index_entry *index_iterator__skip_conflicts(index_iterator *ii)
 {
 	const git_index_entry *ie;
 
-	while ((ie = index_iterator__index_entry(ii)) != NULL &&
-		   git_index_entry_stage(ie) != 0)
-		ii->current++;
+	while ((ie = index_iterator__index_entry(ii)) != NULL) {
+		if (git_index_entry_stage(ie) != 0)
+			ii->current++;
+		else if (!index_iterator__skip_pruned(ii, ie))
+			break;
+	}
 
 	return ie;
 }
@@ -910,6 +1010,7 @@ struct fs_iterator {
 	size_t root_len;
 	uint32_t dirload_flags;
 	int depth;
+	const git_vector *skipped_files;
 
 	int (*enter_dir_cb)(fs_iterator *self);
 	int (*leave_dir_cb)(fs_iterator *self);
@@ -969,6 +1070,48 @@ static int fs_iterator__entry_cmp(const void *i, const void *item)
 	return fi->base.prefixcomp(fi->base.start, ps->path);
 }
 
+static bool fs_iterator__wanted_path(
+	const char *path, size_t path_len, void *payload)
+{
+	fs_iterator *fi = payload;
+
+	if (fi->base.prefixes &&
+		!git_pathspec__prefixes_match(fi->base.prefixes, path, path_len))
+		return false;
+
+	/* skipped files are dropped before they are even stat'ed */
+	return !fi->skipped_files || path[path_len] != '\0' ||
+		git_vector_bsearch(
+			NULL, (git_vector *)fi->skipped_files, path) < 0;
+}
+
+/* directories are judged by their name alone, as when they are loaded */
+static bool fs_iterator__wanted(fs_iterator *fi, const git_path_with_stat *ps)
+{
+	size_t len = ps->path_len;
+
+	if (!fi->base.prefixes && !fi->skipped_files)
+		return true;
+
+	if (len > 0 && ps->path[len - 1] == '/') {
+		if (!fi->base.prefixes)
+			return true;
+		len--;
+	}
+
+	return fs_iterator__wanted_path(ps->path, len, fi);
+}
+
+static void fs_iterator__skip_unwanted(
+	fs_iterator *fi, fs_iterator_frame *ff)
+{
+	git_path_with_stat *ps;
+
+	while ((ps = git_vector_get(&ff->entries, ff->index)) != NULL &&
+		!fs_iterator__wanted(fi, ps))
+		ff->index++;
+}
+
 static void fs_iterator__seek_frame_start(
 	fs_iterator *fi, fs_iterator_frame *ff)
 {
@@ -980,6 +1123,8 @@ static void fs_iterator__seek_frame_start(
 			&ff->index, &ff->entries, fs_iterator__entry_cmp, fi);
 	else
 		ff->index = 0;
+
+	fs_iterator__skip_unwanted(fi, ff);
 }
 
 static int fs_iterator__expand_dir(fs_iterator *fi)
@@ -998,7 +1143,10 @@ static int fs_iterator__expand_dir(fs_iterator *fi)
 
 	error = git_path_dirload_with_stat(
 		fi->path.ptr, fi->root_len, fi->dirload_flags,
-		fi->base.start, fi->base.end, &ff->entries);
+		fi->base.start, fi->base.end,
+		(fi->base.prefixes || fi->skipped_files) ?
+			fs_iterator__wanted_path : NULL, fi,
+		&ff->entries);
 
 	if (error < 0) {
 		git_error_state last_error = { 0 };
@@ -1090,10 +1238,13 @@ static int fs_iterator__advance_over(
 		*entry = NULL;
 
 	while (fi->entry.path != NULL) {
-		ff   = fi->stack;
-		next = git_vector_get(&ff->entries, ++ff->index);
+		ff = fi->stack;
+		ff->index++;
+
+		/* only a frame loaded before the prefixes were set has these */
+		fs_iterator__skip_unwanted(fi, ff);
 
-		if (next != NULL)
+		if ((next = git_vector_get(&ff->entries, ff->index)) != NULL)
 			break;
 
 		fs_iterator__pop_frame(fi, ff, false);
@@ -1427,6 +1578,15 @@ void git_iterator_free(git_iterator *iter)
 	git__free(iter);
 }
 
+void git_iterator_set_prefixes(
+	git_iterator *iter, const git_pathspec_prefixes *prefixes)
+{
+	if (prefixes && !prefixes->prefixes.length)
+		prefixes = NULL;
+
+	iter->prefixes = prefixes;
+}
+
 int git_iterator_set_ignore_case(git_iterator *iter, bool ignore_case)
 {
 	bool desire_ignore_case  = (ignore_case != 0);
@@ -1448,6 +1608,34 @@ int git_iterator_set_ignore_case(git_iterator *iter, bool ignore_case)
 	return 0;
 }
 
+git_tree *git_iterator_get_tree(git_iterator *iter)
+{
+	if (iter->type == GIT_ITERATOR_TYPE_TREE)
+		return ((tree_iterator *)iter)->root->entries[0]->tree;
+	return NULL;
+}
+
+void git_iterator_skip_trees(git_iterator *iter, const git_vector *paths)
+{
+	assert(iter->type == GIT_ITERATOR_TYPE_TREE);
+
+	if (paths && !paths->length)
+		paths = NULL;
+
+	((tree_iterator *)iter)->skipped_trees = paths;
+}
+
+void git_iterator_skip_files(git_iterator *iter, const git_vector *paths)
+{
+	assert(iter->type == GIT_ITERATOR_TYPE_FS ||
+		iter->type == GIT_ITERATOR_TYPE_WORKDIR);
+
+	if (paths && !paths->length)
+		paths = NULL;
+
+	((fs_iterator *)iter)->skipped_files = paths;
+}
+
 git_index *git_iterator_get_index(git_iterator *iter)
 {
 	if (iter->type == GIT_ITERATOR_TYPE_INDEX)
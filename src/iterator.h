@@ -11,6 +11,7 @@
 #include "git2/index.h"
 #include "vector.h"
 #include "buffer.h"
+#include "pathspec.h"
 
 typedef struct git_iterator git_iterator;
 
@@ -52,6 +53,7 @@ struct git_iterator {
 	char *start;
 	char *end;
 	int (*prefixcomp)(const char *str, const char *prefix);
+	const git_pathspec_prefixes *prefixes;
 	size_t stat_calls;
 	unsigned int flags;
 };
@@ -115,6 +117,16 @@ extern int git_iterator_for_filesystem(
 
 extern void git_iterator_free(git_iterator *iter);
 
+/*
+ * Skip everything that cannot match a pathspec with the given `prefixes`
+ * (may be NULL to look at everything again); directories that are ruled
+ * out are not read at all.  The prefixes are not copied and must outlive
+ * their use by the iterator.  Items already loaded are only skipped after
+ * a `git_iterator_reset`.
+ */
+extern void git_iterator_set_prefixes(
+	git_iterator *iter, const git_pathspec_prefixes *prefixes);
+
 /* Return a git_index_entry structure for the current value the iterator
  * is looking at or NULL if the iterator is at the end.
  *
@@ -158,7 +170,8 @@ GIT_INLINE(int) git_iterator_advance(
  *
  * For filesystem and working directory iterators, a tree (i.e. directory)
  * can be empty.  In that case, this function returns GIT_ENOTFOUND and
- * does not advance.  That can't happen for tree and index iterators.
+ * does not advance.  That can't happen for index iterators, nor for tree
+ * iterators unless pathspec prefixes rule out everything in the tree.
  */
 GIT_INLINE(int) git_iterator_advance_into(
 	const git_index_entry **entry, git_iterator *iter)
@@ -261,6 +274,26 @@ extern int git_iterator_current_workdir_path(
 /* Return index pointer if index iterator, else NULL */
 extern git_index *git_iterator_get_index(git_iterator *iter);
 
+/* Get the tree a tree iterator was created for, or NULL for other types */
+extern git_tree *git_iterator_get_tree(git_iterator *iter);
+
+/*
+ * Make a tree iterator leave out the subtrees at the given paths (written
+ * without a trailing slash and sorted by the vector's own comparison, or
+ * NULL to stop skipping).  The vector is not copied; as with prefixes,
+ * it only applies to trees loaded after the next `git_iterator_reset`.
+ */
+extern void git_iterator_skip_trees(git_iterator *iter, const git_vector *paths);
+
+/*
+ * Make a filesystem iterator leave out the entries at the given paths
+ * (sorted by the vector's own comparison, or NULL to stop skipping).
+ * They are dropped by name, before they are stat'ed, so a directory at
+ * one of these paths is left out as well.  As with `git_iterator_skip_trees`,
+ * the vector is not copied and it only applies after the next reset.
+ */
+extern void git_iterator_skip_files(git_iterator *iter, const git_vector *paths);
+
 typedef enum {
 	GIT_ITERATOR_STATUS_NORMAL = 0,
 	GIT_ITERATOR_STATUS_IGNORED = 1,
@@ -1542,7 +1542,7 @@ static int merge_index_insert_reuc(
 
 int index_from_diff_list(git_index **out, git_merge_diff_list *diff_list)
 {
-	git_index *index;
+	git_index *index = NULL;
 	size_t i;
 	git_index_entry *entry;
 	git_merge_diff *conflict;
@@ -1550,8 +1550,9 @@ int index_from_diff_list(git_index **out, git_merge_diff_list *diff_list)
 
 	*out = NULL;
 
-	if ((error = git_index_new(&index)) < 0)
-		return error;
+	if ((error = git_index_new(&index)) < 0 ||
+		(error = git_index_batch_begin(index)) < 0)
+		goto on_error;
 
 	git_vector_foreach(&diff_list->staged, i, entry) {
 		if ((error = git_index_add(index, entry)) < 0)
@@ -1575,6 +1576,9 @@ int index_from_diff_list(git_index **out, git_merge_diff_list *diff_list)
 			goto on_error;
 	}
 
+	if ((error = git_index_batch_commit(index, false)) < 0)
+		goto on_error;
+
 	/* Add each rename entry to the rename portion of the index. */
 	git_vector_foreach(&diff_list->conflicts, i, conflict) {
 		const char *ancestor_path, *our_path, *their_path;
@@ -2189,9 +2193,11 @@ static int merge_normalize_checkout_opts(
 
 	GIT_UNUSED(repo);
 
-	if (given_checkout_opts != NULL)
-		memcpy(checkout_opts, given_checkout_opts, sizeof(git_checkout_options));
-	else {
+	if (given_checkout_opts != NULL) {
+		GIT_INIT_STRUCTURE(checkout_opts, GIT_CHECKOUT_OPTIONS_VERSION);
+		git_checkout__options_read(checkout_opts, given_checkout_opts,
+			sizeof(git_checkout_options), 0, given_checkout_opts->version);
+	} else {
 		git_checkout_options default_checkout_opts = GIT_CHECKOUT_OPTIONS_INIT;
 		default_checkout_opts.checkout_strategy =  GIT_CHECKOUT_SAFE;
 
@@ -184,32 +184,102 @@ done:
 	return error;
 }
 
+struct hash_stream {
+	git_writestream parent;
+	git_hash_ctx *ctx;
+	size_t written;
+};
+
+static int hash_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	struct hash_stream *stream = (struct hash_stream *)s;
+
+	stream->written += len;
+	return git_hash_update(stream->ctx, buffer, len);
+}
+
+static int hash_stream_close(git_writestream *s)
+{
+	GIT_UNUSED(s);
+	return 0;
+}
+
+static void hash_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
+
+static int hashfd_streamed(
+	git_oid *out, git_file fd, size_t size, git_otype type, git_filter_list *fl)
+{
+	struct hash_stream stream;
+	git_hash_ctx ctx;
+	char hdr[64];
+	int hdr_len, error;
+
+	if (!git_object_typeisloose(type)) {
+		giterr_set(GITERR_INVALID, "Invalid object type for hash");
+		return -1;
+	}
+
+	if (p_lseek(fd, 0, SEEK_SET) < 0) {
+		giterr_set(GITERR_OS, "Could not rewind file for hashing");
+		return -1;
+	}
+
+	if ((error = git_hash_ctx_init(&ctx)) < 0)
+		return -1;
+
+	hdr_len = git_odb__format_object_header(hdr, sizeof(hdr), size, type);
+
+	memset(&stream, 0, sizeof(stream));
+	stream.parent.write = hash_stream_write;
+	stream.parent.close = hash_stream_close;
+	stream.parent.free = hash_stream_free;
+	stream.ctx = &ctx;
+
+	if ((error = git_hash_update(&ctx, hdr, hdr_len)) < 0 ||
+		(error = git_filter_list__stream_fd(fl, fd, &stream.parent)) < 0)
+		goto done;
+
+	/* the file changed between the two passes */
+	if (stream.written != size) {
+		giterr_set(GITERR_OS, "Error reading file for hashing");
+		error = -1;
+		goto done;
+	}
+
+	error = git_hash_final(out, &ctx);
+
+done:
+	git_hash_ctx_cleanup(&ctx);
+	return error;
+}
+
 int git_odb__hashfd_filtered(
 	git_oid *out, git_file fd, size_t size, git_otype type, git_filter_list *fl)
 {
 	int error;
-	git_buf raw = GIT_BUF_INIT;
+	git_buf post = GIT_BUF_INIT;
 
 	if (!fl)
 		return git_odb__hashfd(out, fd, size, type);
 
-	/* size of data is used in header, so we have to read the whole file
-	 * into memory to apply filters before beginning to calculate the hash
+	/* size of data is used in header, so the filtered content has to be
+	 * measured before the hash can be calculated; small results are kept
+	 * in memory, large ones are filtered a second time while hashing
 	 */
 
-	if (!(error = git_futils_readbuffer_fd(&raw, fd, size))) {
-		git_buf post = GIT_BUF_INIT;
-
-		error = git_filter_list_apply_to_data(&post, fl, &raw);
-
-		git_buf_free(&raw);
-
-		if (!error)
-			error = git_odb_hash(out, post.ptr, post.size, type);
+	if ((error = git_filter_list__buffer_fd(&post, &size, fl, fd)) < 0)
+		return error;
 
-		git_buf_free(&post);
-	}
+	if (error == 1)
+		error = git_odb_hash(out, post.ptr, post.size, type);
+	else
+		error = hashfd_streamed(out, fd, size, type, fl);
 
+	git_buf_free(&post);
 	return error;
 }
 
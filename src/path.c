@@ -1067,10 +1067,12 @@ int git_path_dirload_with_stat(
 	unsigned int flags,
 	const char *start_stat,
 	const char *end_stat,
+	bool (*filter)(const char *path, size_t path_len, void *payload),
+	void *payload,
 	git_vector *contents)
 {
 	int error;
-	unsigned int i;
+	unsigned int i, kept;
 	git_path_with_stat *ps;
 	git_buf full = GIT_BUF_INIT;
 	int (*strncomp)(const char *a, const char *b, size_t sz);
@@ -1090,12 +1092,23 @@ int git_path_dirload_with_stat(
 	strncomp = (flags & GIT_PATH_DIR_IGNORE_CASE) != 0 ?
 		git__strncasecmp : git__strncmp;
 
-	/* stat struct at start of git_path_with_stat, so shift path text */
-	git_vector_foreach(contents, i, ps) {
-		size_t path_len = strlen((char *)ps);
+	/* stat struct at start of git_path_with_stat, so shift path text
+	 * and drop the entries that the filter does not want
+	 */
+	for (i = 0, kept = 0; i < contents->length; ++i) {
+		size_t path_len;
+
+		ps = contents->contents[i];
+		path_len = strlen((char *)ps);
 		memmove(ps->path, ps, path_len + 1);
 		ps->path_len = path_len;
+
+		if (filter && !filter(ps->path, path_len, payload))
+			git__free(ps);
+		else
+			contents->contents[kept++] = ps;
 	}
+	contents->length = kept;
 
 	git_vector_foreach(contents, i, ps) {
 		/* skip if before start_stat or after end_stat */
@@ -352,12 +352,17 @@ extern int git_path_with_stat_cmp_icase(const void *a, const void *b);
  * 3. Entries that are directories will be suffixed with a '/'
  * 4. Optionally, you can be a start and end prefix and only elements
  *    after the start and before the end (inclusively) will be stat'ed.
+ * 5. Optionally, a filter can drop entries before they are stat'ed; it
+ *    is given the path of the entry (without a trailing '/') and returns
+ *    false for entries to leave out.
  *
  * @param path The directory to read from
  * @param prefix_len The trailing part of path to prefix to entry paths
  * @param flags GIT_PATH_DIR flags from above
  * @param start_stat As optimization, only stat values after this prefix
  * @param end_stat As optimization, only stat values before this prefix
+ * @param filter Callback to drop entries, or NULL to keep all of them
+ * @param payload Passed to the filter
  * @param contents Vector to fill with git_path_with_stat structures
  */
 extern int git_path_dirload_with_stat(
@@ -366,6 +371,8 @@ extern int git_path_dirload_with_stat(
 	uint32_t flags,
 	const char *start_stat,
 	const char *end_stat,
+	bool (*filter)(const char *path, size_t path_len, void *payload),
+	void *payload,
 	git_vector *contents);
 
 enum { GIT_PATH_NOTEQUAL = 0, GIT_PATH_EQUAL = 1, GIT_PATH_PREFIX = 2 };
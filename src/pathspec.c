@@ -229,6 +229,181 @@ bool git_pathspec__match(
 	return (result > 0);
 }
 
+static int pathspec_prefix_cmp(
+	const char *a, size_t alen, const char *b, size_t blen, bool icase)
+{
+	size_t i, len = min(alen, blen);
+	int ac, bc;
+
+	for (i = 0; i < len; ++i) {
+		ac = (unsigned char)a[i];
+		bc = (unsigned char)b[i];
+
+		if (icase) {
+			ac = tolower(ac);
+			bc = tolower(bc);
+		}
+
+		if (ac != bc)
+			return ac - bc;
+	}
+
+	return (alen < blen) ? -1 : (alen > blen);
+}
+
+static int pathspec_prefix_sort(const void *a, const void *b)
+{
+	return pathspec_prefix_cmp(a, strlen(a), b, strlen(b), false);
+}
+
+static int pathspec_prefix_isort(const void *a, const void *b)
+{
+	return pathspec_prefix_cmp(a, strlen(a), b, strlen(b), true);
+}
+
+static bool pathspec_prefix_of(
+	const char *pfx, size_t pfxlen, const char *path, size_t len, bool icase)
+{
+	return pfxlen <= len &&
+		!pathspec_prefix_cmp(pfx, pfxlen, path, pfxlen, icase);
+}
+
+int git_pathspec__prefixes_init(
+	git_pathspec_prefixes *pp, const git_vector *vspec, bool ignore_case)
+{
+	size_t i, len;
+	const git_attr_fnmatch *match;
+	char *pfx, *last = NULL;
+
+	memset(pp, 0, sizeof(*pp));
+	pp->ignore_case = ignore_case;
+
+	if (!vspec || !vspec->length)
+		return 0;
+
+	if (git_vector_init(&pp->prefixes, vspec->length,
+			ignore_case ? pathspec_prefix_isort : pathspec_prefix_sort) < 0)
+		return -1;
+
+	git_vector_foreach(vspec, i, match) {
+		/* stop at the first character that is not taken literally */
+		for (len = 0; len < match->length; ++len) {
+			if (git__iswildcard(match->pattern[len]) ||
+				match->pattern[len] == '\\')
+				break;
+		}
+
+		if ((match->flags & GIT_ATTR_FNMATCH_MATCH_ALL) != 0 || !len) {
+			git_pathspec__prefixes_free(pp);
+			pp->ignore_case = ignore_case;
+			return 0;
+		}
+
+		/* a negative pattern still matches a path that starts with '!' */
+		if ((match->flags & GIT_ATTR_FNMATCH_NEGATIVE) != 0) {
+			if ((pfx = git__malloc(len + 2)) != NULL) {
+				pfx[0] = '!';
+				memcpy(pfx + 1, match->pattern, len);
+				pfx[len + 1] = '\0';
+			}
+		} else
+			pfx = git__strndup(match->pattern, len);
+
+		if (!pfx || git_vector_insert(&pp->prefixes, pfx) < 0) {
+			git__free(pfx);
+			git_pathspec__prefixes_free(pp);
+			return -1;
+		}
+	}
+
+	git_vector_sort(&pp->prefixes);
+
+	/* drop prefixes that are covered by a shorter one */
+	for (i = 0; i < pp->prefixes.length; ) {
+		pfx = git_vector_get(&pp->prefixes, i);
+
+		if (last && pathspec_prefix_of(
+				last, strlen(last), pfx, strlen(pfx), ignore_case)) {
+			git_vector_remove(&pp->prefixes, i);
+			git__free(pfx);
+		} else {
+			last = pfx;
+			i++;
+		}
+	}
+
+	return 0;
+}
+
+void git_pathspec__prefixes_free(git_pathspec_prefixes *pp)
+{
+	git_vector_free_deep(&pp->prefixes);
+	memset(pp, 0, sizeof(*pp));
+}
+
+/* position of the first prefix that does not sort before `path` */
+static size_t pathspec_prefixes_find(
+	const git_pathspec_prefixes *pp, const char *path, size_t len)
+{
+	size_t lo = 0, hi = pp->prefixes.length, mid;
+	const char *pfx;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		pfx = git_vector_get(&pp->prefixes, mid);
+
+		if (pathspec_prefix_cmp(
+				pfx, strlen(pfx), path, len, pp->ignore_case) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+bool git_pathspec__prefixes_match(
+	const git_pathspec_prefixes *pp, const char *path, size_t len)
+{
+	size_t pos;
+	const char *pfx;
+
+	if (!pp || !pp->prefixes.length)
+		return true;
+
+	pos = pathspec_prefixes_find(pp, path, len);
+
+	/* the path leads to a prefix ... */
+	if (pos < pp->prefixes.length) {
+		pfx = git_vector_get(&pp->prefixes, pos);
+
+		if (pathspec_prefix_of(path, len, pfx, strlen(pfx), pp->ignore_case))
+			return true;
+	}
+
+	/* ... or lies below one, which can only be the one just before it */
+	if (pos > 0) {
+		pfx = git_vector_get(&pp->prefixes, pos - 1);
+
+		if (pathspec_prefix_of(pfx, strlen(pfx), path, len, pp->ignore_case))
+			return true;
+	}
+
+	return false;
+}
+
+const char *git_pathspec__prefixes_next(
+	const git_pathspec_prefixes *pp, const char *path)
+{
+	size_t pos;
+
+	if (!pp || !pp->prefixes.length)
+		return NULL;
+
+	pos = pathspec_prefixes_find(pp, path, strlen(path));
+
+	return git_vector_get(&pp->prefixes, pos);
+}
 
 int git_pathspec__init(git_pathspec *ps, const git_strarray *paths)
 {
@@ -406,11 +581,20 @@ static int pathspec_match_from_iterator(
 	size_t pos, used_ct = 0, found_files = 0;
 	git_index *index = NULL;
 	git_bitvec used_patterns;
+	git_pathspec_prefixes prefixes;
 	char **file;
 
 	if (git_bitvec_init(&used_patterns, patterns->length) < 0)
 		return -1;
 
+	/* only walk the parts of the tree that the patterns can match */
+	if (git_pathspec__prefixes_init(
+			&prefixes, patterns, git_iterator_ignore_case(iter)) < 0) {
+		git_bitvec_free(&used_patterns);
+		return -1;
+	}
+	git_iterator_set_prefixes(iter, &prefixes);
+
 	if (out) {
 		*out = m = pathspec_match_alloc(ps, PATHSPEC_DATATYPE_STRINGS);
 		GITERR_CHECK_ALLOC(m);
@@ -490,6 +674,8 @@ static int pathspec_match_from_iterator(
 	}
 
 done:
+	git_iterator_set_prefixes(iter, NULL);
+	git_pathspec__prefixes_free(&prefixes);
 	git_bitvec_free(&used_patterns);
 
 	if (error < 0) {
@@ -66,6 +66,31 @@ extern bool git_pathspec__match(
 	const char **matched_pathspec,
 	size_t *matched_at);
 
+/*
+ * The literal leading parts of the patterns in a pathspec, sorted and with
+ * none being a prefix of another, so the directories that can hold matches
+ * are found with a binary search.  Iterators use them to skip whole trees.
+ * When a pattern starts with a wildcard, anything may match and the list
+ * is left empty.
+ */
+typedef struct {
+	git_vector prefixes;
+	bool ignore_case;
+} git_pathspec_prefixes;
+
+extern int git_pathspec__prefixes_init(
+	git_pathspec_prefixes *pp, const git_vector *vspec, bool ignore_case);
+
+extern void git_pathspec__prefixes_free(git_pathspec_prefixes *pp);
+
+/* Can the first `len` bytes of `path`, or anything below them, match? */
+extern bool git_pathspec__prefixes_match(
+	const git_pathspec_prefixes *pp, const char *path, size_t len);
+
+/* The first prefix that sorts after `path` (which must not match), if any */
+extern const char *git_pathspec__prefixes_next(
+	const git_pathspec_prefixes *pp, const char *path);
+
 /* easy pathspec setup */
 
 extern int git_pathspec__init(git_pathspec *ps, const git_strarray *paths);
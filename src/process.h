@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_process_h__
+#define INCLUDE_process_h__
+
+#include "common.h"
+
+/*
+ * A child process that runs a shell command and is talked to through its
+ * standard input and output.  Its standard error is shared with ours.
+ */
+typedef struct git_process git_process;
+
+/* Start `command` with the shell in the directory `cwd` (may be NULL) */
+extern int git_process_new(
+	git_process **out, const char *command, const char *cwd);
+
+/* Write all of `len` bytes to the standard input of the process */
+extern int git_process_write(git_process *process, const void *buf, size_t len);
+
+/* Read from the standard output of the process; returns 0 at end of file */
+extern ssize_t git_process_read(git_process *process, void *buf, size_t len);
+
+/*
+ * Close the connection to the process and wait for it to exit; returns
+ * its exit status, or -1 if it could not be waited for.
+ */
+extern int git_process_close(git_process *process);
+
+extern void git_process_free(git_process *process);
+
+#endif
@@ -12,11 +12,13 @@
 #include "git2/refs.h"
 #include "git2/refdb.h"
 #include "git2/sys/refdb_backend.h"
+#include "git2/config.h"
 
 #include "hash.h"
 #include "refdb.h"
 #include "refs.h"
 #include "reflog.h"
+#include "reftable.h"
 
 int git_refdb_new(git_refdb **out, git_repository *repo)
 {
@@ -34,10 +36,43 @@ int git_refdb_new(git_refdb **out, git_repository *repo)
 	return 0;
 }
 
+/*
+ * Repositories that already keep their refs in reftables use them, as do
+ * the ones configured with `libgit2.refstorage = reftable` (which get
+ * their existing refs imported).  A lazily opened repository does not
+ * load its config just for this.
+ */
+static bool refdb_uses_reftable(git_repository *repo)
+{
+	git_buf path = GIT_BUF_INIT;
+	git_config *config;
+	const char *storage;
+	bool reftable = false;
+
+	if (!repo->path_repository)
+		return false;
+
+	if (!git_buf_joinpath(&path, repo->path_repository,
+			GIT_REFTABLE_DIR GIT_REFTABLE_LIST_FILE))
+		reftable = git_path_isfile(path.ptr);
+	git_buf_free(&path);
+
+	if (reftable || repo->lazy_config)
+		return reftable;
+
+	if (!git_repository_config__weakptr(&config, repo) &&
+		!git_config_get_string(&storage, config, "libgit2.refstorage"))
+		reftable = !strcasecmp(storage, "reftable");
+
+	giterr_clear();
+	return reftable;
+}
+
 int git_refdb_open(git_refdb **out, git_repository *repo)
 {
 	git_refdb *db;
 	git_refdb_backend *dir;
+	int error;
 
 	assert(out && repo);
 
@@ -46,8 +81,12 @@ int git_refdb_open(git_refdb **out, git_repository *repo)
 	if (git_refdb_new(&db, repo) < 0)
 		return -1;
 
-	/* Add the default (filesystem) backend */
-	if (git_refdb_backend_fs(&dir, repo) < 0) {
+	if (refdb_uses_reftable(repo))
+		error = git_refdb_backend_reftable(&dir, repo);
+	else /* Add the default (filesystem) backend */
+		error = git_refdb_backend_fs(&dir, repo);
+
+	if (error < 0) {
 		git_refdb_free(db);
 		return -1;
 	}
@@ -59,6 +98,9 @@ int git_refdb_open(git_refdb **out, git_repository *repo)
 	return 0;
 }
 
+/* Backends of version 1 end before the transaction and snapshot callbacks */
+#define REFDB_BACKEND_HAS(b, cb) ((b)->version > 1 && (b)->cb != NULL)
+
 static void refdb_free_backend(git_refdb *db)
 {
 	if (db->backend) {
@@ -71,6 +113,8 @@ static void refdb_free_backend(git_refdb *db)
 
 int git_refdb_set_backend(git_refdb *db, git_refdb_backend *backend)
 {
+	GITERR_CHECK_VERSION(backend, GIT_REFDB_BACKEND_VERSION, "git_refdb_backend");
+
 	refdb_free_backend(db);
 	db->backend = backend;
 
@@ -87,6 +131,24 @@ int git_refdb_compress(git_refdb *db)
 	return 0;
 }
 
+int git_refdb_snapshot_begin(git_refdb *db)
+{
+	assert(db);
+
+	if (REFDB_BACKEND_HAS(db->backend, snapshot_begin))
+		return db->backend->snapshot_begin(db->backend);
+
+	return 0;
+}
+
+void git_refdb_snapshot_end(git_refdb *db)
+{
+	assert(db);
+
+	if (REFDB_BACKEND_HAS(db->backend, snapshot_end))
+		db->backend->snapshot_end(db->backend);
+}
+
 void git_refdb__free(git_refdb *db)
 {
 	refdb_free_backend(db);
@@ -207,6 +269,21 @@ int git_refdb_delete(struct git_refdb *db, const char *ref_name, const git_oid *
 	return db->backend->del(db->backend, ref_name, old_id, old_target);
 }
 
+int git_refdb_transaction(
+	git_refdb *db, const git_refdb_update *updates, size_t count)
+{
+	assert(db && db->backend && (updates || !count));
+
+	/* one by one, a failure would keep the earlier updates */
+	if (!REFDB_BACKEND_HAS(db->backend, transaction)) {
+		giterr_set(GITERR_REFERENCE,
+			"The reference database backend does not support transactions");
+		return -1;
+	}
+
+	return db->backend->transaction(db->backend, updates, count);
+}
+
 int git_refdb_reflog_read(git_reflog **out, git_refdb *db,  const char *name)
 {
 	int error;
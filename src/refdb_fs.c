@@ -35,7 +35,6 @@ enum {
 	PACKREF_HAS_PEEL = 1,
 	PACKREF_WAS_LOOSE = 2,
 	PACKREF_CANNOT_PEEL = 4,
-	PACKREF_SHADOWED = 8,
 };
 
 enum {
@@ -51,6 +50,19 @@ struct packref {
 	char name[GIT_FLEX_ARRAY];
 };
 
+typedef struct packed_snapshot packed_snapshot;
+
+/*
+ * A loose ref as it was last read, along with the stamp of its file, or
+ * the fact that there was no file (`ref` is NULL).
+ */
+typedef struct {
+	git_futils_filestamp stamp;
+	git_time_t read_time;
+	git_reference *ref;
+	char name[GIT_FLEX_ARRAY];
+} loose_entry;
+
 typedef struct refdb_fs_backend {
 	git_refdb_backend parent;
 
@@ -58,11 +70,38 @@ typedef struct refdb_fs_backend {
 	char *path;
 
 	git_sortedcache *refcache;
+	git_mutex snapshot_lock;
+	packed_snapshot *snapshot;
+	git_futils_filestamp snapshot_stamp;
+	git_mutex loose_cache_lock;
+	git_strmap *loose_cache;
+	git_atomic snapshot_scope;
 	int peeling_mode;
+	bool flags_loaded;
 	git_iterator_flag_t iterator_flags;
 	uint32_t direach_flags;
 } refdb_fs_backend;
 
+/* Only walking the loose refs needs the config, so look it up then */
+static void load_flags(refdb_fs_backend *backend)
+{
+	int t = 0;
+
+	if (backend->flags_loaded)
+		return;
+
+	if (!git_repository__cvar(&t, backend->repo, GIT_CVAR_IGNORECASE) && t) {
+		backend->iterator_flags |= GIT_ITERATOR_IGNORE_CASE;
+		backend->direach_flags  |= GIT_PATH_DIR_IGNORE_CASE;
+	}
+	if (!git_repository__cvar(&t, backend->repo, GIT_CVAR_PRECOMPOSE) && t) {
+		backend->iterator_flags |= GIT_ITERATOR_PRECOMPOSE_UNICODE;
+		backend->direach_flags  |= GIT_PATH_DIR_PRECOMPOSE_UNICODE;
+	}
+
+	backend->flags_loaded = true;
+}
+
 static int packref_cmp(const void *a_, const void *b_)
 {
 	const struct packref *a = a_, *b = b_;
@@ -192,6 +231,392 @@ parse_failed:
 	return -1;
 }
 
+/*
+ * A read-only view of the packed-refs file for lookups and iteration.
+ *
+ * Rather than parsing the whole file, records are found by a binary
+ * search over the sorted lines of the mapped file and only the records
+ * that are actually looked at get parsed.  A file without the "sorted"
+ * trait is checked once when it is loaded and copied into sorted order
+ * if it needs to be.  Snapshots are refcounted so that an iterator can
+ * keep using one after the file has been reloaded.
+ */
+struct packed_snapshot {
+	git_atomic refcount;
+	git_map map;
+	char *data;
+	const char *start;
+	const char *end;
+};
+
+typedef struct {
+	const char *name;
+	size_t name_len;
+	git_oid oid;
+	git_oid peel;
+	const char *next;
+} packed_record;
+
+static void packed_snapshot_free(packed_snapshot *snap)
+{
+	if (!snap || git_atomic_dec(&snap->refcount) > 0)
+		return;
+
+	if (snap->map.data)
+		git_futils_mmap_free(&snap->map);
+	git__free(snap->data);
+	git__free(snap);
+}
+
+static int packed_record_parse(
+	packed_record *rec, const packed_snapshot *snap, const char *scan)
+{
+	const char *eol;
+
+	memset(rec, 0, sizeof(*rec));
+
+	if (snap->end - scan < GIT_OID_HEXSZ + 2 ||
+		git_oid_fromstrn(&rec->oid, scan, GIT_OID_HEXSZ) < 0 ||
+		scan[GIT_OID_HEXSZ] != ' ')
+		goto corrupted;
+
+	rec->name = scan + GIT_OID_HEXSZ + 1;
+	if (!(eol = memchr(rec->name, '\n', snap->end - rec->name)))
+		goto corrupted;
+
+	rec->name_len = eol - rec->name;
+	if (rec->name_len > 0 && eol[-1] == '\r')
+		rec->name_len--;
+	scan = eol + 1;
+
+	/* look for optional "^<OID>\n" */
+	if (scan < snap->end && *scan == '^') {
+		if (snap->end - scan < GIT_OID_HEXSZ + 1 ||
+			git_oid_fromstrn(&rec->peel, scan + 1, GIT_OID_HEXSZ) < 0)
+			goto corrupted;
+		scan += GIT_OID_HEXSZ + 1;
+
+		if (scan < snap->end) {
+			if (!(eol = memchr(scan, '\n', snap->end - scan)))
+				goto corrupted;
+			scan = eol + 1;
+		}
+	}
+
+	rec->next = scan;
+	return 0;
+
+corrupted:
+	giterr_set(GITERR_REFERENCE, "Corrupted packed references file");
+	return -1;
+}
+
+static int packed_record_cmp(
+	const packed_record *rec, const char *name, size_t len)
+{
+	int cmp = memcmp(rec->name, name, min(rec->name_len, len));
+
+	if (cmp)
+		return cmp;
+	return (rec->name_len > len) - (rec->name_len < len);
+}
+
+/* back up from anywhere in a record to its first line */
+static const char *packed_record_start(const char *lo, const char *pos)
+{
+	while (pos > lo && pos[-1] != '\n')
+		pos--;
+
+	/* a peel line belongs to the record before it */
+	if (*pos == '^' && pos > lo) {
+		pos--;
+		while (pos > lo && pos[-1] != '\n')
+			pos--;
+	}
+
+	return pos;
+}
+
+/* find the first record whose name sorts at or after the given name */
+static int packed_snapshot_seek(
+	const char **out, const packed_snapshot *snap, const char *name, size_t len)
+{
+	const char *lo = snap->start, *hi = snap->end, *pos;
+	packed_record rec;
+
+	while (lo < hi) {
+		pos = packed_record_start(lo, lo + (hi - lo) / 2);
+
+		if (packed_record_parse(&rec, snap, pos) < 0)
+			return -1;
+
+		if (packed_record_cmp(&rec, name, len) < 0)
+			lo = rec.next;
+		else
+			hi = pos;
+	}
+
+	*out = lo;
+	return 0;
+}
+
+static int packed_snapshot_lookup(
+	packed_record *out, const packed_snapshot *snap,
+	const char *name, size_t len)
+{
+	const char *pos;
+
+	if (!snap)
+		return GIT_ENOTFOUND;
+
+	if (packed_snapshot_seek(&pos, snap, name, len) < 0)
+		return -1;
+
+	if (pos >= snap->end)
+		return GIT_ENOTFOUND;
+
+	if (packed_record_parse(out, snap, pos) < 0)
+		return -1;
+
+	return packed_record_cmp(out, name, len) ? GIT_ENOTFOUND : 0;
+}
+
+static int packed_record_start_cmp(const void *a_, const void *b_)
+{
+	const char *a = (const char *)a_ + GIT_OID_HEXSZ + 1;
+	const char *b = (const char *)b_ + GIT_OID_HEXSZ + 1;
+
+	/* records have been validated, so each name ends in a newline */
+	while (*a == *b && *a != '\n') {
+		a++;
+		b++;
+	}
+
+	if (*a == '\n' || *a == '\r')
+		return (*b == '\n' || *b == '\r') ? 0 : -1;
+	if (*b == '\n' || *b == '\r')
+		return 1;
+	return (unsigned char)*a - (unsigned char)*b;
+}
+
+/* make sure the records are in order, sorting a copy of them if not */
+static int packed_snapshot_sort(packed_snapshot *snap)
+{
+	int error = 0;
+	git_vector records = GIT_VECTOR_INIT;
+	git_buf sorted = GIT_BUF_INIT;
+	packed_record rec, prev;
+	const char *pos, *start;
+	bool in_order = true;
+	size_t i;
+
+	for (pos = snap->start; pos < snap->end; pos = rec.next) {
+		if (packed_record_parse(&rec, snap, pos) < 0)
+			return -1;
+
+		if (pos > snap->start &&
+			packed_record_cmp(&prev, rec.name, rec.name_len) >= 0) {
+			in_order = false;
+			break;
+		}
+
+		prev = rec;
+	}
+
+	if (in_order)
+		return 0;
+
+	if ((error = git_vector_init(&records, 0, packed_record_start_cmp)) < 0)
+		return error;
+
+	for (pos = snap->start; !error && pos < snap->end; pos = rec.next) {
+		if ((error = packed_record_parse(&rec, snap, pos)) >= 0)
+			error = git_vector_insert(&records, (void *)pos);
+	}
+
+	if (!error) {
+		git_vector_sort(&records);
+
+		git_vector_foreach(&records, i, start) {
+			packed_record_parse(&rec, snap, start);
+
+			if ((error = git_buf_put(&sorted, start, rec.next - start)) < 0)
+				break;
+			if (sorted.ptr[sorted.size - 1] != '\n' &&
+				(error = git_buf_putc(&sorted, '\n')) < 0)
+				break;
+		}
+	}
+
+	git_vector_free(&records);
+
+	if (error < 0) {
+		git_buf_free(&sorted);
+		return error;
+	}
+
+	if (snap->map.data)
+		git_futils_mmap_free(&snap->map);
+	memset(&snap->map, 0, sizeof(snap->map));
+	git__free(snap->data);
+
+	i = sorted.size;
+	snap->start = snap->data = git_buf_detach(&sorted);
+	snap->end = snap->start + i;
+
+	return 0;
+}
+
+static bool packed_has_trait(const char *line, size_t len, const char *trait)
+{
+	size_t trait_len = strlen(trait);
+
+	for (; len >= trait_len; ++line, --len)
+		if (!memcmp(line, trait, trait_len))
+			return true;
+
+	return false;
+}
+
+static int packed_snapshot_load(packed_snapshot **out, const char *path)
+{
+	static const char *traits_header = "# pack-refs with: ";
+	packed_snapshot *snap;
+	const char *scan, *eol;
+	bool sorted = false;
+	git_file fd;
+	git_off_t size;
+	int error = 0;
+
+	snap = git__calloc(1, sizeof(packed_snapshot));
+	GITERR_CHECK_ALLOC(snap);
+	git_atomic_set(&snap->refcount, 1);
+
+	if ((fd = git_futils_open_ro(path)) < 0) {
+		git__free(snap);
+		return fd;
+	}
+
+	if ((size = git_futils_filesize(fd)) < 0) {
+		giterr_set(GITERR_OS, "Failed to stat '%s'", path);
+		error = -1;
+	} else if (size > 0) {
+#ifdef GIT_WIN32
+		/* a mapped file could not be replaced while we keep the map */
+		git_buf buf = GIT_BUF_INIT;
+
+		if (!(error = git_futils_readbuffer_fd(&buf, fd, (size_t)size)))
+			snap->data = git_buf_detach(&buf);
+		snap->start = snap->data;
+#else
+		if (!(error = git_futils_mmap_ro(&snap->map, fd, 0, (size_t)size)))
+			snap->start = snap->map.data;
+#endif
+		snap->end = snap->start + size;
+	}
+
+	p_close(fd);
+
+	if (error < 0) {
+		packed_snapshot_free(snap);
+		return error;
+	}
+
+	scan = snap->start;
+
+	if (snap->end - scan >= (ptrdiff_t)strlen(traits_header) &&
+		!memcmp(scan, traits_header, strlen(traits_header))) {
+		if (!(eol = memchr(scan, '\n', snap->end - scan)))
+			goto parse_failed;
+
+		sorted = packed_has_trait(scan, eol - scan, " sorted");
+		scan = eol + 1;
+	}
+
+	while (scan < snap->end && *scan == '#') {
+		if (!(eol = memchr(scan, '\n', snap->end - scan)))
+			goto parse_failed;
+		scan = eol + 1;
+	}
+
+	snap->start = scan;
+
+	if (!sorted && packed_snapshot_sort(snap) < 0) {
+		packed_snapshot_free(snap);
+		return -1;
+	}
+
+	*out = snap;
+	return 0;
+
+parse_failed:
+	giterr_set(GITERR_REFERENCE, "Corrupted packed references file");
+	packed_snapshot_free(snap);
+	return -1;
+}
+
+/* get the current snapshot of the packed-refs, or NULL if there is none */
+static int packed_snapshot_get(packed_snapshot **out, refdb_fs_backend *backend)
+{
+	int error;
+	const char *path;
+	packed_snapshot *snap;
+
+	*out = NULL;
+
+	if (!backend->path)
+		return 0;
+
+	path = git_sortedcache_path(backend->refcache);
+
+	if (git_mutex_lock(&backend->snapshot_lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock packed references");
+		return -1;
+	}
+
+	/* inside a snapshot scope, the packed-refs we have are good enough */
+	if (git_atomic_get(&backend->snapshot_scope) > 0 && backend->snapshot)
+		error = 0;
+	else
+		error = git_futils_filestamp_check(&backend->snapshot_stamp, path);
+
+	if (error == GIT_ENOTFOUND) {
+		packed_snapshot_free(backend->snapshot);
+		backend->snapshot = NULL;
+		git_futils_filestamp_set(&backend->snapshot_stamp, NULL);
+		error = 0;
+	} else if (error > 0 || !backend->snapshot) {
+		if ((error = packed_snapshot_load(&snap, path)) < 0) {
+			/* try again next time */
+			git_futils_filestamp_set(&backend->snapshot_stamp, NULL);
+		} else {
+			packed_snapshot_free(backend->snapshot);
+			backend->snapshot = snap;
+		}
+	}
+
+	if (!error && backend->snapshot) {
+		git_atomic_inc(&backend->snapshot->refcount);
+		*out = backend->snapshot;
+	}
+
+	git_mutex_unlock(&backend->snapshot_lock);
+	return error;
+}
+
+/* forget the snapshot after we have rewritten the packed-refs ourselves */
+static void packed_snapshot_reset(refdb_fs_backend *backend)
+{
+	if (git_mutex_lock(&backend->snapshot_lock) < 0)
+		return;
+
+	packed_snapshot_free(backend->snapshot);
+	backend->snapshot = NULL;
+	git_futils_filestamp_set(&backend->snapshot_stamp, NULL);
+
+	git_mutex_unlock(&backend->snapshot_lock);
+}
+
 static int loose_parse_oid(
 	git_oid *oid, const char *filename, git_buf *file_content)
 {
@@ -304,6 +729,8 @@ static int packed_loadloose(refdb_fs_backend *backend)
 	if (git_buf_joinpath(&refs_path, backend->path, GIT_REFS_DIR) < 0)
 		return -1;
 
+	load_flags(backend);
+
 	/*
 	 * Load all the loose files from disk into the Packfile table.
 	 * This will overwrite any old packed entries with their
@@ -324,18 +751,26 @@ static int refdb_fs_backend__exists(
 {
 	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
 	git_buf ref_path = GIT_BUF_INIT;
+	packed_snapshot *snap;
+	packed_record rec;
+	int error = 0;
 
 	assert(backend);
 
-	if (packed_reload(backend) < 0 ||
-		git_buf_joinpath(&ref_path, backend->path, ref_name) < 0)
+	if (git_buf_joinpath(&ref_path, backend->path, ref_name) < 0)
 		return -1;
 
-	*exists = git_path_isfile(ref_path.ptr) ||
-		(git_sortedcache_lookup(backend->refcache, ref_name) != NULL);
-
+	*exists = git_path_isfile(ref_path.ptr);
 	git_buf_free(&ref_path);
-	return 0;
+
+	if (*exists || (error = packed_snapshot_get(&snap, backend)) < 0)
+		return error;
+
+	error = packed_snapshot_lookup(&rec, snap, ref_name, strlen(ref_name));
+	packed_snapshot_free(snap);
+
+	*exists = !error;
+	return (error == GIT_ENOTFOUND) ? 0 : error;
 }
 
 static const char *loose_parse_symbolic(git_buf *file_content)
@@ -359,71 +794,247 @@ static const char *loose_parse_symbolic(git_buf *file_content)
 	return refname_start;
 }
 
+static int ref_error_notfound(const char *name)
+{
+	giterr_set(GITERR_REFERENCE, "Reference '%s' not found", name);
+	return GIT_ENOTFOUND;
+}
+
+static int loose_parse(
+	git_reference **out, const char *ref_name, git_buf *file_content)
+{
+	const char *target;
+	git_oid oid;
+
+	if (git__prefixcmp(git_buf_cstr(file_content), GIT_SYMREF) == 0) {
+		git_buf_rtrim(file_content);
+
+		if (!(target = loose_parse_symbolic(file_content)))
+			return -1;
+
+		*out = git_reference__alloc_symbolic(ref_name, target);
+	} else {
+		if (loose_parse_oid(&oid, ref_name, file_content) < 0)
+			return -1;
+
+		*out = git_reference__alloc(ref_name, &oid, NULL);
+	}
+
+	GITERR_CHECK_ALLOC(*out);
+	return 0;
+}
+
+static void loose_entry_free(loose_entry *entry)
+{
+	if (!entry)
+		return;
+
+	git_reference_free(entry->ref);
+	git__free(entry);
+}
+
+static int loose_ref_dup(git_reference **out, const git_reference *ref)
+{
+	if (!out)
+		return 0;
+
+	if (ref->type == GIT_REF_SYMBOLIC)
+		*out = git_reference__alloc_symbolic(ref->name, ref->target.symbolic);
+	else
+		*out = git_reference__alloc(ref->name, &ref->target.oid, NULL);
+
+	GITERR_CHECK_ALLOC(*out);
+	return 0;
+}
+
+static int loose_entry_dup(git_reference **out, const loose_entry *entry)
+{
+	if (!entry->ref)
+		return ref_error_notfound(entry->name);
+
+	return loose_ref_dup(out, entry->ref);
+}
+
+static bool loose_stamp_matches(
+	const git_futils_filestamp *stamp, const struct stat *st)
+{
+	return stamp->mtime == (git_time_t)st->st_mtime &&
+		stamp->size == (git_off_t)st->st_size &&
+		stamp->ino == (unsigned int)st->st_ino;
+}
+
+/*
+ * Answer from the cache if we can: inside a snapshot scope any entry
+ * will do, otherwise it has to match the file we have just stat'ed.  A
+ * file that was changed in the same second we read it might change
+ * again without a new stamp, so such an entry is never trusted.
+ */
+static int loose_cache_lookup(
+	git_reference **out,
+	refdb_fs_backend *backend,
+	const char *ref_name,
+	const struct stat *st)
+{
+	khiter_t pos;
+	loose_entry *entry;
+	int error = GIT_ITEROVER;
+
+	if (git_mutex_lock(&backend->loose_cache_lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock loose references");
+		return -1;
+	}
+
+	pos = git_strmap_lookup_index(backend->loose_cache, ref_name);
+
+	if (git_strmap_valid_index(backend->loose_cache, pos)) {
+		entry = git_strmap_value_at(backend->loose_cache, pos);
+
+		if (!st || (entry->ref &&
+			loose_stamp_matches(&entry->stamp, st) &&
+			entry->stamp.mtime < entry->read_time))
+			error = loose_entry_dup(out, entry);
+	}
+
+	git_mutex_unlock(&backend->loose_cache_lock);
+	return error;
+}
+
+/* remember what we've read; a NULL `ref` records that there is no file */
+static int loose_cache_store(
+	refdb_fs_backend *backend,
+	const char *ref_name,
+	git_reference *ref,
+	const struct stat *st,
+	git_time_t read_time)
+{
+	loose_entry *entry, *old;
+	size_t namelen = strlen(ref_name);
+	int error;
+
+	entry = git__calloc(1, sizeof(loose_entry) + namelen + 1);
+	GITERR_CHECK_ALLOC(entry);
+
+	memcpy(entry->name, ref_name, namelen);
+	entry->ref = ref;
+	entry->read_time = read_time;
+	if (st)
+		git_futils_filestamp_set_from_stat(&entry->stamp, (struct stat *)st);
+
+	if (git_mutex_lock(&backend->loose_cache_lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock loose references");
+		git__free(entry);
+		return -1;
+	}
+
+	git_strmap_insert2(backend->loose_cache, entry->name, entry, old, error);
+	git_mutex_unlock(&backend->loose_cache_lock);
+
+	if (error < 0) {
+		git__free(entry);
+		return -1;
+	}
+
+	loose_entry_free(old);
+	return 0;
+}
+
+/* forget a loose ref after we have changed its file ourselves */
+static void loose_cache_forget(refdb_fs_backend *backend, const char *ref_name)
+{
+	khiter_t pos;
+	loose_entry *entry = NULL;
+
+	if (git_mutex_lock(&backend->loose_cache_lock) < 0)
+		return;
+
+	pos = git_strmap_lookup_index(backend->loose_cache, ref_name);
+
+	if (git_strmap_valid_index(backend->loose_cache, pos)) {
+		entry = git_strmap_value_at(backend->loose_cache, pos);
+		git_strmap_delete_at(backend->loose_cache, pos);
+	}
+
+	git_mutex_unlock(&backend->loose_cache_lock);
+	loose_entry_free(entry);
+}
+
 static int loose_lookup(
 	git_reference **out,
 	refdb_fs_backend *backend,
 	const char *ref_name)
 {
 	git_buf ref_file = GIT_BUF_INIT;
+	git_reference *ref = NULL;
+	git_time_t read_time;
+	struct stat st;
+	bool in_scope = git_atomic_get(&backend->snapshot_scope) > 0;
 	int error = 0;
 
 	if (out)
 		*out = NULL;
 
-	if ((error = loose_readbuffer(&ref_file, backend->path, ref_name)) < 0)
-		/* cannot read loose ref file - gah */;
-	else if (git__prefixcmp(git_buf_cstr(&ref_file), GIT_SYMREF) == 0) {
-		const char *target;
+	if (in_scope &&
+		(error = loose_cache_lookup(out, backend, ref_name, NULL)) != GIT_ITEROVER)
+		return error;
+
+	if ((error = git_buf_joinpath(&ref_file, backend->path, ref_name)) < 0)
+		return error;
 
-		git_buf_rtrim(&ref_file);
+	error = p_stat(ref_file.ptr, &st);
 
-		if (!(target = loose_parse_symbolic(&ref_file)))
-			error = -1;
-		else if (out != NULL)
-			*out = git_reference__alloc_symbolic(ref_name, target);
-	} else {
-		git_oid oid;
+	if (error < 0 && errno != ENOENT && errno != ENOTDIR) {
+		error = git_path_set_error(errno, ref_file.ptr, "stat");
+		goto done;
+	}
 
-		if (!(error = loose_parse_oid(&oid, ref_name, &ref_file)) &&
-			out != NULL)
-			*out = git_reference__alloc(ref_name, &oid, NULL);
+	if (error < 0 || S_ISDIR(st.st_mode)) {
+		error = ref_error_notfound(ref_name);
+
+		if (in_scope && loose_cache_store(backend, ref_name, NULL, NULL, 0) < 0)
+			error = -1;
+		goto done;
 	}
 
+	if ((error = loose_cache_lookup(out, backend, ref_name, &st)) != GIT_ITEROVER)
+		goto done;
+
+	read_time = (git_time_t)time(NULL);
+
+	if ((error = git_futils_readbuffer(&ref_file, ref_file.ptr)) < 0 ||
+		(error = loose_parse(&ref, ref_name, &ref_file)) < 0)
+		goto done;
+
+	if (!(error = loose_ref_dup(out, ref)))
+		error = loose_cache_store(backend, ref_name, ref, &st, read_time);
+	else
+		git_reference_free(ref);
+
+done:
 	git_buf_free(&ref_file);
 	return error;
 }
 
-static int ref_error_notfound(const char *name)
-{
-	giterr_set(GITERR_REFERENCE, "Reference '%s' not found", name);
-	return GIT_ENOTFOUND;
-}
-
 static int packed_lookup(
 	git_reference **out,
 	refdb_fs_backend *backend,
 	const char *ref_name)
 {
-	int error = 0;
-	struct packref *entry;
+	int error;
+	packed_snapshot *snap;
+	packed_record rec;
 
-	if (packed_reload(backend) < 0)
-		return -1;
+	if ((error = packed_snapshot_get(&snap, backend)) < 0)
+		return error;
 
-	if (git_sortedcache_rlock(backend->refcache) < 0)
-		return -1;
+	error = packed_snapshot_lookup(&rec, snap, ref_name, strlen(ref_name));
 
-	entry = git_sortedcache_lookup(backend->refcache, ref_name);
-	if (!entry) {
+	if (error == GIT_ENOTFOUND)
 		error = ref_error_notfound(ref_name);
-	} else {
-		*out = git_reference__alloc(ref_name, &entry->oid, &entry->peel);
-		if (!*out)
-			error = -1;
-	}
-
-	git_sortedcache_runlock(backend->refcache);
+	else if (!error &&
+		(*out = git_reference__alloc(ref_name, &rec.oid, &rec.peel)) == NULL)
+		error = -1;
 
+	packed_snapshot_free(snap);
 	return error;
 }
 
@@ -454,13 +1065,16 @@ typedef struct {
 	git_reference_iterator parent;
 
 	char *glob;
+	const char *prefix;
+	size_t prefix_len;
 
 	git_pool pool;
 	git_vector loose;
 
-	git_sortedcache *cache;
+	packed_snapshot *packed;
+	git_buf packed_name;
 	size_t loose_pos;
-	size_t packed_pos;
+	const char *packed_pos;
 } refdb_fs_iter;
 
 static void refdb_fs_backend__iterator_free(git_reference_iterator *_iter)
@@ -469,7 +1083,8 @@ static void refdb_fs_backend__iterator_free(git_reference_iterator *_iter)
 
 	git_vector_free(&iter->loose);
 	git_pool_clear(&iter->pool);
-	git_sortedcache_free(iter->cache);
+	packed_snapshot_free(iter->packed);
+	git_buf_free(&iter->packed_name);
 	git__free(iter);
 }
 
@@ -479,25 +1094,39 @@ static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 	git_buf path = GIT_BUF_INIT;
 	git_iterator *fsit = NULL;
 	const git_index_entry *entry = NULL;
+	const char *dir = GIT_REFS_DIR, *slash;
+	size_t dir_len = strlen(GIT_REFS_DIR);
 
 	if (!backend->path) /* do nothing if no path for loose refs */
 		return 0;
 
-	if ((error = git_buf_printf(&path, "%s/refs", backend->path)) < 0 ||
-		(error = git_iterator_for_filesystem(
-			&fsit, path.ptr, backend->iterator_flags, NULL, NULL)) < 0) {
-		git_buf_free(&path);
-		return error;
+	load_flags(backend);
+
+	/* only the directory holding the literal part of the glob can match */
+	if (iter->prefix && !git__prefixcmp(iter->prefix, GIT_REFS_DIR)) {
+		slash = strrchr(iter->prefix, '/');
+		dir = iter->prefix;
+		dir_len = slash - dir + 1;
 	}
 
-	error = git_buf_sets(&path, GIT_REFS_DIR);
+	if ((error = git_buf_printf(&path, "%s/%.*s",
+			backend->path, (int)(dir_len - 1), dir)) < 0)
+		goto done;
+
+	if (!git_path_isdir(path.ptr))
+		goto done;
+
+	if ((error = git_iterator_for_filesystem(
+			&fsit, path.ptr, backend->iterator_flags, NULL, NULL)) < 0)
+		goto done;
+
+	error = git_buf_set(&path, dir, dir_len);
 
 	while (!error && !git_iterator_advance(&entry, fsit)) {
 		const char *ref_name;
-		struct packref *ref;
 		char *ref_dup;
 
-		git_buf_truncate(&path, strlen(GIT_REFS_DIR));
+		git_buf_truncate(&path, dir_len);
 		git_buf_puts(&path, entry->path);
 		ref_name = git_buf_cstr(&path);
 
@@ -505,12 +1134,6 @@ static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 			(iter->glob && p_fnmatch(iter->glob, ref_name, 0) != 0))
 			continue;
 
-		git_sortedcache_rlock(backend->refcache);
-		ref = git_sortedcache_lookup(backend->refcache, ref_name);
-		if (ref)
-			ref->flags |= PACKREF_SHADOWED;
-		git_sortedcache_runlock(backend->refcache);
-
 		ref_dup = git_pool_strdup(&iter->pool, ref_name);
 		if (!ref_dup)
 			error = -1;
@@ -518,19 +1141,56 @@ static int iter_load_loose_paths(refdb_fs_backend *backend, refdb_fs_iter *iter)
 			error = git_vector_insert(&iter->loose, ref_dup);
 	}
 
+	/* sorted so that packed refs shadowed by loose ones can be found */
+	git_vector_sort(&iter->loose);
+
+done:
 	git_iterator_free(fsit);
 	git_buf_free(&path);
 
 	return error;
 }
 
+/* step to the next packed ref that is wanted and not shadowed */
+static int iter_next_packed(packed_record *rec, refdb_fs_iter *iter)
+{
+	const packed_snapshot *snap = iter->packed;
+
+	while (snap && iter->packed_pos < snap->end) {
+		if (packed_record_parse(rec, snap, iter->packed_pos) < 0)
+			return -1;
+
+		/* the records are sorted, so nothing past the prefix matches */
+		if (iter->prefix && (rec->name_len < iter->prefix_len ||
+			memcmp(rec->name, iter->prefix, iter->prefix_len) != 0)) {
+			iter->packed_pos = snap->end;
+			break;
+		}
+
+		iter->packed_pos = rec->next;
+
+		git_buf_clear(&iter->packed_name);
+		if (git_buf_put(&iter->packed_name, rec->name, rec->name_len) < 0)
+			return -1;
+
+		if (git_vector_bsearch(NULL, &iter->loose, iter->packed_name.ptr) >= 0)
+			continue;
+		if (iter->glob && p_fnmatch(iter->glob, iter->packed_name.ptr, 0) != 0)
+			continue;
+
+		return 0;
+	}
+
+	return GIT_ITEROVER;
+}
+
 static int refdb_fs_backend__iterator_next(
 	git_reference **out, git_reference_iterator *_iter)
 {
-	int error = GIT_ITEROVER;
+	int error;
 	refdb_fs_iter *iter = (refdb_fs_iter *)_iter;
 	refdb_fs_backend *backend = (refdb_fs_backend *)iter->parent.db->backend;
-	struct packref *ref;
+	packed_record rec;
 
 	while (iter->loose_pos < iter->loose.length) {
 		const char *path = git_vector_get(&iter->loose, iter->loose_pos++);
@@ -541,71 +1201,37 @@ static int refdb_fs_backend__iterator_next(
 		giterr_clear();
 	}
 
-	if (!iter->cache) {
-		if ((error = git_sortedcache_copy(&iter->cache, backend->refcache, 1, NULL, NULL)) < 0)
-			return error;
-	}
-
-	error = GIT_ITEROVER;
-	while (iter->packed_pos < git_sortedcache_entrycount(iter->cache)) {
-		ref = git_sortedcache_entry(iter->cache, iter->packed_pos++);
-		if (!ref) /* stop now if another thread deleted refs and we past end */
-			break;
-
-		if (ref->flags & PACKREF_SHADOWED)
-			continue;
-		if (iter->glob && p_fnmatch(iter->glob, ref->name, 0) != 0)
-			continue;
-
-		*out = git_reference__alloc(ref->name, &ref->oid, &ref->peel);
-		error = (*out != NULL) ? 0 : -1;
-		break;
-	}
+	if ((error = iter_next_packed(&rec, iter)) < 0)
+		return error;
 
-	return error;
+	*out = git_reference__alloc(iter->packed_name.ptr, &rec.oid, &rec.peel);
+	return (*out != NULL) ? 0 : -1;
 }
 
 static int refdb_fs_backend__iterator_next_name(
 	const char **out, git_reference_iterator *_iter)
 {
-	int error = GIT_ITEROVER;
+	int error;
 	refdb_fs_iter *iter = (refdb_fs_iter *)_iter;
 	refdb_fs_backend *backend = (refdb_fs_backend *)iter->parent.db->backend;
-	struct packref *ref;
+	packed_record rec;
 
 	while (iter->loose_pos < iter->loose.length) {
 		const char *path = git_vector_get(&iter->loose, iter->loose_pos++);
 
 		if (loose_lookup(NULL, backend, path) == 0) {
-			*out = path;
-			return 0;
-		}
-
-		giterr_clear();
-	}
-
-	if (!iter->cache) {
-		if ((error = git_sortedcache_copy(&iter->cache, backend->refcache, 1, NULL, NULL)) < 0)
-			return error;
-	}
-
-	error = GIT_ITEROVER;
-	while (iter->packed_pos < git_sortedcache_entrycount(iter->cache)) {
-		ref = git_sortedcache_entry(iter->cache, iter->packed_pos++);
-		if (!ref) /* stop now if another thread deleted refs and we past end */
-			break;
-
-		if (ref->flags & PACKREF_SHADOWED)
-			continue;
-		if (iter->glob && p_fnmatch(iter->glob, ref->name, 0) != 0)
-			continue;
+			*out = path;
+			return 0;
+		}
 
-		*out = ref->name;
-		error = 0;
-		break;
+		giterr_clear();
 	}
 
-	return error;
+	if ((error = iter_next_packed(&rec, iter)) < 0)
+		return error;
+
+	*out = iter->packed_name.ptr;
+	return 0;
 }
 
 static int refdb_fs_backend__iterator(
@@ -616,19 +1242,31 @@ static int refdb_fs_backend__iterator(
 
 	assert(backend);
 
-	if (packed_reload(backend) < 0)
-		return -1;
-
 	iter = git__calloc(1, sizeof(refdb_fs_iter));
 	GITERR_CHECK_ALLOC(iter);
 
 	if (git_pool_init(&iter->pool, 1, 0) < 0 ||
-		git_vector_init(&iter->loose, 8, NULL) < 0)
+		git_vector_init(&iter->loose, 8, git__strcmp_cb) < 0 ||
+		packed_snapshot_get(&iter->packed, backend) < 0)
 		goto fail;
 
-	if (glob != NULL &&
-		(iter->glob = git_pool_strdup(&iter->pool, glob)) == NULL)
-		goto fail;
+	/* only the refs starting with the literal part of the glob can match */
+	if (glob != NULL) {
+		iter->prefix_len = strcspn(glob, "?*[\\");
+
+		if ((iter->glob = git_pool_strdup(&iter->pool, glob)) == NULL ||
+			(iter->prefix = git_pool_strndup(
+				&iter->pool, glob, iter->prefix_len)) == NULL)
+			goto fail;
+	}
+
+	if (iter->packed) {
+		iter->packed_pos = iter->packed->start;
+
+		if (iter->prefix_len > 0 && packed_snapshot_seek(&iter->packed_pos,
+				iter->packed, iter->prefix, iter->prefix_len) < 0)
+			goto fail;
+	}
 
 	iter->parent.next = refdb_fs_backend__iterator_next;
 	iter->parent.next_name = refdb_fs_backend__iterator_next_name;
@@ -645,21 +1283,60 @@ fail:
 	return -1;
 }
 
-static bool ref_is_available(
-	const char *old_ref, const char *new_ref, const char *this_ref)
+/*
+ * Check that no packed ref other than `old_ref` is a directory of
+ * `new_ref` (e.g. "refs/heads/a" for "refs/heads/a/b") or lives
+ * inside it (e.g. "refs/heads/a/b" for "refs/heads/a").
+ */
+static int packed_path_available(
+	bool *available,
+	const packed_snapshot *snap,
+	const char *new_ref,
+	const char *old_ref)
 {
-	if (old_ref == NULL || strcmp(old_ref, this_ref)) {
-		size_t reflen = strlen(this_ref);
-		size_t newlen = strlen(new_ref);
-		size_t cmplen = reflen < newlen ? reflen : newlen;
-		const char *lead = reflen < newlen ? new_ref : this_ref;
+	int error;
+	const char *slash, *pos;
+	git_buf prefix = GIT_BUF_INIT;
+	packed_record rec;
+
+	*available = true;
+
+	for (slash = strchr(new_ref, '/'); slash; slash = strchr(slash + 1, '/')) {
+		size_t len = slash - new_ref;
+
+		error = packed_snapshot_lookup(&rec, snap, new_ref, len);
+		if (error == GIT_ENOTFOUND)
+			continue;
+		if (error < 0)
+			return error;
+
+		if (!old_ref || strlen(old_ref) != len || memcmp(old_ref, new_ref, len)) {
+			*available = false;
+			return 0;
+		}
+	}
+
+	if (git_buf_printf(&prefix, "%s/", new_ref) < 0)
+		return -1;
+
+	error = packed_snapshot_seek(&pos, snap, prefix.ptr, prefix.size);
+
+	for (; !error && pos < snap->end; pos = rec.next) {
+		if ((error = packed_record_parse(&rec, snap, pos)) < 0)
+			break;
+
+		if (rec.name_len < prefix.size ||
+			memcmp(rec.name, prefix.ptr, prefix.size) != 0)
+			break;
 
-		if (!strncmp(new_ref, this_ref, cmplen) && lead[cmplen] == '/') {
-			return false;
+		if (!old_ref || packed_record_cmp(&rec, old_ref, strlen(old_ref))) {
+			*available = false;
+			break;
 		}
 	}
 
-	return true;
+	git_buf_free(&prefix);
+	return error;
 }
 
 static int reference_path_available(
@@ -668,10 +1345,9 @@ static int reference_path_available(
 	const char* old_ref,
 	int force)
 {
-	size_t i;
-
-	if (packed_reload(backend) < 0)
-		return -1;
+	int error;
+	bool available;
+	packed_snapshot *snap;
 
 	if (!force) {
 		int exists;
@@ -688,21 +1364,19 @@ static int reference_path_available(
 		}
 	}
 
-	git_sortedcache_rlock(backend->refcache);
+	if ((error = packed_snapshot_get(&snap, backend)) < 0 || !snap)
+		return error;
 
-	for (i = 0; i < git_sortedcache_entrycount(backend->refcache); ++i) {
-		struct packref *ref = git_sortedcache_entry(backend->refcache, i);
+	error = packed_path_available(&available, snap, new_ref, old_ref);
+	packed_snapshot_free(snap);
 
-		if (ref && !ref_is_available(old_ref, new_ref, ref->name)) {
-			git_sortedcache_runlock(backend->refcache);
-			giterr_set(GITERR_REFERENCE,
-				"Path to reference '%s' collides with existing one", new_ref);
-			return -1;
-		}
+	if (!error && !available) {
+		giterr_set(GITERR_REFERENCE,
+			"Path to reference '%s' collides with existing one", new_ref);
+		error = -1;
 	}
 
-	git_sortedcache_runlock(backend->refcache);
-	return 0;
+	return error;
 }
 
 static int loose_lock(git_filebuf *file, refdb_fs_backend *backend, const char *name)
@@ -727,9 +1401,12 @@ static int loose_lock(git_filebuf *file, refdb_fs_backend *backend, const char *
         return error;
 }
 
-static int loose_commit(git_filebuf *file, const git_reference *ref)
+static int loose_commit(
+	git_filebuf *file, refdb_fs_backend *backend, const git_reference *ref)
 {
-	assert(file && ref);
+	int error;
+
+	assert(file && backend && ref);
 
 	if (ref->type == GIT_REF_OID) {
 		char oid[GIT_OID_HEXSZ + 1];
@@ -742,7 +1419,10 @@ static int loose_commit(git_filebuf *file, const git_reference *ref)
 		assert(0); /* don't let this happen */
 	}
 
-	return git_filebuf_commit(file);
+	error = git_filebuf_commit(file);
+
+	loose_cache_forget(backend, ref->name);
+	return error;
 }
 
 /*
@@ -861,6 +1541,8 @@ static int packed_remove_loose(refdb_fs_backend *backend)
 			failed = 1;
 		}
 
+		loose_cache_forget(backend, ref->name);
+
 		/*
 		 * if we fail to remove a single file, this is *not* good,
 		 * but we should keep going and remove as many as possible.
@@ -874,41 +1556,53 @@ static int packed_remove_loose(refdb_fs_backend *backend)
 }
 
 /*
- * Write all the contents in the in-memory packfile to disk.
+ * Write the in-memory packfile into the opened lock file and commit it.
  */
-static int packed_write(refdb_fs_backend *backend)
+static int packed_write_locked(refdb_fs_backend *backend, git_filebuf *pack_file)
 {
 	git_sortedcache *refcache = backend->refcache;
-	git_filebuf pack_file = GIT_FILEBUF_INIT;
 	size_t i;
 
-	/* lock the cache to updates while we do this */
-	if (git_sortedcache_wlock(refcache) < 0)
-		return -1;
-
-	/* Open the file! */
-	if (git_filebuf_open(&pack_file, git_sortedcache_path(refcache), 0, GIT_PACKEDREFS_FILE_MODE) < 0)
-		goto fail;
+	/* backend->refcache is already locked when this is called */
 
 	/* Packfiles have a header... apparently
 	 * This is in fact not required, but we might as well print it
 	 * just for kicks */
-	if (git_filebuf_printf(&pack_file, "%s\n", GIT_PACKEDREFS_HEADER) < 0)
-		goto fail;
+	if (git_filebuf_printf(pack_file, "%s\n", GIT_PACKEDREFS_HEADER) < 0)
+		return -1;
 
 	for (i = 0; i < git_sortedcache_entrycount(refcache); ++i) {
 		struct packref *ref = git_sortedcache_entry(refcache, i);
 
 		if (packed_find_peel(backend, ref) < 0)
-			goto fail;
+			return -1;
 
-		if (packed_write_ref(ref, &pack_file) < 0)
-			goto fail;
+		if (packed_write_ref(ref, pack_file) < 0)
+			return -1;
 	}
 
 	/* if we've written all the references properly, we can commit
 	 * the packfile to make the changes effective */
-	if (git_filebuf_commit(&pack_file) < 0)
+	return git_filebuf_commit(pack_file);
+}
+
+/*
+ * Write all the contents in the in-memory packfile to disk.
+ */
+static int packed_write(refdb_fs_backend *backend)
+{
+	git_sortedcache *refcache = backend->refcache;
+	git_filebuf pack_file = GIT_FILEBUF_INIT;
+
+	/* lock the cache to updates while we do this */
+	if (git_sortedcache_wlock(refcache) < 0)
+		return -1;
+
+	/* Open the file! */
+	if (git_filebuf_open(&pack_file, git_sortedcache_path(refcache), 0, GIT_PACKEDREFS_FILE_MODE) < 0)
+		goto fail;
+
+	if (packed_write_locked(backend, &pack_file) < 0)
 		goto fail;
 
 	/* when and only when the packfile has been properly written,
@@ -916,6 +1610,7 @@ static int packed_write(refdb_fs_backend *backend)
 	if (packed_remove_loose(backend) < 0)
 		goto fail;
 
+	packed_snapshot_reset(backend);
 	git_sortedcache_updated(refcache);
 	git_sortedcache_wunlock(refcache);
 
@@ -1011,7 +1706,7 @@ out:
  * check with HEAD only which should cover 99% of all usage
  * scenarios (even 100% of the default ones).
  */
-static int maybe_append_head(refdb_fs_backend *backend, const git_reference *ref, const git_signature *who, const char *message)
+static int maybe_append_head(refdb_fs_backend *backend, const git_reference *ref, const git_oid *old, const git_signature *who, const char *message)
 {
 	int error;
 	git_oid old_id = {{0}};
@@ -1022,7 +1717,10 @@ static int maybe_append_head(refdb_fs_backend *backend, const git_reference *ref
 		return 0;
 
 	/* if we can't resolve, we use {0}*40 as old id */
-	git_reference_name_to_id(&old_id, backend->repo, ref->name);
+	if (old)
+		git_oid_cpy(&old_id, old);
+	else
+		git_reference_name_to_id(&old_id, backend->repo, ref->name);
 
 	if ((error = git_reference_lookup(&head, backend->repo, GIT_HEAD_FILE)) < 0)
 		return error;
@@ -1119,11 +1817,11 @@ static int refdb_fs_backend__write(
 	if (should_write) {
 		if ((error = reflog_append(backend, ref, NULL, NULL, who, message)) < 0)
 			goto on_error;
-		if ((error = maybe_append_head(backend, ref, who, message)) < 0)
+		if ((error = maybe_append_head(backend, ref, NULL, who, message)) < 0)
 			goto on_error;
 	}
 
-	return loose_commit(&file, ref);
+	return loose_commit(&file, backend, ref);
 
 on_error:
         git_filebuf_cleanup(&file);
@@ -1138,6 +1836,8 @@ static int refdb_fs_backend__delete(
 	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
 	git_buf loose_path = GIT_BUF_INIT;
 	size_t pack_pos;
+	packed_snapshot *snap;
+	packed_record rec;
 	git_filebuf file = GIT_FILEBUF_INIT;
 	int error = 0, cmp = 0;
 	bool loose_deleted = 0;
@@ -1166,12 +1866,26 @@ static int refdb_fs_backend__delete(
 		loose_deleted = 1;
 	}
 
+	loose_cache_forget(backend, ref_name);
+
 	git_buf_free(&loose_path);
 
 	if (error != 0)
 		goto cleanup;
 
-	if ((error = packed_reload(backend)) < 0)
+	/* only load the whole packed-refs if it has this ref to remove */
+	if ((error = packed_snapshot_get(&snap, backend)) < 0)
+		goto cleanup;
+
+	error = packed_snapshot_lookup(&rec, snap, ref_name, strlen(ref_name));
+	packed_snapshot_free(snap);
+
+	if (error == GIT_ENOTFOUND) {
+		error = loose_deleted ? 0 : ref_error_notfound(ref_name);
+		goto cleanup;
+	}
+
+	if (error < 0 || (error = packed_reload(backend)) < 0)
 		goto cleanup;
 
 	/* If a packed reference exists, remove it from the packfile and repack */
@@ -1252,7 +1966,7 @@ static int refdb_fs_backend__rename(
 	}
 
 
-	if ((error = loose_commit(&file, new)) < 0 || out == NULL) {
+	if ((error = loose_commit(&file, backend, new)) < 0 || out == NULL) {
 		git_reference_free(new);
 		return error;
 	}
@@ -1261,6 +1975,245 @@ static int refdb_fs_backend__rename(
 	return 0;
 }
 
+static int transaction_check_old(
+	refdb_fs_backend *backend, const git_refdb_update *update)
+{
+	git_reference *ref = NULL;
+	int error, modified;
+
+	error = refdb_fs_backend__lookup(
+		&ref, (git_refdb_backend *)backend, update->name);
+	if (error < 0 && error != GIT_ENOTFOUND)
+		return error;
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		modified = (update->old_type != GIT_REF_INVALID);
+	} else if (ref->type != update->old_type) {
+		modified = 1;
+	} else if (ref->type == GIT_REF_OID) {
+		modified = git_oid_cmp(&update->old_id, &ref->target.oid);
+	} else {
+		modified = git__strcmp(update->old_target, ref->target.symbolic);
+	}
+
+	git_reference_free(ref);
+
+	if (modified) {
+		giterr_set(GITERR_REFERENCE,
+			"old value of reference '%s' does not match", update->name);
+		return GIT_EMODIFIED;
+	}
+
+	return 0;
+}
+
+static int transaction_path_available(
+	refdb_fs_backend *backend, const char *name)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error;
+
+	if ((error = reference_path_available(backend, name, NULL, 1)) < 0)
+		return error;
+
+	/* loose_lock already removed the empty directories in the way */
+	if (git_buf_joinpath(&path, backend->path, name) < 0)
+		return -1;
+
+	if (git_path_isdir(path.ptr)) {
+		giterr_set(GITERR_REFERENCE,
+			"Path to reference '%s' collides with existing one", name);
+		error = -1;
+	}
+
+	git_buf_free(&path);
+	return error;
+}
+
+/* Only direct references below refs/ can live in packed-refs */
+static bool transaction_packs(const git_refdb_update *update)
+{
+	return update->ref && update->ref->type == GIT_REF_OID &&
+		!git__prefixcmp(update->name, GIT_REFS_DIR);
+}
+
+/* Whether an update is logged, and the value it is logged against */
+typedef struct {
+	int write;
+	git_oid old_id;
+} transaction_log;
+
+static int transaction_log_prepare(
+	transaction_log *log,
+	refdb_fs_backend *backend,
+	const git_refdb_update *update)
+{
+	int error;
+
+	if (!update->ref)
+		return 0;
+
+	if ((error = should_write_reflog(
+			&log->write, backend->repo, update->name)) < 0 || !log->write)
+		return error;
+
+	/* symbolic refs are logged with the id they resolve to */
+	error = git_reference_name_to_id(
+		&log->old_id, backend->repo, update->name);
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+	}
+
+	return error;
+}
+
+/*
+ * Apply all the updates under the locks of the references and of the
+ * packed-refs.  The direct references are written into packed-refs with
+ * a single rename; only symbolic refs and those outside of refs/ are
+ * written as loose files afterwards.  The reflogs are appended to last,
+ * against the old values read under the locks.
+ */
+static int refdb_fs_backend__transaction(
+	git_refdb_backend *_backend,
+	const git_refdb_update *updates,
+	size_t count)
+{
+	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
+	git_sortedcache *refcache = backend->refcache;
+	git_filebuf *locks, pack_file = GIT_FILEBUF_INIT;
+	transaction_log *logs = NULL;
+	const git_refdb_update *update;
+	struct packref *ref;
+	git_buf loose_path = GIT_BUF_INIT;
+	size_t i, pos;
+	int error = 0;
+
+	assert(backend && (updates || !count));
+
+	locks = git__calloc(count ? count : 1, sizeof(git_filebuf));
+	GITERR_CHECK_ALLOC(locks);
+
+	if ((logs = git__calloc(count ? count : 1, sizeof(transaction_log))) == NULL) {
+		git__free(locks);
+		return -1;
+	}
+
+	for (i = 0; i < count && !error; ++i)
+		error = loose_lock(&locks[i], backend, updates[i].name);
+
+	if (error < 0 ||
+		(error = git_filebuf_open(&pack_file, git_sortedcache_path(refcache),
+			0, GIT_PACKEDREFS_FILE_MODE)) < 0)
+		goto cleanup;
+
+	/* with everything locked, nobody can change the old values anymore */
+	for (i = 0; i < count; ++i) {
+		update = &updates[i];
+
+		if ((error = transaction_check_old(backend, update)) < 0 ||
+			(update->ref &&
+			 (error = transaction_path_available(backend, update->name)) < 0) ||
+			(error = transaction_log_prepare(&logs[i], backend, update)) < 0)
+			goto cleanup;
+	}
+
+	if ((error = packed_reload(backend)) < 0 ||
+		(error = git_sortedcache_wlock(refcache)) < 0)
+		goto cleanup;
+
+	for (i = 0; i < count && !error; ++i) {
+		update = &updates[i];
+
+		if (transaction_packs(update)) {
+			if ((error = git_sortedcache_upsert(
+					(void **)&ref, refcache, update->name)) < 0)
+				break;
+
+			git_oid_cpy(&ref->oid, &update->ref->target.oid);
+			memset(&ref->peel, 0, sizeof(git_oid));
+			ref->flags = 0;
+		} else if (!git_sortedcache_lookup_index(
+				&pos, refcache, update->name)) {
+			error = git_sortedcache_remove(refcache, pos);
+		}
+	}
+
+	if (!error)
+		error = packed_write_locked(backend, &pack_file);
+
+	if (error < 0) {
+		/* the cache no longer matches the file; load it afresh */
+		git_sortedcache_clear(refcache, false);
+		git_futils_filestamp_set(&refcache->stamp, NULL);
+	} else {
+		git_sortedcache_updated(refcache);
+	}
+
+	packed_snapshot_reset(backend);
+	git_sortedcache_wunlock(refcache);
+
+	if (error < 0)
+		goto cleanup;
+
+	/*
+	 * The new values are in place now, except for the loose files
+	 * which still shadow them.  Failures from here on can leave some
+	 * of those behind.
+	 */
+	for (i = 0; i < count; ++i) {
+		update = &updates[i];
+
+		if (update->ref && !transaction_packs(update)) {
+			if ((error = loose_commit(&locks[i], backend, update->ref)) < 0)
+				goto cleanup;
+			continue;
+		}
+
+		if (git_buf_joinpath(&loose_path, backend->path, update->name) < 0) {
+			error = -1;
+			goto cleanup;
+		}
+
+		error = 0;
+		if (git_path_isfile(loose_path.ptr) && p_unlink(loose_path.ptr) < 0) {
+			giterr_set(GITERR_OS,
+				"Failed to remove loose reference '%s'", loose_path.ptr);
+			error = -1;
+		}
+
+		loose_cache_forget(backend, update->name);
+
+		if (error < 0)
+			goto cleanup;
+	}
+
+	/* only log the changes that went through */
+	for (i = 0; i < count; ++i) {
+		update = &updates[i];
+
+		if (logs[i].write &&
+			((error = reflog_append(backend, update->ref, &logs[i].old_id,
+				NULL, update->who, update->message)) < 0 ||
+			 (error = maybe_append_head(backend, update->ref, &logs[i].old_id,
+				update->who, update->message)) < 0))
+			goto cleanup;
+	}
+
+cleanup:
+	for (i = 0; i < count; ++i)
+		git_filebuf_cleanup(&locks[i]);
+
+	git_filebuf_cleanup(&pack_file);
+	git_buf_free(&loose_path);
+	git__free(logs);
+	git__free(locks);
+	return error;
+}
+
 static int refdb_fs_backend__compress(git_refdb_backend *_backend)
 {
 	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
@@ -1275,12 +2228,46 @@ static int refdb_fs_backend__compress(git_refdb_backend *_backend)
 	return 0;
 }
 
+static int refdb_fs_backend__snapshot_begin(git_refdb_backend *_backend)
+{
+	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
+
+	git_atomic_inc(&backend->snapshot_scope);
+	return 0;
+}
+
+static void refdb_fs_backend__snapshot_end(git_refdb_backend *_backend)
+{
+	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
+
+	assert(git_atomic_get(&backend->snapshot_scope) > 0);
+	git_atomic_dec(&backend->snapshot_scope);
+}
+
+static void loose_cache_free(git_strmap *cache)
+{
+	loose_entry *entry;
+
+	if (!cache)
+		return;
+
+	git_strmap_foreach_value(cache, entry, {
+		loose_entry_free(entry);
+	});
+
+	git_strmap_free(cache);
+}
+
 static void refdb_fs_backend__free(git_refdb_backend *_backend)
 {
 	refdb_fs_backend *backend = (refdb_fs_backend *)_backend;
 
 	assert(backend);
 
+	packed_snapshot_free(backend->snapshot);
+	git_mutex_free(&backend->snapshot_lock);
+	loose_cache_free(backend->loose_cache);
+	git_mutex_free(&backend->loose_cache_lock);
 	git_sortedcache_free(backend->refcache);
 	git__free(backend->path);
 	git__free(backend);
@@ -1799,16 +2786,20 @@ int git_refdb_backend_fs(
 	git_refdb_backend **backend_out,
 	git_repository *repository)
 {
-	int t = 0;
 	git_buf path = GIT_BUF_INIT;
 	refdb_fs_backend *backend;
 
 	backend = git__calloc(1, sizeof(refdb_fs_backend));
 	GITERR_CHECK_ALLOC(backend);
 
+	backend->parent.version = GIT_REFDB_BACKEND_VERSION;
+
 	backend->repo = repository;
+	git_mutex_init(&backend->snapshot_lock);
+	git_mutex_init(&backend->loose_cache_lock);
 
-	if (setup_namespace(&path, repository) < 0)
+	if (git_strmap_alloc(&backend->loose_cache) < 0 ||
+		setup_namespace(&path, repository) < 0)
 		goto fail;
 
 	backend->path = git_buf_detach(&path);
@@ -1821,15 +2812,6 @@ int git_refdb_backend_fs(
 
 	git_buf_free(&path);
 
-	if (!git_repository__cvar(&t, backend->repo, GIT_CVAR_IGNORECASE) && t) {
-		backend->iterator_flags |= GIT_ITERATOR_IGNORE_CASE;
-		backend->direach_flags  |= GIT_PATH_DIR_IGNORE_CASE;
-	}
-	if (!git_repository__cvar(&t, backend->repo, GIT_CVAR_PRECOMPOSE) && t) {
-		backend->iterator_flags |= GIT_ITERATOR_PRECOMPOSE_UNICODE;
-		backend->direach_flags  |= GIT_PATH_DIR_PRECOMPOSE_UNICODE;
-	}
-
 	backend->parent.exists = &refdb_fs_backend__exists;
 	backend->parent.lookup = &refdb_fs_backend__lookup;
 	backend->parent.iterator = &refdb_fs_backend__iterator;
@@ -1844,12 +2826,18 @@ int git_refdb_backend_fs(
 	backend->parent.reflog_write = &refdb_reflog_fs__write;
 	backend->parent.reflog_rename = &refdb_reflog_fs__rename;
 	backend->parent.reflog_delete = &refdb_reflog_fs__delete;
+	backend->parent.transaction = &refdb_fs_backend__transaction;
+	backend->parent.snapshot_begin = &refdb_fs_backend__snapshot_begin;
+	backend->parent.snapshot_end = &refdb_fs_backend__snapshot_end;
 
 	*backend_out = (git_refdb_backend *)backend;
 	return 0;
 
 fail:
 	git_buf_free(&path);
+	git_mutex_free(&backend->snapshot_lock);
+	loose_cache_free(backend->loose_cache);
+	git_mutex_free(&backend->loose_cache_lock);
 	git__free(backend->path);
 	git__free(backend);
 	return -1;
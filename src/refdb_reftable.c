@@ -0,0 +1,2143 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "refs.h"
+#include "repository.h"
+#include "fileops.h"
+#include "filebuf.h"
+#include "reflog.h"
+#include "refdb.h"
+#include "reftable.h"
+#include "vector.h"
+
+#include <git2/refdb.h>
+#include <git2/sys/refdb_backend.h>
+#include <git2/sys/refs.h>
+#include <git2/sys/reflog.h>
+
+#define MAX_NESTING_LEVEL 10
+
+/*
+ * The tables of the refdb, oldest first.  A stack is never changed once
+ * it has been loaded; writers build a new one and readers keep using the
+ * one they started with.
+ */
+typedef struct {
+	git_atomic refcount;
+	size_t count;
+	git_reftable **tables;
+	char **names;
+	uint64_t next_index;
+} reftable_stack;
+
+typedef struct {
+	git_refdb_backend parent;
+
+	git_repository *repo;
+	char *path;
+	char *list_path;
+
+	/* pseudo-refs like FETCH_HEAD or MERGE_HEAD stay plain files */
+	git_refdb_backend *files;
+
+	git_mutex lock;
+	reftable_stack *stack;
+	git_futils_filestamp stamp;
+} refdb_reftable_backend;
+
+static bool is_pseudoref(const char *name)
+{
+	return strcmp(name, GIT_HEAD_FILE) != 0 &&
+		git__prefixcmp(name, GIT_REFS_DIR) != 0;
+}
+
+static int ref_error_notfound(const char *name)
+{
+	giterr_set(GITERR_REFERENCE, "Reference '%s' not found", name);
+	return GIT_ENOTFOUND;
+}
+
+static void ref_record_init(git_reftable_ref *rec)
+{
+	memset(rec, 0, sizeof(*rec));
+	git_buf_init(&rec->name, 0);
+	git_buf_init(&rec->target, 0);
+}
+
+static void log_record_init(git_reftable_log *rec)
+{
+	memset(rec, 0, sizeof(*rec));
+	git_buf_init(&rec->name, 0);
+	git_buf_init(&rec->who_name, 0);
+	git_buf_init(&rec->who_email, 0);
+	git_buf_init(&rec->message, 0);
+}
+
+static void log_record_free(git_reftable_log *rec)
+{
+	if (!rec)
+		return;
+
+	git_reftable_log_free(rec);
+	git__free(rec);
+}
+
+static void stack_free(reftable_stack *stack)
+{
+	size_t i;
+
+	if (!stack || git_atomic_dec(&stack->refcount) > 0)
+		return;
+
+	for (i = 0; i < stack->count; ++i) {
+		git_reftable_free(stack->tables[i]);
+		git__free(stack->names[i]);
+	}
+
+	git__free(stack->tables);
+	git__free(stack->names);
+	git__free(stack);
+}
+
+/* open the tables in the list, reusing the ones `prev` already has open */
+static int stack_load(
+	reftable_stack **out,
+	refdb_reftable_backend *backend,
+	const reftable_stack *prev)
+{
+	reftable_stack *stack;
+	git_buf list = GIT_BUF_INIT, path = GIT_BUF_INIT;
+	char *scan, *line;
+	size_t i, lines = 0;
+	int error;
+
+	error = git_futils_readbuffer(&list, backend->list_path);
+	if (error < 0 && error != GIT_ENOTFOUND)
+		return error;
+	giterr_clear();
+
+	for (scan = list.ptr; *scan; ++scan)
+		lines += (*scan == '\n');
+
+	stack = git__calloc(1, sizeof(reftable_stack));
+	GITERR_CHECK_ALLOC(stack);
+	git_atomic_set(&stack->refcount, 1);
+	stack->next_index = 1;
+
+	stack->tables = git__calloc(lines + 1, sizeof(git_reftable *));
+	stack->names = git__calloc(lines + 1, sizeof(char *));
+	if (!stack->tables || !stack->names) {
+		error = -1;
+		goto done;
+	}
+
+	error = 0;
+	scan = list.ptr;
+
+	while (!error && (line = git__strsep(&scan, "\n")) != NULL) {
+		git_reftable *table = NULL;
+
+		if (!*line)
+			continue;
+
+		for (i = 0; prev && i < prev->count; ++i) {
+			if (strcmp(prev->names[i], line) == 0) {
+				table = prev->tables[i];
+				git_reftable_incref(table);
+				break;
+			}
+		}
+
+		if (!table &&
+			(git_buf_joinpath(&path, backend->path, line) < 0 ||
+			 (error = git_reftable_open(&table, path.ptr)) < 0))
+			break;
+
+		stack->tables[stack->count] = table;
+		stack->names[stack->count] = git__strdup(line);
+		stack->count++;
+
+		if (!stack->names[stack->count - 1])
+			error = -1;
+	}
+
+	if (git_buf_oom(&path))
+		error = -1;
+
+	if (!error && stack->count > 0)
+		stack->next_index =
+			git_reftable_max_index(stack->tables[stack->count - 1]) + 1;
+
+done:
+	git_buf_free(&list);
+	git_buf_free(&path);
+
+	if (error < 0) {
+		stack_free(stack);
+		return error;
+	}
+
+	*out = stack;
+	return 0;
+}
+
+/* get the current stack of tables, reloading it if the list has changed */
+static int stack_get(reftable_stack **out, refdb_reftable_backend *backend)
+{
+	reftable_stack *stack;
+	int error, attempts = 3;
+
+	if (git_mutex_lock(&backend->lock) < 0) {
+		giterr_set(GITERR_OS, "Unable to lock the reftable stack");
+		return -1;
+	}
+
+	for (;;) {
+		error = git_futils_filestamp_check(&backend->stamp, backend->list_path);
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			error = 1;
+		}
+
+		if (error < 0 || (!error && backend->stack))
+			break;
+
+		if ((error = stack_load(&stack, backend, backend->stack)) < 0) {
+			git_futils_filestamp_set(&backend->stamp, NULL);
+
+			/* a table can vanish when another writer compacts the stack */
+			if (error == GIT_ENOTFOUND && --attempts > 0)
+				continue;
+			break;
+		}
+
+		stack_free(backend->stack);
+		backend->stack = stack;
+		break;
+	}
+
+	if (!error) {
+		git_atomic_inc(&backend->stack->refcount);
+		*out = backend->stack;
+	}
+
+	git_mutex_unlock(&backend->lock);
+	return error;
+}
+
+/* make the next `stack_get` look at the list again */
+static void stack_reset(refdb_reftable_backend *backend)
+{
+	if (git_mutex_lock(&backend->lock) < 0)
+		return;
+
+	git_futils_filestamp_set(&backend->stamp, NULL);
+	git_mutex_unlock(&backend->lock);
+}
+
+/*
+ * Merging the records of several tables, where the newest table wins
+ * when more than one of them has a record with the same key.
+ */
+
+typedef struct {
+	git_reftable_iter iter;
+	git_reftable_ref ref;
+	git_reftable_log log;
+	bool live;
+} merge_source;
+
+typedef struct {
+	bool logs;
+	size_t count;
+	merge_source *sources;
+	git_reftable_ref ref;
+	git_reftable_log log;
+} table_merge;
+
+static int merge_advance(table_merge *merge, size_t i)
+{
+	merge_source *source = &merge->sources[i];
+	int error;
+
+	if (merge->logs)
+		error = git_reftable_next_log(&source->log, &source->iter);
+	else
+		error = git_reftable_next_ref(&source->ref, &source->iter);
+
+	source->live = !error;
+	return (error == GIT_ITEROVER) ? 0 : error;
+}
+
+static int merge_cmp(
+	const table_merge *merge,
+	const git_reftable_ref *ref, const git_reftable_log *log,
+	const merge_source *source)
+{
+	if (merge->logs)
+		return git_reftable_log_cmp(log, &source->log);
+	return strcmp(ref->name.ptr, source->ref.name.ptr);
+}
+
+static void merge_free(table_merge *merge)
+{
+	size_t i;
+
+	for (i = 0; merge->sources && i < merge->count; ++i) {
+		git_reftable_iter_free(&merge->sources[i].iter);
+		git_reftable_ref_free(&merge->sources[i].ref);
+		git_reftable_log_free(&merge->sources[i].log);
+	}
+
+	git__free(merge->sources);
+	git_reftable_ref_free(&merge->ref);
+	git_reftable_log_free(&merge->log);
+}
+
+static int merge_init(
+	table_merge *merge,
+	git_reftable **tables,
+	size_t count,
+	bool logs,
+	const char *start)
+{
+	size_t i;
+	int error = 0;
+
+	memset(merge, 0, sizeof(*merge));
+	merge->logs = logs;
+	ref_record_init(&merge->ref);
+	log_record_init(&merge->log);
+
+	if (!count)
+		return 0;
+
+	merge->sources = git__calloc(count, sizeof(merge_source));
+	GITERR_CHECK_ALLOC(merge->sources);
+
+	for (i = 0; i < count; ++i) {
+		merge_source *source = &merge->sources[i];
+
+		git_buf_init(&source->iter.key, 0);
+		ref_record_init(&source->ref);
+		log_record_init(&source->log);
+	}
+
+	merge->count = count;
+
+	for (i = 0; !error && i < count; ++i) {
+		if (logs)
+			error = git_reftable_seek_log(
+				&merge->sources[i].iter, tables[i], start);
+		else
+			error = git_reftable_seek_ref(
+				&merge->sources[i].iter, tables[i], start);
+
+		if (!error)
+			error = merge_advance(merge, i);
+	}
+
+	return error;
+}
+
+/* produce the next record in `merge->ref` or `merge->log` */
+static int merge_next(table_merge *merge)
+{
+	size_t i, best = merge->count;
+	merge_source *source;
+	git_reftable_ref ref;
+	git_reftable_log log;
+	int error;
+
+	for (i = 0; i < merge->count; ++i) {
+		source = &merge->sources[i];
+
+		if (source->live && (best == merge->count ||
+			merge_cmp(merge, &source->ref, &source->log,
+				&merge->sources[best]) <= 0))
+			best = i;
+	}
+
+	if (best == merge->count)
+		return GIT_ITEROVER;
+
+	source = &merge->sources[best];
+
+	if (merge->logs) {
+		log = merge->log;
+		merge->log = source->log;
+		source->log = log;
+	} else {
+		ref = merge->ref;
+		merge->ref = source->ref;
+		source->ref = ref;
+	}
+
+	/* the same key in older tables is shadowed */
+	for (i = 0; i < merge->count; ++i) {
+		source = &merge->sources[i];
+
+		if (i != best && source->live &&
+			merge_cmp(merge, &merge->ref, &merge->log, source) == 0 &&
+			(error = merge_advance(merge, i)) < 0)
+			return error;
+	}
+
+	return merge_advance(merge, best);
+}
+
+/*
+ * Reading
+ */
+
+/* find the newest record of `name`, GIT_ENOTFOUND if it is not there */
+static int stack_read_ref(
+	git_reftable_ref *out, const reftable_stack *stack, const char *name)
+{
+	git_reftable_iter iter = GIT_REFTABLE_ITER_INIT;
+	size_t i;
+	int error;
+
+	for (i = stack->count; i > 0; --i) {
+		error = git_reftable_seek_ref(&iter, stack->tables[i - 1], name);
+		if (!error)
+			error = git_reftable_next_ref(out, &iter);
+
+		if (error == GIT_ITEROVER)
+			continue;
+		if (error < 0)
+			break;
+
+		if (strcmp(out->name.ptr, name) == 0) {
+			error = (out->type == GIT_REFTABLE_REF_DELETION) ?
+				GIT_ENOTFOUND : 0;
+			break;
+		}
+	}
+
+	if (i == 0)
+		error = GIT_ENOTFOUND;
+
+	git_reftable_iter_free(&iter);
+	return error;
+}
+
+static int ref_from_record(git_reference **out, const git_reftable_ref *rec)
+{
+	switch (rec->type) {
+	case GIT_REFTABLE_REF_OID:
+		*out = git_reference__alloc(rec->name.ptr, &rec->oid, NULL);
+		break;
+	case GIT_REFTABLE_REF_PEELED:
+		*out = git_reference__alloc(rec->name.ptr, &rec->oid, &rec->peel);
+		break;
+	case GIT_REFTABLE_REF_SYMBOLIC:
+		*out = git_reference__alloc_symbolic(rec->name.ptr, rec->target.ptr);
+		break;
+	default:
+		return ref_error_notfound(rec->name.ptr);
+	}
+
+	GITERR_CHECK_ALLOC(*out);
+	return 0;
+}
+
+static int stack_lookup(
+	git_reference **out, const reftable_stack *stack, const char *name)
+{
+	git_reftable_ref rec;
+	int error;
+
+	ref_record_init(&rec);
+
+	error = stack_read_ref(&rec, stack, name);
+
+	if (error == GIT_ENOTFOUND)
+		error = ref_error_notfound(name);
+	else if (!error && out)
+		error = ref_from_record(out, &rec);
+
+	git_reftable_ref_free(&rec);
+	return error;
+}
+
+/* peel symbolic refs down to an id, GIT_ENOTFOUND for unborn branches */
+static int stack_resolve(
+	git_oid *out, const reftable_stack *stack, const char *name)
+{
+	git_reftable_ref rec;
+	git_buf target = GIT_BUF_INIT;
+	int error, nesting;
+
+	ref_record_init(&rec);
+
+	if ((error = git_buf_sets(&target, name)) < 0)
+		return error;
+
+	for (nesting = 0; nesting < MAX_NESTING_LEVEL; ++nesting) {
+		if ((error = stack_read_ref(&rec, stack, target.ptr)) < 0)
+			break;
+
+		if (rec.type != GIT_REFTABLE_REF_SYMBOLIC) {
+			git_oid_cpy(out, &rec.oid);
+			break;
+		}
+
+		git_buf_swap(&target, &rec.target);
+	}
+
+	if (nesting == MAX_NESTING_LEVEL) {
+		giterr_set(GITERR_REFERENCE,
+			"Cannot resolve reference (>%u levels deep)", MAX_NESTING_LEVEL);
+		error = -1;
+	}
+
+	git_buf_free(&target);
+	git_reftable_ref_free(&rec);
+	return error;
+}
+
+/*
+ * Collect the log entries of `name`, newest first, and whether it has a
+ * log at all.  A creation or deletion marker ends the log.
+ */
+static int stack_read_log(
+	git_vector *entries, bool *exists,
+	const reftable_stack *stack, const char *name)
+{
+	git_reftable_iter iter = GIT_REFTABLE_ITER_INIT;
+	git_reftable_log *rec = NULL;
+	size_t i;
+	int error = 0;
+	bool done = false;
+
+	*exists = false;
+
+	for (i = stack->count; !done && i > 0; --i) {
+		if ((error = git_reftable_seek_log(&iter, stack->tables[i - 1], name)) < 0)
+			break;
+
+		while (!done) {
+			if (!rec) {
+				if ((rec = git__malloc(sizeof(git_reftable_log))) == NULL) {
+					error = -1;
+					break;
+				}
+				log_record_init(rec);
+			}
+
+			if ((error = git_reftable_next_log(rec, &iter)) < 0)
+				break;
+
+			if (strcmp(rec->name.ptr, name) != 0)
+				break;
+
+			if (rec->type != GIT_REFTABLE_LOG_ENTRY) {
+				*exists = (rec->type == GIT_REFTABLE_LOG_CREATION);
+				done = true;
+			} else if (!entries) {
+				*exists = true;
+				done = true;
+			} else if ((error = git_vector_insert(entries, rec)) < 0) {
+				break;
+			} else {
+				*exists = true;
+				rec = NULL;
+			}
+		}
+
+		if (error == GIT_ITEROVER)
+			error = 0;
+		if (error < 0)
+			break;
+	}
+
+	log_record_free(rec);
+	git_reftable_iter_free(&iter);
+	return error;
+}
+
+static void log_entries_free(git_vector *entries)
+{
+	git_reftable_log *rec;
+	size_t i;
+
+	git_vector_foreach(entries, i, rec)
+		log_record_free(rec);
+	git_vector_free(entries);
+}
+
+static int stack_has_log(
+	bool *exists, const reftable_stack *stack, const char *name)
+{
+	return stack_read_log(NULL, exists, stack, name);
+}
+
+/*
+ * Writing
+ *
+ * Every change adds a table with the records it touches to the top of
+ * the stack under the lock of the tables list.
+ */
+
+typedef struct {
+	git_filebuf lock;
+	reftable_stack *stack;
+	uint64_t next_index;
+	git_vector refs;
+	git_vector logs;
+} reftable_addition;
+
+static int ref_record_cmp(const void *a, const void *b)
+{
+	const git_reftable_ref *ref_a = a, *ref_b = b;
+	return strcmp(ref_a->name.ptr, ref_b->name.ptr);
+}
+
+static int log_record_cmp(const void *a, const void *b)
+{
+	return git_reftable_log_cmp(a, b);
+}
+
+static void addition_free(reftable_addition *add)
+{
+	git_reftable_ref *ref;
+	size_t i;
+
+	git_filebuf_cleanup(&add->lock);
+	stack_free(add->stack);
+
+	git_vector_foreach(&add->refs, i, ref) {
+		git_reftable_ref_free(ref);
+		git__free(ref);
+	}
+
+	git_vector_free(&add->refs);
+	log_entries_free(&add->logs);
+}
+
+static int addition_begin(
+	reftable_addition *add, refdb_reftable_backend *backend)
+{
+	int error;
+
+	memset(add, 0, sizeof(*add));
+
+	if (git_vector_init(&add->refs, 4, ref_record_cmp) < 0 ||
+		git_vector_init(&add->logs, 4, log_record_cmp) < 0)
+		return -1;
+
+	if ((error = git_filebuf_open(
+			&add->lock, backend->list_path, 0, GIT_REFS_FILE_MODE)) < 0)
+		return error;
+
+	/* now that nobody else can change it, make sure the stack is current */
+	stack_reset(backend);
+
+	if ((error = stack_get(&add->stack, backend)) < 0)
+		return error;
+
+	add->next_index = add->stack->next_index;
+	return 0;
+}
+
+static int addition_ref(
+	reftable_addition *add, const char *name, const git_reference *ref)
+{
+	git_reftable_ref *rec;
+
+	rec = git__malloc(sizeof(git_reftable_ref));
+	GITERR_CHECK_ALLOC(rec);
+	ref_record_init(rec);
+
+	if (git_vector_insert(&add->refs, rec) < 0) {
+		git__free(rec);
+		return -1;
+	}
+
+	if (git_buf_sets(&rec->name, name) < 0)
+		return -1;
+
+	if (!ref) {
+		rec->type = GIT_REFTABLE_REF_DELETION;
+	} else if (ref->type == GIT_REF_SYMBOLIC) {
+		rec->type = GIT_REFTABLE_REF_SYMBOLIC;
+		return git_buf_sets(&rec->target, ref->target.symbolic);
+	} else {
+		rec->type = git_oid_iszero(&ref->peel) ?
+			GIT_REFTABLE_REF_OID : GIT_REFTABLE_REF_PEELED;
+		git_oid_cpy(&rec->oid, &ref->target.oid);
+		git_oid_cpy(&rec->peel, &ref->peel);
+	}
+
+	return 0;
+}
+
+/* add a log record; every one gets its own update index */
+static int addition_log(
+	git_reftable_log **out,
+	reftable_addition *add,
+	const char *name,
+	git_reftable_log_t type)
+{
+	git_reftable_log *rec;
+
+	rec = git__malloc(sizeof(git_reftable_log));
+	GITERR_CHECK_ALLOC(rec);
+	log_record_init(rec);
+
+	if (git_vector_insert(&add->logs, rec) < 0) {
+		git__free(rec);
+		return -1;
+	}
+
+	rec->type = type;
+	rec->update_index = add->next_index++;
+
+	if (out)
+		*out = rec;
+
+	return git_buf_sets(&rec->name, name);
+}
+
+static int addition_log_entry(
+	reftable_addition *add,
+	const char *name,
+	const git_oid *old_id,
+	const git_oid *new_id,
+	const git_signature *who,
+	const char *message)
+{
+	git_reftable_log *rec;
+
+	if (addition_log(&rec, add, name, GIT_REFTABLE_LOG_ENTRY) < 0)
+		return -1;
+
+	git_oid_cpy(&rec->old_id, old_id);
+	git_oid_cpy(&rec->new_id, new_id);
+	rec->when = who->when;
+	rec->has_message = (message != NULL);
+
+	if (git_buf_sets(&rec->who_name, who->name) < 0 ||
+		git_buf_sets(&rec->who_email, who->email) < 0 ||
+		(message && git_buf_sets(&rec->message, message) < 0))
+		return -1;
+
+	return 0;
+}
+
+/* copy the existing entries of a log, oldest first, under a new name */
+static int addition_copy_log(
+	reftable_addition *add, const char *name, git_vector *entries)
+{
+	git_reftable_log *src, *rec;
+	size_t i;
+
+	if (addition_log(NULL, add, name, GIT_REFTABLE_LOG_CREATION) < 0)
+		return -1;
+
+	for (i = entries->length; i > 0; --i) {
+		src = git_vector_get(entries, i - 1);
+
+		if (addition_log(&rec, add, name, GIT_REFTABLE_LOG_ENTRY) < 0)
+			return -1;
+
+		git_oid_cpy(&rec->old_id, &src->old_id);
+		git_oid_cpy(&rec->new_id, &src->new_id);
+		rec->when = src->when;
+		rec->has_message = src->has_message;
+		git_buf_swap(&rec->who_name, &src->who_name);
+		git_buf_swap(&rec->who_email, &src->who_email);
+		git_buf_swap(&rec->message, &src->message);
+	}
+
+	return 0;
+}
+
+static int table_write(
+	git_buf *out,
+	uint64_t min_index,
+	uint64_t max_index,
+	git_vector *refs,
+	git_vector *logs)
+{
+	git_reftable_writer *writer;
+	git_reftable_ref *ref;
+	git_reftable_log *log;
+	size_t i;
+	int error;
+
+	if ((error = git_reftable_writer_new(&writer, min_index, max_index)) < 0)
+		return error;
+
+	git_vector_foreach(refs, i, ref) {
+		if ((error = git_reftable_writer_add_ref(writer, ref)) < 0)
+			goto done;
+	}
+
+	git_vector_foreach(logs, i, log) {
+		if ((error = git_reftable_writer_add_log(writer, log)) < 0)
+			goto done;
+	}
+
+	error = git_reftable_writer_finish(out, writer);
+
+done:
+	git_reftable_writer_free(writer);
+	return error;
+}
+
+/*
+ * Merge the tables into a single one.  Deletions only have to be kept
+ * if there are older tables below the merged ones that they hide.
+ */
+static int table_merge_write(
+	git_buf *out, git_reftable **tables, size_t count, bool keep_deletions)
+{
+	git_reftable_writer *writer;
+	table_merge merge;
+	git_buf hidden = GIT_BUF_INIT;
+	int error;
+
+	if ((error = git_reftable_writer_new(&writer,
+			git_reftable_min_index(tables[0]),
+			git_reftable_max_index(tables[count - 1]))) < 0)
+		return error;
+
+	if ((error = merge_init(&merge, tables, count, false, "")) < 0)
+		goto done;
+
+	while (!(error = merge_next(&merge))) {
+		if (merge.ref.type == GIT_REFTABLE_REF_DELETION && !keep_deletions)
+			continue;
+
+		if ((error = git_reftable_writer_add_ref(writer, &merge.ref)) < 0)
+			goto done;
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	merge_free(&merge);
+
+	if ((error = merge_init(&merge, tables, count, true, "")) < 0)
+		goto done;
+
+	/* records older than a marker are not part of the log anymore */
+	while (!(error = merge_next(&merge))) {
+		git_reftable_log *log = &merge.log;
+
+		if (hidden.size && strcmp(hidden.ptr, log->name.ptr) == 0)
+			continue;
+
+		git_buf_clear(&hidden);
+
+		if (log->type != GIT_REFTABLE_LOG_ENTRY &&
+			(error = git_buf_set(&hidden, log->name.ptr, log->name.size)) < 0)
+			goto done;
+
+		if (log->type == GIT_REFTABLE_LOG_DELETION && !keep_deletions)
+			continue;
+
+		if ((error = git_reftable_writer_add_log(writer, log)) < 0)
+			goto done;
+	}
+
+	if (error == GIT_ITEROVER)
+		error = git_reftable_writer_finish(out, writer);
+
+done:
+	merge_free(&merge);
+	git_reftable_writer_free(writer);
+	git_buf_free(&hidden);
+	return error;
+}
+
+static int table_name(git_buf *out, uint64_t min_index, uint64_t max_index)
+{
+	git_buf_clear(out);
+	return git_buf_printf(out,
+		"%016"PRIx64"-%016"PRIx64".ref", min_index, max_index);
+}
+
+static int table_save(
+	git_reftable **out,
+	git_buf *name,
+	refdb_reftable_backend *backend,
+	git_buf *content,
+	uint64_t min_index,
+	uint64_t max_index)
+{
+	git_buf path = GIT_BUF_INIT;
+	int error;
+
+	if ((error = table_name(name, min_index, max_index)) < 0 ||
+		(error = git_buf_joinpath(&path, backend->path, name->ptr)) < 0 ||
+		(error = git_futils_writebuffer(content, path.ptr, 0, GIT_REFS_FILE_MODE)) < 0)
+		goto done;
+
+	if (out)
+		error = git_reftable_open(out, path.ptr);
+
+done:
+	git_buf_free(&path);
+	return error;
+}
+
+/*
+ * Write the added records as a new table and publish the new stack.
+ * The newest tables get merged for as long as a table is smaller than
+ * twice the ones above it, so the stack stays logarithmic in the number
+ * of changes.  `compact_all` merges the whole stack instead.
+ */
+static int addition_commit(
+	refdb_reftable_backend *backend,
+	reftable_addition *add,
+	bool compact_all)
+{
+	git_reftable **tables = NULL;
+	git_reftable *added = NULL;
+	git_buf content = GIT_BUF_INIT, path = GIT_BUF_INIT, list = GIT_BUF_INIT;
+	git_buf added_name = GIT_BUF_INIT, merged_name = GIT_BUF_INIT;
+	size_t i, count = add->stack->count, first;
+	uint64_t min_index = add->stack->next_index;
+	uint64_t max_index = max(min_index, add->next_index - 1);
+	size_t total;
+	int error = 0;
+
+	tables = git__calloc(count + 1, sizeof(git_reftable *));
+	GITERR_CHECK_ALLOC(tables);
+
+	for (i = 0; i < count; ++i)
+		tables[i] = add->stack->tables[i];
+
+	if (add->refs.length || add->logs.length) {
+		git_vector_sort(&add->refs);
+		git_vector_sort(&add->logs);
+
+		if ((error = table_write(&content,
+				min_index, max_index, &add->refs, &add->logs)) < 0 ||
+			(error = table_save(&added, &added_name, backend,
+				&content, min_index, max_index)) < 0)
+			goto done;
+
+		tables[count++] = added;
+	}
+
+	first = count;
+
+	if (compact_all) {
+		first = 0;
+	} else if (count > 0) {
+		total = git_reftable_size(tables[--first]);
+
+		while (first > 0 && git_reftable_size(tables[first - 1]) < 2 * total)
+			total += git_reftable_size(tables[--first]);
+	}
+
+	if (count - first > 1) {
+		git_buf_clear(&content);
+
+		if ((error = table_merge_write(&content,
+				tables + first, count - first, first > 0)) < 0 ||
+			(error = table_save(NULL, &merged_name, backend, &content,
+				git_reftable_min_index(tables[first]),
+				git_reftable_max_index(tables[count - 1]))) < 0)
+			goto done;
+	} else {
+		first = count;
+	}
+
+	for (i = 0; i < first && i < add->stack->count; ++i)
+		git_buf_printf(&list, "%s\n", add->stack->names[i]);
+
+	if (merged_name.size)
+		git_buf_printf(&list, "%s\n", merged_name.ptr);
+	else if (added_name.size)
+		git_buf_printf(&list, "%s\n", added_name.ptr);
+
+	if (git_buf_oom(&list) ||
+		(error = git_filebuf_write(&add->lock, list.ptr, list.size)) < 0 ||
+		(error = git_filebuf_commit(&add->lock)) < 0)
+		goto done;
+
+	stack_reset(backend);
+
+	/* the merged tables are not listed anymore, so nobody opens them again */
+	for (i = first; i < count; ++i) {
+		const char *name = (i < add->stack->count) ?
+			add->stack->names[i] : added_name.ptr;
+
+		if (!git_buf_joinpath(&path, backend->path, name))
+			p_unlink(path.ptr);
+	}
+
+done:
+	git_reftable_free(added);
+	git__free(tables);
+	git_buf_free(&content);
+	git_buf_free(&added_name);
+	git_buf_free(&merged_name);
+	git_buf_free(&path);
+	git_buf_free(&list);
+	return error;
+}
+
+/*
+ * Backend operations
+ */
+
+static int refdb_reftable__exists(
+	int *exists, git_refdb_backend *_backend, const char *ref_name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_stack *stack;
+	git_reftable_ref rec;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudoref(ref_name))
+		return backend->files->exists(exists, backend->files, ref_name);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	ref_record_init(&rec);
+	error = stack_read_ref(&rec, stack, ref_name);
+
+	*exists = !error;
+	if (error == GIT_ENOTFOUND)
+		error = 0;
+
+	git_reftable_ref_free(&rec);
+	stack_free(stack);
+	return error;
+}
+
+static int refdb_reftable__lookup(
+	git_reference **out, git_refdb_backend *_backend, const char *ref_name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_stack *stack;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudoref(ref_name))
+		return backend->files->lookup(out, backend->files, ref_name);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	error = stack_lookup(out, stack, ref_name);
+
+	stack_free(stack);
+	return error;
+}
+
+typedef struct {
+	git_reference_iterator parent;
+
+	reftable_stack *stack;
+	table_merge merge;
+	char *glob;
+	git_buf prefix;
+} refdb_reftable_iter;
+
+static void refdb_reftable__iterator_free(git_reference_iterator *_iter)
+{
+	refdb_reftable_iter *iter = (refdb_reftable_iter *)_iter;
+
+	merge_free(&iter->merge);
+	stack_free(iter->stack);
+	git__free(iter->glob);
+	git_buf_free(&iter->prefix);
+	git__free(iter);
+}
+
+/* step to the next live ref under "refs/" that matches the glob */
+static int iter_step(refdb_reftable_iter *iter)
+{
+	const git_reftable_ref *ref = &iter->merge.ref;
+	int error;
+
+	while (!(error = merge_next(&iter->merge))) {
+		if (git__prefixcmp(ref->name.ptr, iter->prefix.ptr) != 0)
+			return GIT_ITEROVER;
+
+		if (ref->type == GIT_REFTABLE_REF_DELETION ||
+			git__prefixcmp(ref->name.ptr, GIT_REFS_DIR) != 0 ||
+			(iter->glob && p_fnmatch(iter->glob, ref->name.ptr, 0) != 0))
+			continue;
+
+		return 0;
+	}
+
+	return error;
+}
+
+static int refdb_reftable__iterator_next(
+	git_reference **out, git_reference_iterator *_iter)
+{
+	refdb_reftable_iter *iter = (refdb_reftable_iter *)_iter;
+	int error;
+
+	if ((error = iter_step(iter)) < 0)
+		return error;
+
+	return ref_from_record(out, &iter->merge.ref);
+}
+
+static int refdb_reftable__iterator_next_name(
+	const char **out, git_reference_iterator *_iter)
+{
+	refdb_reftable_iter *iter = (refdb_reftable_iter *)_iter;
+	int error;
+
+	if ((error = iter_step(iter)) < 0)
+		return error;
+
+	*out = iter->merge.ref.name.ptr;
+	return 0;
+}
+
+static int refdb_reftable__iterator(
+	git_reference_iterator **out, git_refdb_backend *_backend, const char *glob)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	refdb_reftable_iter *iter;
+	size_t literal;
+
+	assert(backend);
+
+	iter = git__calloc(1, sizeof(refdb_reftable_iter));
+	GITERR_CHECK_ALLOC(iter);
+
+	git_buf_init(&iter->prefix, 0);
+	merge_init(&iter->merge, NULL, 0, false, NULL);
+
+	iter->parent.next = refdb_reftable__iterator_next;
+	iter->parent.next_name = refdb_reftable__iterator_next_name;
+	iter->parent.free = refdb_reftable__iterator_free;
+
+	/* only the refs starting with the literal part of the glob can match */
+	if (glob) {
+		literal = strcspn(glob, "?*[\\");
+
+		if ((iter->glob = git__strdup(glob)) == NULL ||
+			git_buf_set(&iter->prefix, glob, literal) < 0)
+			goto fail;
+	}
+
+	if (stack_get(&iter->stack, backend) < 0 ||
+		merge_init(&iter->merge, iter->stack->tables, iter->stack->count,
+			false, iter->prefix.ptr) < 0)
+		goto fail;
+
+	*out = (git_reference_iterator *)iter;
+	return 0;
+
+fail:
+	refdb_reftable__iterator_free((git_reference_iterator *)iter);
+	return -1;
+}
+
+/*
+ * Check that no ref other than `old_ref` is a directory of `new_ref`
+ * (e.g. "refs/heads/a" for "refs/heads/a/b") or lives inside it.
+ */
+static int stack_path_available(
+	const reftable_stack *stack,
+	const char *new_ref,
+	const char *old_ref,
+	int force)
+{
+	table_merge merge;
+	git_reftable_ref rec;
+	git_buf name = GIT_BUF_INIT;
+	const char *slash;
+	int error = 0;
+	bool available = true;
+
+	ref_record_init(&rec);
+
+	if (!force) {
+		if (!(error = stack_read_ref(&rec, stack, new_ref))) {
+			giterr_set(GITERR_REFERENCE,
+				"Failed to write reference '%s': a reference with "
+				"that name already exists.", new_ref);
+			error = GIT_EEXISTS;
+		}
+
+		if (error != GIT_ENOTFOUND)
+			goto done;
+	}
+
+	for (slash = strchr(new_ref, '/'); slash; slash = strchr(slash + 1, '/')) {
+		if ((error = git_buf_set(&name, new_ref, slash - new_ref)) < 0)
+			goto done;
+
+		error = stack_read_ref(&rec, stack, name.ptr);
+		if (error == GIT_ENOTFOUND)
+			continue;
+		if (error < 0)
+			goto done;
+
+		if (!old_ref || strcmp(old_ref, name.ptr) != 0) {
+			available = false;
+			break;
+		}
+	}
+
+	if (available) {
+		git_buf_clear(&name);
+
+		if ((error = git_buf_printf(&name, "%s/", new_ref)) < 0 ||
+			(error = merge_init(&merge, stack->tables, stack->count,
+				false, name.ptr)) < 0) {
+			merge_free(&merge);
+			goto done;
+		}
+
+		while (!(error = merge_next(&merge)) &&
+			!git__prefixcmp(merge.ref.name.ptr, name.ptr)) {
+			if (merge.ref.type != GIT_REFTABLE_REF_DELETION &&
+				(!old_ref || strcmp(old_ref, merge.ref.name.ptr) != 0)) {
+				available = false;
+				break;
+			}
+		}
+
+		merge_free(&merge);
+
+		if (error < 0 && error != GIT_ITEROVER)
+			goto done;
+	}
+
+	error = 0;
+
+	if (!available) {
+		giterr_set(GITERR_REFERENCE,
+			"Path to reference '%s' collides with existing one", new_ref);
+		error = -1;
+	}
+
+done:
+	git_buf_free(&name);
+	git_reftable_ref_free(&rec);
+	return error;
+}
+
+static int cmp_old_ref(
+	int *cmp,
+	const reftable_stack *stack,
+	const char *name,
+	const git_oid *old_id,
+	const char *old_target)
+{
+	git_reference *old_ref = NULL;
+	int error;
+
+	*cmp = 0;
+
+	/* It "matches" if there is no old value to compare against */
+	if (!old_id && !old_target)
+		return 0;
+
+	if ((error = stack_lookup(&old_ref, stack, name)) < 0)
+		return error;
+
+	if (old_id)
+		*cmp = (old_ref->type != GIT_REF_OID) ? -1 :
+			git_oid_cmp(old_id, &old_ref->target.oid);
+	else
+		*cmp = (old_ref->type != GIT_REF_SYMBOLIC) ? 1 :
+			git__strcmp(old_target, old_ref->target.symbolic);
+
+	git_reference_free(old_ref);
+	return 0;
+}
+
+/* We only write if it's under heads/, remotes/ or notes/ or if it already has a log */
+static int should_write_reflog(
+	int *write, git_repository *repo,
+	const reftable_stack *stack, const char *name)
+{
+	int error, logall;
+	bool exists;
+
+	error = git_repository__cvar(&logall, repo, GIT_CVAR_LOGALLREFUPDATES);
+	if (error < 0)
+		return error;
+
+	/* Defaults to the opposite of the repo being bare */
+	if (logall == GIT_LOGALLREFUPDATES_UNSET)
+		logall = !git_repository_is_bare(repo);
+
+	*write = 0;
+
+	if (!logall)
+		return 0;
+
+	if ((error = stack_has_log(&exists, stack, name)) < 0)
+		return error;
+
+	*write = exists ||
+		!git__prefixcmp(name, GIT_REFS_HEADS_DIR) ||
+		!git__strcmp(name, GIT_HEAD_FILE) ||
+		!git__prefixcmp(name, GIT_REFS_REMOTES_DIR) ||
+		!git__prefixcmp(name, GIT_REFS_NOTES_DIR);
+
+	return 0;
+}
+
+/* the same rules for which updates get logged as the files backend */
+static int log_append(
+	reftable_addition *add,
+	const git_reference *ref,
+	const git_signature *who,
+	const char *message)
+{
+	git_oid old_id = {{0}}, new_id = {{0}};
+	int error;
+
+	/* only HEAD logs the change of a symbolic ref */
+	if (ref->type == GIT_REF_SYMBOLIC && strcmp(ref->name, GIT_HEAD_FILE))
+		return 0;
+
+	error = stack_resolve(&old_id, add->stack, ref->name);
+	if (error < 0 && error != GIT_ENOTFOUND)
+		return error;
+
+	if (ref->type == GIT_REF_OID) {
+		git_oid_cpy(&new_id, &ref->target.oid);
+	} else {
+		error = stack_resolve(&new_id, add->stack, ref->target.symbolic);
+
+		/* detaching HEAD does not create an entry */
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			return 0;
+		}
+		if (error < 0)
+			return error;
+	}
+
+	giterr_clear();
+	return addition_log_entry(add, ref->name, &old_id, &new_id, who, message);
+}
+
+/* a branch updated directly also updates the log of the HEAD pointing to it */
+static int maybe_append_head(
+	reftable_addition *add,
+	const git_reference *ref,
+	const git_signature *who,
+	const char *message)
+{
+	git_reftable_ref head;
+	git_buf target = GIT_BUF_INIT;
+	git_oid old_id = {{0}};
+	int error, nesting;
+
+	if (ref->type == GIT_REF_SYMBOLIC)
+		return 0;
+
+	ref_record_init(&head);
+
+	if ((error = git_buf_sets(&target, GIT_HEAD_FILE)) < 0)
+		return error;
+
+	/* go down the symref chain until we find the branch */
+	for (nesting = 0; nesting < MAX_NESTING_LEVEL; ++nesting) {
+		error = stack_read_ref(&head, add->stack, target.ptr);
+		if (error < 0 || head.type != GIT_REFTABLE_REF_SYMBOLIC)
+			break;
+
+		git_buf_swap(&target, &head.target);
+	}
+
+	/* a detached HEAD or one pointing elsewhere is left alone */
+	if (!error || error == GIT_ENOTFOUND) {
+		giterr_clear();
+		error = 0;
+
+		if (nesting > 0 && strcmp(target.ptr, ref->name) == 0) {
+			if (stack_resolve(&old_id, add->stack, ref->name) < 0)
+				giterr_clear();
+
+			error = addition_log_entry(add, GIT_HEAD_FILE,
+				&old_id, &ref->target.oid, who, message);
+		}
+	}
+
+	git_buf_free(&target);
+	git_reftable_ref_free(&head);
+	return error;
+}
+
+static int refdb_reftable__write(
+	git_refdb_backend *_backend,
+	const git_reference *ref,
+	int force,
+	const git_signature *who,
+	const char *message,
+	const git_oid *old_id,
+	const char *old_target)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	const git_oid *new_id = NULL;
+	const char *new_target = NULL;
+	int error, cmp, should_write;
+
+	assert(backend);
+
+	if (is_pseudoref(ref->name))
+		return backend->files->write(backend->files,
+			ref, force, who, message, old_id, old_target);
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_path_available(add.stack, ref->name, NULL, force)) < 0 ||
+		(error = cmp_old_ref(&cmp, add.stack, ref->name, old_id, old_target)) < 0)
+		goto done;
+
+	if (cmp) {
+		giterr_set(GITERR_REFERENCE, "old reference value does not match");
+		error = GIT_EMODIFIED;
+		goto done;
+	}
+
+	if (ref->type == GIT_REF_SYMBOLIC)
+		new_target = ref->target.symbolic;
+	else
+		new_id = &ref->target.oid;
+
+	/* Don't update if we have the same value */
+	error = cmp_old_ref(&cmp, add.stack, ref->name, new_id, new_target);
+	if (!error && !cmp)
+		goto done;
+	if (error < 0 && error != GIT_ENOTFOUND)
+		goto done;
+
+	giterr_clear();
+
+	if ((error = should_write_reflog(
+			&should_write, backend->repo, add.stack, ref->name)) < 0 ||
+		(error = addition_ref(&add, ref->name, ref)) < 0)
+		goto done;
+
+	if (should_write &&
+		((error = log_append(&add, ref, who, message)) < 0 ||
+		 (error = maybe_append_head(&add, ref, who, message)) < 0))
+		goto done;
+
+	error = addition_commit(backend, &add, false);
+
+done:
+	addition_free(&add);
+	return error;
+}
+
+static int refdb_reftable__delete(
+	git_refdb_backend *_backend,
+	const char *ref_name,
+	const git_oid *old_id, const char *old_target)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	int error, cmp;
+
+	assert(backend && ref_name);
+
+	if (is_pseudoref(ref_name))
+		return backend->files->del(backend->files, ref_name, old_id, old_target);
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_lookup(NULL, add.stack, ref_name)) < 0 ||
+		(error = cmp_old_ref(&cmp, add.stack, ref_name, old_id, old_target)) < 0)
+		goto done;
+
+	if (cmp) {
+		giterr_set(GITERR_REFERENCE, "old reference value does not match");
+		error = GIT_EMODIFIED;
+		goto done;
+	}
+
+	if ((error = addition_ref(&add, ref_name, NULL)) < 0)
+		goto done;
+
+	error = addition_commit(backend, &add, false);
+
+done:
+	addition_free(&add);
+	return error;
+}
+
+/* All the updates go into a single new table, which makes them atomic */
+static int refdb_reftable__transaction(
+	git_refdb_backend *_backend,
+	const git_refdb_update *updates,
+	size_t count)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	const git_refdb_update *update;
+	reftable_addition add;
+	git_reference *old_ref;
+	size_t i;
+	int error, modified, should_write;
+
+	assert(backend && (updates || !count));
+
+	for (i = 0; i < count; ++i) {
+		if (is_pseudoref(updates[i].name)) {
+			giterr_set(GITERR_REFERENCE,
+				"Cannot update '%s' in a transaction", updates[i].name);
+			return -1;
+		}
+	}
+
+	if ((error = addition_begin(&add, backend)) < 0)
+		goto done;
+
+	for (i = 0; i < count; ++i) {
+		update = &updates[i];
+
+		error = stack_lookup(&old_ref, add.stack, update->name);
+		if (error < 0 && error != GIT_ENOTFOUND)
+			goto done;
+
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			modified = (update->old_type != GIT_REF_INVALID);
+		} else if (old_ref->type != update->old_type) {
+			modified = 1;
+		} else if (old_ref->type == GIT_REF_OID) {
+			modified = git_oid_cmp(&update->old_id, &old_ref->target.oid);
+		} else {
+			modified = git__strcmp(
+				update->old_target, old_ref->target.symbolic);
+		}
+
+		if (!error)
+			git_reference_free(old_ref);
+
+		if (modified) {
+			giterr_set(GITERR_REFERENCE,
+				"old value of reference '%s' does not match", update->name);
+			error = GIT_EMODIFIED;
+			goto done;
+		}
+
+		if ((error = addition_ref(&add, update->name, update->ref)) < 0)
+			goto done;
+
+		if (!update->ref)
+			continue;
+
+		if ((error = stack_path_available(
+				add.stack, update->name, NULL, true)) < 0 ||
+			(error = should_write_reflog(&should_write,
+				backend->repo, add.stack, update->name)) < 0)
+			goto done;
+
+		if (should_write &&
+			((error = log_append(&add, update->ref,
+				update->who, update->message)) < 0 ||
+			 (error = maybe_append_head(&add, update->ref,
+				update->who, update->message)) < 0))
+			goto done;
+	}
+
+	error = addition_commit(backend, &add, false);
+
+done:
+	addition_free(&add);
+	return error;
+}
+
+static int refdb_reftable__rename(
+	git_reference **out,
+	git_refdb_backend *_backend,
+	const char *old_name,
+	const char *new_name,
+	int force,
+	const git_signature *who,
+	const char *message)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	git_reference *old = NULL, *new = NULL;
+	git_vector entries = GIT_VECTOR_INIT;
+	git_oid old_id = {{0}};
+	bool has_log;
+	int error;
+
+	assert(backend);
+
+	if (is_pseudoref(old_name) || is_pseudoref(new_name)) {
+		if (is_pseudoref(old_name) && is_pseudoref(new_name))
+			return backend->files->rename(out, backend->files,
+				old_name, new_name, force, who, message);
+
+		giterr_set(GITERR_REFERENCE,
+			"Cannot rename '%s' to '%s'", old_name, new_name);
+		return -1;
+	}
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_path_available(add.stack, new_name, old_name, force)) < 0 ||
+		(error = stack_lookup(&old, add.stack, old_name)) < 0)
+		goto done;
+
+	if ((new = git_reference__set_name(old, new_name)) == NULL) {
+		error = -1;
+		goto done;
+	}
+	old = NULL;
+
+	if (strcmp(old_name, new_name) != 0 &&
+		(error = addition_ref(&add, old_name, NULL)) < 0)
+		goto done;
+
+	if ((error = addition_ref(&add, new_name, new)) < 0 ||
+		(error = stack_read_log(&entries, &has_log, add.stack, old_name)) < 0)
+		goto done;
+
+	/* the log moves along with the ref */
+	if (has_log && strcmp(old_name, new_name) != 0 &&
+		((error = addition_log(NULL, &add, old_name, GIT_REFTABLE_LOG_DELETION)) < 0 ||
+		 (error = addition_copy_log(&add, new_name, &entries)) < 0))
+		goto done;
+
+	if (stack_resolve(&old_id, add.stack, new_name) < 0)
+		giterr_clear();
+
+	if (new->type == GIT_REF_OID &&
+		(error = addition_log_entry(&add, new_name,
+			&old_id, &new->target.oid, who, message)) < 0)
+		goto done;
+
+	if ((error = addition_commit(backend, &add, false)) < 0)
+		goto done;
+
+	if (out) {
+		*out = new;
+		new = NULL;
+	}
+
+done:
+	log_entries_free(&entries);
+	git_reference_free(old);
+	git_reference_free(new);
+	addition_free(&add);
+	return error;
+}
+
+static int refdb_reftable__compress(git_refdb_backend *_backend)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	int error;
+
+	assert(backend);
+
+	if ((error = addition_begin(&add, backend)) == 0)
+		error = addition_commit(backend, &add, true);
+
+	addition_free(&add);
+	return error;
+}
+
+static int refdb_reftable__has_log(git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_stack *stack;
+	bool exists;
+	int error;
+
+	assert(backend && name);
+
+	if (is_pseudoref(name))
+		return backend->files->has_log(backend->files, name);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	error = stack_has_log(&exists, stack, name);
+	stack_free(stack);
+
+	return error < 0 ? error : exists;
+}
+
+static int refdb_reftable__ensure_log(git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	bool exists;
+	int error;
+
+	assert(backend && name);
+
+	if (is_pseudoref(name))
+		return backend->files->ensure_log(backend->files, name);
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_has_log(&exists, add.stack, name)) < 0 || exists)
+		goto done;
+
+	if ((error = addition_log(NULL, &add, name, GIT_REFTABLE_LOG_CREATION)) == 0)
+		error = addition_commit(backend, &add, false);
+
+done:
+	addition_free(&add);
+	return error;
+}
+
+static int reflog_entry_from_record(
+	git_reflog_entry **out, const git_reftable_log *rec)
+{
+	git_reflog_entry *entry;
+	git_signature *who;
+
+	entry = git_reflog_entry__alloc();
+	GITERR_CHECK_ALLOC(entry);
+
+	entry->committer = who = git__calloc(1, sizeof(git_signature));
+	if (!who)
+		goto fail;
+
+	git_oid_cpy(&entry->oid_old, &rec->old_id);
+	git_oid_cpy(&entry->oid_cur, &rec->new_id);
+
+	who->name = git__strndup(rec->who_name.ptr, rec->who_name.size);
+	who->email = git__strndup(rec->who_email.ptr, rec->who_email.size);
+	who->when = rec->when;
+
+	if (!who->name || !who->email)
+		goto fail;
+
+	if (rec->has_message &&
+		!(entry->msg = git__strndup(rec->message.ptr, rec->message.size)))
+		goto fail;
+
+	*out = entry;
+	return 0;
+
+fail:
+	git_reflog_entry__free(entry);
+	return -1;
+}
+
+static int refdb_reftable__reflog_read(
+	git_reflog **out, git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_stack *stack;
+	git_vector entries = GIT_VECTOR_INIT;
+	git_reflog *log = NULL;
+	git_reflog_entry *entry;
+	size_t i;
+	bool exists;
+	int error;
+
+	assert(out && backend && name);
+
+	if (is_pseudoref(name))
+		return backend->files->reflog_read(out, backend->files, name);
+
+	if ((error = stack_get(&stack, backend)) < 0)
+		return error;
+
+	if ((error = stack_read_log(&entries, &exists, stack, name)) < 0)
+		goto done;
+
+	if ((log = git__calloc(1, sizeof(git_reflog))) == NULL ||
+		(log->ref_name = git__strdup(name)) == NULL ||
+		git_vector_init(&log->entries, entries.length, NULL) < 0) {
+		error = -1;
+		goto done;
+	}
+
+	/* the entries are kept oldest first */
+	for (i = entries.length; i > 0; --i) {
+		if ((error = reflog_entry_from_record(
+				&entry, git_vector_get(&entries, i - 1))) < 0)
+			goto done;
+
+		if ((error = git_vector_insert(&log->entries, entry)) < 0) {
+			git_reflog_entry__free(entry);
+			goto done;
+		}
+	}
+
+	*out = log;
+	log = NULL;
+
+done:
+	git_reflog_free(log);
+	log_entries_free(&entries);
+	stack_free(stack);
+	return error;
+}
+
+static int refdb_reftable__reflog_write(
+	git_refdb_backend *_backend, git_reflog *reflog)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	git_reflog_entry *entry;
+	size_t i;
+	bool exists;
+	int error;
+
+	assert(backend && reflog);
+
+	if (is_pseudoref(reflog->ref_name))
+		return backend->files->reflog_write(backend->files, reflog);
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_has_log(&exists, add.stack, reflog->ref_name)) < 0)
+		goto done;
+
+	if (!exists) {
+		giterr_set(GITERR_INVALID,
+			"Log file for reference '%s' doesn't exist.", reflog->ref_name);
+		error = -1;
+		goto done;
+	}
+
+	if ((error = addition_log(NULL, &add,
+			reflog->ref_name, GIT_REFTABLE_LOG_CREATION)) < 0)
+		goto done;
+
+	git_vector_foreach(&reflog->entries, i, entry) {
+		if ((error = addition_log_entry(&add, reflog->ref_name,
+				&entry->oid_old, &entry->oid_cur,
+				entry->committer, entry->msg)) < 0)
+			goto done;
+	}
+
+	error = addition_commit(backend, &add, false);
+
+done:
+	addition_free(&add);
+	return error;
+}
+
+static int refdb_reftable__reflog_rename(
+	git_refdb_backend *_backend, const char *old_name, const char *new_name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	git_vector entries = GIT_VECTOR_INIT;
+	git_buf normalized = GIT_BUF_INIT;
+	bool exists;
+	int error;
+
+	assert(backend && old_name && new_name);
+
+	if (is_pseudoref(old_name) && is_pseudoref(new_name))
+		return backend->files->reflog_rename(backend->files, old_name, new_name);
+
+	if ((error = git_reference__normalize_name(
+			&normalized, new_name, GIT_REF_FORMAT_ALLOW_ONELEVEL)) < 0)
+		return error;
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_read_log(&entries, &exists, add.stack, old_name)) < 0)
+		goto done;
+
+	if (!exists) {
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	if ((error = addition_log(NULL, &add, old_name, GIT_REFTABLE_LOG_DELETION)) < 0 ||
+		(error = addition_copy_log(&add, normalized.ptr, &entries)) < 0)
+		goto done;
+
+	error = addition_commit(backend, &add, false);
+
+done:
+	log_entries_free(&entries);
+	git_buf_free(&normalized);
+	addition_free(&add);
+	return error;
+}
+
+static int refdb_reftable__reflog_delete(
+	git_refdb_backend *_backend, const char *name)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+	reftable_addition add;
+	bool exists;
+	int error;
+
+	assert(backend && name);
+
+	if (is_pseudoref(name))
+		return backend->files->reflog_delete(backend->files, name);
+
+	if ((error = addition_begin(&add, backend)) < 0 ||
+		(error = stack_has_log(&exists, add.stack, name)) < 0 || !exists)
+		goto done;
+
+	if ((error = addition_log(NULL, &add, name, GIT_REFTABLE_LOG_DELETION)) == 0)
+		error = addition_commit(backend, &add, false);
+
+done:
+	addition_free(&add);
+	return error;
+}
+
+static void refdb_reftable__free(git_refdb_backend *_backend)
+{
+	refdb_reftable_backend *backend = (refdb_reftable_backend *)_backend;
+
+	assert(backend);
+
+	if (backend->files)
+		backend->files->free(backend->files);
+
+	stack_free(backend->stack);
+	git_mutex_free(&backend->lock);
+	git__free(backend->path);
+	git__free(backend->list_path);
+	git__free(backend);
+}
+
+static int import_log(
+	reftable_addition *add, git_refdb_backend *files, const char *name)
+{
+	git_reflog *reflog;
+	git_reflog_entry *entry;
+	size_t i;
+	int error;
+
+	if ((error = files->has_log(files, name)) <= 0)
+		return error;
+
+	if ((error = files->reflog_read(&reflog, files, name)) < 0)
+		return error;
+
+	error = addition_log(NULL, add, name, GIT_REFTABLE_LOG_CREATION);
+
+	git_vector_foreach(&reflog->entries, i, entry) {
+		if (error < 0)
+			break;
+
+		error = addition_log_entry(add, name,
+			&entry->oid_old, &entry->oid_cur, entry->committer, entry->msg);
+	}
+
+	git_reflog_free(reflog);
+	return error;
+}
+
+/*
+ * Once imported, the files would only go stale, so they are removed.
+ * HEAD has to stay for the directory to be a repository; like git does
+ * for its reftables, it is pointed at a ref that cannot exist.  Git would
+ * still take the repository for one without any refs and prune all of
+ * its objects, so it is locked out first with an extension it refuses.
+ */
+static int import_retire_files(
+	refdb_reftable_backend *backend,
+	git_refdb_backend *files,
+	const git_vector *refs)
+{
+	const char *repo_path = backend->repo->path_repository;
+	git_buf path = GIT_BUF_INIT;
+	git_filebuf head = GIT_FILEBUF_INIT;
+	git_reftable_ref *rec;
+	git_config *config;
+	size_t i;
+	int error;
+
+	if ((error = git_repository_config__weakptr(&config, backend->repo)) < 0 ||
+		(error = git_config_set_string(
+			config, GIT_REPO_EXTENSION_REFSTORAGE, "reftable")) < 0 ||
+		(error = git_config_set_int32(config,
+			"core.repositoryformatversion", GIT_REPO_EXTENSIONS_VERSION)) < 0)
+		goto done;
+
+	git_vector_foreach(refs, i, rec) {
+		if ((error = files->reflog_delete(files, rec->name.ptr)) < 0)
+			goto done;
+
+		if (!strcmp(rec->name.ptr, GIT_HEAD_FILE))
+			continue;
+
+		if ((error = git_buf_joinpath(
+				&path, repo_path, rec->name.ptr)) < 0 ||
+			(git_path_isfile(path.ptr) && (error = p_unlink(path.ptr)) < 0))
+			goto done;
+	}
+
+	if ((error = git_buf_joinpath(&path, repo_path, GIT_PACKEDREFS_FILE)) < 0 ||
+		(git_path_isfile(path.ptr) && (error = p_unlink(path.ptr)) < 0))
+		goto done;
+
+	if ((error = git_buf_joinpath(&path, repo_path, GIT_HEAD_FILE)) < 0 ||
+		(error = git_filebuf_open(
+			&head, path.ptr, 0, GIT_REFS_FILE_MODE)) < 0 ||
+		(error = git_filebuf_printf(
+			&head, GIT_SYMREF GIT_REFS_HEADS_DIR ".invalid\n")) < 0 ||
+		(error = git_filebuf_commit(&head)) < 0)
+		goto done;
+
+	/* the directories that are left empty */
+	error = git_futils_rmdir_r(GIT_REFS_DIR, repo_path,
+		GIT_RMDIR_SKIP_NONEMPTY | GIT_RMDIR_SKIP_ROOT);
+
+	if (!error && !git_buf_joinpath(&path, repo_path, GIT_REFLOG_DIR) &&
+		git_path_isdir(path.ptr))
+		error = git_futils_rmdir_r(GIT_REFLOG_DIR, repo_path,
+			GIT_RMDIR_SKIP_NONEMPTY);
+
+done:
+	if (error < 0 && !giterr_last())
+		giterr_set(GITERR_OS, "Failed to remove the imported reference files");
+
+	git_filebuf_cleanup(&head);
+	git_buf_free(&path);
+	return error;
+}
+
+/* move the refs and logs of the files backend into the first table */
+static int reftable_import(refdb_reftable_backend *backend)
+{
+	reftable_addition add;
+	git_refdb *db = NULL;
+	git_refdb_backend *files = NULL;
+	git_reference_iterator *iter = NULL;
+	git_reference *ref = NULL;
+	size_t i;
+	int error;
+
+	if ((error = git_futils_mkdir(
+			backend->path, NULL, GIT_REFS_DIR_MODE, GIT_MKDIR_PATH)) < 0)
+		return error;
+
+	if ((error = addition_begin(&add, backend)) < 0)
+		goto done;
+
+	/* somebody else got here first */
+	if (git_path_exists(backend->list_path))
+		goto done;
+
+	if ((error = git_refdb_new(&db, backend->repo)) < 0 ||
+		(error = git_refdb_backend_fs(&files, backend->repo)) < 0 ||
+		(error = git_refdb_set_backend(db, files)) < 0)
+		goto done;
+
+	error = git_refdb_lookup(&ref, db, GIT_HEAD_FILE);
+	if (!error)
+		error = addition_ref(&add, GIT_HEAD_FILE, ref);
+	else if (error == GIT_ENOTFOUND)
+		error = 0;
+
+	git_reference_free(ref);
+
+	if (error < 0 || (error = git_refdb_iterator(&iter, db, NULL)) < 0)
+		goto done;
+
+	while (!(error = git_refdb_iterator_next(&ref, iter))) {
+		error = addition_ref(&add, ref->name, ref);
+		git_reference_free(ref);
+
+		if (error < 0)
+			goto done;
+	}
+
+	if (error != GIT_ITEROVER)
+		goto done;
+
+	giterr_clear();
+	error = 0;
+
+	for (i = 0; !error && i < add.refs.length; ++i) {
+		git_reftable_ref *rec = git_vector_get(&add.refs, i);
+		error = import_log(&add, files, rec->name.ptr);
+	}
+
+	if (!error)
+		error = addition_commit(backend, &add, false);
+
+	if (!error)
+		error = import_retire_files(backend, files, &add.refs);
+
+done:
+	if (iter)
+		git_refdb_iterator_free(iter);
+	git_refdb_free(db);
+	addition_free(&add);
+	return error;
+}
+
+int git_refdb_backend_reftable(
+	git_refdb_backend **backend_out,
+	git_repository *repository)
+{
+	git_buf path = GIT_BUF_INIT;
+	refdb_reftable_backend *backend;
+
+	if (!repository->path_repository) {
+		giterr_set(GITERR_REFERENCE,
+			"The reftable backend needs a repository on disk");
+		return -1;
+	}
+
+	backend = git__calloc(1, sizeof(refdb_reftable_backend));
+	GITERR_CHECK_ALLOC(backend);
+
+	backend->parent.version = GIT_REFDB_BACKEND_VERSION;
+
+	backend->repo = repository;
+	git_mutex_init(&backend->lock);
+
+	if (git_buf_joinpath(&path, repository->path_repository, GIT_REFTABLE_DIR) < 0)
+		goto fail;
+
+	backend->path = git_buf_detach(&path);
+
+	if (git_buf_joinpath(&path, backend->path, GIT_REFTABLE_LIST_FILE) < 0)
+		goto fail;
+
+	backend->list_path = git_buf_detach(&path);
+
+	if (git_refdb_backend_fs(&backend->files, repository) < 0)
+		goto fail;
+
+	if (!git_path_exists(backend->list_path) && reftable_import(backend) < 0)
+		goto fail;
+
+	backend->parent.exists = &refdb_reftable__exists;
+	backend->parent.lookup = &refdb_reftable__lookup;
+	backend->parent.iterator = &refdb_reftable__iterator;
+	backend->parent.write = &refdb_reftable__write;
+	backend->parent.del = &refdb_reftable__delete;
+	backend->parent.rename = &refdb_reftable__rename;
+	backend->parent.compress = &refdb_reftable__compress;
+	backend->parent.has_log = &refdb_reftable__has_log;
+	backend->parent.ensure_log = &refdb_reftable__ensure_log;
+	backend->parent.free = &refdb_reftable__free;
+	backend->parent.reflog_read = &refdb_reftable__reflog_read;
+	backend->parent.reflog_write = &refdb_reftable__reflog_write;
+	backend->parent.reflog_rename = &refdb_reftable__reflog_rename;
+	backend->parent.reflog_delete = &refdb_reftable__reflog_delete;
+	backend->parent.transaction = &refdb_reftable__transaction;
+
+	*backend_out = (git_refdb_backend *)backend;
+	return 0;
+
+fail:
+	git_buf_free(&path);
+	refdb_reftable__free((git_refdb_backend *)backend);
+	return -1;
+}
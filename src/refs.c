@@ -158,15 +158,21 @@ int git_reference_name_to_id(
 	return 0;
 }
 
-static int reference_normalize_for_repo(
+int git_reference__normalize_for_repo(
 	git_refname_t out,
 	git_repository *repo,
 	const char *name)
 {
 	int precompose;
 	unsigned int flags = GIT_REF_FORMAT_ALLOW_ONELEVEL;
+	const char *scan;
 
-	if (!git_repository__cvar(&precompose, repo, GIT_CVAR_PRECOMPOSE) &&
+	/* precomposing only changes non-ASCII names; skip the config for others */
+	for (scan = name; *scan && !((unsigned char)*scan & 0x80); ++scan)
+		/* find the first non-ASCII byte */;
+
+	if (*scan &&
+		!git_repository__cvar(&precompose, repo, GIT_CVAR_PRECOMPOSE) &&
 		precompose)
 		flags |= GIT_REF_FORMAT__PRECOMPOSE_UNICODE;
 
@@ -196,7 +202,7 @@ int git_reference_lookup_resolved(
 
 	scan_type = GIT_REF_SYMBOLIC;
 
-	if ((error = reference_normalize_for_repo(scan_name, repo, name)) < 0)
+	if ((error = git_reference__normalize_for_repo(scan_name, repo, name)) < 0)
 		return error;
 
 	if ((error = git_repository_refdb__weakptr(&refdb, repo)) < 0)
@@ -363,7 +369,7 @@ static int reference__create(
 	if (ref_out)
 		*ref_out = NULL;
 
-	error = reference_normalize_for_repo(normalized, repo, name);
+	error = git_reference__normalize_for_repo(normalized, repo, name);
 	if (error < 0)
 		return error;
 
@@ -390,7 +396,7 @@ static int reference__create(
 	} else {
 		git_refname_t normalized_target;
 
-		if ((error = reference_normalize_for_repo(normalized_target, repo, symbolic)) < 0)
+		if ((error = git_reference__normalize_for_repo(normalized_target, repo, symbolic)) < 0)
 			return error;
 
 		ref = git_reference__alloc_symbolic(normalized, normalized_target);
@@ -411,7 +417,7 @@ static int reference__create(
 	return 0;
 }
 
-static int log_signature(git_signature **out, git_repository *repo)
+int git_reference__log_signature(git_signature **out, git_repository *repo)
 {
 	int error;
 	git_signature *who;
@@ -441,7 +447,7 @@ int git_reference_create_matching(
 	assert(id);
 
 	if (!signature) {
-		if ((error = log_signature(&who, repo)) < 0)
+		if ((error = git_reference__log_signature(&who, repo)) < 0)
 			return error;
 		else
 			signature = who;
@@ -482,7 +488,7 @@ int git_reference_symbolic_create_matching(
 	assert(target);
 
 	if (!signature) {
-		if ((error = log_signature(&who, repo)) < 0)
+		if ((error = git_reference__log_signature(&who, repo)) < 0)
 			return error;
 		else
 			signature = who;
@@ -572,7 +578,7 @@ static int reference__rename(git_reference **out, git_reference *ref, const char
 
 	assert(ref && new_name && signature);
 
-	if ((error = reference_normalize_for_repo(
+	if ((error = git_reference__normalize_for_repo(
 			normalized, git_reference_owner(ref), new_name)) < 0)
 		return error;
 
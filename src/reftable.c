@@ -0,0 +1,1002 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include <zlib.h>
+
+#include "reftable.h"
+#include "array.h"
+#include "fileops.h"
+
+#define REFTABLE_MAGIC "LG2R"
+#define REFTABLE_VERSION 1
+#define REFTABLE_HEADER_SIZE 24
+#define REFTABLE_FOOTER_SIZE (REFTABLE_HEADER_SIZE + 3 * 8 + 4)
+#define REFTABLE_RESTART_INTERVAL 16
+
+#define BLOCK_REF 'r'
+#define BLOCK_LOG 'g'
+#define BLOCK_INDEX 'i'
+#define BLOCK_HEADER_SIZE 5
+
+static int reftable_corrupted(void)
+{
+	giterr_set(GITERR_REFERENCE, "Corrupted reftable");
+	return -1;
+}
+
+static void put_be32(unsigned char *out, uint32_t value)
+{
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+static void put_be64(unsigned char *out, uint64_t value)
+{
+	put_be32(out, (uint32_t)(value >> 32));
+	put_be32(out + 4, (uint32_t)value);
+}
+
+static uint32_t get_be32(const unsigned char *in)
+{
+	return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) |
+		((uint32_t)in[2] << 8) | (uint32_t)in[3];
+}
+
+static uint64_t get_be64(const unsigned char *in)
+{
+	return ((uint64_t)get_be32(in) << 32) | get_be32(in + 4);
+}
+
+static int buf_put_be32(git_buf *buf, uint32_t value)
+{
+	unsigned char raw[4];
+	put_be32(raw, value);
+	return git_buf_put(buf, (const char *)raw, sizeof(raw));
+}
+
+static int buf_put_be64(git_buf *buf, uint64_t value)
+{
+	unsigned char raw[8];
+	put_be64(raw, value);
+	return git_buf_put(buf, (const char *)raw, sizeof(raw));
+}
+
+static int buf_put_varint(git_buf *buf, uint64_t value)
+{
+	unsigned char raw[10];
+	size_t len = 0;
+
+	do {
+		raw[len++] = (unsigned char)((value & 0x7f) | 0x80);
+		value >>= 7;
+	} while (value);
+
+	raw[len - 1] &= 0x7f;
+
+	return git_buf_put(buf, (const char *)raw, len);
+}
+
+static int get_varint(
+	uint64_t *out, const unsigned char *buf, size_t *pos, size_t end)
+{
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	unsigned char c;
+
+	do {
+		if (*pos >= end || shift > 63)
+			return reftable_corrupted();
+
+		c = buf[(*pos)++];
+		value |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	*out = value;
+	return 0;
+}
+
+static int buf_put_string(git_buf *buf, const char *str, size_t len)
+{
+	if (buf_put_varint(buf, len) < 0)
+		return -1;
+	return git_buf_put(buf, str, len);
+}
+
+static int get_string(
+	git_buf *out, const unsigned char *buf, size_t *pos, size_t end)
+{
+	uint64_t len;
+
+	if (get_varint(&len, buf, pos, end) < 0)
+		return -1;
+	if (len > end - *pos)
+		return reftable_corrupted();
+
+	if (out && git_buf_set(out, buf + *pos, (size_t)len) < 0)
+		return -1;
+
+	*pos += (size_t)len;
+	return 0;
+}
+
+static int header_write(git_buf *out, uint64_t min_index, uint64_t max_index)
+{
+	git_buf_put(out, REFTABLE_MAGIC, 4);
+	buf_put_be32(out, REFTABLE_VERSION);
+	buf_put_be64(out, min_index);
+	buf_put_be64(out, max_index);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+static int log_key(git_buf *out, const git_buf *name, uint64_t update_index)
+{
+	git_buf_clear(out);
+	git_buf_put(out, name->ptr, name->size);
+	git_buf_putc(out, '\0');
+	buf_put_be64(out, ~update_index);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+static int key_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+	int cmp = memcmp(a, b, min(alen, blen));
+
+	if (cmp)
+		return cmp;
+	return (alen > blen) - (alen < blen);
+}
+
+void git_reftable_ref_free(git_reftable_ref *ref)
+{
+	git_buf_free(&ref->name);
+	git_buf_free(&ref->target);
+}
+
+void git_reftable_log_free(git_reftable_log *log)
+{
+	git_buf_free(&log->name);
+	git_buf_free(&log->who_name);
+	git_buf_free(&log->who_email);
+	git_buf_free(&log->message);
+}
+
+int git_reftable_log_cmp(const git_reftable_log *a, const git_reftable_log *b)
+{
+	int cmp = key_cmp(a->name.ptr, a->name.size, b->name.ptr, b->name.size);
+
+	if (cmp)
+		return cmp;
+	return (a->update_index < b->update_index) -
+		(a->update_index > b->update_index);
+}
+
+/*
+ * Writing
+ */
+
+typedef struct {
+	git_buf records;
+	git_array_t(uint32_t) restarts;
+	size_t count;
+	git_buf last_key;
+} block_builder;
+
+static int block_add(
+	block_builder *block,
+	const char *key, size_t key_len,
+	unsigned int value_type,
+	const git_buf *value)
+{
+	size_t prefix = 0, offset = BLOCK_HEADER_SIZE + block->records.size;
+	uint32_t *restart;
+
+	if (block->count % REFTABLE_RESTART_INTERVAL == 0) {
+		restart = git_array_alloc(block->restarts);
+		GITERR_CHECK_ALLOC(restart);
+		*restart = (uint32_t)offset;
+	} else {
+		while (prefix < key_len && prefix < block->last_key.size &&
+			key[prefix] == block->last_key.ptr[prefix])
+			prefix++;
+	}
+
+	buf_put_varint(&block->records, prefix);
+	buf_put_varint(&block->records,
+		((uint64_t)(key_len - prefix) << 3) | value_type);
+	git_buf_put(&block->records, key + prefix, key_len - prefix);
+	git_buf_put(&block->records, value->ptr, value->size);
+
+	if (git_buf_oom(&block->records) ||
+		git_buf_set(&block->last_key, key, key_len) < 0)
+		return -1;
+
+	block->count++;
+	return 0;
+}
+
+static size_t block_size(const block_builder *block)
+{
+	return BLOCK_HEADER_SIZE + block->records.size +
+		4 * (git_array_size(block->restarts) + 1);
+}
+
+static int block_finish(git_buf *out, block_builder *block, char type)
+{
+	size_t i;
+
+	git_buf_putc(out, type);
+	buf_put_be32(out, (uint32_t)block_size(block));
+	git_buf_put(out, block->records.ptr, block->records.size);
+
+	for (i = 0; i < git_array_size(block->restarts); ++i)
+		buf_put_be32(out, *git_array_get(block->restarts, i));
+	buf_put_be32(out, (uint32_t)git_array_size(block->restarts));
+
+	git_buf_clear(&block->records);
+	git_array_clear(block->restarts);
+	git_buf_clear(&block->last_key);
+	block->count = 0;
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+static void block_free(block_builder *block)
+{
+	git_buf_free(&block->records);
+	git_array_clear(block->restarts);
+	git_buf_free(&block->last_key);
+}
+
+struct git_reftable_writer {
+	uint64_t min_index;
+	uint64_t max_index;
+	git_buf out;
+
+	char section;
+	git_buf section_last_key;
+	block_builder block;
+	block_builder index;
+	size_t blocks;
+
+	uint64_t ref_index;
+	uint64_t log_start;
+	uint64_t log_index;
+
+	git_buf key;
+	git_buf value;
+	git_buf block_offset;
+};
+
+int git_reftable_writer_new(
+	git_reftable_writer **out, uint64_t min_index, uint64_t max_index)
+{
+	git_reftable_writer *writer;
+
+	writer = git__calloc(1, sizeof(git_reftable_writer));
+	GITERR_CHECK_ALLOC(writer);
+
+	writer->min_index = min_index;
+	writer->max_index = max_index;
+
+	if (header_write(&writer->out, min_index, max_index) < 0) {
+		git_reftable_writer_free(writer);
+		return -1;
+	}
+
+	*out = writer;
+	return 0;
+}
+
+static int writer_flush_block(git_reftable_writer *writer)
+{
+	size_t offset = writer->out.size;
+
+	if (!writer->block.count)
+		return 0;
+
+	git_buf_clear(&writer->block_offset);
+	buf_put_varint(&writer->block_offset, offset);
+
+	if (git_buf_oom(&writer->block_offset) ||
+		block_add(&writer->index,
+			writer->block.last_key.ptr, writer->block.last_key.size,
+			0, &writer->block_offset) < 0 ||
+		block_finish(&writer->out, &writer->block, writer->section) < 0)
+		return -1;
+
+	writer->blocks++;
+	return 0;
+}
+
+/* finish the section, returning the offset of its index if it needs one */
+static int writer_finish_section(uint64_t *index, git_reftable_writer *writer)
+{
+	*index = 0;
+
+	if (writer_flush_block(writer) < 0)
+		return -1;
+
+	if (writer->blocks > 1) {
+		*index = writer->out.size;
+		if (block_finish(&writer->out, &writer->index, BLOCK_INDEX) < 0)
+			return -1;
+	}
+
+	git_buf_clear(&writer->index.records);
+	git_array_clear(writer->index.restarts);
+	git_buf_clear(&writer->index.last_key);
+	writer->index.count = 0;
+	writer->blocks = 0;
+	git_buf_clear(&writer->section_last_key);
+
+	return 0;
+}
+
+static int writer_add(
+	git_reftable_writer *writer,
+	char section,
+	const git_buf *key,
+	unsigned int value_type,
+	const git_buf *value)
+{
+	if (writer->section != section) {
+		if (writer->section == BLOCK_LOG) {
+			giterr_set(GITERR_REFERENCE,
+				"Reftable refs must be written before the logs");
+			return -1;
+		}
+
+		if (writer->section == BLOCK_REF &&
+			writer_finish_section(&writer->ref_index, writer) < 0)
+			return -1;
+
+		if (section == BLOCK_LOG)
+			writer->log_start = writer->out.size;
+		writer->section = section;
+	} else if (key_cmp(key->ptr, key->size,
+		writer->section_last_key.ptr, writer->section_last_key.size) <= 0) {
+		giterr_set(GITERR_REFERENCE,
+			"Reftable records must be written in order");
+		return -1;
+	}
+
+	if (writer->block.count > 0 &&
+		block_size(&writer->block) + key->size + value->size + 24 >
+			GIT_REFTABLE_BLOCK_SIZE &&
+		writer_flush_block(writer) < 0)
+		return -1;
+
+	if (block_add(&writer->block, key->ptr, key->size, value_type, value) < 0)
+		return -1;
+
+	return git_buf_set(&writer->section_last_key, key->ptr, key->size);
+}
+
+int git_reftable_writer_add_ref(
+	git_reftable_writer *writer, const git_reftable_ref *ref)
+{
+	git_buf_clear(&writer->value);
+
+	switch (ref->type) {
+	case GIT_REFTABLE_REF_DELETION:
+		break;
+	case GIT_REFTABLE_REF_OID:
+		git_buf_put(&writer->value, (const char *)ref->oid.id, GIT_OID_RAWSZ);
+		break;
+	case GIT_REFTABLE_REF_PEELED:
+		git_buf_put(&writer->value, (const char *)ref->oid.id, GIT_OID_RAWSZ);
+		git_buf_put(&writer->value, (const char *)ref->peel.id, GIT_OID_RAWSZ);
+		break;
+	case GIT_REFTABLE_REF_SYMBOLIC:
+		buf_put_string(&writer->value, ref->target.ptr, ref->target.size);
+		break;
+	default:
+		giterr_set(GITERR_REFERENCE, "Invalid reftable ref type");
+		return -1;
+	}
+
+	if (git_buf_oom(&writer->value))
+		return -1;
+
+	return writer_add(writer, BLOCK_REF, &ref->name, ref->type, &writer->value);
+}
+
+int git_reftable_writer_add_log(
+	git_reftable_writer *writer, const git_reftable_log *log)
+{
+	git_buf_clear(&writer->value);
+
+	if (log->type == GIT_REFTABLE_LOG_ENTRY) {
+		git_buf_put(&writer->value, (const char *)log->old_id.id, GIT_OID_RAWSZ);
+		git_buf_put(&writer->value, (const char *)log->new_id.id, GIT_OID_RAWSZ);
+		buf_put_string(&writer->value, log->who_name.ptr, log->who_name.size);
+		buf_put_string(&writer->value, log->who_email.ptr, log->who_email.size);
+		buf_put_varint(&writer->value, (uint64_t)log->when.time);
+		buf_put_be32(&writer->value, (uint32_t)log->when.offset);
+		buf_put_varint(&writer->value,
+			log->has_message ? log->message.size + 1 : 0);
+		if (log->has_message)
+			git_buf_put(&writer->value, log->message.ptr, log->message.size);
+	} else if (log->type != GIT_REFTABLE_LOG_DELETION &&
+		log->type != GIT_REFTABLE_LOG_CREATION) {
+		giterr_set(GITERR_REFERENCE, "Invalid reftable log type");
+		return -1;
+	}
+
+	if (git_buf_oom(&writer->value) ||
+		log_key(&writer->key, &log->name, log->update_index) < 0)
+		return -1;
+
+	return writer_add(writer, BLOCK_LOG, &writer->key, log->type, &writer->value);
+}
+
+int git_reftable_writer_finish(git_buf *out, git_reftable_writer *writer)
+{
+	size_t footer;
+	unsigned long crc;
+
+	if (writer->section == BLOCK_REF &&
+		writer_finish_section(&writer->ref_index, writer) < 0)
+		return -1;
+
+	if (writer->section == BLOCK_LOG &&
+		writer_finish_section(&writer->log_index, writer) < 0)
+		return -1;
+
+	footer = writer->out.size;
+
+	if (header_write(&writer->out, writer->min_index, writer->max_index) < 0 ||
+		buf_put_be64(&writer->out, writer->ref_index) < 0 ||
+		buf_put_be64(&writer->out, writer->log_start) < 0 ||
+		buf_put_be64(&writer->out, writer->log_index) < 0)
+		return -1;
+
+	crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, (const Bytef *)writer->out.ptr + footer,
+		(uInt)(writer->out.size - footer));
+
+	if (buf_put_be32(&writer->out, (uint32_t)crc) < 0)
+		return -1;
+
+	git_buf_swap(out, &writer->out);
+	return 0;
+}
+
+void git_reftable_writer_free(git_reftable_writer *writer)
+{
+	if (!writer)
+		return;
+
+	git_buf_free(&writer->out);
+	git_buf_free(&writer->section_last_key);
+	block_free(&writer->block);
+	block_free(&writer->index);
+	git_buf_free(&writer->key);
+	git_buf_free(&writer->value);
+	git_buf_free(&writer->block_offset);
+	git__free(writer);
+}
+
+/*
+ * Reading
+ */
+
+struct git_reftable {
+	git_atomic refcount;
+	git_map map;
+	char *data;
+	const unsigned char *buf;
+	size_t size;
+
+	uint64_t min_index;
+	uint64_t max_index;
+	uint64_t ref_index;
+	uint64_t log_start;
+	uint64_t log_index;
+};
+
+int git_reftable_open(git_reftable **out, const char *path)
+{
+	git_reftable *table;
+	git_file fd;
+	git_off_t size;
+	const unsigned char *footer;
+	unsigned long crc;
+	int error = 0;
+
+	table = git__calloc(1, sizeof(git_reftable));
+	GITERR_CHECK_ALLOC(table);
+	git_atomic_set(&table->refcount, 1);
+
+	if ((fd = git_futils_open_ro(path)) < 0) {
+		git__free(table);
+		return fd;
+	}
+
+	if ((size = git_futils_filesize(fd)) < 0) {
+		giterr_set(GITERR_OS, "Failed to stat '%s'", path);
+		error = -1;
+	} else if (size < REFTABLE_HEADER_SIZE + REFTABLE_FOOTER_SIZE) {
+		error = reftable_corrupted();
+	} else {
+#ifdef GIT_WIN32
+		/* a mapped table could not be deleted after compacting it */
+		git_buf data = GIT_BUF_INIT;
+
+		if (!(error = git_futils_readbuffer_fd(&data, fd, (size_t)size)))
+			table->data = git_buf_detach(&data);
+		table->buf = (const unsigned char *)table->data;
+#else
+		if (!(error = git_futils_mmap_ro(&table->map, fd, 0, (size_t)size)))
+			table->buf = table->map.data;
+#endif
+		table->size = (size_t)size - REFTABLE_FOOTER_SIZE;
+	}
+
+	p_close(fd);
+
+	if (error < 0)
+		goto fail;
+
+	footer = table->buf + table->size;
+
+	crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, footer, REFTABLE_FOOTER_SIZE - 4);
+
+	if (memcmp(table->buf, REFTABLE_MAGIC, 4) != 0 ||
+		get_be32(table->buf + 4) != REFTABLE_VERSION ||
+		memcmp(table->buf, footer, REFTABLE_HEADER_SIZE) != 0 ||
+		get_be32(footer + REFTABLE_FOOTER_SIZE - 4) != (uint32_t)crc) {
+		error = reftable_corrupted();
+		goto fail;
+	}
+
+	table->min_index = get_be64(table->buf + 8);
+	table->max_index = get_be64(table->buf + 16);
+	table->ref_index = get_be64(footer + REFTABLE_HEADER_SIZE);
+	table->log_start = get_be64(footer + REFTABLE_HEADER_SIZE + 8);
+	table->log_index = get_be64(footer + REFTABLE_HEADER_SIZE + 16);
+
+	if (table->ref_index >= table->size || table->log_start >= table->size ||
+		table->log_index >= table->size) {
+		error = reftable_corrupted();
+		goto fail;
+	}
+
+	*out = table;
+	return 0;
+
+fail:
+	git_reftable_free(table);
+	return error;
+}
+
+void git_reftable_incref(git_reftable *table)
+{
+	git_atomic_inc(&table->refcount);
+}
+
+void git_reftable_free(git_reftable *table)
+{
+	if (!table || git_atomic_dec(&table->refcount) > 0)
+		return;
+
+	if (table->map.data)
+		git_futils_mmap_free(&table->map);
+	git__free(table->data);
+	git__free(table);
+}
+
+uint64_t git_reftable_min_index(const git_reftable *table)
+{
+	return table->min_index;
+}
+
+uint64_t git_reftable_max_index(const git_reftable *table)
+{
+	return table->max_index;
+}
+
+size_t git_reftable_size(const git_reftable *table)
+{
+	return table->size + REFTABLE_FOOTER_SIZE;
+}
+
+typedef struct {
+	size_t start;
+	size_t records;
+	size_t restarts;
+	size_t end;
+	uint32_t restart_count;
+} block_info;
+
+/* returns GIT_ITEROVER if there is no block of the given type there */
+static int block_read(
+	block_info *block, const git_reftable *table, size_t offset, char type)
+{
+	uint32_t len;
+
+	if (offset < REFTABLE_HEADER_SIZE ||
+		offset + BLOCK_HEADER_SIZE > table->size ||
+		table->buf[offset] != type)
+		return GIT_ITEROVER;
+
+	len = get_be32(table->buf + offset + 1);
+	if (len < BLOCK_HEADER_SIZE + 4 || len > table->size - offset)
+		return reftable_corrupted();
+
+	block->start = offset;
+	block->records = offset + BLOCK_HEADER_SIZE;
+	block->end = offset + len;
+	block->restart_count = get_be32(table->buf + block->end - 4);
+
+	if (block->restart_count > (len - BLOCK_HEADER_SIZE - 4) / 4)
+		return reftable_corrupted();
+
+	block->restarts = block->end - 4 - 4 * (size_t)block->restart_count;
+	return 0;
+}
+
+static int record_read_key(
+	git_buf *key, unsigned int *value_type,
+	const git_reftable *table, size_t *pos, size_t end)
+{
+	uint64_t prefix, suffix;
+
+	if (get_varint(&prefix, table->buf, pos, end) < 0 ||
+		get_varint(&suffix, table->buf, pos, end) < 0)
+		return -1;
+
+	*value_type = (unsigned int)(suffix & 7);
+	suffix >>= 3;
+
+	if (prefix > key->size || suffix > end - *pos)
+		return reftable_corrupted();
+
+	git_buf_truncate(key, (size_t)prefix);
+	if (git_buf_put(key, (const char *)table->buf + *pos, (size_t)suffix) < 0)
+		return -1;
+
+	*pos += (size_t)suffix;
+	return 0;
+}
+
+static int ref_read_value(
+	git_reftable_ref *out, unsigned int value_type,
+	const git_reftable *table, size_t *pos, size_t end)
+{
+	size_t oids = 0;
+
+	switch (value_type) {
+	case GIT_REFTABLE_REF_DELETION:
+		break;
+	case GIT_REFTABLE_REF_OID:
+		oids = 1;
+		break;
+	case GIT_REFTABLE_REF_PEELED:
+		oids = 2;
+		break;
+	case GIT_REFTABLE_REF_SYMBOLIC:
+		return get_string(out ? &out->target : NULL, table->buf, pos, end);
+	default:
+		return reftable_corrupted();
+	}
+
+	if (oids * GIT_OID_RAWSZ > end - *pos)
+		return reftable_corrupted();
+
+	if (out && oids > 0)
+		git_oid_fromraw(&out->oid, table->buf + *pos);
+	if (out && oids > 1)
+		git_oid_fromraw(&out->peel, table->buf + *pos + GIT_OID_RAWSZ);
+
+	*pos += oids * GIT_OID_RAWSZ;
+	return 0;
+}
+
+static int log_read_value(
+	git_reftable_log *out, unsigned int value_type,
+	const git_reftable *table, size_t *pos, size_t end)
+{
+	uint64_t time, message_len;
+
+	if (value_type == GIT_REFTABLE_LOG_DELETION ||
+		value_type == GIT_REFTABLE_LOG_CREATION)
+		return 0;
+	if (value_type != GIT_REFTABLE_LOG_ENTRY)
+		return reftable_corrupted();
+
+	if (2 * GIT_OID_RAWSZ > end - *pos)
+		return reftable_corrupted();
+
+	if (out) {
+		git_oid_fromraw(&out->old_id, table->buf + *pos);
+		git_oid_fromraw(&out->new_id, table->buf + *pos + GIT_OID_RAWSZ);
+	}
+	*pos += 2 * GIT_OID_RAWSZ;
+
+	if (get_string(out ? &out->who_name : NULL, table->buf, pos, end) < 0 ||
+		get_string(out ? &out->who_email : NULL, table->buf, pos, end) < 0 ||
+		get_varint(&time, table->buf, pos, end) < 0)
+		return -1;
+
+	if (4 > end - *pos)
+		return reftable_corrupted();
+
+	if (out) {
+		out->when.time = (git_time_t)time;
+		out->when.offset = (int)(int32_t)get_be32(table->buf + *pos);
+	}
+	*pos += 4;
+
+	if (get_varint(&message_len, table->buf, pos, end) < 0)
+		return -1;
+
+	if (message_len == 0)
+		return 0;
+	if (message_len - 1 > end - *pos)
+		return reftable_corrupted();
+
+	if (out) {
+		out->has_message = true;
+		if (git_buf_set(&out->message,
+				table->buf + *pos, (size_t)message_len - 1) < 0)
+			return -1;
+	}
+	*pos += (size_t)message_len - 1;
+
+	return 0;
+}
+
+static int record_skip_value(
+	char type, unsigned int value_type,
+	const git_reftable *table, size_t *pos, size_t end)
+{
+	uint64_t offset;
+
+	if (type == BLOCK_REF)
+		return ref_read_value(NULL, value_type, table, pos, end);
+	if (type == BLOCK_LOG)
+		return log_read_value(NULL, value_type, table, pos, end);
+
+	return get_varint(&offset, table->buf, pos, end);
+}
+
+/*
+ * Position the iterator just before the first record in the block with
+ * a key at or after `key`, keeping the key of the record before it so
+ * that the next record can be decoded.
+ */
+static int block_seek(
+	git_reftable_iter *iter, const block_info *block,
+	const char *key, size_t key_len)
+{
+	const git_reftable *table = iter->table;
+	git_buf prev = GIT_BUF_INIT;
+	size_t lo = 0, hi = block->restart_count, mid, pos, start;
+	unsigned int value_type;
+	int error = 0;
+
+	iter->records_end = block->restarts;
+	iter->block_end = block->end;
+
+	/* find the last restart point before the key */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		pos = get_be32(table->buf + block->restarts + 4 * mid);
+
+		if (pos < block->records - block->start ||
+			pos >= block->restarts - block->start)
+			return reftable_corrupted();
+
+		pos += block->start;
+		git_buf_clear(&iter->key);
+
+		if (record_read_key(&iter->key, &value_type,
+				table, &pos, block->restarts) < 0)
+			return -1;
+
+		if (key_cmp(iter->key.ptr, iter->key.size, key, key_len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	start = lo > 0 ?
+		block->start + get_be32(table->buf + block->restarts + 4 * (lo - 1)) :
+		block->records;
+
+	git_buf_clear(&iter->key);
+
+	for (pos = start; pos < block->restarts; ) {
+		size_t record = pos;
+
+		if ((error = git_buf_set(&prev, iter->key.ptr, iter->key.size)) < 0 ||
+			(error = record_read_key(&iter->key, &value_type,
+				table, &pos, block->restarts)) < 0 ||
+			(error = record_skip_value(iter->type, value_type,
+				table, &pos, block->restarts)) < 0)
+			break;
+
+		if (key_cmp(iter->key.ptr, iter->key.size, key, key_len) >= 0) {
+			git_buf_swap(&iter->key, &prev);
+			pos = record;
+			break;
+		}
+	}
+
+	iter->pos = pos;
+	git_buf_free(&prev);
+	return error;
+}
+
+static int table_seek(
+	git_reftable_iter *iter, const git_reftable *table, char type,
+	const char *key, size_t key_len)
+{
+	block_info block;
+	size_t start, offset, pos;
+	uint64_t index, value;
+	unsigned int value_type;
+	int error;
+
+	iter->table = table;
+	iter->type = type;
+	iter->pos = iter->records_end = iter->block_end = 0;
+	git_buf_clear(&iter->key);
+
+	start = (type == BLOCK_REF) ?
+		REFTABLE_HEADER_SIZE : (size_t)table->log_start;
+	index = (type == BLOCK_REF) ? table->ref_index : table->log_index;
+	offset = start;
+
+	if (index) {
+		git_reftable_iter index_iter = GIT_REFTABLE_ITER_INIT;
+
+		index_iter.table = table;
+		index_iter.type = BLOCK_INDEX;
+
+		if ((error = block_read(&block, table, (size_t)index, BLOCK_INDEX)) < 0 ||
+			(error = block_seek(&index_iter, &block, key, key_len)) < 0) {
+			git_reftable_iter_free(&index_iter);
+			return (error == GIT_ITEROVER) ? reftable_corrupted() : error;
+		}
+
+		pos = index_iter.pos;
+
+		if (pos >= block.restarts) {
+			/* every key in the section sorts before this one */
+			git_reftable_iter_free(&index_iter);
+			iter->table = NULL;
+			return 0;
+		}
+
+		error = record_read_key(
+			&index_iter.key, &value_type, table, &pos, block.restarts);
+		if (!error)
+			error = get_varint(&value, table->buf, &pos, block.restarts);
+
+		git_reftable_iter_free(&index_iter);
+
+		if (error < 0)
+			return error;
+
+		offset = (size_t)value;
+	}
+
+	if (!start || (error = block_read(&block, table, offset, type)) == GIT_ITEROVER) {
+		iter->table = NULL;
+		return (index && start) ? reftable_corrupted() : 0;
+	}
+
+	if (error < 0)
+		return error;
+
+	return block_seek(iter, &block, key, key_len);
+}
+
+int git_reftable_seek_ref(
+	git_reftable_iter *iter, const git_reftable *table, const char *name)
+{
+	return table_seek(iter, table, BLOCK_REF, name, strlen(name));
+}
+
+int git_reftable_seek_log(
+	git_reftable_iter *iter, const git_reftable *table, const char *name)
+{
+	/* the name followed by its NUL starts the keys of its entries */
+	return table_seek(iter, table, BLOCK_LOG, name, strlen(name) + 1);
+}
+
+static int iter_next_key(unsigned int *value_type, git_reftable_iter *iter)
+{
+	block_info block;
+	int error;
+
+	if (!iter->table)
+		return GIT_ITEROVER;
+
+	while (iter->pos >= iter->records_end) {
+		error = block_read(&block, iter->table, iter->block_end, iter->type);
+
+		if (error == GIT_ITEROVER)
+			iter->table = NULL;
+		if (error < 0)
+			return error;
+
+		iter->pos = block.records;
+		iter->records_end = block.restarts;
+		iter->block_end = block.end;
+		git_buf_clear(&iter->key);
+	}
+
+	return record_read_key(
+		&iter->key, value_type, iter->table, &iter->pos, iter->records_end);
+}
+
+int git_reftable_next_ref(git_reftable_ref *out, git_reftable_iter *iter)
+{
+	unsigned int value_type;
+	int error;
+
+	if ((error = iter_next_key(&value_type, iter)) < 0)
+		return error;
+
+	memset(&out->oid, 0, sizeof(out->oid));
+	memset(&out->peel, 0, sizeof(out->peel));
+	git_buf_clear(&out->target);
+	out->type = (git_reftable_ref_t)value_type;
+
+	if (git_buf_set(&out->name, iter->key.ptr, iter->key.size) < 0)
+		return -1;
+
+	return ref_read_value(
+		out, value_type, iter->table, &iter->pos, iter->records_end);
+}
+
+int git_reftable_next_log(git_reftable_log *out, git_reftable_iter *iter)
+{
+	unsigned int value_type;
+	size_t name_len;
+	int error;
+
+	if ((error = iter_next_key(&value_type, iter)) < 0)
+		return error;
+
+	if (iter->key.size < 9 || iter->key.ptr[iter->key.size - 9] != '\0')
+		return reftable_corrupted();
+
+	name_len = iter->key.size - 9;
+
+	memset(&out->old_id, 0, sizeof(out->old_id));
+	memset(&out->new_id, 0, sizeof(out->new_id));
+	memset(&out->when, 0, sizeof(out->when));
+	git_buf_clear(&out->who_name);
+	git_buf_clear(&out->who_email);
+	git_buf_clear(&out->message);
+	out->has_message = false;
+	out->type = (git_reftable_log_t)value_type;
+	out->update_index =
+		~get_be64((const unsigned char *)iter->key.ptr + name_len + 1);
+
+	if (git_buf_set(&out->name, iter->key.ptr, name_len) < 0)
+		return -1;
+
+	return log_read_value(
+		out, value_type, iter->table, &iter->pos, iter->records_end);
+}
+
+void git_reftable_iter_free(git_reftable_iter *iter)
+{
+	git_buf_free(&iter->key);
+	iter->table = NULL;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_reftable_h__
+#define INCLUDE_reftable_h__
+
+#include "common.h"
+#include "buffer.h"
+#include "map.h"
+#include "thread-utils.h"
+#include "git2/oid.h"
+#include "git2/types.h"
+
+/*
+ * A reftable is an immutable file holding a sorted list of references
+ * and reflog entries.  The reftable refdb backend keeps a stack of them,
+ * where later tables shadow the records of earlier ones.  Every table
+ * covers a range of "update indices" that only ever grow.
+ *
+ * A table is a header, the ref blocks, an optional ref index, the log
+ * blocks, an optional log index and a footer (integers are big endian):
+ *
+ *   header  "LG2R" | version (4) | min update index (8) | max update index (8)
+ *   block   type (1) | length (4) | records | restart offsets (4 each) | count (4)
+ *   footer  header | ref index (8) | log blocks (8) | log index (8) | crc32 (4)
+ *
+ * Records are prefix compressed against the key of the record before:
+ *
+ *   varint prefix length | varint (suffix length << 3 | value type) |
+ *   suffix | value
+ *
+ * Every 16th record of a block is a restart point that stores its whole
+ * key, so that a block can be binary searched by its restart points.  An
+ * index block lists the last key of every block of its section with the
+ * block's offset as value; it is only written when there is more than one
+ * block to choose from.
+ *
+ * Log keys are the ref name, a NUL and the inverted update index, so the
+ * entries of a ref sort newest first.
+ *
+ * The format is libgit2's own and unrelated to git's reftables, so the
+ * tables live in a directory of their own under a different magic.
+ */
+
+#define GIT_REFTABLE_DIR "libgit2-reftable/"
+#define GIT_REFTABLE_LIST_FILE "tables.list"
+
+#define GIT_REFTABLE_BLOCK_SIZE 4096
+
+typedef enum {
+	GIT_REFTABLE_REF_DELETION = 0,
+	GIT_REFTABLE_REF_OID = 1,
+	GIT_REFTABLE_REF_PEELED = 2,
+	GIT_REFTABLE_REF_SYMBOLIC = 3,
+} git_reftable_ref_t;
+
+typedef struct {
+	git_buf name;
+	git_reftable_ref_t type;
+	git_oid oid;
+	git_oid peel;
+	git_buf target;
+} git_reftable_ref;
+
+typedef enum {
+	/* the log was deleted, nothing older belongs to the ref */
+	GIT_REFTABLE_LOG_DELETION = 0,
+	GIT_REFTABLE_LOG_ENTRY = 1,
+	/* the log was (re)created, nothing older is part of it */
+	GIT_REFTABLE_LOG_CREATION = 2,
+} git_reftable_log_t;
+
+typedef struct {
+	git_buf name;
+	uint64_t update_index;
+	git_reftable_log_t type;
+	git_oid old_id;
+	git_oid new_id;
+	git_buf who_name;
+	git_buf who_email;
+	git_time when;
+	bool has_message;
+	git_buf message;
+} git_reftable_log;
+
+extern void git_reftable_ref_free(git_reftable_ref *ref);
+extern void git_reftable_log_free(git_reftable_log *log);
+
+/*
+ * Tables are written in memory.  Refs have to be added in order, then
+ * the logs in order of their keys.
+ */
+typedef struct git_reftable_writer git_reftable_writer;
+
+extern int git_reftable_writer_new(
+	git_reftable_writer **out, uint64_t min_index, uint64_t max_index);
+extern int git_reftable_writer_add_ref(
+	git_reftable_writer *writer, const git_reftable_ref *ref);
+extern int git_reftable_writer_add_log(
+	git_reftable_writer *writer, const git_reftable_log *log);
+extern int git_reftable_writer_finish(
+	git_buf *out, git_reftable_writer *writer);
+extern void git_reftable_writer_free(git_reftable_writer *writer);
+
+/* Compare the keys of two log records, i.e. by name, then newest first */
+extern int git_reftable_log_cmp(
+	const git_reftable_log *a, const git_reftable_log *b);
+
+typedef struct git_reftable git_reftable;
+
+extern int git_reftable_open(git_reftable **out, const char *path);
+extern void git_reftable_incref(git_reftable *table);
+extern void git_reftable_free(git_reftable *table);
+
+extern uint64_t git_reftable_min_index(const git_reftable *table);
+extern uint64_t git_reftable_max_index(const git_reftable *table);
+extern size_t git_reftable_size(const git_reftable *table);
+
+typedef struct {
+	const git_reftable *table;
+	char type;
+	size_t pos;
+	size_t records_end;
+	size_t block_end;
+	git_buf key;
+} git_reftable_iter;
+
+#define GIT_REFTABLE_ITER_INIT { NULL, 0, 0, 0, 0, GIT_BUF_INIT }
+
+/* Position the iterator at the first ref named `name` or after it */
+extern int git_reftable_seek_ref(
+	git_reftable_iter *iter, const git_reftable *table, const char *name);
+
+/* Position the iterator at the newest log entry of `name` or after it */
+extern int git_reftable_seek_log(
+	git_reftable_iter *iter, const git_reftable *table, const char *name);
+
+/* Get the next record, or GIT_ITEROVER at the end of the section */
+extern int git_reftable_next_ref(git_reftable_ref *out, git_reftable_iter *iter);
+extern int git_reftable_next_log(git_reftable_log *out, git_reftable_iter *iter);
+
+extern void git_reftable_iter_free(git_reftable_iter *iter);
+
+#endif
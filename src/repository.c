@@ -117,9 +117,13 @@ void git_repository_free(git_repository *repo)
 	git_diff_driver_registry_free(repo->diff_drivers);
 	repo->diff_drivers = NULL;
 
+	git_filter_process_registry_free(repo->filter_processes);
+	repo->filter_processes = NULL;
+
 	git__free(repo->path_repository);
 	git__free(repo->workdir);
 	git__free(repo->namespace);
+	git__free(repo->lazy_parent);
 
 	git__memzero(repo, sizeof(*repo));
 	git__free(repo);
@@ -160,6 +164,8 @@ static git_repository *repository_alloc(void)
 	/* set all the entries in the cvar cache to `unset` */
 	git_repository__cvar_cache_clear(repo);
 
+	repo->perf.version = GIT_REPOSITORY_PERFDATA_VERSION;
+
 	return repo;
 }
 
@@ -185,13 +191,13 @@ static int load_config_data(git_repository *repo, const git_config *config)
 static int load_workdir(git_repository *repo, git_config *config, git_buf *parent_path)
 {
 	int         error;
-	const git_config_entry *ce;
+	const git_config_entry *ce = NULL;
 	git_buf     worktree = GIT_BUF_INIT;
 
 	if (repo->is_bare)
 		return 0;
 
-	if ((error = git_config__lookup_entry(
+	if (config != NULL && (error = git_config__lookup_entry(
 			&ce, config, "core.worktree", false)) < 0)
 		return error;
 
@@ -216,6 +222,47 @@ static int load_workdir(git_repository *repo, git_config *config, git_buf *paren
 	return 0;
 }
 
+/*
+ * Read core.bare and core.worktree for a repository that was opened with
+ * GIT_REPOSITORY_OPEN_LAZY.  A config that cannot be loaded leaves the
+ * repository non-bare with the default working directory; the error shows
+ * up again as soon as anything else asks for the config.
+ */
+static void load_lazy_config(git_repository *repo)
+{
+	git_repository tmp;
+	git_config *config = NULL;
+	git_buf parent = GIT_BUF_INIT;
+	char *workdir;
+
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.path_repository = repo->path_repository;
+
+	if (repo->lazy_parent)
+		git_buf_sets(&parent, repo->lazy_parent);
+
+	if (git_repository_config_snapshot(&config, repo) < 0 ||
+		load_config_data(&tmp, config) < 0 ||
+		load_workdir(&tmp, config, &parent) < 0) {
+		git__free(tmp.workdir);
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.path_repository = repo->path_repository;
+		(void)load_workdir(&tmp, NULL, &parent);
+		giterr_clear();
+	}
+
+	git_config_free(config);
+	git_buf_free(&parent);
+
+	repo->is_bare = tmp.is_bare;
+
+	workdir = git__compare_and_swap(&repo->workdir, NULL, tmp.workdir);
+	if (workdir != NULL)
+		git__free(tmp.workdir);
+
+	repo->lazy_config = false;
+}
+
 /*
  * This function returns furthest offset into path where a ceiling dir
  * is found, so we can stop processing the path at that point.
@@ -434,6 +481,27 @@ int git_repository_open_bare(
 	return 0;
 }
 
+static int find_gitdir(git_buf *repo_path, const char *gitdir)
+{
+	int error;
+
+	/* only relative paths need the current directory */
+	if (git_path_root(gitdir) < 0)
+		error = git_path_prettify_dir(repo_path, gitdir, NULL);
+	else if (!(error = git_buf_sets(repo_path, gitdir)))
+		error = git_path_to_dir(repo_path);
+
+	if (error < 0)
+		return error;
+
+	if (!valid_repository_path(repo_path)) {
+		giterr_set(GITERR_REPOSITORY, "Path is not a repository: %s", gitdir);
+		return GIT_ENOTFOUND;
+	}
+
+	return 0;
+}
+
 int git_repository_open_ext(
 	git_repository **repo_ptr,
 	const char *start_path,
@@ -443,13 +511,21 @@ int git_repository_open_ext(
 	int error;
 	git_buf path = GIT_BUF_INIT, parent = GIT_BUF_INIT;
 	git_repository *repo;
+	double start = git__timer();
 
 	if (repo_ptr)
 		*repo_ptr = NULL;
 
-	error = find_repo(&path, &parent, start_path, flags, ceiling_dirs);
-	if (error < 0 || !repo_ptr)
+	if ((flags & GIT_REPOSITORY_OPEN_GITDIR) != 0)
+		error = find_gitdir(&path, start_path);
+	else
+		error = find_repo(&path, &parent, start_path, flags, ceiling_dirs);
+
+	if (error < 0 || !repo_ptr) {
+		git_buf_free(&path);
+		git_buf_free(&parent);
 		return error;
+	}
 
 	repo = repository_alloc();
 	GITERR_CHECK_ALLOC(repo);
@@ -457,8 +533,16 @@ int git_repository_open_ext(
 	repo->path_repository = git_buf_detach(&path);
 	GITERR_CHECK_ALLOC(repo->path_repository);
 
+	repo->perf.open_time = git__timer() - start;
+
 	if ((flags & GIT_REPOSITORY_OPEN_BARE) != 0)
 		repo->is_bare = 1;
+	else if ((flags & GIT_REPOSITORY_OPEN_LAZY) != 0) {
+		repo->lazy_config = true;
+
+		if (git_buf_len(&parent) > 0)
+			repo->lazy_parent = git_buf_detach(&parent);
+	}
 	else {
 		git_config *config = NULL;
 
@@ -583,6 +667,7 @@ int git_repository_config__weakptr(git_config **out, git_repository *repo)
 		git_buf xdg_buf = GIT_BUF_INIT;
 		git_buf system_buf = GIT_BUF_INIT;
 		git_config *config;
+		double start = git__timer();
 
 		git_config_find_global(&global_buf);
 		git_config_find_xdg(&xdg_buf);
@@ -605,6 +690,9 @@ int git_repository_config__weakptr(git_config **out, git_repository *repo)
 				GIT_REFCOUNT_OWN(config, NULL);
 				git_config_free(config);
 			}
+
+			repo->perf.config_loads++;
+			repo->perf.config_time += git__timer() - start;
 		}
 
 		git_buf_free(&global_buf);
@@ -651,6 +739,7 @@ int git_repository_odb__weakptr(git_odb **out, git_repository *repo)
 	if (repo->_odb == NULL) {
 		git_buf odb_path = GIT_BUF_INIT;
 		git_odb *odb;
+		double start = git__timer();
 
 		git_buf_joinpath(&odb_path, repo->path_repository, GIT_OBJECTS_DIR);
 
@@ -663,6 +752,9 @@ int git_repository_odb__weakptr(git_odb **out, git_repository *repo)
 				GIT_REFCOUNT_OWN(odb, NULL);
 				git_odb_free(odb);
 			}
+
+			repo->perf.odb_loads++;
+			repo->perf.odb_time += git__timer() - start;
 		}
 
 		git_buf_free(&odb_path);
@@ -695,6 +787,7 @@ int git_repository_refdb__weakptr(git_refdb **out, git_repository *repo)
 
 	if (repo->_refdb == NULL) {
 		git_refdb *refdb;
+		double start = git__timer();
 
 		error = git_refdb_open(&refdb, repo);
 		if (!error) {
@@ -705,6 +798,9 @@ int git_repository_refdb__weakptr(git_refdb **out, git_repository *repo)
 				GIT_REFCOUNT_OWN(refdb, NULL);
 				git_refdb_free(refdb);
 			}
+
+			repo->perf.refdb_loads++;
+			repo->perf.refdb_time += git__timer() - start;
 		}
 	}
 
@@ -736,6 +832,7 @@ int git_repository_index__weakptr(git_index **out, git_repository *repo)
 	if (repo->_index == NULL) {
 		git_buf index_path = GIT_BUF_INIT;
 		git_index *index;
+		double start = git__timer();
 
 		git_buf_joinpath(&index_path, repo->path_repository, GIT_INDEX_FILE);
 
@@ -750,6 +847,9 @@ int git_repository_index__weakptr(git_index **out, git_repository *repo)
 			}
 
 			error = git_index_set_caps(repo->_index, GIT_INDEXCAP_FROM_OWNER);
+
+			repo->perf.index_loads++;
+			repo->perf.index_time += git__timer() - start;
 		}
 
 		git_buf_free(&index_path);
@@ -791,20 +891,38 @@ const char *git_repository_get_namespace(git_repository *repo)
 	return repo->namespace;
 }
 
-static int check_repositoryformatversion(git_config *config)
+static int check_repository_extension(const git_config_entry *entry, void *payload)
+{
+	GIT_UNUSED(payload);
+
+	if (!strcasecmp(entry->name, GIT_REPO_EXTENSION_REFSTORAGE))
+		return 0;
+
+	giterr_set(GITERR_REPOSITORY,
+		"Unsupported repository extension '%s'", entry->name);
+	return -1;
+}
+
+static int check_repositoryformatversion(int *out, git_config *config)
 {
 	int version;
 
 	if (git_config_get_int32(&version, config, "core.repositoryformatversion") < 0)
 		return -1;
 
-	if (GIT_REPO_VERSION < version) {
+	if (GIT_REPO_EXTENSIONS_VERSION < version) {
 		giterr_set(GITERR_REPOSITORY,
 			"Unsupported repository version %d. Only versions up to %d are supported.",
-			version, GIT_REPO_VERSION);
+			version, GIT_REPO_EXTENSIONS_VERSION);
 		return -1;
 	}
 
+	if (version >= GIT_REPO_EXTENSIONS_VERSION &&
+		git_config_foreach_match(
+			config, "^extensions\\.", check_repository_extension, NULL) < 0)
+		return -1;
+
+	*out = version;
 	return 0;
 }
 
@@ -998,11 +1116,12 @@ static int repo_init_config(
 	git_config *config = NULL;
 	bool is_bare = ((flags & GIT_REPOSITORY_INIT_BARE) != 0);
 	bool is_reinit = ((flags & GIT_REPOSITORY_INIT__IS_REINIT) != 0);
+	int version = GIT_REPO_VERSION;
 
 	if ((error = repo_local_config(&config, &cfg_path, NULL, repo_dir)) < 0)
 		goto cleanup;
 
-	if (is_reinit && (error = check_repositoryformatversion(config)) < 0)
+	if (is_reinit && (error = check_repositoryformatversion(&version, config)) < 0)
 		goto cleanup;
 
 #define SET_REPO_CONFIG(TYPE, NAME, VAL) do { \
@@ -1010,7 +1129,7 @@ static int repo_init_config(
 		goto cleanup; } while (0)
 
 	SET_REPO_CONFIG(bool, "core.bare", is_bare);
-	SET_REPO_CONFIG(int32, "core.repositoryformatversion", GIT_REPO_VERSION);
+	SET_REPO_CONFIG(int32, "core.repositoryformatversion", version);
 
 	if ((error = repo_init_fs_configs(
 			config, cfg_path.ptr, repo_dir, work_dir, !is_reinit)) < 0)
@@ -1072,7 +1191,7 @@ int git_repository_reinit_filesystem(git_repository *repo, int recurse)
 
 	git_repository__cvar_cache_clear(repo);
 
-	if (!repo->is_bare && recurse)
+	if (!git_repository_is_bare(repo) && recurse)
 		(void)git_submodule_foreach(repo, repo_reinit_submodule_fs, NULL);
 
 	return error;
@@ -1609,6 +1728,9 @@ const char *git_repository_workdir(git_repository *repo)
 {
 	assert(repo);
 
+	if (repo->lazy_config)
+		load_lazy_config(repo);
+
 	if (repo->is_bare)
 		return NULL;
 
@@ -1652,6 +1774,7 @@ int git_repository_set_workdir(
 
 		repo->workdir = git_buf_detach(&path);
 		repo->is_bare = 0;
+		repo->lazy_config = false;
 
 		git__free(old_workdir);
 	}
@@ -1662,9 +1785,23 @@ int git_repository_set_workdir(
 int git_repository_is_bare(git_repository *repo)
 {
 	assert(repo);
+
+	if (repo->lazy_config)
+		load_lazy_config(repo);
+
 	return repo->is_bare;
 }
 
+int git_repository_get_perfdata(
+	git_repository_perfdata *out, const git_repository *repo)
+{
+	assert(out && repo);
+	GITERR_CHECK_VERSION(
+		out, GIT_REPOSITORY_PERFDATA_VERSION, "git_repository_perfdata");
+	memcpy(out, &repo->perf, sizeof(*out));
+	return 0;
+}
+
 int git_repository_head_tree(git_tree **tree, git_repository *repo)
 {
 	git_reference *head;
@@ -13,6 +13,7 @@
 #include "git2/repository.h"
 #include "git2/object.h"
 #include "git2/config.h"
+#include "git2/sys/repository.h"
 
 #include "cache.h"
 #include "refs.h"
@@ -21,12 +22,21 @@
 #include "attrcache.h"
 #include "submodule.h"
 #include "diff_driver.h"
+#include "filter_process.h"
 
 #define DOT_GIT ".git"
 #define GIT_DIR DOT_GIT "/"
 #define GIT_DIR_MODE 0755
 #define GIT_BARE_DIR_MODE 0777
 
+/*
+ * Repositories that need libgit2 to be read, like those keeping their
+ * refs in reftables, use this format version with an extension that
+ * git does not know, so that git refuses them.
+ */
+#define GIT_REPO_EXTENSIONS_VERSION 1
+#define GIT_REPO_EXTENSION_REFSTORAGE "extensions.libgit2refstorage"
+
 /** Cvar cache identifiers */
 typedef enum {
 	GIT_CVAR_AUTO_CRLF = 0, /* core.autocrlf */
@@ -40,6 +50,10 @@ typedef enum {
 	GIT_CVAR_PRECOMPOSE,    /* core.precomposeunicode */
 	GIT_CVAR_SAFE_CRLF,		/* core.safecrlf */
 	GIT_CVAR_LOGALLREFUPDATES, /* core.logallrefupdates */
+	GIT_CVAR_INDEXVERSION,  /* index.version */
+	GIT_CVAR_SPLITINDEX,    /* core.splitindex */
+	GIT_CVAR_SPLITINDEXMAXCHANGE, /* splitindex.maxpercentchange */
+	GIT_CVAR_SPARSECHECKOUT, /* core.sparsecheckout */
 	GIT_CVAR_CACHE_MAX
 } git_cvar_cached;
 
@@ -96,6 +110,15 @@ typedef enum {
 	/* core.logallrefupdates */
 	GIT_LOGALLREFUPDATES_UNSET = 2,
 	GIT_LOGALLREFUPDATES_DEFAULT = GIT_LOGALLREFUPDATES_UNSET,
+	/* index.version */
+	GIT_INDEXVERSION_DEFAULT = 0,
+	/* core.splitindex */
+	GIT_SPLITINDEX_UNSET = 2,
+	GIT_SPLITINDEX_DEFAULT = GIT_SPLITINDEX_UNSET,
+	/* splitindex.maxpercentchange */
+	GIT_SPLITINDEXMAXCHANGE_DEFAULT = 20,
+	/* core.sparsecheckout */
+	GIT_SPARSECHECKOUT_DEFAULT = GIT_CVAR_FALSE,
 } git_cvar_value;
 
 /* internal repository init flags */
@@ -115,15 +138,23 @@ struct git_repository {
 
 	git_cache objects;
 	git_attr_cache *attrcache;
+	git_atomic attr_session_key;
 	git_diff_driver_registry *diff_drivers;
+	git_filter_process_registry *filter_processes;
 
 	char *path_repository;
 	char *workdir;
 	char *namespace;
 
+	/* opened lazily: core.bare and core.worktree have not been read yet */
+	bool lazy_config;
+	char *lazy_parent;
+
 	unsigned is_bare:1;
 	unsigned int lru_counter;
 
+	git_repository_perfdata perf;
+
 	git_cvar_value cvar_cache[GIT_CVAR_CACHE_MAX];
 };
 
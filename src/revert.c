@@ -9,6 +9,7 @@
 #include "repository.h"
 #include "filebuf.h"
 #include "merge.h"
+#include "checkout.h"
 
 #include "git2/types.h"
 #include "git2/merge.h"
@@ -71,17 +72,19 @@ static int revert_normalize_opts(
 	const git_revert_options *given,
 	const char *their_label)
 {
+	git_revert_options default_opts = GIT_REVERT_OPTIONS_INIT;
 	int error = 0;
 	unsigned int default_checkout_strategy = GIT_CHECKOUT_SAFE_CREATE |
 		GIT_CHECKOUT_ALLOW_CONFLICTS;
 
 	GIT_UNUSED(repo);
 
-	if (given != NULL)
-		memcpy(opts, given, sizeof(git_revert_options));
-	else {
-		git_revert_options default_opts = GIT_REVERT_OPTIONS_INIT;
-		memcpy(opts, &default_opts, sizeof(git_revert_options));
+	memcpy(opts, &default_opts, sizeof(git_revert_options));
+
+	if (given != NULL) {
+		git_checkout__options_read(opts, given, sizeof(git_revert_options),
+			offsetof(git_revert_options, checkout_opts), given->version);
+		opts->version = GIT_REVERT_OPTIONS_VERSION;
 	}
 
 	if (!opts->checkout_opts.checkout_strategy)
@@ -220,7 +223,12 @@ done:
 
 int git_revert_init_options(git_revert_options *opts, unsigned int version)
 {
-	GIT_INIT_STRUCTURE_FROM_TEMPLATE(
-		opts, version, git_revert_options, GIT_REVERT_OPTIONS_INIT);
+	git_revert_options tmpl = GIT_REVERT_OPTIONS_INIT;
+
+	GITERR_CHECK_VERSION(&version, tmpl.version, "git_revert_options");
+
+	git_checkout__options_write(opts, &tmpl, sizeof(tmpl),
+		offsetof(git_revert_options, checkout_opts), version);
+	opts->version = version;
 	return 0;
 }
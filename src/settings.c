@@ -35,6 +35,7 @@ int git_libgit2_features()
 /* Declarations for tuneable settings */
 extern size_t git_mwindow__window_size;
 extern size_t git_mwindow__mapped_limit;
+extern unsigned int git_index__threads;
 
 static int config_level_to_sysdir(int config_level)
 {
@@ -131,6 +132,14 @@ int git_libgit2_opts(int key, ...)
 	case GIT_OPT_SET_TEMPLATE_PATH:
 		error = git_sysdir_set(GIT_SYSDIR_TEMPLATE, va_arg(ap, const char *));
 		break;
+
+	case GIT_OPT_GET_INDEX_THREADS:
+		*(va_arg(ap, unsigned int *)) = git_index__threads;
+		break;
+
+	case GIT_OPT_SET_INDEX_THREADS:
+		git_index__threads = va_arg(ap, unsigned int);
+		break;
 	}
 
 	va_end(ap);
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "sparse.h"
+#include "repository.h"
+#include "fileops.h"
+
+GIT__USE_IDXMAP
+
+enum {
+	SPARSE_DIR_NONE = 0,
+	SPARSE_DIR_PARENT = 1,
+	SPARSE_DIR_RECURSIVE = 2,
+};
+
+/*
+ * A cone always starts with the patterns that select the files at the
+ * root, then lists a pattern for every directory in it, each optionally
+ * followed by a negated one that leaves out its subdirectories.
+ */
+#define SPARSE_ROOT_FILES "/*"
+#define SPARSE_NO_ROOT_DIRS "!/*/"
+#define SPARSE_NO_SUBDIRS "/*/"
+
+static int sparse_dir_type(
+	const git_sparse *sparse, const char *path, size_t path_len)
+{
+	git_idxmap_key key;
+	khiter_t pos;
+
+	key.path = path;
+	key.path_len = path_len;
+	key.stage = 0;
+
+	pos = kh_get(idx, sparse->dirs, key);
+
+	return (pos == kh_end(sparse->dirs)) ?
+		SPARSE_DIR_NONE : (int)(intptr_t)kh_val(sparse->dirs, pos);
+}
+
+static int sparse_set_dir(
+	git_sparse *sparse, const char *path, size_t path_len, int type)
+{
+	git_idxmap_key key;
+	khiter_t pos;
+	int rval;
+
+	key.path = path;
+	key.path_len = path_len;
+	key.stage = 0;
+
+	pos = kh_get(idx, sparse->dirs, key);
+
+	if (pos == kh_end(sparse->dirs)) {
+		if ((key.path = git_pool_strndup(&sparse->names, path, path_len)) == NULL)
+			return -1;
+
+		pos = kh_put(idx, sparse->dirs, key, &rval);
+		if (rval < 0) {
+			giterr_set_oom();
+			return -1;
+		}
+	}
+
+	kh_val(sparse->dirs, pos) = (void *)(intptr_t)type;
+	return 0;
+}
+
+/* unescape `pattern` and strip the slashes around it */
+static int sparse_pattern_dir(git_buf *out, const char *pattern, size_t len)
+{
+	size_t i;
+
+	git_buf_clear(out);
+
+	if (len < 3 || pattern[0] != '/' || pattern[len - 1] != '/')
+		return GIT_ENOTFOUND;
+
+	for (i = 1; i < len - 1; ++i) {
+		if (pattern[i] == '\\' && i + 1 < len - 1)
+			i++;
+		else if (pattern[i] == '*' || pattern[i] == '?' || pattern[i] == '[')
+			return GIT_ENOTFOUND;
+
+		git_buf_putc(out, pattern[i]);
+	}
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+int git_sparse__parse(git_sparse *sparse, const char *patterns)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const char *scan = patterns, *line, *end;
+	bool root_files = false, no_root_dirs = false;
+	int error = 0;
+	size_t len, i;
+
+	while (!error && *scan) {
+		line = scan;
+		end = strchr(line, '\n');
+		scan = end ? end + 1 : line + strlen(line);
+		if (!end)
+			end = scan;
+
+		while (line < end && git__isspace(*line))
+			line++;
+		while (end > line && git__isspace(end[-1]))
+			end--;
+
+		len = (size_t)(end - line);
+
+		if (!len || *line == '#')
+			continue;
+
+		if (len == strlen(SPARSE_ROOT_FILES) &&
+			!memcmp(line, SPARSE_ROOT_FILES, len))
+			root_files = true;
+		else if (len == strlen(SPARSE_NO_ROOT_DIRS) &&
+			!memcmp(line, SPARSE_NO_ROOT_DIRS, len))
+			no_root_dirs = true;
+
+		/* "!/dir/" "*" "/" - only the files directly inside of dir */
+		else if (*line == '!') {
+			size_t suffix = strlen(SPARSE_NO_SUBDIRS);
+
+			if (len <= suffix + 1 ||
+				memcmp(end - suffix, SPARSE_NO_SUBDIRS, suffix) != 0 ||
+				(error = sparse_pattern_dir(
+					&dir, line + 1, len - suffix)) < 0)
+				break;
+
+			if (sparse_dir_type(sparse, dir.ptr, dir.size) == SPARSE_DIR_NONE) {
+				error = GIT_ENOTFOUND;
+				break;
+			}
+
+			error = sparse_set_dir(
+				sparse, dir.ptr, dir.size, SPARSE_DIR_PARENT);
+		}
+
+		/* "/dir/" - everything below dir, until it is negated */
+		else if ((error = sparse_pattern_dir(&dir, line, len)) == 0)
+			error = sparse_set_dir(
+				sparse, dir.ptr, dir.size, SPARSE_DIR_RECURSIVE);
+
+		/* the directories above it hold files of the cone too */
+		for (i = dir.size; !error && i > 0; --i) {
+			if (dir.ptr[i - 1] == '/' &&
+				sparse_dir_type(sparse, dir.ptr, i - 1) == SPARSE_DIR_NONE)
+				error = sparse_set_dir(
+					sparse, dir.ptr, i - 1, SPARSE_DIR_PARENT);
+		}
+	}
+
+	if (!error && (!root_files || !no_root_dirs))
+		error = GIT_ENOTFOUND;
+
+	if (error == GIT_ENOTFOUND)
+		giterr_set(GITERR_INVALID,
+			"Sparse checkout patterns do not describe a cone");
+
+	git_buf_free(&dir);
+	return error;
+}
+
+bool git_sparse__includes(const git_sparse *sparse, const char *path)
+{
+	const char *end;
+
+	/* look for the first directory that is not a parent of the cone */
+	for (end = strchr(path, '/'); end != NULL; end = strchr(end + 1, '/')) {
+		int type = sparse_dir_type(sparse, path, (size_t)(end - path));
+
+		if (type != SPARSE_DIR_PARENT)
+			return (type == SPARSE_DIR_RECURSIVE);
+	}
+
+	return true;
+}
+
+int git_sparse__new(git_sparse **out)
+{
+	git_sparse *sparse = git__calloc(1, sizeof(git_sparse));
+	GITERR_CHECK_ALLOC(sparse);
+
+	if ((sparse->dirs = kh_init(idx)) == NULL ||
+		git_pool_init(&sparse->names, 1, 0) < 0) {
+		git_sparse__free(sparse);
+		giterr_set_oom();
+		return -1;
+	}
+
+	*out = sparse;
+	return 0;
+}
+
+int git_sparse__load(git_sparse **out, git_repository *repo)
+{
+	git_sparse *sparse = NULL;
+	git_buf path = GIT_BUF_INIT, patterns = GIT_BUF_INIT;
+	int enabled, error;
+
+	*out = NULL;
+
+	if ((error = git_repository__cvar(
+			&enabled, repo, GIT_CVAR_SPARSECHECKOUT)) < 0 || !enabled)
+		return error;
+
+	if ((error = git_buf_joinpath(&path,
+			repo->path_repository, GIT_SPARSE_CHECKOUT_FILE)) < 0)
+		return error;
+
+	/* without patterns (or with ones we cannot match quickly), check
+	 * out everything, as if sparse checkout was not enabled */
+	if ((error = git_futils_readbuffer(&patterns, path.ptr)) < 0 ||
+		(error = git_sparse__new(&sparse)) < 0 ||
+		(error = git_sparse__parse(sparse, patterns.ptr)) < 0) {
+		git_sparse__free(sparse);
+		sparse = NULL;
+
+		if (error == GIT_ENOTFOUND) {
+			giterr_clear();
+			error = 0;
+		}
+	}
+
+	*out = sparse;
+
+	git_buf_free(&path);
+	git_buf_free(&patterns);
+	return error;
+}
+
+void git_sparse__free(git_sparse *sparse)
+{
+	if (!sparse)
+		return;
+
+	if (sparse->dirs)
+		kh_destroy(idx, sparse->dirs);
+	git_pool_clear(&sparse->names);
+	git__free(sparse);
+}
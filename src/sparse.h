@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_sparse_h__
+#define INCLUDE_sparse_h__
+
+#include "common.h"
+#include "idxmap.h"
+#include "pool.h"
+#include "git2/repository.h"
+
+#define GIT_SPARSE_CHECKOUT_FILE "info/sparse-checkout"
+
+/*
+ * The directories of a cone mode sparse checkout.  A file is in the
+ * checkout if it is at the root of the repository, directly inside a
+ * "parent" directory or anywhere below a "recursive" one.  Every parent
+ * of a recursive directory is a parent directory itself, so a path can be
+ * matched one directory at a time.
+ */
+typedef struct {
+	git_idxmap *dirs;
+	git_pool names;
+} git_sparse;
+
+/*
+ * Load the sparse checkout of `repo`.  `out` is set to NULL when sparse
+ * checkout is not enabled, or when its patterns are not in cone mode.
+ */
+extern int git_sparse__load(git_sparse **out, git_repository *repo);
+
+/* Parse the patterns of a sparse-checkout file into `sparse`; returns
+ * GIT_ENOTFOUND if they do not describe a cone.
+ */
+extern int git_sparse__parse(git_sparse *sparse, const char *patterns);
+
+extern bool git_sparse__includes(const git_sparse *sparse, const char *path);
+
+extern int git_sparse__new(git_sparse **out);
+extern void git_sparse__free(git_sparse *sparse);
+
+#endif
@@ -19,6 +19,8 @@
 
 #include "git2/diff.h"
 #include "diff.h"
+#include "filter.h"
+#include "odb.h"
 
 static unsigned int index_delta2status(const git_diff_delta *head2idx)
 {
@@ -469,7 +471,7 @@ static int get_one_status(const char *path, unsigned int status, void *data)
 	return 0;
 }
 
-int git_status_file(
+static int status_file_with_diff(
 	unsigned int *status_flags,
 	git_repository *repo,
 	const char *path)
@@ -555,3 +557,416 @@ int git_status_list_get_perfdata(
 	return 0;
 }
 
+typedef struct {
+	git_repository *repo;
+	git_index *index;
+	git_tree *head;
+	git_buf full_path;
+	bool has_symlinks;
+	bool trust_mode;
+	bool trust_ctime;
+	bool trust_nanosecs;
+} status_file_context;
+
+static int status_file_context_init(
+	status_file_context *ctxt, git_repository *repo)
+{
+	int error, val;
+
+	memset(ctxt, 0, sizeof(*ctxt));
+	ctxt->repo = repo;
+
+	if ((error = git_repository__ensure_not_bare(repo, "status")) < 0 ||
+		(error = git_repository_index__weakptr(&ctxt->index, repo)) < 0)
+		return error;
+
+	if ((error = git_repository_head_tree(&ctxt->head, repo)) < 0) {
+		if (error != GIT_ENOTFOUND && error != GIT_EUNBORNBRANCH)
+			return error;
+		giterr_clear();
+	}
+
+	/* refresh index from disk, just like a full status run does */
+	if (git_index_read(ctxt->index, false) < 0)
+		giterr_clear();
+
+	if ((error = git_repository__cvar(&val, repo, GIT_CVAR_SYMLINKS)) < 0)
+		return error;
+	ctxt->has_symlinks = (val != 0);
+
+	if ((error = git_repository__cvar(&val, repo, GIT_CVAR_FILEMODE)) < 0)
+		return error;
+	ctxt->trust_mode = (val != 0);
+
+	if ((error = git_repository__cvar(&val, repo, GIT_CVAR_TRUSTCTIME)) < 0)
+		return error;
+	ctxt->trust_ctime = (val != 0);
+
+	/* the same as the diff, which this has to agree with */
+	ctxt->trust_nanosecs =
+		((GIT_DIFFCAPS__PLATFORM & GIT_DIFFCAPS_TRUST_NANOSECS) != 0);
+
+	return 0;
+}
+
+static void status_file_context_free(status_file_context *ctxt)
+{
+	git_tree_free(ctxt->head);
+	git_buf_free(&ctxt->full_path);
+}
+
+static bool status_file_index_has_dir(git_index *index, const char *path)
+{
+	git_buf dir = GIT_BUF_INIT;
+	const git_index_entry *entry;
+	size_t pos;
+	bool found = false;
+
+	if (git_buf_joinpath(&dir, path, "") < 0) {
+		giterr_clear();
+		return true;
+	}
+
+	git_index__find_pos(&pos, index, dir.ptr, dir.size, 0);
+
+	if ((entry = git_index_get_byindex(index, pos)) != NULL)
+		found = ((index->ignore_case ?
+			git__prefixcmp_icase(entry->path, dir.ptr) :
+			git__prefixcmp(entry->path, dir.ptr)) == 0);
+
+	git_buf_free(&dir);
+	return found;
+}
+
+static int status_file_hash(
+	git_oid *out, status_file_context *ctxt, const git_index_entry *wd)
+{
+	git_filter_list *fl = NULL;
+	int fd, error;
+
+	if (S_ISLNK(wd->mode))
+		return git_odb__hashlink(out, ctxt->full_path.ptr);
+
+	if (!git__is_sizet(wd->file_size)) {
+		giterr_set(GITERR_OS, "File size overflow (for 32-bits) on '%s'",
+			wd->path);
+		return -1;
+	}
+
+	if ((error = git_filter_list_load(&fl, ctxt->repo, NULL, wd->path,
+			GIT_FILTER_TO_ODB, GIT_FILTER_OPT_ALLOW_UNSAFE)) < 0)
+		return error;
+
+	if ((fd = git_futils_open_ro(ctxt->full_path.ptr)) < 0)
+		error = fd;
+	else {
+		error = git_odb__hashfd_filtered(
+			out, fd, (size_t)wd->file_size, GIT_OBJ_BLOB, fl);
+		p_close(fd);
+	}
+
+	git_filter_list_free(fl);
+	return error;
+}
+
+/* Work out the index to workdir status the same way the diff does for a
+ * file that is in both, only hashing the file when the stat data differs.
+ */
+static int status_file_workdir_modified(
+	unsigned int *status,
+	status_file_context *ctxt,
+	const git_index_entry *idx,
+	git_index_entry *wd)
+{
+	git_oid oid;
+	bool uncertain = false, modified = false;
+
+	/* preserve the mode of what we cannot represent in the workdir */
+	if (S_ISLNK(idx->mode) && S_ISREG(wd->mode) && !ctxt->has_symlinks)
+		wd->mode = idx->mode;
+
+	if (!ctxt->trust_mode)
+		wd->mode = (wd->mode & ~0777) | (idx->mode & 0777);
+
+	if (GIT_MODE_TYPE(idx->mode) != GIT_MODE_TYPE(wd->mode)) {
+		*status |= GIT_STATUS_WT_TYPECHANGE;
+		return 0;
+	}
+
+	if (idx->mode != wd->mode || idx->file_size != wd->file_size) {
+		modified = true;
+		uncertain = (idx->file_size <= 0 && wd->file_size > 0);
+	}
+	else if (!git_diff__time_eq(
+			&idx->mtime, &wd->mtime, ctxt->trust_nanosecs) ||
+		(ctxt->trust_ctime && !git_diff__time_eq(
+			&idx->ctime, &wd->ctime, ctxt->trust_nanosecs)) ||
+		idx->ino != wd->ino ||
+		idx->uid != wd->uid ||
+		idx->gid != wd->gid)
+		modified = uncertain = true;
+
+	if (uncertain) {
+		int error = status_file_hash(&oid, ctxt, wd);
+
+		if (error < 0)
+			return error;
+
+		if (idx->mode == wd->mode && git_oid_equal(&idx->id, &oid))
+			modified = false;
+	}
+
+	if (modified)
+		*status |= GIT_STATUS_WT_MODIFIED;
+
+	return 0;
+}
+
+/* Like `git_tree_entry_bypath`, but ignoring case; GIT_PASSTHROUGH when
+ * more than one entry matches.
+ */
+static int status_tree_entry_bypath_icase(
+	git_tree_entry **out, git_tree *root, const char *path)
+{
+	git_tree *tree = root, *subtree = NULL;
+	const git_tree_entry *entry, *found;
+	const char *name = path, *slash;
+	size_t i, len;
+	int error = 0;
+
+	*out = NULL;
+
+	for (;;) {
+		slash = strchr(name, '/');
+		len = slash ? (size_t)(slash - name) : strlen(name);
+		found = NULL;
+
+		for (i = 0; i < git_tree_entrycount(tree); ++i) {
+			entry = git_tree_entry_byindex(tree, i);
+
+			if (git__strncasecmp(entry->filename, name, len) != 0 ||
+				entry->filename[len] != '\0')
+				continue;
+
+			if (found) {
+				error = GIT_PASSTHROUGH;
+				goto done;
+			}
+			found = entry;
+		}
+
+		if (found && !slash) {
+			error = git_tree_entry_dup(out, found);
+			goto done;
+		}
+
+		if (!found || git_tree_entry_type(found) != GIT_OBJ_TREE) {
+			giterr_set(GITERR_TREE,
+				"The path '%s' does not exist in the given tree", path);
+			error = GIT_ENOTFOUND;
+			goto done;
+		}
+
+		git_tree_free(subtree);
+		subtree = NULL;
+
+		if ((error = git_tree_lookup(&subtree,
+				git_tree_owner(root), git_tree_entry_id(found))) < 0)
+			goto done;
+
+		tree = subtree;
+		name = slash + 1;
+	}
+
+done:
+	git_tree_free(subtree);
+	return error;
+}
+
+/* Compute the status of a single file from the HEAD tree, the index and
+ * one lstat of the workdir, without iterating over the whole directory
+ * it is in.  Returns GIT_PASSTHROUGH for anything that needs the full
+ * diff machinery to be answered correctly (directories, submodules,
+ * conflicts, pathspec patterns and the like).
+ */
+static int status_file_direct(
+	unsigned int *status_flags,
+	status_file_context *ctxt,
+	const char *path)
+{
+	git_tree_entry *head = NULL;
+	const git_index_entry *idx;
+	const char *basename;
+	git_index_entry wd;
+	struct stat st;
+	bool in_wd = false;
+	unsigned int status = GIT_STATUS_CURRENT;
+	int stage, error = 0;
+
+	if (!*path || path[strlen(path) - 1] == '/' ||
+		strpbrk(path, "*?[\\") != NULL)
+		return GIT_PASSTHROUGH;
+
+	/* entries that only match in another case are left to the full
+	 * status, which knows how to pair them up with the workdir */
+	basename = strrchr(path, '/');
+	basename = basename ? basename + 1 : path;
+
+	if (ctxt->head && (error = ctxt->index->ignore_case ?
+			status_tree_entry_bypath_icase(&head, ctxt->head, path) :
+			git_tree_entry_bypath(&head, ctxt->head, path)) < 0) {
+		if (error != GIT_ENOTFOUND)
+			return error;
+		giterr_clear();
+		error = 0;
+	}
+
+	if (head && (head->attr == GIT_FILEMODE_TREE ||
+			head->attr == GIT_FILEMODE_COMMIT ||
+			strcmp(head->filename, basename) != 0)) {
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	for (stage = 1; stage <= 3; ++stage) {
+		if (git_index_get_bypath(ctxt->index, path, stage) != NULL) {
+			error = GIT_PASSTHROUGH;
+			goto done;
+		}
+	}
+
+	idx = git_index_get_bypath(ctxt->index, path, 0);
+
+	/* the lookups above set an error for each stage they do not find */
+	giterr_clear();
+
+	if ((idx && (S_ISGITLINK(idx->mode) ||
+			strcmp(idx->path, path) != 0 ||
+			(idx->flags & GIT_IDXENTRY_VALID) != 0 ||
+			(idx->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0)) ||
+		(!idx && status_file_index_has_dir(ctxt->index, path))) {
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	if ((error = git_buf_joinpath(&ctxt->full_path,
+			git_repository_workdir(ctxt->repo), path)) < 0)
+		goto done;
+
+	if (p_lstat(ctxt->full_path.ptr, &st) == 0) {
+		memset(&wd, 0, sizeof(wd));
+		git_index_entry__init_from_stat(&wd, &st, true);
+		wd.path = path;
+		wd.mode = git_futils_canonical_mode(st.st_mode);
+
+		if (!S_ISREG(wd.mode) && !S_ISLNK(wd.mode)) {
+			error = GIT_PASSTHROUGH;
+			goto done;
+		}
+
+		in_wd = true;
+	} else if ((errno != ENOENT && errno != ENOTDIR) ||
+		ctxt->index->ignore_case) {
+		/* the file may be there under another case, which the full
+		 * status finds when the filesystem is case sensitive */
+		error = GIT_PASSTHROUGH;
+		goto done;
+	}
+
+	if (!head && !idx && !in_wd) {
+		giterr_set(GITERR_INVALID,
+			"Attempt to get status of nonexistent file '%s'", path);
+		error = GIT_ENOTFOUND;
+		goto done;
+	}
+
+	/* HEAD to index */
+	if (head && !idx)
+		status |= GIT_STATUS_INDEX_DELETED;
+	else if (!head && idx)
+		status |= GIT_STATUS_INDEX_NEW;
+	else if (head && idx) {
+		if (GIT_MODE_TYPE(head->attr) != GIT_MODE_TYPE(idx->mode))
+			status |= GIT_STATUS_INDEX_TYPECHANGE;
+		else if (head->attr != idx->mode ||
+			!git_oid_equal(&head->oid, &idx->id))
+			status |= GIT_STATUS_INDEX_MODIFIED;
+	}
+
+	/* index to workdir */
+	if (idx && !in_wd)
+		status |= GIT_STATUS_WT_DELETED;
+	else if (!idx && in_wd) {
+		int ignored;
+
+		if ((error = git_ignore_path_is_ignored(
+				&ignored, ctxt->repo, path)) < 0)
+			goto done;
+
+		status |= ignored ? GIT_STATUS_IGNORED : GIT_STATUS_WT_NEW;
+	}
+	else if (idx && in_wd) {
+		/* let the full status report files that cannot be read */
+		if ((error = status_file_workdir_modified(
+				&status, ctxt, idx, &wd)) < 0) {
+			giterr_clear();
+			error = GIT_PASSTHROUGH;
+			goto done;
+		}
+	}
+
+	*status_flags = status;
+
+done:
+	git_tree_entry_free(head);
+	return error;
+}
+
+int git_status_file(
+	unsigned int *status_flags,
+	git_repository *repo,
+	const char *path)
+{
+	status_file_context ctxt;
+	int error;
+
+	assert(status_flags && repo && path);
+
+	*status_flags = 0;
+
+	if ((error = status_file_context_init(&ctxt, repo)) == 0 &&
+		(error = status_file_direct(status_flags, &ctxt, path)) ==
+			GIT_PASSTHROUGH)
+		error = status_file_with_diff(status_flags, repo, path);
+
+	status_file_context_free(&ctxt);
+	return error;
+}
+
+int git_status_files(
+	unsigned int *status_flags,
+	git_repository *repo,
+	const char **paths,
+	size_t count)
+{
+	status_file_context ctxt;
+	size_t i;
+	int error;
+
+	assert(status_flags && repo && (paths || !count));
+
+	memset(status_flags, 0, count * sizeof(unsigned int));
+
+	if ((error = status_file_context_init(&ctxt, repo)) < 0)
+		goto done;
+
+	for (i = 0; i < count && !error; ++i) {
+		if ((error = status_file_direct(
+				&status_flags[i], &ctxt, paths[i])) == GIT_PASSTHROUGH)
+			error = status_file_with_diff(&status_flags[i], repo, paths[i]);
+	}
+
+done:
+	status_file_context_free(&ctxt);
+	return error;
+}
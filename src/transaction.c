@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "repository.h"
+#include "refs.h"
+#include "refdb.h"
+#include "vector.h"
+
+#include "git2/transaction.h"
+#include "git2/signature.h"
+#include "git2/sys/refs.h"
+#include "git2/sys/refdb_backend.h"
+
+typedef enum {
+	TRANSACTION_NONE,
+	TRANSACTION_UPDATE,
+	TRANSACTION_REMOVE,
+} transaction_action_t;
+
+typedef struct {
+	char *name;
+
+	git_ref_t old_type;
+	git_oid old_id;
+	char *old_target;
+
+	transaction_action_t action;
+	git_reference *ref;
+	git_signature *who;
+	char *message;
+} transaction_node;
+
+struct git_transaction {
+	git_repository *repo;
+	git_refdb *db;
+	git_vector nodes;
+};
+
+static int node_cmp(const void *a, const void *b)
+{
+	const transaction_node *node_a = a, *node_b = b;
+	return strcmp(node_a->name, node_b->name);
+}
+
+static int node_name_cmp(const void *key, const void *node)
+{
+	return strcmp(key, ((const transaction_node *)node)->name);
+}
+
+static void node_clear_change(transaction_node *node)
+{
+	node->action = TRANSACTION_NONE;
+
+	git_reference_free(node->ref);
+	node->ref = NULL;
+	git_signature_free(node->who);
+	node->who = NULL;
+	git__free(node->message);
+	node->message = NULL;
+}
+
+static void node_free(transaction_node *node)
+{
+	if (!node)
+		return;
+
+	node_clear_change(node);
+	git__free(node->old_target);
+	git__free(node->name);
+	git__free(node);
+}
+
+int git_transaction_new(git_transaction **out, git_repository *repo)
+{
+	git_transaction *tx;
+
+	assert(out && repo);
+
+	tx = git__calloc(1, sizeof(git_transaction));
+	GITERR_CHECK_ALLOC(tx);
+
+	if (git_vector_init(&tx->nodes, 0, node_cmp) < 0 ||
+		git_repository_refdb(&tx->db, repo) < 0) {
+		git_transaction_free(tx);
+		return -1;
+	}
+
+	tx->repo = repo;
+
+	*out = tx;
+	return 0;
+}
+
+int git_transaction_lock_ref(git_transaction *tx, const char *refname)
+{
+	git_refname_t normalized;
+	transaction_node *node;
+	git_reference *ref = NULL;
+	size_t pos;
+	int error;
+
+	assert(tx && refname);
+
+	if ((error = git_reference__normalize_for_repo(
+			normalized, tx->repo, refname)) < 0)
+		return error;
+
+	if (!git_vector_bsearch2(&pos, &tx->nodes, node_name_cmp, normalized)) {
+		giterr_set(GITERR_REFERENCE,
+			"The reference '%s' is already locked", normalized);
+		return GIT_ELOCKED;
+	}
+
+	error = git_refdb_lookup(&ref, tx->db, normalized);
+	if (error < 0 && error != GIT_ENOTFOUND)
+		return error;
+
+	node = git__calloc(1, sizeof(transaction_node));
+	GITERR_CHECK_ALLOC(node);
+
+	node->name = git__strdup(normalized);
+	if (!node->name)
+		goto on_error;
+
+	if (error == GIT_ENOTFOUND) {
+		giterr_clear();
+		node->old_type = GIT_REF_INVALID;
+	} else if (ref->type == GIT_REF_OID) {
+		node->old_type = GIT_REF_OID;
+		git_oid_cpy(&node->old_id, &ref->target.oid);
+	} else {
+		node->old_type = GIT_REF_SYMBOLIC;
+		if ((node->old_target = git__strdup(ref->target.symbolic)) == NULL)
+			goto on_error;
+	}
+
+	if (git_vector_insert_sorted(&tx->nodes, node, NULL) < 0)
+		goto on_error;
+
+	git_reference_free(ref);
+	return 0;
+
+on_error:
+	git_reference_free(ref);
+	node_free(node);
+	return -1;
+}
+
+static int find_locked(
+	transaction_node **out, git_transaction *tx, const char *refname)
+{
+	git_refname_t normalized;
+	size_t pos;
+	int error;
+
+	if ((error = git_reference__normalize_for_repo(
+			normalized, tx->repo, refname)) < 0)
+		return error;
+
+	if (git_vector_bsearch2(&pos, &tx->nodes, node_name_cmp, normalized) < 0) {
+		giterr_set(GITERR_REFERENCE,
+			"The reference '%s' is not locked", normalized);
+		return GIT_ENOTFOUND;
+	}
+
+	*out = git_vector_get(&tx->nodes, pos);
+	return 0;
+}
+
+static int set_change(
+	transaction_node *node,
+	git_transaction *tx,
+	git_reference *ref,
+	const git_signature *sig,
+	const char *msg)
+{
+	node_clear_change(node);
+
+	node->action = TRANSACTION_UPDATE;
+	node->ref = ref;
+
+	if ((sig ? git_signature_dup(&node->who, sig) :
+			git_reference__log_signature(&node->who, tx->repo)) < 0 ||
+		(msg && (node->message = git__strdup(msg)) == NULL)) {
+		node_clear_change(node);
+		return -1;
+	}
+
+	return 0;
+}
+
+int git_transaction_set_target(
+	git_transaction *tx,
+	const char *refname,
+	const git_oid *target,
+	const git_signature *sig,
+	const char *msg)
+{
+	transaction_node *node;
+	git_reference *ref;
+	git_odb *odb;
+	int error;
+
+	assert(tx && refname && target);
+
+	if ((error = find_locked(&node, tx, refname)) < 0)
+		return error;
+
+	/* Sanity check the reference being created - target must exist. */
+	if ((error = git_repository_odb__weakptr(&odb, tx->repo)) < 0)
+		return error;
+
+	if (!git_odb_exists(odb, target)) {
+		giterr_set(GITERR_REFERENCE,
+			"Target OID for the reference doesn't exist on the repository");
+		return -1;
+	}
+
+	ref = git_reference__alloc(node->name, target, NULL);
+	GITERR_CHECK_ALLOC(ref);
+
+	return set_change(node, tx, ref, sig, msg);
+}
+
+int git_transaction_set_symbolic_target(
+	git_transaction *tx,
+	const char *refname,
+	const char *target,
+	const git_signature *sig,
+	const char *msg)
+{
+	git_refname_t normalized_target;
+	transaction_node *node;
+	git_reference *ref;
+	int error;
+
+	assert(tx && refname && target);
+
+	if ((error = find_locked(&node, tx, refname)) < 0 ||
+		(error = git_reference__normalize_for_repo(
+			normalized_target, tx->repo, target)) < 0)
+		return error;
+
+	ref = git_reference__alloc_symbolic(node->name, normalized_target);
+	GITERR_CHECK_ALLOC(ref);
+
+	return set_change(node, tx, ref, sig, msg);
+}
+
+int git_transaction_remove(git_transaction *tx, const char *refname)
+{
+	transaction_node *node;
+	int error;
+
+	assert(tx && refname);
+
+	if ((error = find_locked(&node, tx, refname)) < 0)
+		return error;
+
+	if (node->old_type == GIT_REF_INVALID) {
+		giterr_set(GITERR_REFERENCE,
+			"Reference '%s' not found", node->name);
+		return GIT_ENOTFOUND;
+	}
+
+	node_clear_change(node);
+	node->action = TRANSACTION_REMOVE;
+
+	return 0;
+}
+
+/* Check that no two new references of the transaction are in each other's way */
+static int check_paths(git_transaction *tx)
+{
+	transaction_node *node, *other;
+	const char *slash;
+	size_t i, pos;
+	git_buf prefix = GIT_BUF_INIT;
+	int error = 0;
+
+	git_vector_foreach(&tx->nodes, i, node) {
+		if (node->action != TRANSACTION_UPDATE)
+			continue;
+
+		for (slash = strchr(node->name, '/'); slash; slash = strchr(slash + 1, '/')) {
+			if ((error = git_buf_set(&prefix, node->name, slash - node->name)) < 0)
+				goto done;
+
+			if (git_vector_bsearch2(&pos, &tx->nodes, node_name_cmp, prefix.ptr) < 0)
+				continue;
+
+			other = git_vector_get(&tx->nodes, pos);
+			if (other->action != TRANSACTION_UPDATE)
+				continue;
+
+			giterr_set(GITERR_REFERENCE,
+				"Path to reference '%s' collides with '%s'",
+				node->name, other->name);
+			error = -1;
+			goto done;
+		}
+	}
+
+done:
+	git_buf_free(&prefix);
+	return error;
+}
+
+int git_transaction_commit(git_transaction *tx)
+{
+	git_refdb_update *updates, *update;
+	transaction_node *node;
+	size_t i, count = 0;
+	int error;
+
+	assert(tx);
+
+	if ((error = check_paths(tx)) < 0)
+		return error;
+
+	updates = git__calloc(tx->nodes.length ? tx->nodes.length : 1,
+		sizeof(git_refdb_update));
+	GITERR_CHECK_ALLOC(updates);
+
+	/* the nodes are sorted by name, and so are the updates */
+	git_vector_foreach(&tx->nodes, i, node) {
+		if (node->action == TRANSACTION_NONE)
+			continue;
+
+		update = &updates[count++];
+		update->name = node->name;
+		update->ref = node->ref;
+		update->old_type = node->old_type;
+		git_oid_cpy(&update->old_id, &node->old_id);
+		update->old_target = node->old_target;
+		update->who = node->who;
+		update->message = node->message;
+	}
+
+	if (count > 0)
+		error = git_refdb_transaction(tx->db, updates, count);
+
+	git__free(updates);
+	return error;
+}
+
+void git_transaction_free(git_transaction *tx)
+{
+	transaction_node *node;
+	size_t i;
+
+	if (!tx)
+		return;
+
+	git_vector_foreach(&tx->nodes, i, node)
+		node_free(node);
+
+	git_vector_free(&tx->nodes);
+	git_refdb_free(tx->db);
+	git__free(tx);
+}
@@ -61,7 +61,7 @@ const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char
 		if (tree == NULL) /* Can't find it */
 			return NULL;
 
-		if (end == NULL || *end + 1 == '\0')
+		if (end == NULL || *(end + 1) == '\0')
 			return tree;
 
 		ptr = end + 1;
@@ -84,17 +84,10 @@ static int read_tree_internal(git_tree_cache **out,
 	if (++buffer >= buffer_end)
 		goto corrupted;
 
-	name_len = strlen(name_start);
-	tree = git__malloc(sizeof(git_tree_cache) + name_len + 1);
-	GITERR_CHECK_ALLOC(tree);
-
-	memset(tree, 0x0, sizeof(git_tree_cache));
-	tree->parent = parent;
-
 	/* NUL-terminated tree name */
-	tree->namelen = name_len;
-	memcpy(tree->name, name_start, name_len);
-	tree->name[name_len] = '\0';
+	name_len = strlen(name_start);
+	if (git_tree_cache_new(&tree, name_start, name_len, parent) < 0)
+		return -1;
 
 	/* Blank-terminated ASCII decimal number of entries in this tree */
 	if (git__strtol32(&count, buffer, &buffer, 10) < 0)
@@ -164,6 +157,94 @@ int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer
 	return 0;
 }
 
+int git_tree_cache_new(
+	git_tree_cache **out, const char *name, size_t namelen,
+	git_tree_cache *parent)
+{
+	git_tree_cache *tree;
+
+	tree = git__calloc(1, sizeof(git_tree_cache) + namelen + 1);
+	GITERR_CHECK_ALLOC(tree);
+
+	tree->parent = parent;
+	tree->entries = -1;
+	tree->namelen = namelen;
+	memcpy(tree->name, name, namelen);
+	tree->name[namelen] = '\0';
+
+	*out = tree;
+	return 0;
+}
+
+int git_tree_cache_add_child(git_tree_cache *tree, git_tree_cache *child)
+{
+	git_tree_cache **children = git__realloc(tree->children,
+		(tree->children_count + 1) * sizeof(git_tree_cache *));
+	GITERR_CHECK_ALLOC(children);
+
+	children[tree->children_count++] = child;
+	tree->children = children;
+	child->parent = tree;
+
+	return 0;
+}
+
+int git_tree_cache_reuse_child(
+	git_tree_cache **out,
+	git_tree_cache *tree,
+	git_tree_cache **old_children,
+	size_t old_count,
+	const char *name,
+	size_t namelen)
+{
+	git_tree_cache *child = NULL;
+	size_t i;
+
+	for (i = 0; i < old_count; ++i) {
+		if (old_children[i] != NULL &&
+			old_children[i]->namelen == namelen &&
+			!memcmp(old_children[i]->name, name, namelen)) {
+			child = old_children[i];
+			old_children[i] = NULL;
+			break;
+		}
+	}
+
+	if (child == NULL && git_tree_cache_new(&child, name, namelen, tree) < 0)
+		return -1;
+
+	if (git_tree_cache_add_child(tree, child) < 0) {
+		git_tree_cache_free(child);
+		return -1;
+	}
+
+	*out = child;
+	return 0;
+}
+
+static int write_tree_internal(git_buf *out, const git_tree_cache *tree)
+{
+	size_t i;
+
+	/* NUL-terminated name, number of entries and children, and the id */
+	git_buf_put(out, tree->name, tree->namelen + 1);
+	git_buf_printf(out, "%d %d\n",
+		(int)tree->entries, (int)tree->children_count);
+
+	if (tree->entries >= 0)
+		git_buf_put(out, (const char *)tree->oid.id, GIT_OID_RAWSZ);
+
+	for (i = 0; i < tree->children_count; ++i)
+		write_tree_internal(out, tree->children[i]);
+
+	return git_buf_oom(out) ? -1 : 0;
+}
+
+int git_tree_cache_write(git_buf *out, const git_tree_cache *tree)
+{
+	return write_tree_internal(out, tree);
+}
+
 void git_tree_cache_free(git_tree_cache *tree)
 {
 	unsigned int i;
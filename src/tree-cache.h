@@ -9,6 +9,7 @@
 #define INCLUDE_tree_cache_h__
 
 #include "common.h"
+#include "buffer.h"
 #include "git2/oid.h"
 
 struct git_tree_cache {
@@ -25,6 +26,26 @@ struct git_tree_cache {
 typedef struct git_tree_cache git_tree_cache;
 
 int git_tree_cache_read(git_tree_cache **tree, const char *buffer, size_t buffer_size);
+int git_tree_cache_write(git_buf *out, const git_tree_cache *tree);
+
+int git_tree_cache_new(
+	git_tree_cache **out, const char *name, size_t namelen,
+	git_tree_cache *parent);
+int git_tree_cache_add_child(git_tree_cache *tree, git_tree_cache *child);
+
+/*
+ * Add the child `name` back to `tree`, whose children the caller took away
+ * into `old_children` before rebuilding it, reusing its old cache if it
+ * had one.  Whatever is left in `old_children` is for the caller to free.
+ */
+int git_tree_cache_reuse_child(
+	git_tree_cache **out,
+	git_tree_cache *tree,
+	git_tree_cache **old_children,
+	size_t old_count,
+	const char *name,
+	size_t namelen);
+
 void git_tree_cache_invalidate_path(git_tree_cache *tree, const char *path);
 const git_tree_cache *git_tree_cache_get(const git_tree_cache *tree, const char *path);
 void git_tree_cache_free(git_tree_cache *tree);
@@ -429,23 +429,6 @@ int git_tree__parse(void *_tree, git_odb_object *odb_obj)
 	return 0;
 }
 
-static size_t find_next_dir(const char *dirname, git_index *index, size_t start)
-{
-	size_t dirlen, i, entries = git_index_entrycount(index);
-
-	dirlen = strlen(dirname);
-	for (i = start; i < entries; ++i) {
-		const git_index_entry *entry = git_index_get_byindex(index, i);
-		if (strlen(entry->path) < dirlen ||
-		    memcmp(entry->path, dirname, dirlen) ||
-			(dirlen > 0 && entry->path[dirlen] != '/')) {
-			break;
-		}
-	}
-
-	return i;
-}
-
 static int append_entry(
 	git_treebuilder *bld,
 	const char *filename,
@@ -474,27 +457,70 @@ static int append_entry(
 	return 0;
 }
 
+GIT_INLINE(bool) entry_in_dir(
+	const git_index_entry *entry, const char *dirname, size_t dirlen)
+{
+	return !(strlen(entry->path) < dirlen ||
+		memcmp(entry->path, dirname, dirlen) ||
+		(dirlen > 0 && entry->path[dirlen] != '/'));
+}
+
+/*
+ * A cached tree can only be trusted if the index still has exactly the
+ * number of entries it was written from under that directory.
+ */
+static bool cache_covers_entries(
+	git_index *index, const git_tree_cache *cache,
+	const char *dirname, size_t dirlen, size_t start)
+{
+	size_t end = start + cache->entries, entries = git_index_entrycount(index);
+
+	if (cache->entries <= 0 || end > entries)
+		return false;
+
+	return entry_in_dir(git_index_get_byindex(index, start), dirname, dirlen) &&
+		entry_in_dir(git_index_get_byindex(index, end - 1), dirname, dirlen) &&
+		(end == entries ||
+		 !entry_in_dir(git_index_get_byindex(index, end), dirname, dirlen));
+}
+
 static int write_tree(
 	git_oid *oid,
 	git_repository *repo,
 	git_index *index,
 	const char *dirname,
-	size_t start)
+	size_t start,
+	git_tree_cache *cache)
 {
 	git_treebuilder *bld = NULL;
-	size_t i, entries = git_index_entrycount(index);
+	git_tree_cache **old_children = NULL;
+	size_t i, old_count = 0, entries = git_index_entrycount(index);
 	int error;
 	size_t dirname_len = strlen(dirname);
-	const git_tree_cache *cache;
 
-	cache = git_tree_cache_get(index->tree, dirname);
-	if (cache != NULL && cache->entries >= 0){
-		git_oid_cpy(oid, &cache->oid);
-		return (int)find_next_dir(dirname, index, start);
+	/*
+	 * Subtrees whose cache entry survived since the last write can be
+	 * skipped over wholesale; anything else is rebuilt, and its cache
+	 * entry (and those of its children) filled in as we go.
+	 */
+	if (cache != NULL && cache->entries >= 0) {
+		if (cache_covers_entries(index, cache, dirname, dirname_len, start)) {
+			git_oid_cpy(oid, &cache->oid);
+			return (int)(start + cache->entries);
+		}
+
+		cache->entries = -1;
+	}
+
+	if (cache != NULL) {
+		old_children = cache->children;
+		old_count = cache->children_count;
+		cache->children = NULL;
+		cache->children_count = 0;
 	}
 
 	if ((error = git_treebuilder_create(&bld, NULL)) < 0 || bld == NULL)
-		return -1;
+		goto on_error;
 
 	/*
 	 * This loop is unfortunate, but necessary. The index doesn't have
@@ -513,11 +539,8 @@ static int write_tree(
 	 * win32/sys and a file win32mmap.c. Without it, the following
 	 * code believes there is a file win32/mmap.c
 	 */
-		if (strlen(entry->path) < dirname_len ||
-		    memcmp(entry->path, dirname, dirname_len) ||
-		    (dirname_len > 0 && entry->path[dirname_len] != '/')) {
+		if (!entry_in_dir(entry, dirname, dirname_len))
 			break;
-		}
 
 		filename = entry->path + dirname_len;
 		if (*filename == '/')
@@ -527,19 +550,11 @@ static int write_tree(
 			git_oid sub_oid;
 			int written;
 			char *subdir, *last_comp;
+			git_tree_cache *child = NULL;
 
 			subdir = git__strndup(entry->path, next_slash - entry->path);
 			GITERR_CHECK_ALLOC(subdir);
 
-			/* Write out the subtree */
-			written = write_tree(&sub_oid, repo, index, subdir, i);
-			if (written < 0) {
-				git__free(subdir);
-				goto on_error;
-			} else {
-				i = written - 1; /* -1 because of the loop increment */
-			}
-
 			/*
 			 * We need to figure out what we want toinsert
 			 * into this tree. If we're traversing
@@ -553,6 +568,21 @@ static int write_tree(
 				last_comp = subdir;
 			}
 
+			if (cache != NULL && git_tree_cache_reuse_child(&child, cache,
+					old_children, old_count, last_comp, strlen(last_comp)) < 0) {
+				git__free(subdir);
+				goto on_error;
+			}
+
+			/* Write out the subtree */
+			written = write_tree(&sub_oid, repo, index, subdir, i, child);
+			if (written < 0) {
+				git__free(subdir);
+				goto on_error;
+			} else {
+				i = written - 1; /* -1 because of the loop increment */
+			}
+
 			error = append_entry(bld, last_comp, &sub_oid, S_IFDIR);
 			git__free(subdir);
 			if (error < 0)
@@ -567,12 +597,25 @@ static int write_tree(
 	if (git_treebuilder_write(oid, repo, bld) < 0)
 		goto on_error;
 
-	git_treebuilder_free(bld);
-	return (int)i;
+	if (cache != NULL) {
+		git_oid_cpy(&cache->oid, oid);
+		cache->entries = (ssize_t)(i - start);
+	}
+
+	error = (int)i;
+	goto done;
 
 on_error:
+	error = -1;
+
+done:
+	/* drop the cache of subtrees that are gone from the index */
+	for (i = 0; i < old_count; ++i)
+		git_tree_cache_free(old_children[i]);
+	git__free(old_children);
+
 	git_treebuilder_free(bld);
-	return -1;
+	return error;
 }
 
 int git_tree__write_index(
@@ -580,6 +623,7 @@ int git_tree__write_index(
 {
 	int ret;
 	bool old_ignore_case = false;
+	git_tree_cache *cache = NULL;
 
 	assert(oid && index && repo);
 
@@ -589,9 +633,21 @@ int git_tree__write_index(
 		return GIT_EUNMERGED;
 	}
 
-	if (index->tree != NULL && index->tree->entries >= 0) {
-		git_oid_cpy(oid, &index->tree->oid);
-		return 0;
+	/*
+	 * The tree cache only describes objects in the index's own
+	 * repository, so trees written elsewhere are always rebuilt.
+	 */
+	if (GIT_REFCOUNT_OWNER(index) == repo) {
+		if (index->tree != NULL && index->tree->entries >= 0) {
+			git_oid_cpy(oid, &index->tree->oid);
+			return 0;
+		}
+
+		if (index->tree == NULL &&
+			git_tree_cache_new(&index->tree, "", 0, NULL) < 0)
+			return -1;
+
+		cache = index->tree;
 	}
 
 	/* The tree cache didn't help us; we'll have to write
@@ -604,7 +660,7 @@ int git_tree__write_index(
 		git_index__set_ignore_case(index, false);
 	}
 
-	ret = write_tree(oid, repo, index, "", 0);
+	ret = write_tree(oid, repo, index, "", 0, cache);
 
 	if (old_ignore_case)
 		git_index__set_ignore_case(index, true);
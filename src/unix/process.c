@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#include "common.h"
+#include "process.h"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+
+/* A write to a process that went away must not raise SIGPIPE in ours, so
+ * the process is connected through a socket rather than through pipes.
+ */
+#ifdef MSG_NOSIGNAL
+# define PROCESS_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define PROCESS_SEND_FLAGS 0
+#endif
+
+struct git_process {
+	pid_t pid;
+	int fd;
+};
+
+int git_process_new(
+	git_process **out, const char *command, const char *cwd)
+{
+	git_process *process;
+	char *argv[4];
+	int fds[2];
+	pid_t pid;
+
+	/* prepared before forking, nothing is allocated in the child */
+	argv[0] = "/bin/sh";
+	argv[1] = "-c";
+	argv[2] = (char *)command;
+	argv[3] = NULL;
+
+	process = git__calloc(1, sizeof(git_process));
+	GITERR_CHECK_ALLOC(process);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		giterr_set(GITERR_OS, "Could not connect to '%s'", command);
+		git__free(process);
+		return -1;
+	}
+
+	(void)fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+	{
+		int on = 1;
+		(void)setsockopt(fds[0], SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	}
+#endif
+
+	if ((pid = fork()) < 0) {
+		giterr_set(GITERR_OS, "Could not start '%s'", command);
+		close(fds[0]);
+		close(fds[1]);
+		git__free(process);
+		return -1;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+
+		if (dup2(fds[1], STDIN_FILENO) < 0 ||
+			dup2(fds[1], STDOUT_FILENO) < 0 ||
+			(cwd && chdir(cwd) < 0))
+			_exit(127);
+
+		if (fds[1] > STDOUT_FILENO)
+			close(fds[1]);
+
+		execv(argv[0], argv);
+		_exit(127);
+	}
+
+	close(fds[1]);
+
+	process->pid = pid;
+	process->fd = fds[0];
+
+	*out = process;
+	return 0;
+}
+
+int git_process_write(git_process *process, const void *buf, size_t len)
+{
+	const char *data = buf;
+	ssize_t written;
+
+	while (len > 0) {
+		written = send(process->fd, data, len, PROCESS_SEND_FLAGS);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0) {
+			giterr_set(GITERR_OS, "Could not write to child process");
+			return -1;
+		}
+
+		data += written;
+		len -= (size_t)written;
+	}
+
+	return 0;
+}
+
+ssize_t git_process_read(git_process *process, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	do {
+		ret = read(process->fd, buf, len);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		giterr_set(GITERR_OS, "Could not read from child process");
+
+	return ret;
+}
+
+int git_process_close(git_process *process)
+{
+	int status;
+	pid_t ret;
+
+	if (process->fd >= 0) {
+		close(process->fd);
+		process->fd = -1;
+	}
+
+	if (process->pid <= 0)
+		return -1;
+
+	do {
+		ret = waitpid(process->pid, &status, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	process->pid = 0;
+
+	if (ret < 0 || !WIFEXITED(status))
+		return -1;
+
+	return WEXITSTATUS(status);
+}
+
+void git_process_free(git_process *process)
+{
+	if (!process)
+		return;
+
+	(void)git_process_close(process);
+	git__free(process);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "common.h"
+#include "varint.h"
+
+#define VARINT_MSB(x, bits) ((x) & ((uintmax_t)~0 << (sizeof(x) * 8 - (bits))))
+
+uintmax_t git_decode_varint(
+	const unsigned char *buf, size_t bufsize, size_t *varint_len)
+{
+	const unsigned char *ptr = buf, *end = buf + bufsize;
+	unsigned char c;
+	uintmax_t val;
+
+	*varint_len = 0;
+
+	if (ptr >= end)
+		return 0;
+
+	c = *ptr++;
+	val = c & 127;
+
+	while (c & 128) {
+		val += 1;
+
+		if (!val || VARINT_MSB(val, 7) || ptr >= end)
+			return 0;
+
+		c = *ptr++;
+		val = (val << 7) + (c & 127);
+	}
+
+	*varint_len = ptr - buf;
+	return val;
+}
+
+int git_encode_varint(unsigned char *buf, size_t bufsize, uintmax_t value)
+{
+	unsigned char varint[16];
+	unsigned pos = sizeof(varint) - 1;
+
+	varint[pos] = value & 127;
+
+	while (value >>= 7)
+		varint[--pos] = 128 | (--value & 127);
+
+	if (buf) {
+		if (bufsize < (sizeof(varint) - pos))
+			return -1;
+
+		memcpy(buf, varint + pos, sizeof(varint) - pos);
+	}
+
+	return (int)(sizeof(varint) - pos);
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_varint_h__
+#define INCLUDE_varint_h__
+
+#include <stdint.h>
+
+/**
+ * Encode `value` as one of git's offset varints into `buf`.
+ *
+ * Returns the number of bytes the encoding takes, or -1 if `bufsize`
+ * is too small.  Pass a NULL `buf` to only compute the length.
+ */
+extern int git_encode_varint(unsigned char *buf, size_t bufsize, uintmax_t value);
+
+/**
+ * Decode a varint from at most `bufsize` bytes of `buf`.
+ *
+ * `varint_len` is set to the number of bytes consumed, or to 0 if the
+ * varint is truncated or overflows.
+ */
+extern uintmax_t git_decode_varint(
+	const unsigned char *buf, size_t bufsize, size_t *varint_len);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#include "common.h"
+#include "process.h"
+
+int git_process_new(
+	git_process **out, const char *command, const char *cwd)
+{
+	GIT_UNUSED(cwd);
+
+	*out = NULL;
+	giterr_set(GITERR_OS,
+		"Cannot start '%s': child processes are not supported on Windows",
+		command);
+	return -1;
+}
+
+int git_process_write(git_process *process, const void *buf, size_t len)
+{
+	GIT_UNUSED(process); GIT_UNUSED(buf); GIT_UNUSED(len);
+	return -1;
+}
+
+ssize_t git_process_read(git_process *process, void *buf, size_t len)
+{
+	GIT_UNUSED(process); GIT_UNUSED(buf); GIT_UNUSED(len);
+	return -1;
+}
+
+int git_process_close(git_process *process)
+{
+	GIT_UNUSED(process);
+	return -1;
+}
+
+void git_process_free(git_process *process)
+{
+	GIT_UNUSED(process);
+}
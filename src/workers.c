@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+
+#include "workers.h"
+
+typedef struct {
+	git_thread thread;
+	unsigned int started:1;
+	git_workers *workers;
+	git_workers_cb cb;
+	void *payload;
+} workers_thread;
+
+unsigned int git_workers__threads(
+	unsigned int threads, size_t work, size_t work_per_thread)
+{
+#ifdef GIT_THREADS
+	if (!threads) {
+		size_t wanted = work / work_per_thread;
+
+		threads = (unsigned int)git_online_cpus();
+		if (wanted < threads)
+			threads = (unsigned int)wanted;
+	}
+
+	return threads ? threads : 1;
+#else
+	GIT_UNUSED(threads);
+	GIT_UNUSED(work);
+	GIT_UNUSED(work_per_thread);
+	return 1;
+#endif
+}
+
+#ifdef GIT_THREADS
+static void *workers_thread_run(void *payload)
+{
+	workers_thread *t = payload;
+	t->cb(t->workers, t->payload);
+	return NULL;
+}
+#endif
+
+void git_workers__run(
+	git_workers *workers,
+	size_t count,
+	unsigned int threads,
+	git_workers_cb cb,
+	void *payload)
+{
+	workers_thread *others = NULL;
+	unsigned int i;
+
+	workers->count = count;
+	git_atomic_set(&workers->next, 0);
+	git_atomic_set(&workers->failed, 0);
+
+#ifdef GIT_THREADS
+	if (threads > 1 &&
+		(others = git__calloc(threads - 1, sizeof(*others))) != NULL) {
+		for (i = 0; i < threads - 1; ++i) {
+			others[i].workers = workers;
+			others[i].cb = cb;
+			others[i].payload = payload;
+
+			if (!git_thread_create(
+					&others[i].thread, NULL, workers_thread_run, &others[i]))
+				others[i].started = 1;
+		}
+	}
+#endif
+
+	cb(workers, payload);
+
+#ifdef GIT_THREADS
+	for (i = 0; others && i < threads - 1; ++i) {
+		if (others[i].started)
+			git_thread_join(&others[i].thread, NULL);
+	}
+#else
+	GIT_UNUSED(i);
+	GIT_UNUSED(threads);
+#endif
+
+	git__free(others);
+}
+
+bool git_workers__next(size_t *out, git_workers *workers)
+{
+	if (git_atomic_get(&workers->failed))
+		return false;
+
+	*out = (size_t)git_atomic_inc(&workers->next) - 1;
+	return *out < workers->count;
+}
+
+void git_workers__error_keep(git_workers_error *out, int error)
+{
+	const git_error *e;
+
+	out->error = error;
+
+	if (error < 0 && (e = giterr_last()) != NULL) {
+		out->klass = e->klass;
+		out->message = git__strdup(e->message);
+	}
+	giterr_clear();
+}
+
+int git_workers__error_restore(const git_workers_error *err)
+{
+	if (err->error < 0 && err->message)
+		giterr_set(err->klass, "%s", err->message);
+
+	return err->error;
+}
+
+void git_workers__error_free(git_workers_error *err)
+{
+	git__free(err->message);
+	err->message = NULL;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) the libgit2 contributors. All rights reserved.
+ *
+ * This file is part of libgit2, distributed under the GNU GPL v2 with
+ * a Linking Exception. For full terms see the included COPYING file.
+ */
+#ifndef INCLUDE_workers_h__
+#define INCLUDE_workers_h__
+
+#include "common.h"
+#include "thread-utils.h"
+
+/*
+ * A few threads working through the items of a batch, which they claim
+ * in order.  Once an item has failed no more are claimed, so every item
+ * before the failure is done.  The calling thread always takes part, and
+ * works alone if need be.
+ */
+typedef struct git_workers git_workers;
+
+/* Run by each thread: claims items with `git_workers__next` until none
+ * are left.
+ */
+typedef void (*git_workers_cb)(git_workers *workers, void *payload);
+
+struct git_workers {
+	size_t count;
+	git_atomic next;
+	git_atomic failed;
+};
+
+/*
+ * The error of an item.  Errors are thread local, so the message is
+ * kept here for the calling thread to restore.
+ */
+typedef struct {
+	int error;
+	int klass;
+	char *message;
+} git_workers_error;
+
+/*
+ * How many threads to use for `work` items: `threads` if it is set,
+ * else one per `work_per_thread` items up to the number of CPUs.  Always
+ * 1 without thread support.
+ */
+extern unsigned int git_workers__threads(
+	unsigned int threads, size_t work, size_t work_per_thread);
+
+/* Work through `count` items on up to `threads` threads. */
+extern void git_workers__run(
+	git_workers *workers,
+	size_t count,
+	unsigned int threads,
+	git_workers_cb cb,
+	void *payload);
+
+/* Claim the next item; false once they are all claimed or one failed. */
+extern bool git_workers__next(size_t *out, git_workers *workers);
+
+/* Stop handing out items after a failure. */
+GIT_INLINE(void) git_workers__stop(git_workers *workers)
+{
+	git_atomic_set(&workers->failed, 1);
+}
+
+/* Keep `error` with the last error of this thread, and clear the latter. */
+extern void git_workers__error_keep(git_workers_error *out, int error);
+
+/* Set the kept error for the calling thread again, and return it. */
+extern int git_workers__error_restore(const git_workers_error *err);
+
+extern void git_workers__error_free(git_workers_error *err);
+
+#endif
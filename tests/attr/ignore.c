@@ -173,3 +173,81 @@ void test_attr_ignore__expand_tilde_to_homedir(void)
 
 	assert_is_ignored(false, "example.global_with_tilde");
 }
+
+static void write_many_ignores(const char *rules)
+{
+	git_buf content = GIT_BUF_INIT;
+	int i;
+
+	for (i = 0; i < 100; ++i)
+		cl_git_pass(git_buf_printf(&content, "file%d.txt\n*.ext%d\n", i, i));
+	for (i = 0; i < 100; ++i)
+		cl_git_pass(git_buf_printf(&content, "/dir%d/sub/\n", i));
+
+	cl_git_pass(git_buf_puts(&content, rules));
+	cl_git_rewritefile("attr/.gitignore", content.ptr);
+
+	git_buf_free(&content);
+}
+
+void test_attr_ignore__many_rules(void)
+{
+	write_many_ignores(
+		"*.o\n"
+		"!keep.o\n"
+		"build/\n"
+		"/docs/*.html\n"
+		"!/docs/index.html\n"
+		"Makefile\n"
+		"src/gen/\n"
+		"foo*bar\n");
+
+	cl_must_pass(p_mkdir("attr/build", 0777));
+	cl_must_pass(p_mkdir("attr/src", 0777));
+	cl_must_pass(p_mkdir("attr/src/gen", 0777));
+
+	assert_is_ignored(true, "file7.txt");
+	assert_is_ignored(true, "dir/file7.txt");
+	assert_is_ignored(false, "file7.txt.orig");
+	assert_is_ignored(true, "a.ext12");
+	assert_is_ignored(false, "a.ext12.orig");
+	assert_is_ignored(true, "dir3/sub/a.c");
+	assert_is_ignored(false, "dir3/a.c");
+	assert_is_ignored(false, "x/dir3/sub/a.c");
+
+	assert_is_ignored(true, "a.o");
+	assert_is_ignored(true, "sub/a.o");
+	assert_is_ignored(false, "keep.o");
+	assert_is_ignored(false, "sub/keep.o");
+	assert_is_ignored(true, "build/a.c");
+	assert_is_ignored(true, "sub/build/a.c");
+	assert_is_ignored(true, "docs/a.html");
+	assert_is_ignored(false, "docs/index.html");
+	assert_is_ignored(false, "docs/sub/a.html");
+	assert_is_ignored(false, "other/docs/a.html");
+	assert_is_ignored(true, "Makefile");
+	assert_is_ignored(true, "src/Makefile");
+	assert_is_ignored(true, "src/gen/a.c");
+	assert_is_ignored(false, "lib/src/gen/a.c");
+	assert_is_ignored(true, "foo-x-bar");
+	assert_is_ignored(false, "foo-x-baz");
+
+	assert_is_ignored(false, "A.O");
+	assert_is_ignored(false, "MAKEFILE");
+}
+
+void test_attr_ignore__many_rules_ignorecase(void)
+{
+	cl_repo_set_bool(g_repo, "core.ignorecase", true);
+
+	write_many_ignores("*.o\n!keep.o\nMakefile\n/docs/*.html\n");
+
+	assert_is_ignored(true, "A.O");
+	assert_is_ignored(false, "KEEP.O");
+	assert_is_ignored(true, "MAKEFILE");
+	assert_is_ignored(true, "sub/makefile");
+	assert_is_ignored(true, "DOCS/A.HTML");
+	assert_is_ignored(true, "FILE7.TXT");
+	assert_is_ignored(true, "DIR3/SUB/a.c");
+	assert_is_ignored(true, "a.EXT12");
+}
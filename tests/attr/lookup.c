@@ -260,3 +260,61 @@ void test_attr_lookup__from_buffer(void)
 
 	git_attr_file__free(file);
 }
+
+void test_attr_lookup__many_rules(void)
+{
+	git_attr_file *file;
+	git_buf rules = GIT_BUF_INIT;
+	int i;
+
+	struct attr_expected cases[] = {
+		{ "file7.txt", "filler", EXPECT_STRING, "7" },
+		{ "dir/file7.txt", "filler", EXPECT_STRING, "7" },
+		{ "file7.txtx", "filler", EXPECT_UNDEFINED, NULL },
+		{ "a.ext12", "ext", EXPECT_STRING, "12" },
+		{ "a.b.ext12", "ext", EXPECT_STRING, "12" },
+		{ "a.ext12.b", "ext", EXPECT_UNDEFINED, NULL },
+		{ "dir3/sub/a.c", "dir", EXPECT_STRING, "3" },
+		{ "dir3/a.c", "dir", EXPECT_UNDEFINED, NULL },
+		{ "x/dir3/sub/a.c", "dir", EXPECT_UNDEFINED, NULL },
+		/* the last matching rule wins across all kinds of patterns */
+		{ "a.c", "lang", EXPECT_STRING, "c" },
+		{ "src/a.c", "lang", EXPECT_STRING, "src" },
+		{ "src/main.c", "lang", EXPECT_STRING, "main" },
+		{ "src/sub/main.c", "lang", EXPECT_STRING, "main" },
+		{ "src/sub/a.c", "lang", EXPECT_STRING, "src" },
+		{ "sub/src/a.c", "lang", EXPECT_STRING, "c" },
+		{ "src/a.h", "lang", EXPECT_STRING, "src" },
+		{ "main.c", "lang", EXPECT_STRING, "main" },
+		{ "a.c", "glob", EXPECT_UNDEFINED, NULL },
+		{ "foo-x-bar", "glob", EXPECT_TRUE, NULL },
+		/* negative rules apply to the paths that do not match */
+		{ "a.c", "notmain", EXPECT_TRUE, NULL },
+		{ "main.c", "notmain", EXPECT_UNDEFINED, NULL },
+		{ NULL, NULL, 0, NULL }
+	};
+
+	for (i = 0; i < 100; ++i)
+		cl_git_pass(git_buf_printf(&rules, "file%d.txt filler=%d\n", i, i));
+	for (i = 0; i < 100; ++i)
+		cl_git_pass(git_buf_printf(&rules, "*.ext%d ext=%d\n", i, i));
+	for (i = 0; i < 100; ++i)
+		cl_git_pass(git_buf_printf(&rules, "dir%d/sub/* dir=%d\n", i, i));
+
+	cl_git_pass(git_buf_puts(&rules,
+		"*.c lang=c\n"
+		"src/* lang=src\n"
+		"main.c lang=main\n"
+		"foo*bar glob\n"
+		"!main.c notmain\n"));
+
+	cl_git_pass(git_attr_file__new(&file, NULL, 0));
+	cl_git_pass(git_attr_file__parse_buffer(NULL, file, rules.ptr));
+	cl_assert_equal_i(305, (int)file->rules.length);
+	cl_assert(file->matcher != NULL);
+
+	run_test_cases(file, cases, 0);
+
+	git_attr_file__free(file);
+	git_buf_free(&rules);
+}
@@ -333,3 +333,58 @@ void test_attr_repo__staging_properly_normalizes_line_endings_according_to_gitat
 
 	git_index_free(index);
 }
+
+void test_attr_repo__session_checks_files_once(void)
+{
+	git_attr_session session;
+	const char *names[1] = { "subattr" };
+	const char *value;
+
+	git_attr_session__init(&session, g_repo);
+
+	cl_git_pass(git_attr_get_many_with_session(
+		&value, g_repo, &session, 0, "sub/subdir_test1", 1, names));
+	cl_assert_equal_s("yes", value);
+
+	cl_git_rewritefile("attr/sub/.gitattributes",
+		"subdir_test1 subattr=changed\n");
+
+	/* the session keeps using the files it has already looked at */
+	cl_git_pass(git_attr_get_many_with_session(
+		&value, g_repo, &session, 0, "sub/subdir_test1", 1, names));
+	cl_assert_equal_s("yes", value);
+
+	/* but lookups outside of it see the change */
+	cl_git_pass(git_attr_get(&value, g_repo, 0, "sub/subdir_test1", "subattr"));
+	cl_assert_equal_s("changed", value);
+
+	git_attr_session__free(&session);
+	git_attr_session__init(&session, g_repo);
+
+	cl_git_rewritefile("attr/sub/.gitattributes",
+		"subdir_test1 subattr=again\n");
+
+	cl_git_pass(git_attr_get_many_with_session(
+		&value, g_repo, &session, 0, "sub/subdir_test1", 1, names));
+	cl_assert_equal_s("again", value);
+
+	git_attr_session__free(&session);
+}
+
+void test_attr_repo__missing_files_are_not_reported_as_cached(void)
+{
+	const char *value;
+
+	cl_git_pass(git_attr_get(&value, g_repo, 0, "dir/file", "subattr"));
+
+	cl_assert(!git_attr_cache__is_cached(
+		g_repo, GIT_ATTR_FILE__FROM_FILE, "dir/.gitattributes"));
+
+	/* a file that appears later is picked up */
+	cl_git_mkfile("attr/dir/.gitattributes", "file subattr=indir\n");
+
+	cl_git_pass(git_attr_get(&value, g_repo, 0, "dir/file", "subattr"));
+	cl_assert_equal_s("indir", value);
+	cl_assert(git_attr_cache__is_cached(
+		g_repo, GIT_ATTR_FILE__FROM_FILE, "dir/.gitattributes"));
+}
@@ -0,0 +1,169 @@
+#include "clar_libgit2.h"
+#include "checkout_helpers.h"
+
+#include "git2/checkout.h"
+#include "checkout.h"
+#include "fileops.h"
+
+static git_repository *g_repo;
+static git_checkout_options g_opts;
+static git_tree *g_tree;
+
+#define DIRS 8
+#define FILES_PER_DIR 40
+
+static void file_path(git_buf *path, int dir, int file)
+{
+	git_buf_clear(path);
+	cl_git_pass(git_buf_printf(path, "testrepo/dir%d/file%d", dir, file));
+}
+
+void test_checkout_parallel__initialize(void)
+{
+	git_index *index;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	git_object *head;
+	git_oid tree_id;
+	int i, j;
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	GIT_INIT_STRUCTURE(&g_opts, GIT_CHECKOUT_OPTIONS_VERSION);
+	g_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+
+	/* write a tree with enough files to be shared between workers */
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD^{tree}"));
+	cl_git_pass(git_index_read_tree(index, (git_tree *)head));
+	git_object_free(head);
+
+	for (i = 0; i < DIRS; ++i) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "testrepo/dir%d", i));
+		cl_git_pass(p_mkdir(path.ptr, 0777));
+
+		for (j = 0; j < FILES_PER_DIR; ++j) {
+			file_path(&path, i, j);
+			git_buf_clear(&content);
+			cl_git_pass(git_buf_printf(&content, "file %d in dir %d\n", j, i));
+			cl_git_mkfile(path.ptr, content.ptr);
+			cl_git_pass(git_index_add_bypath(index, path.ptr + strlen("testrepo/")));
+		}
+	}
+
+	cl_git_pass(git_index_write_tree(&tree_id, index));
+	cl_git_pass(git_tree_lookup(&g_tree, g_repo, &tree_id));
+
+	/* go back to HEAD, which has none of the files */
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+	for (i = 0; i < DIRS; ++i) {
+		git_buf_clear(&path);
+		cl_git_pass(git_buf_printf(&path, "testrepo/dir%d", i));
+		cl_git_pass(git_futils_rmdir_r(path.ptr, NULL, GIT_RMDIR_REMOVE_FILES));
+	}
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+	git_index_free(index);
+}
+
+void test_checkout_parallel__cleanup(void)
+{
+	git_tree_free(g_tree);
+	g_tree = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static void assert_files_checked_out(void)
+{
+	git_index *index;
+	git_buf path = GIT_BUF_INIT, content = GIT_BUF_INIT;
+	int i, j;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	for (i = 0; i < DIRS; ++i) {
+		for (j = 0; j < FILES_PER_DIR; ++j) {
+			file_path(&path, i, j);
+			git_buf_clear(&content);
+			cl_git_pass(git_buf_printf(&content, "file %d in dir %d\n", j, i));
+			check_file_contents(path.ptr, content.ptr);
+
+			cl_assert(git_index_get_bypath(
+				index, path.ptr + strlen("testrepo/"), 0) != NULL);
+		}
+	}
+
+	git_buf_free(&path);
+	git_buf_free(&content);
+	git_index_free(index);
+}
+
+static void progress_in_order(
+	const char *path, size_t completed, size_t total, void *payload)
+{
+	size_t *last = payload;
+
+	GIT_UNUSED(path);
+
+	cl_assert(completed <= total);
+	cl_assert(completed == 0 || completed == *last + 1);
+	*last = completed;
+}
+
+void test_checkout_parallel__writes_files_on_several_threads(void)
+{
+	size_t last = 0;
+
+	g_opts.workers = 4;
+	g_opts.progress_cb = progress_in_order;
+	g_opts.progress_payload = &last;
+
+	cl_git_pass(git_checkout_tree(g_repo, (git_object *)g_tree, &g_opts));
+
+	assert_files_checked_out();
+	cl_assert_equal_i(DIRS * FILES_PER_DIR, last);
+}
+
+void test_checkout_parallel__writes_files_on_one_thread(void)
+{
+	g_opts.workers = 1;
+
+	cl_git_pass(git_checkout_tree(g_repo, (git_object *)g_tree, &g_opts));
+
+	assert_files_checked_out();
+}
+
+void test_checkout_parallel__reports_errors_from_workers(void)
+{
+	const git_error *error;
+
+	/* a file that is in the way cannot be opened exclusively */
+	cl_git_pass(p_mkdir("testrepo/dir3", 0777));
+	cl_git_mkfile("testrepo/dir3/file7", "in the way\n");
+
+	g_opts.workers = 4;
+	g_opts.file_open_flags = O_CREAT | O_EXCL | O_WRONLY;
+
+	cl_git_fail(git_checkout_tree(g_repo, (git_object *)g_tree, &g_opts));
+
+	cl_assert((error = giterr_last()) != NULL);
+	cl_assert(strstr(error->message, "dir3/file7") != NULL);
+}
+
+void test_checkout_parallel__accepts_version_1_options(void)
+{
+	/* a caller built against version 1 has no room for `workers` */
+	git_checkout_options *opts = git__malloc(GIT_CHECKOUT_OPTIONS_V1_SIZE);
+	cl_assert(opts);
+
+	cl_git_pass(git_checkout_init_options(opts, 1));
+	cl_assert_equal_i(1, opts->version);
+	opts->checkout_strategy = GIT_CHECKOUT_FORCE;
+
+	cl_git_pass(git_checkout_tree(g_repo, (git_object *)g_tree, opts));
+	assert_files_checked_out();
+
+	git__free(opts);
+}
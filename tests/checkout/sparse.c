@@ -0,0 +1,203 @@
+#include "clar_libgit2.h"
+#include "checkout_helpers.h"
+
+#include "git2/checkout.h"
+#include "git2/sys/diff.h"
+#include "sparse.h"
+#include "fileops.h"
+
+static git_repository *g_repo;
+static git_checkout_options g_opts;
+
+#define CONE_PATTERNS \
+	"# sub and subdir, but not what is below sub\n" \
+	"/*\n!/*/\n/sub/\n!/sub/*/\n/subdir/\n"
+
+void test_checkout_sparse__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("attr");
+
+	GIT_INIT_STRUCTURE(&g_opts, GIT_CHECKOUT_OPTIONS_VERSION);
+	g_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+}
+
+void test_checkout_sparse__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+static void enable_sparse(const char *patterns)
+{
+	cl_repo_set_bool(g_repo, "core.sparsecheckout", true);
+	cl_git_rewritefile("attr/.git/info/sparse-checkout", patterns);
+}
+
+static void assert_skip_worktree(const char *path, bool skip)
+{
+	git_index *index;
+	const git_index_entry *entry;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	cl_assert((entry = git_index_get_bypath(index, path, 0)) != NULL);
+	cl_assert_equal_b(
+		skip, (entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE) != 0);
+
+	git_index_free(index);
+}
+
+static void assert_status(const char *path, unsigned int expected)
+{
+	unsigned int status;
+
+	cl_git_pass(git_status_file(&status, g_repo, path));
+	cl_assert_equal_i(expected, status);
+}
+
+void test_checkout_sparse__parses_cone_patterns(void)
+{
+	git_sparse *sparse;
+
+	cl_git_pass(git_sparse__new(&sparse));
+	cl_git_pass(git_sparse__parse(sparse,
+		CONE_PATTERNS "/a/b\\ c/\n"));
+
+	cl_assert(git_sparse__includes(sparse, "attr0"));
+	cl_assert(git_sparse__includes(sparse, "sub/abc"));
+	cl_assert(!git_sparse__includes(sparse, "sub/sub/file"));
+	cl_assert(git_sparse__includes(sparse, "subdir/abc"));
+	cl_assert(!git_sparse__includes(sparse, "subdir2/subdir2_test1"));
+
+	/* the parents of a directory in the cone hold their files only */
+	cl_assert(git_sparse__includes(sparse, "a/file"));
+	cl_assert(!git_sparse__includes(sparse, "a/c/file"));
+	cl_assert(git_sparse__includes(sparse, "a/b c/d/file"));
+
+	git_sparse__free(sparse);
+}
+
+void test_checkout_sparse__rejects_other_patterns(void)
+{
+	git_sparse *sparse;
+
+	cl_git_pass(git_sparse__new(&sparse));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_sparse__parse(sparse, "/sub/\n"));
+	git_sparse__free(sparse);
+
+	cl_git_pass(git_sparse__new(&sparse));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_sparse__parse(sparse, "/*\n!/*/\n*.txt\n"));
+	git_sparse__free(sparse);
+}
+
+void test_checkout_sparse__skips_files_outside_of_the_cone(void)
+{
+	enable_sparse(CONE_PATTERNS);
+
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+
+	cl_assert(git_path_isfile("attr/attr0"));
+	cl_assert(git_path_isfile("attr/sub/abc"));
+	cl_assert(git_path_isfile("attr/subdir/abc"));
+	cl_assert(!git_path_exists("attr/sub/sub/file"));
+	cl_assert(!git_path_exists("attr/subdir2"));
+
+	/* untracked files are left alone */
+	cl_assert(git_path_isfile("attr/sub/sub/.gitattributes"));
+
+	assert_skip_worktree("sub/abc", false);
+	assert_skip_worktree("sub/sub/file", true);
+	assert_skip_worktree("subdir2/subdir2_test1", true);
+
+	/* the missing files are not reported as deleted */
+	assert_status("sub/sub/file", GIT_STATUS_CURRENT);
+	assert_status("subdir2/subdir2_test1", GIT_STATUS_CURRENT);
+}
+
+static size_t diff_stat_calls(const char *path)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
+	git_diff *diff;
+	char *pathspec = (char *)path;
+
+	opts.flags = GIT_DIFF_INCLUDE_UNTRACKED;
+	opts.pathspec.strings = &pathspec;
+	opts.pathspec.count = 1;
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, NULL, &opts));
+	cl_assert_equal_sz(0, git_diff_num_deltas(diff));
+	cl_git_pass(git_diff_get_perfdata(&perf, diff));
+	git_diff_free(diff);
+
+	return perf.stat_calls;
+}
+
+void test_checkout_sparse__diff_does_not_look_at_skipped_files(void)
+{
+	size_t stat_calls;
+
+	enable_sparse(CONE_PATTERNS);
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+
+	stat_calls = diff_stat_calls("sub/sub/file");
+
+	/* a file that shows up again outside of the cone is not even stat'ed */
+	cl_git_mkfile("attr/sub/sub/file", "modified\n");
+
+	cl_assert_equal_sz(stat_calls, diff_stat_calls("sub/sub/file"));
+	assert_status("sub/sub/file", GIT_STATUS_CURRENT);
+}
+
+void test_checkout_sparse__keeps_modified_files(void)
+{
+	enable_sparse(CONE_PATTERNS);
+	cl_git_rewritefile("attr/sub/sub/file", "modified\n");
+
+	g_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+
+	cl_assert(git_path_isfile("attr/sub/sub/file"));
+	assert_skip_worktree("sub/sub/file", false);
+
+	cl_assert(!git_path_exists("attr/sub/sub/subsub.txt"));
+	assert_skip_worktree("sub/sub/subsub.txt", true);
+}
+
+void test_checkout_sparse__widening_the_cone_restores_files(void)
+{
+	enable_sparse(CONE_PATTERNS);
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+	cl_assert(!git_path_exists("attr/subdir2"));
+
+	enable_sparse("/*\n!/*/\n/sub/\n/subdir/\n/subdir2/\n");
+	g_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+
+	cl_assert(git_path_isfile("attr/sub/sub/file"));
+	cl_assert(git_path_isfile("attr/subdir2/subdir2_test1"));
+	assert_skip_worktree("sub/sub/file", false);
+	assert_skip_worktree("subdir2/subdir2_test1", false);
+	assert_status("subdir2/subdir2_test1", GIT_STATUS_CURRENT);
+}
+
+void test_checkout_sparse__other_patterns_check_out_everything(void)
+{
+	enable_sparse("/*\n!/*/\n*.txt\n");
+
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+
+	cl_assert(git_path_isfile("attr/sub/sub/file"));
+	cl_assert(git_path_isfile("attr/subdir2/subdir2_test1"));
+	assert_skip_worktree("sub/sub/file", false);
+}
+
+void test_checkout_sparse__is_ignored_unless_enabled(void)
+{
+	cl_git_rewritefile("attr/.git/info/sparse-checkout", CONE_PATTERNS);
+
+	cl_git_pass(git_checkout_head(g_repo, &g_opts));
+
+	cl_assert(git_path_isfile("attr/sub/sub/file"));
+	assert_skip_worktree("sub/sub/file", false);
+}
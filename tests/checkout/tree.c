@@ -948,3 +948,53 @@ void test_checkout_tree__filemode_preserved_in_index(void)
 	git_commit_free(commit);
 	git_index_free(index);
 }
+
+void test_checkout_tree__safe_checkout_leaves_unchanged_subtrees_alone(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	checkout_counts ct;
+	git_object *obj;
+	git_tree *tree, *target;
+	git_treebuilder *builder;
+	git_oid blob_id, tree_id;
+
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_revparse_single(&obj, g_repo, "subtrees"));
+	cl_git_pass(git_checkout_tree(g_repo, obj, &opts));
+	cl_git_pass(git_repository_set_head(g_repo, "refs/heads/subtrees", NULL, NULL));
+
+	/* make sure the index has a complete tree cache */
+	reset_index_to_treeish(obj);
+
+	/* a target that only differs from HEAD in README */
+	cl_git_pass(git_object_peel((git_object **)&tree, obj, GIT_OBJ_TREE));
+	cl_git_pass(git_oid_fromstr(
+		&blob_id, "a71586c1dfe8a71c6cbf6c129f404c5642ff31bd"));
+	cl_git_pass(git_treebuilder_create(&builder, tree));
+	cl_git_pass(git_treebuilder_insert(
+		NULL, builder, "README", &blob_id, GIT_FILEMODE_BLOB));
+	cl_git_pass(git_treebuilder_write(&tree_id, g_repo, builder));
+	cl_git_pass(git_tree_lookup(&target, g_repo, &tree_id));
+
+	cl_git_mkfile("testrepo/ab/de/2.txt", "dirty\n");
+	cl_must_pass(p_unlink("testrepo/ab/c/3.txt"));
+
+	memset(&ct, 0, sizeof(ct));
+	opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+	opts.notify_flags = GIT_CHECKOUT_NOTIFY_UPDATED;
+	opts.notify_cb = checkout_count_callback;
+	opts.notify_payload = &ct;
+
+	cl_git_pass(git_checkout_tree(g_repo, (git_object *)target, &opts));
+
+	cl_assert_equal_i(1, ct.n_updates);
+	check_file_contents("testrepo/README", "my new file\n");
+	check_file_contents("testrepo/ab/de/2.txt", "dirty\n");
+	cl_assert(!git_path_exists("testrepo/ab/c/3.txt"));
+	check_file_contents("testrepo/ab/4.txt", "4.txt\n");
+
+	git_treebuilder_free(builder);
+	git_tree_free(target);
+	git_tree_free(tree);
+	git_object_free(obj);
+}
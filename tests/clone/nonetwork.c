@@ -4,6 +4,7 @@
 #include "remote.h"
 #include "fileops.h"
 #include "repository.h"
+#include "checkout.h"
 
 #define LIVE_REPO_URL "git://github.com/libgit2/TestGitRepository"
 
@@ -84,6 +85,27 @@ void test_clone_nonetwork__local(void)
 	cl_git_pass(git_clone(&g_repo, cl_git_fixture_url("testrepo.git"), "./foo", &g_options));
 }
 
+void test_clone_nonetwork__local_with_version_1_options(void)
+{
+	/* version 1 embeds the smaller version 1 of the checkout options */
+	size_t tail = sizeof(git_clone_options) -
+		offsetof(git_clone_options, remote_callbacks);
+	size_t size = offsetof(git_clone_options, checkout_opts) +
+		GIT_CHECKOUT_OPTIONS_V1_SIZE + tail;
+	git_clone_options *opts = git__malloc(size);
+	cl_assert(opts);
+
+	cl_git_pass(git_clone_init_options(opts, 1));
+	cl_assert_equal_i(1, opts->version);
+	cl_assert_equal_i(GIT_CHECKOUT_SAFE_CREATE, opts->checkout_opts.checkout_strategy);
+
+	cl_git_pass(git_clone(&g_repo, cl_git_fixture_url("testrepo.git"), "./foo", opts));
+	cl_assert(git_path_isfile("./foo/README"));
+	cl_assert(!git_repository_is_bare(g_repo));
+
+	git__free(opts);
+}
+
 void test_clone_nonetwork__local_absolute_path(void)
 {
 	const char *local_src;
@@ -0,0 +1,117 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+
+#ifdef GIT_WIN32
+# include <sys/utime.h>
+#else
+# include <utime.h>
+#endif
+
+/* files changed within the current second are never cached */
+static void mkfile_in_the_past(const char *path, const char *content, int age)
+{
+	struct utimbuf times;
+
+	cl_git_mkfile(path, content);
+
+	times.actime = times.modtime = time(NULL) - age;
+	cl_must_pass(utime(path, &times));
+}
+
+static git_config *open_global(const char *path)
+{
+	git_config *cfg;
+
+	cl_git_pass(git_config_new(&cfg));
+	cl_git_pass(git_config_add_file_ondisk(
+		cfg, path, GIT_CONFIG_LEVEL_GLOBAL, 0));
+
+	return cfg;
+}
+
+void test_config_cache__global_files_are_parsed_once(void)
+{
+	git_config *one, *two, *three;
+	const git_config_entry *a, *b, *c;
+
+	mkfile_in_the_past("cached-global", "[foo]\n\tbar = one\n", 60);
+
+	one = open_global("cached-global");
+	two = open_global("cached-global");
+
+	cl_git_pass(git_config_get_entry(&a, one, "foo.bar"));
+	cl_git_pass(git_config_get_entry(&b, two, "foo.bar"));
+	cl_assert_equal_s("one", a->value);
+	cl_assert(a == b);
+
+	/* a changed file is parsed again */
+	mkfile_in_the_past("cached-global", "[foo]\n\tbar = three\n", 30);
+
+	three = open_global("cached-global");
+	cl_git_pass(git_config_get_entry(&c, three, "foo.bar"));
+	cl_assert_equal_s("three", c->value);
+
+	git_config_free(one);
+	git_config_free(two);
+	git_config_free(three);
+}
+
+void test_config_cache__included_files_are_revalidated(void)
+{
+	git_config *one, *two;
+	const char *str;
+
+	mkfile_in_the_past("cached-included", "[foo]\n\tbar = one\n", 60);
+	mkfile_in_the_past("cached-include",
+		"[include]\n\tpath = cached-included\n", 60);
+
+	one = open_global("cached-include");
+	cl_git_pass(git_config_get_string(&str, one, "foo.bar"));
+	cl_assert_equal_s("one", str);
+
+	mkfile_in_the_past("cached-included", "[foo]\n\tbar = other\n", 30);
+
+	two = open_global("cached-include");
+	cl_git_pass(git_config_get_string(&str, two, "foo.bar"));
+	cl_assert_equal_s("other", str);
+
+	git_config_free(one);
+	git_config_free(two);
+}
+
+void test_config_cache__recently_changed_files_are_not_shared(void)
+{
+	git_config *one, *two;
+	const git_config_entry *a, *b;
+
+	cl_git_mkfile("cached-recent", "[foo]\n\tbar = one\n");
+
+	one = open_global("cached-recent");
+	two = open_global("cached-recent");
+
+	cl_git_pass(git_config_get_entry(&a, one, "foo.bar"));
+	cl_git_pass(git_config_get_entry(&b, two, "foo.bar"));
+	cl_assert_equal_s("one", a->value);
+	cl_assert(a != b);
+
+	git_config_free(one);
+	git_config_free(two);
+}
+
+void test_config_cache__local_files_are_not_shared(void)
+{
+	git_config *one, *two;
+	const git_config_entry *a, *b;
+
+	mkfile_in_the_past("cached-local", "[foo]\n\tbar = one\n", 60);
+
+	cl_git_pass(git_config_open_ondisk(&one, "cached-local"));
+	cl_git_pass(git_config_open_ondisk(&two, "cached-local"));
+
+	cl_git_pass(git_config_get_entry(&a, one, "foo.bar"));
+	cl_git_pass(git_config_get_entry(&b, two, "foo.bar"));
+	cl_assert(a != b);
+
+	git_config_free(one);
+	git_config_free(two);
+}
@@ -1131,3 +1131,127 @@ void test_core_buffer__lf_and_crlf_conversions(void)
 	git_buf_free(&src);
 	git_buf_free(&tgt);
 }
+
+static void fill_text(char *ptr, size_t len, unsigned int seed)
+{
+	static const char alphabet[] = "ab \t\r\n\r\n\x1b\x7f\x01\xe9\b\v";
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		seed = seed * 1103515245 + 12345;
+		ptr[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+	}
+}
+
+static void assert_stats_equal(git_buf_text_stats *a, git_buf_text_stats *b)
+{
+	cl_assert_equal_i(a->nul, b->nul);
+	cl_assert_equal_i(a->cr, b->cr);
+	cl_assert_equal_i(a->lf, b->lf);
+	cl_assert_equal_i(a->crlf, b->crlf);
+	cl_assert_equal_i(a->printable, b->printable);
+	cl_assert_equal_i(a->nonprintable, b->nonprintable);
+}
+
+void test_core_buffer__text_kernels_agree(void)
+{
+	git_buf src = GIT_BUF_INIT, tgt = GIT_BUF_INIT;
+	git_buf_text_stats expected_stats, stats;
+	char *expected_out, *out;
+	size_t len, expected_len, outlen, i;
+	bool expected_binary;
+	int kernel, max_kernel;
+
+	max_kernel = git_buf_text__use_kernel(GIT_BUF_TEXT_AVX2);
+
+	expected_out = git__malloc(2 * 4096 + 1);
+	out = git__malloc(2 * 4096 + 1);
+	cl_assert(expected_out && out);
+
+	/* lengths around the vector widths and the 255 block flush */
+	for (len = 0; len < 4096; len += (len < 100) ? 1 : 253) {
+		cl_git_pass(git_buf_grow(&src, len + 1));
+		fill_text(src.ptr, len, (unsigned int)len);
+		src.ptr[len] = '\0';
+		src.size = len;
+
+		/* the scalar results are the reference */
+		git_buf_text__use_kernel(GIT_BUF_TEXT_SCALAR);
+		git_buf_text__count(&expected_stats, src.ptr, len);
+		expected_binary = git_buf_text_is_binary(&src);
+
+		for (kernel = GIT_BUF_TEXT_SSE2; kernel <= max_kernel; ++kernel) {
+			git_buf_text__use_kernel(kernel);
+
+			git_buf_text__count(&stats, src.ptr, len);
+			assert_stats_equal(&expected_stats, &stats);
+			cl_assert_equal_b(expected_binary, git_buf_text_is_binary(&src));
+
+			if (expected_stats.crlf)
+				cl_git_fail_with(GIT_PASSTHROUGH,
+					git_buf_text_lf_to_crlf(&tgt, &src));
+			else {
+				cl_git_pass(git_buf_text_lf_to_crlf(&tgt, &src));
+				cl_assert_equal_sz(len + expected_stats.lf, tgt.size);
+			}
+
+			/* a NUL anywhere makes the content binary */
+			for (i = 0; i < len; i += 37) {
+				char c = src.ptr[i];
+				src.ptr[i] = '\0';
+				cl_assert(git_buf_text_is_binary(&src));
+				src.ptr[i] = c;
+			}
+		}
+
+		for (i = 0; i < 2; ++i) {
+			char prev = i ? '\r' : '\0';
+
+			git_buf_text__use_kernel(GIT_BUF_TEXT_SCALAR);
+			expected_len = git_buf_text__crlf_to_lf(expected_out, src.ptr, len);
+
+			for (kernel = GIT_BUF_TEXT_SSE2; kernel <= max_kernel; ++kernel) {
+				git_buf_text__use_kernel(kernel);
+				outlen = git_buf_text__crlf_to_lf(out, src.ptr, len);
+				cl_assert_equal_sz(expected_len, outlen);
+				cl_assert(memcmp(expected_out, out, outlen) == 0);
+			}
+
+			git_buf_text__use_kernel(GIT_BUF_TEXT_SCALAR);
+			expected_len = git_buf_text__lf_to_crlf(
+				expected_out, src.ptr, len, prev);
+			cl_assert_equal_sz(len + expected_stats.lf -
+				expected_stats.crlf - (prev && len && src.ptr[0] == '\n'),
+				expected_len);
+
+			for (kernel = GIT_BUF_TEXT_SSE2; kernel <= max_kernel; ++kernel) {
+				git_buf_text__use_kernel(kernel);
+				outlen = git_buf_text__lf_to_crlf(out, src.ptr, len, prev);
+				cl_assert_equal_sz(expected_len, outlen);
+				cl_assert(memcmp(expected_out, out, outlen) == 0);
+			}
+		}
+	}
+
+	/* CRLF pairs that straddle a vector boundary */
+	git_buf_text__use_kernel(max_kernel);
+	for (i = 0; i < 70; ++i) {
+		git_buf_clear(&src);
+		cl_git_pass(git_buf_putcn(&src, 'x', i));
+		cl_git_pass(git_buf_puts(&src, "\r\nx\r\r\nyy\r"));
+		cl_git_pass(git_buf_putcn(&src, 'z', 40));
+
+		cl_git_pass(git_buf_text_crlf_to_lf(&tgt, &src));
+		cl_assert_equal_sz(src.size - 2, tgt.size);
+		cl_assert(memcmp(tgt.ptr + i, "\nx\r\nyy\r", 7) == 0);
+
+		git_buf_text_gather_stats(&stats, &src, false);
+		cl_assert_equal_i(4, stats.cr);
+		cl_assert_equal_i(2, stats.crlf);
+	}
+
+	git__free(expected_out);
+	git__free(out);
+	git_buf_free(&src);
+	git_buf_free(&tgt);
+}
@@ -1,5 +1,7 @@
 #include "clar_libgit2.h"
 #include "diff_helpers.h"
+#include "index.h"
+#include "tree-cache.h"
 
 static git_repository *g_repo = NULL;
 
@@ -163,3 +165,67 @@ void test_diff_index__checks_options_version(void)
 	git_tree_free(a);
 }
 
+
+static void diff_tree_to_index_files(
+	diff_expects *exp, git_tree *tree, git_index *index, uint32_t flags)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff *diff = NULL;
+
+	opts.flags = flags;
+	memset(exp, 0, sizeof(*exp));
+
+	cl_git_pass(git_diff_tree_to_index(&diff, g_repo, tree, index, &opts));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, exp));
+
+	git_diff_free(diff);
+}
+
+void test_diff_index__skips_subtrees_unchanged_in_tree_cache(void)
+{
+	git_tree *a = resolve_commit_oid_to_tree(g_repo, "26a125ee1bf");
+	git_index *index;
+	git_index_entry entry;
+	git_tree_entry *te;
+	git_tree_cache *cache;
+	git_oid id;
+	diff_expects exp;
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_read_tree(index, a));
+
+	/* change a file at the top and add one to the subdirectory */
+	memcpy(&entry, git_index_get_bypath(index, "current_file", 0), sizeof(entry));
+	git_oid_cpy(&entry.id, &git_index_get_bypath(index, "modified_file", 0)->id);
+	cl_git_pass(git_index_add(index, &entry));
+
+	memcpy(&entry, git_index_get_bypath(index, "subdir/current_file", 0), sizeof(entry));
+	entry.path = "subdir/new_file";
+	cl_git_pass(git_index_add(index, &entry));
+
+	diff_tree_to_index_files(&exp, a, index, 0);
+	cl_assert_equal_i(2, exp.files);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_ADDED]);
+
+	diff_tree_to_index_files(&exp, a, index, GIT_DIFF_INCLUDE_UNMODIFIED);
+	cl_assert_equal_i((int)git_index_entrycount(index), exp.files);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_MODIFIED]);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_ADDED]);
+
+	/* whatever the cache claims to be unchanged is not looked at */
+	cl_git_pass(git_index_write_tree(&id, index));
+	cl_git_pass(git_tree_entry_bypath(&te, a, "subdir"));
+
+	cache = (git_tree_cache *)git_tree_cache_get(index->tree, "subdir");
+	cl_assert(cache != NULL && cache->entries >= 0);
+	git_oid_cpy(&cache->oid, git_tree_entry_id(te));
+
+	diff_tree_to_index_files(&exp, a, index, 0);
+	cl_assert_equal_i(1, exp.files);
+	cl_assert_equal_i(1, exp.file_status[GIT_DELTA_MODIFIED]);
+
+	git_tree_entry_free(te);
+	git_index_free(index);
+	git_tree_free(a);
+}
@@ -1694,3 +1694,32 @@ void test_diff_workdir__binary_detection(void)
 	git_index_free(idx);
 	git_buf_free(&b);
 }
+
+void test_diff_workdir__pathspec_skips_unmatched_directories(void)
+{
+	git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+	git_diff *diff = NULL;
+	git_diff_perfdata perf = GIT_DIFF_PERFDATA_INIT;
+	diff_expects exp;
+	char *pathspec[] = { "modified_file", "subdir/modified_file" };
+
+	g_repo = cl_git_sandbox_init("status");
+
+	opts.flags |= GIT_DIFF_INCLUDE_IGNORED | GIT_DIFF_INCLUDE_UNTRACKED;
+	opts.pathspec.strings = pathspec;
+	opts.pathspec.count = 2;
+
+	cl_git_pass(git_diff_index_to_workdir(&diff, g_repo, NULL, &opts));
+
+	memset(&exp, 0, sizeof(exp));
+	cl_git_pass(git_diff_foreach(diff, diff_file_cb, NULL, NULL, &exp));
+
+	cl_assert_equal_i(2, exp.files);
+	cl_assert_equal_i(2, exp.file_status[GIT_DELTA_MODIFIED]);
+
+	/* the root is listed in full, but only one file is read in subdir */
+	cl_git_pass(git_diff_get_perfdata(&perf, diff));
+	cl_assert_equal_sz(13 + 1, perf.stat_calls);
+
+	git_diff_free(diff);
+}
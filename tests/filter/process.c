@@ -0,0 +1,230 @@
+#include "clar_libgit2.h"
+#include "posix.h"
+#include "fileops.h"
+#include "git2/sys/filter.h"
+
+static git_repository *g_repo = NULL;
+static git_buf g_log = GIT_BUF_INIT;
+
+void test_filter_process__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_mkfile("empty_standard_repo/.gitattributes",
+		"*.r13 filter=rot13\n");
+
+	cl_git_mkfile("filter_process.log", "");
+	cl_git_pass(git_path_prettify(&g_log, "filter_process.log", NULL));
+}
+
+void test_filter_process__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+
+	p_unlink(g_log.ptr);
+	git_buf_free(&g_log);
+}
+
+/* The drivers are perl scripts */
+static void skip_without_perl(void)
+{
+#ifdef GIT_WIN32
+	cl_skip();
+#else
+	if (system("perl -e 1 >/dev/null 2>&1") != 0)
+		cl_skip();
+#endif
+}
+
+static void set_driver(const char *capabilities, int required)
+{
+	git_buf command = GIT_BUF_INIT;
+
+	cl_git_pass(git_buf_printf(&command, "perl '%s' '%s' %s",
+		cl_fixture("filter_process/rot13.pl"), g_log.ptr, capabilities));
+
+	cl_repo_set_string(g_repo, "filter.rot13.process", command.ptr);
+	cl_repo_set_bool(g_repo, "filter.rot13.required", required);
+
+	git_buf_free(&command);
+}
+
+static void assert_blob(const char *path, const char *expected)
+{
+	git_oid id;
+	git_blob *blob;
+
+	cl_git_pass(git_blob_create_fromworkdir(&id, g_repo, path));
+	cl_git_pass(git_blob_lookup(&blob, g_repo, &id));
+
+	cl_assert_equal_s(expected, git_blob_rawcontent(blob));
+
+	git_blob_free(blob);
+}
+
+static void assert_log(const char *expected)
+{
+	git_buf log = GIT_BUF_INIT;
+
+	cl_git_pass(git_futils_readbuffer(&log, g_log.ptr));
+	cl_assert_equal_s(expected, log.ptr);
+
+	git_buf_free(&log);
+}
+
+void test_filter_process__one_process_filters_every_file(void)
+{
+	git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+	git_index *index;
+
+	skip_without_perl();
+
+	set_driver("clean smudge", 1);
+
+	cl_git_mkfile("empty_standard_repo/one.r13", "Hello\n");
+	cl_git_mkfile("empty_standard_repo/two.r13", "World\n");
+	cl_git_mkfile("empty_standard_repo/plain.txt", "Plain\n");
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_bypath(index, "one.r13"));
+	cl_git_pass(git_index_add_bypath(index, "two.r13"));
+	cl_git_pass(git_index_add_bypath(index, "plain.txt"));
+	cl_git_pass(git_index_write(index));
+
+	assert_blob("one.r13", "Uryyb\n");
+
+	cl_must_pass(p_unlink("empty_standard_repo/one.r13"));
+	cl_must_pass(p_unlink("empty_standard_repo/two.r13"));
+	opts.checkout_strategy = GIT_CHECKOUT_FORCE;
+	cl_git_pass(git_checkout_index(g_repo, index, &opts));
+
+	cl_assert_equal_file("Hello\n", 0, "empty_standard_repo/one.r13");
+	cl_assert_equal_file("World\n", 0, "empty_standard_repo/two.r13");
+
+	git_index_free(index);
+
+	/* freeing the repository stops the process */
+	cl_git_sandbox_cleanup();
+
+	assert_log(
+		"START\n"
+		"clean one.r13\n"
+		"clean two.r13\n"
+		"clean one.r13\n"
+		"smudge one.r13\n"
+		"smudge two.r13\n"
+		"STOP\n");
+}
+
+void test_filter_process__only_negotiated_commands_are_sent(void)
+{
+	git_filter_list *fl;
+	git_buf out = GIT_BUF_INIT;
+
+	skip_without_perl();
+
+	set_driver("smudge", 1);
+
+	cl_git_mkfile("empty_standard_repo/one.r13", "Hello\n");
+	assert_blob("one.r13", "Hello\n");
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "one.r13", GIT_FILTER_TO_WORKTREE, 0));
+	cl_assert(fl != NULL);
+	cl_git_pass(git_filter_list_apply_to_file(&out, fl, g_repo, "one.r13"));
+	cl_assert_equal_s("Uryyb\n", out.ptr);
+
+	git_filter_list_free(fl);
+	git_buf_free(&out);
+
+	assert_log("START\nsmudge one.r13\n");
+}
+
+void test_filter_process__lists_keep_a_replaced_process(void)
+{
+	git_filter_list *fl, *other;
+	git_buf in = GIT_BUF_INIT, out = GIT_BUF_INIT;
+
+	skip_without_perl();
+
+	set_driver("clean smudge", 1);
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "one.r13", GIT_FILTER_TO_WORKTREE, 0));
+	cl_assert(fl != NULL);
+
+	/* the new command replaces the process the first list uses */
+	set_driver("smudge", 1);
+	cl_git_pass(git_filter_list_load(
+		&other, g_repo, NULL, "two.r13", GIT_FILTER_TO_WORKTREE, 0));
+	cl_assert(other != NULL);
+
+	cl_git_pass(git_buf_sets(&in, "Hello\n"));
+	cl_git_pass(git_filter_list_apply_to_data(&out, fl, &in));
+	cl_assert_equal_s("Uryyb\n", out.ptr);
+
+	git_filter_list_free(fl);
+
+	cl_git_pass(git_filter_list_apply_to_data(&out, other, &in));
+	cl_assert_equal_s("Uryyb\n", out.ptr);
+
+	git_filter_list_free(other);
+	git_buf_free(&in);
+	git_buf_free(&out);
+}
+
+void test_filter_process__errors_fail_required_drivers(void)
+{
+	const git_error *err;
+	git_oid id;
+
+	skip_without_perl();
+
+	set_driver("clean smudge", 1);
+
+	cl_git_mkfile("empty_standard_repo/error.r13", "Hello\n");
+	cl_git_fail(git_blob_create_fromworkdir(&id, g_repo, "error.r13"));
+
+	cl_assert((err = giterr_last()) != NULL);
+	cl_assert(strstr(err->message, "error.r13") != NULL);
+}
+
+void test_filter_process__errors_pass_optional_content_through(void)
+{
+	skip_without_perl();
+
+	set_driver("clean smudge", 0);
+
+	cl_git_mkfile("empty_standard_repo/error.r13", "Hello\n");
+	cl_git_mkfile("empty_standard_repo/abort.r13", "Hello\n");
+	cl_git_mkfile("empty_standard_repo/other.r13", "Hello\n");
+
+	assert_blob("error.r13", "Hello\n");
+	assert_blob("other.r13", "Uryyb\n");
+
+	/* after an abort, the driver is not asked to clean again */
+	assert_blob("abort.r13", "Hello\n");
+	assert_blob("other.r13", "Hello\n");
+
+	assert_log(
+		"START\n"
+		"clean error.r13\n"
+		"clean other.r13\n"
+		"clean abort.r13\n");
+}
+
+void test_filter_process__missing_driver(void)
+{
+	git_oid id;
+
+#ifdef GIT_WIN32
+	cl_skip();
+#endif
+
+	cl_repo_set_string(g_repo, "filter.rot13.process", "exit 1");
+	cl_git_mkfile("empty_standard_repo/one.r13", "Hello\n");
+
+	assert_blob("one.r13", "Hello\n");
+
+	cl_repo_set_bool(g_repo, "filter.rot13.required", true);
+	cl_git_fail(git_blob_create_fromworkdir(&id, g_repo, "one.r13"));
+}
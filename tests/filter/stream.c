@@ -0,0 +1,263 @@
+#include "clar_libgit2.h"
+#include <ctype.h>
+#include <stddef.h>
+#include "posix.h"
+#include "fileops.h"
+#include "filter.h"
+#include "git2/sys/filter.h"
+
+static git_repository *g_repo = NULL;
+
+#define BIG_LINES 150000
+
+void test_filter_stream__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("crlf");
+
+	cl_git_mkfile("crlf/.gitattributes",
+		"*.txt text\n*.crlf text eol=crlf\n*.id ident\n");
+
+	cl_repo_set_bool(g_repo, "core.autocrlf", true);
+}
+
+void test_filter_stream__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+/* a target that remembers what was written to it and how */
+struct collect_stream {
+	git_writestream base;
+	git_buf data;
+	size_t writes;
+	size_t largest_write;
+	int closed;
+};
+
+static int collect_stream_write(
+	git_writestream *s, const char *buffer, size_t len)
+{
+	struct collect_stream *stream = (struct collect_stream *)s;
+
+	cl_assert(!stream->closed);
+
+	stream->writes++;
+	if (len > stream->largest_write)
+		stream->largest_write = len;
+
+	return git_buf_put(&stream->data, buffer, len);
+}
+
+static int collect_stream_close(git_writestream *s)
+{
+	struct collect_stream *stream = (struct collect_stream *)s;
+
+	cl_assert(!stream->closed);
+	stream->closed = 1;
+	return 0;
+}
+
+static void collect_stream_free(git_writestream *s)
+{
+	GIT_UNUSED(s);
+}
+
+static void collect_stream_init(struct collect_stream *stream)
+{
+	memset(stream, 0, sizeof(struct collect_stream));
+	stream->base.write = collect_stream_write;
+	stream->base.close = collect_stream_close;
+	stream->base.free = collect_stream_free;
+}
+
+static void big_text(git_buf *out, const char *eol)
+{
+	int i;
+
+	git_buf_clear(out);
+	for (i = 0; i < BIG_LINES; ++i)
+		cl_git_pass(git_buf_printf(out, "this is line %d%s", i, eol));
+
+	cl_assert(out->size > GIT_FILTER_STREAM_LOOKAHEAD);
+}
+
+void test_filter_stream__large_data_to_odb_is_written_in_chunks(void)
+{
+	git_filter_list *fl;
+	git_buf in = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+	struct collect_stream target;
+
+	big_text(&in, "\r\n");
+	big_text(&expected, "\n");
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "big.txt", GIT_FILTER_TO_ODB, 0));
+	cl_assert(fl != NULL);
+
+	collect_stream_init(&target);
+	cl_git_pass(git_filter_list_stream_data(fl, &in, &target.base));
+
+	cl_assert(target.closed);
+	cl_assert(target.writes > 1);
+	cl_assert(target.largest_write <= GIT_FILTER_STREAM_CHUNK);
+	cl_assert_equal_i(expected.size, target.data.size);
+	cl_assert(memcmp(expected.ptr, target.data.ptr, expected.size) == 0);
+
+	git_filter_list_free(fl);
+	git_buf_free(&target.data);
+	git_buf_free(&in);
+	git_buf_free(&expected);
+}
+
+void test_filter_stream__large_data_to_worktree(void)
+{
+	git_filter_list *fl;
+	git_buf in = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+	struct collect_stream target;
+
+	big_text(&in, "\n");
+	big_text(&expected, "\r\n");
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "big.crlf", GIT_FILTER_TO_WORKTREE, 0));
+	cl_assert(fl != NULL);
+
+	collect_stream_init(&target);
+	cl_git_pass(git_filter_list_stream_data(fl, &in, &target.base));
+
+	cl_assert(target.closed);
+	cl_assert(target.writes > 1);
+	cl_assert_equal_i(expected.size, target.data.size);
+	cl_assert(memcmp(expected.ptr, target.data.ptr, expected.size) == 0);
+
+	git_filter_list_free(fl);
+	git_buf_free(&target.data);
+	git_buf_free(&in);
+	git_buf_free(&expected);
+}
+
+void test_filter_stream__ident_across_chunk_boundaries(void)
+{
+	git_filter_list *fl;
+	git_buf in = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+	struct collect_stream target;
+	size_t offset = GIT_FILTER_STREAM_LOOKAHEAD + GIT_FILTER_STREAM_CHUNK - 4;
+
+	/* the keyword straddles the boundary of two reads from the file */
+	cl_git_pass(git_buf_grow(&in, offset + 64));
+	memset(in.ptr, 'x', offset);
+	in.size = offset;
+	cl_git_pass(git_buf_puts(&in, "$I$Id: junk$ and $Id$ is kept\n"));
+
+	git_buf_clear(&expected);
+	cl_git_pass(git_buf_put(&expected, in.ptr, offset));
+	cl_git_pass(git_buf_puts(&expected, "$I$Id$ and $Id$ is kept\n"));
+
+	cl_git_pass(git_futils_writebuffer(&in, "crlf/big.id", 0, 0));
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "big.id", GIT_FILTER_TO_ODB, 0));
+	cl_assert(fl != NULL);
+
+	collect_stream_init(&target);
+	cl_git_pass(git_filter_list_stream_file(
+		fl, g_repo, "big.id", &target.base));
+
+	cl_assert(target.closed);
+	cl_assert_equal_i(expected.size, target.data.size);
+	cl_assert(memcmp(expected.ptr, target.data.ptr, expected.size) == 0);
+
+	git_filter_list_free(fl);
+	git_buf_free(&target.data);
+	git_buf_free(&in);
+	git_buf_free(&expected);
+}
+
+void test_filter_stream__large_file_hashes_like_buffered_content(void)
+{
+	git_buf in = GIT_BUF_INIT, expected = GIT_BUF_INIT;
+	git_oid expected_id, hashed_id, blob_id;
+
+	big_text(&in, "\r\n");
+	big_text(&expected, "\n");
+
+	/* no attributes, so core.autocrlf decides from the content */
+	cl_git_pass(git_futils_writebuffer(&in, "crlf/big.dat", 0, 0));
+
+	cl_git_pass(git_odb_hash(
+		&expected_id, expected.ptr, expected.size, GIT_OBJ_BLOB));
+
+	cl_git_pass(git_repository_hashfile(
+		&hashed_id, g_repo, "big.dat", GIT_OBJ_BLOB, NULL));
+	cl_assert(git_oid_equal(&expected_id, &hashed_id));
+
+	cl_git_pass(git_blob_create_fromworkdir(&blob_id, g_repo, "big.dat"));
+	cl_assert(git_oid_equal(&expected_id, &blob_id));
+
+	git_buf_free(&in);
+	git_buf_free(&expected);
+}
+
+static int upcase_filter_apply(
+	git_filter *self,
+	void **payload,
+	git_buf *to,
+	const git_buf *from,
+	const git_filter_source *source)
+{
+	size_t i;
+
+	GIT_UNUSED(self); GIT_UNUSED(payload); GIT_UNUSED(source);
+
+	cl_git_pass(git_buf_set(to, from->ptr, from->size));
+	for (i = 0; i < to->size; ++i)
+		to->ptr[i] = (char)toupper((unsigned char)to->ptr[i]);
+
+	return 0;
+}
+
+void test_filter_stream__version_1_filters_are_applied_whole(void)
+{
+	git_filter *filter;
+	git_filter_list *fl;
+	git_buf in = GIT_BUF_INIT;
+	struct collect_stream target;
+
+	/* a filter built against the old header ends before `stream` */
+	filter = git__calloc(1, offsetof(git_filter, stream));
+	cl_assert(filter);
+	filter->version = 1;
+	filter->attributes = "+upcase";
+	filter->apply = upcase_filter_apply;
+
+	cl_git_append2file("crlf/.gitattributes", "*.up upcase\n");
+	cl_git_pass(git_filter_register("upcase", filter, 300));
+
+	cl_git_pass(git_filter_list_load(
+		&fl, g_repo, NULL, "file.up", GIT_FILTER_TO_ODB, 0));
+	cl_assert(fl != NULL);
+
+	cl_git_pass(git_buf_sets(&in, "streamed all at once\n"));
+	collect_stream_init(&target);
+	cl_git_pass(git_filter_list_stream_data(fl, &in, &target.base));
+
+	cl_assert(target.closed);
+	cl_assert_equal_s("STREAMED ALL AT ONCE\n", target.data.ptr);
+
+	git_filter_list_free(fl);
+	cl_git_pass(git_filter_unregister("upcase"));
+	git__free(filter);
+	git_buf_free(&target.data);
+	git_buf_free(&in);
+}
+
+void test_filter_stream__newer_filter_versions_are_refused(void)
+{
+	git_filter filter;
+
+	memset(&filter, 0, sizeof(filter));
+	filter.version = GIT_FILTER_VERSION + 1;
+
+	cl_git_fail(git_filter_register("from_the_future", &filter, 300));
+	cl_git_fail_with(GIT_ENOTFOUND, git_filter_unregister("from_the_future"));
+}
@@ -354,3 +354,79 @@ void test_index_addall__callback_filtering(void)
 
 	git_index_free(index);
 }
+
+static void cleanup_index_threads(void *opaque)
+{
+	GIT_UNUSED(opaque);
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 0));
+}
+
+static void check_blob_at(git_index *index, const char *path, const char *data)
+{
+	const git_index_entry *entry;
+	git_odb *odb;
+	git_oid id;
+
+	cl_assert((entry = git_index_get_bypath(index, path, 0)) != NULL);
+	cl_git_pass(git_odb_hash(&id, data, strlen(data), GIT_OBJ_BLOB));
+	cl_assert_equal_oid(&id, &entry->id);
+
+	cl_git_pass(git_repository_odb(&odb, g_repo));
+	cl_assert(git_odb_exists(odb, &id));
+	git_odb_free(odb);
+}
+
+void test_index_addall__hashes_files_in_parallel(void)
+{
+	git_index *index;
+	char path[64], data[64];
+	int i;
+
+	cl_set_cleanup(&cleanup_index_threads, NULL);
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 4));
+
+	cl_git_pass(git_repository_init(&g_repo, TEST_DIR, false));
+	cl_must_pass(p_mkdir(TEST_DIR "/sub", 0777));
+
+	for (i = 0; i < 300; ++i) {
+		p_snprintf(path, sizeof(path), TEST_DIR "/%sfile%d", i % 2 ? "sub/" : "", i);
+		p_snprintf(data, sizeof(data), "contents of file %d\n", i);
+		cl_git_mkfile(path, data);
+	}
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_git_pass(git_index_add_all(index, NULL, 0, NULL, NULL));
+	cl_assert_equal_sz(300, git_index_entrycount(index));
+
+	for (i = 0; i < 300; ++i) {
+		p_snprintf(path, sizeof(path), "%sfile%d", i % 2 ? "sub/" : "", i);
+		p_snprintf(data, sizeof(data), "contents of file %d\n", i);
+		check_blob_at(index, path, data);
+	}
+	check_status(g_repo, 300, 0, 0, 0, 0, 0, 0);
+
+	/* change some of the files and remove others */
+	for (i = 0; i < 300; i += 3) {
+		p_snprintf(path, sizeof(path), TEST_DIR "/%sfile%d", i % 2 ? "sub/" : "", i);
+		p_snprintf(data, sizeof(data), "changed file %d\n", i);
+		if (i % 2)
+			cl_git_rewritefile(path, data);
+		else
+			cl_must_pass(p_unlink(path));
+	}
+
+	cl_git_pass(git_index_update_all(index, NULL, NULL, NULL));
+	cl_assert_equal_sz(250, git_index_entrycount(index));
+
+	for (i = 0; i < 300; i += 3) {
+		p_snprintf(path, sizeof(path), "%sfile%d", i % 2 ? "sub/" : "", i);
+		p_snprintf(data, sizeof(data), "changed file %d\n", i);
+		if (i % 2)
+			check_blob_at(index, path, data);
+		else
+			cl_assert(git_index_get_bypath(index, path, 0) == NULL);
+	}
+	check_status(g_repo, 250, 0, 0, 0, 0, 0, 0);
+
+	git_index_free(index);
+}
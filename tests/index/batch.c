@@ -0,0 +1,210 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "tree-cache.h"
+
+static git_repository *g_repo;
+static git_index *g_index;
+
+#define ONE_OID "45b983be36b73c0788dc9cbcb76cbb80fc7bb057"
+#define TWO_OID "a8233120f6ad708f843d861ce2b7228ec4e3dec6"
+
+void test_index_batch__initialize(void)
+{
+	git_object *head;
+
+	g_repo = cl_git_sandbox_init("attr");
+	cl_git_pass(git_repository_index(&g_index, g_repo));
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD^{tree}"));
+	cl_git_pass(git_index_read_tree(g_index, (git_tree *)head));
+	git_object_free(head);
+}
+
+void test_index_batch__cleanup(void)
+{
+	git_index_free(g_index);
+	g_index = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static void batch_add(const char *path, int stage, const char *oid)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.path = path;
+	entry.mode = GIT_FILEMODE_BLOB;
+	GIT_IDXENTRY_STAGE_SET(&entry, stage);
+	cl_git_pass(git_oid_fromstr(&entry.id, oid));
+
+	cl_git_pass(git_index_add(g_index, &entry));
+}
+
+static void assert_entry(const char *path, int stage, const char *oid)
+{
+	const git_index_entry *entry = git_index_get_bypath(g_index, path, stage);
+	git_oid expected;
+
+	if (!oid) {
+		cl_assert(entry == NULL);
+		return;
+	}
+
+	cl_assert(entry != NULL);
+	cl_git_pass(git_oid_fromstr(&expected, oid));
+	cl_assert_equal_oid(&expected, &entry->id);
+}
+
+static void assert_sorted(void)
+{
+	size_t i;
+
+	for (i = 1; i < git_index_entrycount(g_index); ++i)
+		cl_assert(git_index_entry_cmp(
+			git_index_get_byindex(g_index, i - 1),
+			git_index_get_byindex(g_index, i)) < 0);
+}
+
+void test_index_batch__changes_apply_on_commit(void)
+{
+	size_t count = git_index_entrycount(g_index);
+
+	cl_git_pass(git_index_batch_begin(g_index));
+
+	batch_add("zz", 0, ONE_OID);
+	batch_add("sub/new", 0, ONE_OID);
+	batch_add("attr0", 0, TWO_OID);
+	batch_add("aa", 0, ONE_OID);
+	cl_git_pass(git_index_remove(g_index, "subdir/abc", 0));
+	cl_git_pass(git_index_remove(g_index, "not/there", 0));
+
+	/* nothing changes until the batch is committed */
+	cl_assert_equal_i(count, git_index_entrycount(g_index));
+	assert_entry("aa", 0, NULL);
+	cl_assert(git_index_get_bypath(g_index, "subdir/abc", 0) != NULL);
+
+	cl_git_pass(git_index_batch_commit(g_index, false));
+
+	cl_assert_equal_i(count + 2, git_index_entrycount(g_index));
+	assert_sorted();
+
+	assert_entry("aa", 0, ONE_OID);
+	assert_entry("zz", 0, ONE_OID);
+	assert_entry("sub/new", 0, ONE_OID);
+	assert_entry("attr0", 0, TWO_OID);
+	assert_entry("subdir/abc", 0, NULL);
+}
+
+void test_index_batch__last_change_wins(void)
+{
+	cl_git_pass(git_index_batch_begin(g_index));
+
+	batch_add("new", 0, ONE_OID);
+	cl_git_pass(git_index_remove(g_index, "new", 0));
+
+	cl_git_pass(git_index_remove(g_index, "attr0", 0));
+	batch_add("attr0", 0, ONE_OID);
+	batch_add("attr0", 0, TWO_OID);
+
+	cl_git_pass(git_index_batch_commit(g_index, false));
+
+	assert_entry("new", 0, NULL);
+	assert_entry("attr0", 0, TWO_OID);
+	assert_sorted();
+}
+
+void test_index_batch__cannot_nest(void)
+{
+	cl_git_pass(git_index_batch_begin(g_index));
+	cl_git_fail(git_index_batch_begin(g_index));
+	git_index_batch_discard(g_index);
+
+	cl_git_pass(git_index_batch_begin(g_index));
+	batch_add("new", 0, ONE_OID);
+	git_index_batch_discard(g_index);
+
+	assert_entry("new", 0, NULL);
+
+	/* once discarded, changes are made right away again */
+	batch_add("new", 0, ONE_OID);
+	assert_entry("new", 0, ONE_OID);
+}
+
+void test_index_batch__adds_and_removes_conflicts(void)
+{
+	git_index_entry ancestor, ours, theirs;
+
+	memset(&ancestor, 0, sizeof(ancestor));
+	ancestor.path = "conflicted";
+	ancestor.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(&ancestor.id, ONE_OID));
+	memcpy(&ours, &ancestor, sizeof(ours));
+	memcpy(&theirs, &ancestor, sizeof(theirs));
+	cl_git_pass(git_oid_fromstr(&theirs.id, TWO_OID));
+
+	cl_git_pass(git_index_batch_begin(g_index));
+	cl_git_pass(git_index_conflict_add(g_index, &ancestor, &ours, &theirs));
+	cl_assert(!git_index_has_conflicts(g_index));
+	cl_git_pass(git_index_batch_commit(g_index, false));
+
+	assert_entry("conflicted", 1, ONE_OID);
+	assert_entry("conflicted", 2, ONE_OID);
+	assert_entry("conflicted", 3, TWO_OID);
+
+	cl_git_pass(git_index_batch_begin(g_index));
+	cl_git_pass(git_index_conflict_remove(g_index, "conflicted"));
+	batch_add("conflicted", 0, TWO_OID);
+	cl_git_pass(git_index_batch_commit(g_index, false));
+
+	cl_assert(!git_index_has_conflicts(g_index));
+	assert_entry("conflicted", 0, TWO_OID);
+	assert_sorted();
+}
+
+void test_index_batch__invalidates_the_tree_cache(void)
+{
+	cl_git_pass(git_index_batch_begin(g_index));
+	batch_add("sub/sub/new", 0, ONE_OID);
+	cl_git_pass(git_index_remove(g_index, "subdir2/subdir2_test1", 0));
+
+	cl_assert(git_tree_cache_get(g_index->tree, "sub/sub")->entries >= 0);
+
+	cl_git_pass(git_index_batch_commit(g_index, false));
+
+	cl_assert(g_index->tree->entries < 0);
+	cl_assert(git_tree_cache_get(g_index->tree, "sub/sub")->entries < 0);
+	cl_assert(git_tree_cache_get(g_index->tree, "subdir2")->entries < 0);
+	cl_assert(git_tree_cache_get(g_index->tree, "subdir")->entries >= 0);
+}
+
+void test_index_batch__reports_file_and_directory_collisions(void)
+{
+	cl_git_pass(git_index_batch_begin(g_index));
+	batch_add("aa", 0, ONE_OID);
+	batch_add("sub", 0, ONE_OID);
+	batch_add("zz", 0, ONE_OID);
+	cl_git_fail(git_index_batch_commit(g_index, false));
+
+	/* the changes before the failing one were made */
+	assert_entry("aa", 0, ONE_OID);
+	assert_entry("zz", 0, NULL);
+	assert_sorted();
+
+	/* and the batch is over */
+	batch_add("zz", 0, ONE_OID);
+	assert_entry("zz", 0, ONE_OID);
+}
+
+void test_index_batch__can_write_the_index(void)
+{
+	git_index *reread;
+
+	cl_git_pass(git_index_batch_begin(g_index));
+	batch_add("new", 0, ONE_OID);
+	cl_git_pass(git_index_batch_commit(g_index, true));
+
+	cl_git_pass(git_index_open(&reread, "attr/.git/index"));
+	cl_assert(git_index_get_bypath(reread, "new", 0) != NULL);
+	git_index_free(reread);
+}
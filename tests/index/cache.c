@@ -0,0 +1,173 @@
+#include "clar_libgit2.h"
+#include "index.h"
+#include "tree-cache.h"
+
+static git_repository *g_repo;
+static git_index *g_index;
+static git_tree *g_head;
+
+void test_index_cache__initialize(void)
+{
+	git_object *head;
+
+	g_repo = cl_git_sandbox_init("attr");
+	cl_git_pass(git_repository_index(&g_index, g_repo));
+
+	cl_git_pass(git_revparse_single(&head, g_repo, "HEAD^{tree}"));
+	g_head = (git_tree *)head;
+}
+
+void test_index_cache__cleanup(void)
+{
+	git_tree_free(g_head);
+	g_head = NULL;
+	git_index_free(g_index);
+	g_index = NULL;
+
+	cl_git_sandbox_cleanup();
+}
+
+static const git_tree_cache *cache_at(git_index *index, const char *path)
+{
+	return *path ? git_tree_cache_get(index->tree, path) : index->tree;
+}
+
+static void assert_cache_valid(git_index *index, const char *path, bool valid)
+{
+	const git_tree_cache *cache = cache_at(index, path);
+
+	cl_assert(cache != NULL);
+	cl_assert_equal_b(valid, cache->entries >= 0);
+}
+
+/* the cache at `path` must name the subtree at `path` of `tree` */
+static void assert_cache_matches(
+	git_index *index, git_tree *tree, const char *path)
+{
+	const git_tree_cache *cache = cache_at(index, path);
+	git_tree_entry *te;
+
+	cl_assert(cache != NULL && cache->entries >= 0);
+
+	if (!*path) {
+		cl_assert_equal_oid(git_tree_id(tree), &cache->oid);
+		return;
+	}
+
+	cl_git_pass(git_tree_entry_bypath(&te, tree, path));
+	cl_assert_equal_oid(git_tree_entry_id(te), &cache->oid);
+	git_tree_entry_free(te);
+}
+
+static void add_entry(git_index *index, const char *path)
+{
+	git_index_entry entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.path = path;
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(
+		&entry.id, "45b983be36b73c0788dc9cbcb76cbb80fc7bb057"));
+	cl_git_pass(git_index_add(index, &entry));
+}
+
+void test_index_cache__read_tree_fills_cache(void)
+{
+	cl_git_pass(git_index_read_tree(g_index, g_head));
+
+	assert_cache_matches(g_index, g_head, "");
+	assert_cache_matches(g_index, g_head, "sub");
+	assert_cache_matches(g_index, g_head, "sub/sub");
+	assert_cache_matches(g_index, g_head, "subdir2");
+
+	cl_assert_equal_i(
+		(int)git_index_entrycount(g_index), (int)g_index->tree->entries);
+	cl_assert_equal_i(2, (int)cache_at(g_index, "sub/sub")->entries);
+}
+
+void test_index_cache__changes_only_invalidate_their_parents(void)
+{
+	git_index_entry entry;
+
+	cl_git_pass(git_index_read_tree(g_index, g_head));
+
+	add_entry(g_index, "sub/sub/new.txt");
+
+	assert_cache_valid(g_index, "", false);
+	assert_cache_valid(g_index, "sub", false);
+	assert_cache_valid(g_index, "sub/sub", false);
+	assert_cache_valid(g_index, "subdir", true);
+	assert_cache_valid(g_index, "subdir2", true);
+
+	/* new stat data for unchanged content leaves the cache alone */
+	memcpy(&entry, git_index_get_bypath(g_index, "subdir/abc", 0), sizeof(entry));
+	entry.mtime.seconds++;
+	cl_git_pass(git_index_add(g_index, &entry));
+
+	assert_cache_valid(g_index, "subdir", true);
+
+	cl_git_pass(git_index_remove(g_index, "subdir/abc", 0));
+	assert_cache_valid(g_index, "subdir", false);
+	assert_cache_valid(g_index, "subdir2", true);
+}
+
+void test_index_cache__write_tree_refreshes_cache(void)
+{
+	git_index *fresh;
+	git_tree *tree;
+	git_oid id, expected;
+	size_t i;
+
+	cl_git_pass(git_index_read_tree(g_index, g_head));
+
+	add_entry(g_index, "sub/sub/new.txt");
+	cl_git_pass(git_index_remove_directory(g_index, "subdir2", 0));
+
+	cl_git_pass(git_index_write_tree(&id, g_index));
+
+	/* an index without a cache writes the same tree */
+	cl_git_pass(git_index_new(&fresh));
+	for (i = 0; i < git_index_entrycount(g_index); ++i)
+		cl_git_pass(git_index_add(fresh, git_index_get_byindex(g_index, i)));
+	cl_git_pass(git_index_write_tree_to(&expected, fresh, g_repo));
+	cl_assert(fresh->tree == NULL);
+	git_index_free(fresh);
+
+	cl_assert_equal_oid(&expected, &id);
+
+	cl_git_pass(git_tree_lookup(&tree, g_repo, &id));
+
+	assert_cache_matches(g_index, tree, "");
+	assert_cache_matches(g_index, tree, "sub");
+	assert_cache_matches(g_index, tree, "sub/sub");
+	assert_cache_matches(g_index, tree, "subdir");
+	cl_assert_equal_i(3, (int)cache_at(g_index, "sub/sub")->entries);
+
+	/* the cache of the directory that went away is dropped */
+	cl_assert(git_tree_cache_get(g_index->tree, "subdir2") == NULL);
+
+	git_tree_free(tree);
+}
+
+void test_index_cache__is_written_with_the_index(void)
+{
+	git_index *reread;
+
+	cl_git_pass(git_index_read_tree(g_index, g_head));
+	add_entry(g_index, "sub/sub/new.txt");
+	cl_git_pass(git_index_write(g_index));
+
+	cl_git_pass(git_index_open(&reread, "attr/.git/index"));
+
+	cl_assert(reread->tree != NULL);
+	assert_cache_valid(reread, "", false);
+	assert_cache_valid(reread, "sub", false);
+	assert_cache_valid(reread, "sub/sub", false);
+	assert_cache_matches(reread, g_head, "subdir");
+	assert_cache_matches(reread, g_head, "subdir2");
+	cl_assert_equal_i(
+		(int)cache_at(g_index, "subdir")->entries,
+		(int)cache_at(reread, "subdir")->entries);
+
+	git_index_free(reread);
+}
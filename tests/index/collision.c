@@ -104,3 +104,77 @@ void test_index_collision__add_with_highstage_2(void)
 
 	git_index_free(index);
 }
+
+void test_index_collision__add_file_over_directory(void)
+{
+	git_index *index;
+	git_index_entry entry;
+
+	cl_git_pass(git_index_new(&index));
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode  = 0100644;
+	git_oid_fromstr(&entry.id, "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391");
+
+	entry.path = "a/b/c";
+	cl_git_pass(git_index_add(index, &entry));
+	entry.path = "a/d";
+	cl_git_pass(git_index_add(index, &entry));
+
+	/* once a directory is empty, it may become a file */
+	cl_git_pass(git_index_remove(index, "a/b/c", 0));
+	entry.path = "a/b";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert_equal_sz(2, git_index_entrycount(index));
+
+	entry.path = "a/b/c";
+	cl_git_fail(git_index_add(index, &entry));
+	entry.path = "a";
+	cl_git_fail(git_index_add(index, &entry));
+
+	git_index_free(index);
+}
+
+void test_index_collision__add_ignoring_case(void)
+{
+	git_index *index;
+	git_index_entry entry;
+
+	cl_git_pass(git_index_new(&index));
+	cl_git_pass(git_index_set_caps(index, GIT_INDEXCAP_IGNORE_CASE));
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode  = 0100644;
+	git_oid_fromstr(&entry.id, "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391");
+
+	entry.path = "Dir/File";
+	cl_git_pass(git_index_add(index, &entry));
+
+	cl_assert(git_index_get_bypath(index, "dir/file", 0) != NULL);
+	cl_assert(git_index_get_bypath(index, "DIR/FILE", 0) != NULL);
+
+	/* differently cased names are the same entry */
+	entry.path = "DIR/FILE";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert_equal_sz(1, git_index_entrycount(index));
+	cl_assert_equal_s("Dir/File", git_index_get_byindex(index, 0)->path);
+
+	/* until the case is no longer ignored */
+	cl_git_pass(git_index_set_caps(index, 0));
+	cl_assert(git_index_get_bypath(index, "dir/file", 0) == NULL);
+	entry.path = "dir";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert_equal_sz(2, git_index_entrycount(index));
+	cl_git_pass(git_index_remove(index, "dir", 0));
+
+	cl_git_pass(git_index_set_caps(index, GIT_INDEXCAP_IGNORE_CASE));
+	entry.path = "dir";
+	cl_git_fail(git_index_add(index, &entry));
+
+	entry.path = "dir/file";
+	cl_git_pass(git_index_add(index, &entry));
+	entry.path = "DIR/FILE/sub";
+	cl_git_fail(git_index_add(index, &entry));
+
+	git_index_free(index);
+}
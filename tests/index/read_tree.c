@@ -1,5 +1,6 @@
 #include "clar_libgit2.h"
 #include "posix.h"
+#include "index.h"
 
 /* Test that reading and writing a tree is a no-op */
 void test_index_read_tree__read_write_involution(void)
@@ -44,3 +45,101 @@ void test_index_read_tree__read_write_involution(void)
 
 	cl_fixture_cleanup("read_tree");
 }
+
+static git_tree *tree_of(git_repository *repo, const char *spec)
+{
+	git_object *obj;
+
+	cl_git_pass(git_revparse_single(&obj, repo, spec));
+	return (git_tree *)obj;
+}
+
+void test_index_read_tree__only_changes_entries_that_differ(void)
+{
+	git_repository *repo = cl_git_sandbox_init("attr");
+	git_index *index;
+	git_index_entry entry;
+	const git_index_entry *kept, *changed;
+	git_tree *head, *other;
+	git_oid other_id;
+
+	cl_git_pass(git_repository_index(&index, repo));
+	head = tree_of(repo, "HEAD^{tree}");
+
+	/* a tree that differs from HEAD in one file */
+	memcpy(&entry, git_index_get_bypath(index, "sub/abc", 0), sizeof(entry));
+	cl_git_pass(git_oid_fromstr(
+		&entry.id, "45b983be36b73c0788dc9cbcb76cbb80fc7bb057"));
+	cl_git_pass(git_index_add(index, &entry));
+	cl_git_pass(git_index_write_tree(&other_id, index));
+	cl_git_pass(git_tree_lookup(&other, repo, &other_id));
+
+	kept = git_index_get_bypath(index, "subdir/abc", 0);
+	cl_assert(kept->mtime.seconds != 0);
+
+	cl_git_pass(git_index_read_tree(index, head));
+
+	/* the untouched entries are the very same ones, stat data and all */
+	cl_assert_equal_p(kept, git_index_get_bypath(index, "subdir/abc", 0));
+	cl_assert(kept->mtime.seconds != 0);
+
+	changed = git_index_get_bypath(index, "sub/abc", 0);
+	cl_assert(!git_oid_equal(&entry.id, &changed->id));
+	cl_assert_equal_i(0, changed->mtime.seconds);
+
+	/* and back again */
+	cl_git_pass(git_index_read_tree(index, other));
+	cl_assert_equal_p(kept, git_index_get_bypath(index, "subdir/abc", 0));
+	cl_assert_equal_oid(&entry.id, &git_index_get_bypath(index, "sub/abc", 0)->id);
+
+	cl_git_pass(git_index_write_tree(&other_id, index));
+	cl_assert_equal_oid(git_tree_id(other), &other_id);
+
+	git_tree_free(head);
+	git_tree_free(other);
+	git_index_free(index);
+	cl_git_sandbox_cleanup();
+}
+
+void test_index_read_tree__removes_entries_and_conflicts_not_in_tree(void)
+{
+	git_repository *repo = cl_git_sandbox_init("attr");
+	git_index *index;
+	git_index_entry entry;
+	git_tree *head;
+	git_oid id;
+
+	cl_git_pass(git_repository_index(&index, repo));
+	head = tree_of(repo, "HEAD^{tree}");
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(
+		&entry.id, "45b983be36b73c0788dc9cbcb76cbb80fc7bb057"));
+
+	entry.path = "sub/sub/extra";
+	cl_git_pass(git_index_add(index, &entry));
+	entry.path = "zzz";
+	cl_git_pass(git_index_add(index, &entry));
+	entry.path = "subdir/abc";
+	cl_git_pass(git_index_conflict_add(index, &entry, &entry, &entry));
+	cl_assert(git_index_has_conflicts(index));
+
+	cl_git_pass(git_index_read_tree(index, head));
+
+	cl_assert(!git_index_has_conflicts(index));
+	cl_assert(git_index_get_bypath(index, "sub/sub/extra", 0) == NULL);
+	cl_assert(git_index_get_bypath(index, "zzz", 0) == NULL);
+	cl_assert(git_index_get_bypath(index, "subdir/abc", 0) != NULL);
+	cl_assert_equal_sz(23, git_index_entrycount(index));
+	cl_git_pass(git_vector_verify_sorted(&index->entries));
+
+	/* the tree cache describes the tree exactly */
+	cl_assert(index->tree != NULL && index->tree->entries == 23);
+	cl_git_pass(git_index_write_tree(&id, index));
+	cl_assert_equal_oid(git_tree_id(head), &id);
+
+	git_tree_free(head);
+	git_index_free(index);
+	cl_git_sandbox_cleanup();
+}
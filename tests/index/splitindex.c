@@ -0,0 +1,291 @@
+#include "clar_libgit2.h"
+#include "index.h"
+
+#ifdef GIT_WIN32
+# include <sys/utime.h>
+#else
+# include <utime.h>
+#endif
+
+#define TEST_INDEX2_PATH cl_fixture("gitgit.index")
+
+static git_index *g_original;
+
+void test_index_splitindex__initialize(void)
+{
+	cl_must_pass(p_mkdir("split", 0777));
+	cl_git_pass(git_futils_cp(TEST_INDEX2_PATH, "split/index", 0644));
+	cl_git_pass(git_index_open(&g_original, TEST_INDEX2_PATH));
+}
+
+void test_index_splitindex__cleanup(void)
+{
+	git_index_free(g_original);
+	g_original = NULL;
+
+	cl_git_pass(git_futils_rmdir_r("split", NULL, GIT_RMDIR_REMOVE_FILES));
+}
+
+static int find_shared_cb(void *payload, git_buf *path)
+{
+	git_buf *found = payload;
+	const char *name = git_path_basename(path->ptr);
+
+	if (!git__prefixcmp(name, "sharedindex.")) {
+		if (found->size)
+			git_buf_putc(found, ' ');
+		git_buf_puts(found, name);
+	}
+
+	git__free((char *)name);
+	return 0;
+}
+
+/* names of the shared index files, separated by spaces */
+static void shared_indexes(git_buf *out)
+{
+	git_buf path = GIT_BUF_INIT;
+
+	git_buf_clear(out);
+	cl_git_pass(git_buf_sets(&path, "split"));
+	cl_git_pass(git_path_direach(&path, 0, find_shared_cb, out));
+	git_buf_free(&path);
+}
+
+static git_off_t file_size(const char *path)
+{
+	struct stat st;
+
+	cl_must_pass(p_stat(path, &st));
+	return st.st_size;
+}
+
+/* the entries all live in the shared index, next to which the split
+ * index (holding little more than the tree cache) is tiny */
+static void assert_small_split_index(void)
+{
+	cl_assert(file_size("split/index") < file_size(TEST_INDEX2_PATH) / 16);
+}
+
+static void assert_same_entries(git_index *a, git_index *b)
+{
+	size_t i;
+
+	cl_assert_equal_sz(git_index_entrycount(a), git_index_entrycount(b));
+
+	for (i = 0; i < git_index_entrycount(a); ++i) {
+		const git_index_entry *x = git_index_get_byindex(a, i);
+		const git_index_entry *y = git_index_get_byindex(b, i);
+
+		cl_assert_equal_s(x->path, y->path);
+		cl_assert_equal_oid(&x->id, &y->id);
+		cl_assert_equal_i(x->mode, y->mode);
+		cl_assert_equal_i(x->mtime.seconds, y->mtime.seconds);
+	}
+}
+
+static void split_index(git_buf *shared)
+{
+	git_index *index;
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_assert(!git_index_is_split(index));
+	cl_git_pass(git_index_set_split(index, 1));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	shared_indexes(shared);
+	cl_assert(!git__prefixcmp(shared->ptr, "sharedindex."));
+	cl_assert(strchr(shared->ptr, ' ') == NULL);
+}
+
+void test_index_splitindex__can_write_and_read_split_index(void)
+{
+	git_buf shared = GIT_BUF_INIT;
+	git_index *index;
+
+	split_index(&shared);
+
+	/* all of the entries went to the shared index */
+	assert_small_split_index();
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_assert(git_index_is_split(index));
+	assert_same_entries(g_original, index);
+	git_index_free(index);
+
+	git_buf_free(&shared);
+}
+
+void test_index_splitindex__small_changes_only_write_split_index(void)
+{
+	git_buf shared = GIT_BUF_INIT, after = GIT_BUF_INIT;
+	git_index *index;
+	git_index_entry entry;
+	const git_index_entry *found;
+
+	split_index(&shared);
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+
+	/* a new entry, a changed one and a removed one */
+	memset(&entry, 0, sizeof(entry));
+	entry.path = "a_new_file.c";
+	entry.mode = GIT_FILEMODE_BLOB;
+	cl_git_pass(git_oid_fromstr(
+		&entry.id, "a5df5d2a85a4a8ad1b0d0a1e64e5e7f8c4b2c1a0"));
+	cl_git_pass(git_index_add(index, &entry));
+
+	cl_assert((found = git_index_get_bypath(index, "Makefile", 0)) != NULL);
+	memcpy(&entry, found, sizeof(entry));
+	entry.file_size++;
+	cl_git_pass(git_index_add(index, &entry));
+
+	cl_git_pass(git_index_remove(index, "decorate.h", 0));
+
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	/* the shared index is left alone */
+	shared_indexes(&after);
+	cl_assert_equal_s(shared.ptr, after.ptr);
+	assert_small_split_index();
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_assert_equal_sz(
+		git_index_entrycount(g_original), git_index_entrycount(index));
+
+	cl_assert(git_index_get_bypath(index, "a_new_file.c", 0) != NULL);
+	cl_assert(git_index_get_bypath(index, "decorate.h", 0) == NULL);
+	cl_assert((found = git_index_get_bypath(index, "Makefile", 0)) != NULL);
+	cl_assert_equal_i(
+		git_index_get_bypath(g_original, "Makefile", 0)->file_size + 1,
+		found->file_size);
+	cl_git_pass(git_vector_verify_sorted(&index->entries));
+
+	git_index_free(index);
+	git_buf_free(&shared);
+	git_buf_free(&after);
+}
+
+void test_index_splitindex__large_changes_rewrite_shared_index(void)
+{
+	git_buf shared = GIT_BUF_INIT, after = GIT_BUF_INIT;
+	git_index *index;
+	git_index_entry entry;
+	size_t i, count;
+	char path[64];
+
+	split_index(&shared);
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+
+	/* no more than 10% of the entries may live in the split index */
+	index->split_max_change = 10;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.path = path;
+
+	for (i = 0; i < git_index_entrycount(g_original) / 5; ++i) {
+		p_snprintf(path, sizeof(path), "zzz/%d.c", (int)i);
+		cl_git_pass(git_index_add(index, &entry));
+	}
+
+	count = git_index_entrycount(index);
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	/* there is a new shared index; the old one is kept for readers of
+	 * the previous split index */
+	shared_indexes(&after);
+	cl_assert(strchr(after.ptr, ' ') != NULL);
+	cl_assert(strstr(after.ptr, shared.ptr) != NULL);
+	assert_small_split_index();
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_assert_equal_sz(count, git_index_entrycount(index));
+	cl_assert(git_index_get_bypath(index, "zzz/0.c", 0) != NULL);
+	git_index_free(index);
+
+	git_buf_free(&shared);
+	git_buf_free(&after);
+}
+
+static void age_file(const char *name, time_t age)
+{
+	git_buf path = GIT_BUF_INIT;
+	struct utimbuf times;
+
+	cl_git_pass(git_buf_joinpath(&path, "split", name));
+	times.actime = times.modtime = time(NULL) - age;
+	cl_must_pass(utime(path.ptr, &times));
+	git_buf_free(&path);
+}
+
+void test_index_splitindex__expired_shared_indexes_are_removed(void)
+{
+	git_buf shared = GIT_BUF_INIT, after = GIT_BUF_INIT;
+	git_index *index;
+	git_index_entry entry;
+
+	split_index(&shared);
+
+	/* the old shared index was last written a day ago */
+	age_file(shared.ptr, 24 * 60 * 60);
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	index->split_max_change = 0;
+	index->split_shared_expire = 2 * 24 * 60 * 60;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.path = "zzz/first.c";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_git_pass(git_index_write(index));
+
+	/* it has not expired yet */
+	shared_indexes(&after);
+	cl_assert(strstr(after.ptr, shared.ptr) != NULL);
+
+	index->split_shared_expire = 60 * 60;
+
+	entry.path = "zzz/second.c";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	/* now it has, unlike the one written just before */
+	shared_indexes(&after);
+	cl_assert(strstr(after.ptr, shared.ptr) == NULL);
+	cl_assert(strchr(after.ptr, ' ') != NULL);
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_assert(git_index_get_bypath(index, "zzz/second.c", 0) != NULL);
+	git_index_free(index);
+
+	git_buf_free(&shared);
+	git_buf_free(&after);
+}
+
+void test_index_splitindex__can_unsplit(void)
+{
+	git_buf shared = GIT_BUF_INIT;
+	git_index *index;
+
+	split_index(&shared);
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_git_pass(git_index_set_split(index, 0));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_assert(file_size("split/index") > file_size(TEST_INDEX2_PATH) / 16);
+
+	cl_git_pass(git_index_open(&index, "split/index"));
+	cl_assert(!git_index_is_split(index));
+	assert_same_entries(g_original, index);
+	git_index_free(index);
+
+	git_buf_free(&shared);
+}
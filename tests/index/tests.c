@@ -563,3 +563,125 @@ void test_index_tests__reload_while_ignoring_case(void)
 
 	git_index_free(index);
 }
+
+static bool file_contains(const char *path, const char *needle)
+{
+	git_buf buf = GIT_BUF_INIT;
+	size_t i, len = strlen(needle);
+	bool found = false;
+
+	cl_git_pass(git_futils_readbuffer(&buf, path));
+
+	for (i = 0; !found && i + len <= buf.size; ++i)
+		found = !memcmp(buf.ptr + i, needle, len);
+
+	git_buf_free(&buf);
+	return found;
+}
+
+static void cleanup_index_threads(void *opaque)
+{
+	GIT_UNUSED(opaque);
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 0));
+	p_unlink("index_offsets");
+}
+
+void test_index_tests__write_entry_offsets(void)
+{
+	git_index *original, *index;
+	unsigned int threads;
+	size_t i;
+
+	cl_set_cleanup(&cleanup_index_threads, NULL);
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_GET_INDEX_THREADS, &threads));
+	cl_assert_equal_i(0, threads);
+
+	copy_file(TEST_INDEX2_PATH, "index_offsets");
+
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 4));
+
+	cl_git_pass(git_index_open(&index, "index_offsets"));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_assert(file_contains("index_offsets", "IEOT"));
+	cl_assert(file_contains("index_offsets", "EOIE"));
+
+	/* reading it back yields the same entries, in the same order */
+	cl_git_pass(git_index_open(&original, TEST_INDEX2_PATH));
+	cl_git_pass(git_index_open(&index, "index_offsets"));
+
+	cl_assert_equal_sz(
+		git_index_entrycount(original), git_index_entrycount(index));
+	cl_assert(git_vector_is_sorted(&index->entries));
+
+	for (i = 0; i < git_index_entrycount(index); ++i) {
+		const git_index_entry *a = git_index_get_byindex(original, i);
+		const git_index_entry *b = git_index_get_byindex(index, i);
+
+		cl_assert_equal_s(a->path, b->path);
+		cl_assert_equal_oid(&a->id, &b->id);
+		cl_assert_equal_i(a->mtime.seconds, b->mtime.seconds);
+	}
+
+	/* a single thread neither writes nor needs the offset table */
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 1));
+	cl_git_pass(git_index_read(index, true));
+	cl_assert_equal_sz(
+		git_index_entrycount(original), git_index_entrycount(index));
+	cl_git_pass(git_index_write(index));
+	cl_assert(!file_contains("index_offsets", "IEOT"));
+
+	git_index_free(original);
+	git_index_free(index);
+}
+
+void test_index_tests__add_many_out_of_order(void)
+{
+	git_index *index;
+	git_index_entry entry;
+	char path[64];
+	int i;
+
+	cl_git_pass(git_index_new(&index));
+
+	memset(&entry, 0, sizeof(entry));
+	entry.mode = GIT_FILEMODE_BLOB;
+	entry.path = path;
+
+	for (i = 999; i >= 0; --i) {
+		p_snprintf(path, sizeof(path), "dir%d/file%03d.c", i % 7, i);
+		cl_git_pass(git_index_add(index, &entry));
+	}
+
+	/* adding only appends; the entries are sorted when next needed */
+	cl_assert(!git_vector_is_sorted(&index->entries));
+	cl_assert(git_index_get_bypath(index, "dir3/file500.c", 0) != NULL);
+	cl_assert(git_index_get_bypath(index, "dir4/file500.c", 0) == NULL);
+	cl_assert(!git_vector_is_sorted(&index->entries));
+
+	/* re-adding an entry replaces it rather than duplicating it */
+	entry.file_size = 42;
+	entry.path = "dir3/file500.c";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert_equal_sz(1000, git_index_entrycount(index));
+	cl_assert_equal_i(
+		42, git_index_get_bypath(index, "dir3/file500.c", 0)->file_size);
+
+	cl_assert_equal_s("dir0/file000.c", git_index_get_byindex(index, 0)->path);
+	cl_git_pass(git_vector_verify_sorted(&index->entries));
+
+	/* entries appended in order keep the index sorted */
+	entry.path = "zzz.c";
+	cl_git_pass(git_index_add(index, &entry));
+	cl_assert(git_vector_is_sorted(&index->entries));
+
+	cl_git_pass(git_index_remove(index, "dir3/file500.c", 0));
+	cl_assert(git_index_get_bypath(index, "dir3/file500.c", 0) == NULL);
+	cl_git_fail_with(
+		GIT_ENOTFOUND, git_index_remove(index, "dir3/file500.c", 0));
+	cl_assert_equal_sz(1000, git_index_entrycount(index));
+
+	git_index_free(index);
+}
@@ -0,0 +1,129 @@
+#include "clar_libgit2.h"
+#include "index.h"
+
+#define TEST_INDEX2_PATH cl_fixture("gitgit.index")
+
+static git_repository *g_repo = NULL;
+
+void test_index_version__cleanup(void)
+{
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 0));
+	p_unlink("index_v4");
+
+	if (g_repo) {
+		cl_git_sandbox_cleanup();
+		g_repo = NULL;
+	}
+}
+
+static void assert_same_entries(git_index *a, git_index *b)
+{
+	size_t i;
+
+	cl_assert_equal_sz(git_index_entrycount(a), git_index_entrycount(b));
+
+	for (i = 0; i < git_index_entrycount(a); ++i) {
+		const git_index_entry *x = git_index_get_byindex(a, i);
+		const git_index_entry *y = git_index_get_byindex(b, i);
+
+		cl_assert_equal_s(x->path, y->path);
+		cl_assert_equal_oid(&x->id, &y->id);
+		cl_assert_equal_i(x->mode, y->mode);
+		cl_assert_equal_i(x->file_size, y->file_size);
+		cl_assert_equal_i(x->mtime.seconds, y->mtime.seconds);
+	}
+}
+
+static git_off_t file_size(const char *path)
+{
+	struct stat st;
+
+	cl_must_pass(p_stat(path, &st));
+	return st.st_size;
+}
+
+static void assert_rewrites_as_v4(void)
+{
+	git_index *original, *index;
+	git_off_t v2_size;
+
+	cl_git_pass(git_index_open(&original, TEST_INDEX2_PATH));
+	cl_assert_equal_i(2, git_index_version(original));
+
+	cl_git_pass(git_index_open(&index, "index_v4"));
+	assert_same_entries(original, index);
+	v2_size = file_size("index_v4");
+
+	cl_git_pass(git_index_set_version(index, 4));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	/* prefix compression makes the index noticeably smaller */
+	cl_assert(file_size("index_v4") < v2_size);
+
+	cl_git_pass(git_index_open(&index, "index_v4"));
+	cl_assert_equal_i(4, git_index_version(index));
+	assert_same_entries(original, index);
+
+	git_index_free(original);
+	git_index_free(index);
+}
+
+void test_index_version__can_write_v4(void)
+{
+	cl_git_pass(git_futils_cp(TEST_INDEX2_PATH, "index_v4", 0644));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 1));
+
+	assert_rewrites_as_v4();
+}
+
+void test_index_version__can_write_v4_with_entry_offsets(void)
+{
+	cl_git_pass(git_futils_cp(TEST_INDEX2_PATH, "index_v4", 0644));
+	cl_git_pass(git_libgit2_opts(GIT_OPT_SET_INDEX_THREADS, 4));
+
+	assert_rewrites_as_v4();
+}
+
+void test_index_version__rejects_unknown_versions(void)
+{
+	git_index *index;
+
+	cl_git_pass(git_index_new(&index));
+	cl_assert_equal_i(2, git_index_version(index));
+
+	cl_git_fail(git_index_set_version(index, 1));
+	cl_git_fail(git_index_set_version(index, 5));
+	cl_assert_equal_i(2, git_index_version(index));
+
+	cl_git_pass(git_index_set_version(index, 3));
+	cl_assert_equal_i(3, git_index_version(index));
+
+	git_index_free(index);
+}
+
+void test_index_version__new_index_uses_configured_version(void)
+{
+	git_config *cfg;
+	git_index *index;
+
+	g_repo = cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_int32(cfg, "index.version", 4));
+	git_config_free(cfg);
+
+	cl_git_mkfile("empty_standard_repo/one.txt", "one\n");
+
+	cl_git_pass(git_repository_index(&index, g_repo));
+	cl_assert_equal_i(4, git_index_version(index));
+	cl_git_pass(git_index_add_bypath(index, "one.txt"));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+
+	cl_git_pass(git_index_open(&index, "empty_standard_repo/.git/index"));
+	cl_assert_equal_i(4, git_index_version(index));
+	cl_assert_equal_sz(1, git_index_entrycount(index));
+	cl_assert_equal_s("one.txt", git_index_get_byindex(index, 0)->path);
+	git_index_free(index);
+}
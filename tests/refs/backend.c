@@ -0,0 +1,53 @@
+#include "clar_libgit2.h"
+
+#include <stddef.h>
+#include "refdb.h"
+#include "git2/sys/refdb_backend.h"
+
+static git_repository *g_repo;
+
+void test_refs_backend__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo.git");
+}
+
+void test_refs_backend__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+void test_refs_backend__checks_version(void)
+{
+	git_refdb *refdb;
+	git_refdb_backend backend = GIT_REFDB_BACKEND_INIT;
+	const git_error *err;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+
+	backend.version = 1024;
+	cl_git_fail(git_refdb_set_backend(refdb, &backend));
+	err = giterr_last();
+	cl_assert_equal_i(GITERR_INVALID, err->klass);
+
+	git_refdb_free(refdb);
+}
+
+void test_refs_backend__version_1_has_no_new_callbacks(void)
+{
+	git_refdb *refdb;
+	git_refdb_backend *backend;
+
+	/* a backend built against version 1 ends before `transaction` */
+	backend = git__calloc(1, offsetof(git_refdb_backend, transaction));
+	cl_assert(backend);
+	backend->version = 1;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_set_backend(refdb, backend));
+
+	cl_git_pass(git_refdb_snapshot_begin(refdb));
+	git_refdb_snapshot_end(refdb);
+	cl_git_fail(git_refdb_transaction(refdb, NULL, 0));
+
+	git_refdb_free(refdb);
+}
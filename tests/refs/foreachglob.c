@@ -72,6 +72,20 @@ void test_refs_foreachglob__retrieve_partially_named_references(void)
 	assert_retrieval("*test*", 4);
 }
 
+void test_refs_foreachglob__retrieve_by_literal_prefix(void)
+{
+	/* refs/heads/packed is only packed, refs/heads/packed-test is both */
+	assert_retrieval("refs/heads/pa*", 2);
+	assert_retrieval("refs/heads/packed", 1);
+	assert_retrieval("refs/tags/?est", 1);
+	assert_retrieval("refs/remotes/nulltoken/*", 1);
+}
+
+void test_refs_foreachglob__retrieve_from_missing_directory(void)
+{
+	assert_retrieval("refs/missing/*", 0);
+	assert_retrieval("refs/heads/packed/*", 0);
+}
 
 static int interrupt_cb(const char *reference_name, void *payload)
 {
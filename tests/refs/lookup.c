@@ -58,3 +58,58 @@ void test_refs_lookup__namespace(void)
 	error = git_reference_lookup(&ref, g_repo, "refs/heads/");
 	cl_assert_equal_i(error, GIT_EINVALIDSPEC);
 }
+
+static void assert_master(const char *sha)
+{
+	git_oid id;
+
+	cl_git_pass(git_reference_name_to_id(&id, g_repo, "refs/heads/master"));
+	cl_assert_equal_i(0, git_oid_streq(&id, sha));
+}
+
+void test_refs_lookup__sees_loose_refs_changed_on_disk(void)
+{
+	assert_master("a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+
+	cl_git_rewritefile("testrepo.git/refs/heads/master",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f\n");
+	assert_master("a4a7dce85cf63874e984719f4fdd239f5145052f");
+}
+
+void test_refs_lookup__snapshot_scope_serves_refs_from_memory(void)
+{
+	git_refdb *refdb;
+	git_reference *ref;
+	git_oid id;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_snapshot_begin(refdb));
+
+	assert_master("a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/heads/scoped"));
+
+	/* changes behind our back are not looked for */
+	cl_git_rewritefile("testrepo.git/refs/heads/master",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f\n");
+	cl_git_rewritefile("testrepo.git/refs/heads/scoped",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f\n");
+	assert_master("a65fedf39aefe402d3bb6e24df4d4f5fe4547750");
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/heads/scoped"));
+
+	/* but our own are */
+	cl_git_pass(git_oid_fromstr(&id, "be3563ae3f795b2b4353bcce3a527ad0a4f7f644"));
+	cl_git_pass(git_reference_create(&ref, g_repo, "refs/heads/master", &id, 1, NULL, NULL));
+	git_reference_free(ref);
+	assert_master("be3563ae3f795b2b4353bcce3a527ad0a4f7f644");
+
+	git_refdb_snapshot_end(refdb);
+
+	cl_git_rewritefile("testrepo.git/refs/heads/master",
+		"a4a7dce85cf63874e984719f4fdd239f5145052f\n");
+	assert_master("a4a7dce85cf63874e984719f4fdd239f5145052f");
+	cl_git_pass(git_reference_name_to_id(&id, g_repo, "refs/heads/scoped"));
+
+	git_refdb_free(refdb);
+}
@@ -0,0 +1,191 @@
+#include "clar_libgit2.h"
+
+#include "fileops.h"
+#include "git2/refdb.h"
+#include "refdb.h"
+#include "refs.h"
+
+#define FIRST_ID "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9"
+#define OTHER_ID "5b5b025afb0b4c913b4c338a42934a3863bf3644"
+#define PEEL_ID  "e90810b8df3e80c413d903f631643c716887138d"
+
+static git_repository *g_repo;
+
+void test_refs_packed__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo");
+}
+
+void test_refs_packed__cleanup(void)
+{
+	cl_git_sandbox_cleanup();
+}
+
+/* numbered refs "refs/packed/000" and up, in sorted order */
+static void write_packed_refs(const char *header, int count, const char *tail)
+{
+	git_buf content = GIT_BUF_INIT;
+	int i;
+
+	cl_git_pass(git_buf_puts(&content, header));
+	for (i = 0; i < count; ++i)
+		cl_git_pass(git_buf_printf(
+			&content, "%s refs/packed/%03d\n", i % 2 ? OTHER_ID : FIRST_ID, i));
+	cl_git_pass(git_buf_puts(&content, tail));
+
+	cl_git_rewritefile("testrepo/.git/packed-refs", content.ptr);
+	git_buf_free(&content);
+}
+
+static void assert_packed(const char *name, const char *id)
+{
+	git_reference *ref;
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, name));
+	cl_assert_equal_i(0, git_oid_streq(git_reference_target(ref), id));
+	git_reference_free(ref);
+}
+
+static int packed_exists(const char *name)
+{
+	git_refdb *refdb;
+	int exists;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_exists(&exists, refdb, name));
+	git_refdb_free(refdb);
+
+	return exists;
+}
+
+static int count_cb(const char *name, void *payload)
+{
+	GIT_UNUSED(name);
+	(*(int *)payload)++;
+	return 0;
+}
+
+void test_refs_packed__lookup_in_sorted_file(void)
+{
+	git_reference *ref;
+	int count = 0;
+	char name[32];
+	int i;
+
+	write_packed_refs("# pack-refs with: peeled fully-peeled sorted \n", 301, "");
+
+	for (i = 0; i < 301; ++i) {
+		p_snprintf(name, sizeof(name), "refs/packed/%03d", i);
+		assert_packed(name, i % 2 ? OTHER_ID : FIRST_ID);
+	}
+
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/packed/1500"));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/packed/00"));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/packed/301"));
+
+	cl_assert(packed_exists("refs/packed/150"));
+	cl_assert(!packed_exists("refs/packed/15"));
+
+	cl_git_pass(git_reference_foreach_glob(
+		g_repo, "refs/packed/1*", count_cb, &count));
+	cl_assert_equal_i(100, count);
+}
+
+void test_refs_packed__unsorted_files_are_sorted_when_loaded(void)
+{
+	git_reference *ref;
+	git_reference_iterator *iter;
+	const char *name;
+	static const char *expected[] = {
+		"refs/packed/a", "refs/packed/b", "refs/packed/c", NULL
+	};
+	int i = 0;
+
+	cl_git_rewritefile("testrepo/.git/packed-refs",
+		"# pack-refs with: peeled \n"
+		OTHER_ID " refs/packed/c\n"
+		FIRST_ID " refs/packed/a\n"
+		OTHER_ID " refs/packed/b\n"
+		"^" PEEL_ID);
+
+	assert_packed("refs/packed/a", FIRST_ID);
+	assert_packed("refs/packed/c", OTHER_ID);
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/packed/b"));
+	cl_assert_equal_i(0, git_oid_streq(git_reference_target_peel(ref), PEEL_ID));
+	git_reference_free(ref);
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, "refs/packed/*"));
+	while (!git_reference_next_name(&name, iter))
+		cl_assert_equal_s(expected[i++], name);
+	cl_assert_equal_p(NULL, expected[i]);
+	git_reference_iterator_free(iter);
+}
+
+void test_refs_packed__only_the_records_looked_at_are_parsed(void)
+{
+	git_reference *ref;
+	int count = 0;
+
+	write_packed_refs("# pack-refs with: peeled fully-peeled sorted \n",
+		64, "not a record\n");
+
+	assert_packed("refs/packed/000", FIRST_ID);
+	assert_packed("refs/packed/031", OTHER_ID);
+
+	cl_git_fail(git_reference_foreach_glob(
+		g_repo, "refs/packed/*", count_cb, &count));
+
+	/* without the trait, the whole file has to be checked */
+	write_packed_refs("# pack-refs with: peeled fully-peeled \n",
+		64, "not a record\n");
+	cl_git_fail(git_reference_lookup(&ref, g_repo, "refs/packed/000"));
+}
+
+void test_refs_packed__new_refs_cannot_collide_with_packed_ones(void)
+{
+	git_reference *ref, *renamed;
+	git_oid id;
+
+	write_packed_refs("# pack-refs with: peeled fully-peeled sorted \n", 20, "");
+	cl_git_pass(git_oid_fromstr(&id, FIRST_ID));
+
+	cl_git_fail(git_reference_create(
+		&ref, g_repo, "refs/packed/010/child", &id, 0, NULL, NULL));
+	cl_git_fail(git_reference_create(
+		&ref, g_repo, "refs/packed", &id, 0, NULL, NULL));
+
+	cl_git_pass(git_reference_create(
+		&ref, g_repo, "refs/packed/01", &id, 0, NULL, NULL));
+	git_reference_free(ref);
+
+	/* a ref may only be renamed into its own directory */
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/packed/010"));
+	cl_git_fail(git_reference_rename(
+		&renamed, ref, "refs/packed/011/child", 0, NULL, NULL));
+	cl_git_pass(git_reference_rename(
+		&renamed, ref, "refs/packed/010/child", 0, NULL, NULL));
+	git_reference_free(renamed);
+	git_reference_free(ref);
+}
+
+void test_refs_packed__written_file_is_marked_sorted(void)
+{
+	git_refdb *refdb;
+	git_buf content = GIT_BUF_INIT;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_compress(refdb));
+	git_refdb_free(refdb);
+
+	cl_git_pass(git_futils_readbuffer(&content, "testrepo/.git/packed-refs"));
+	cl_assert(git__prefixcmp(content.ptr, GIT_PACKEDREFS_HEADER) == 0);
+	cl_assert(strstr(content.ptr, " sorted ") != NULL);
+	git_buf_free(&content);
+
+	assert_packed("refs/heads/packed", FIRST_ID);
+	cl_assert(packed_exists("refs/heads/master"));
+}
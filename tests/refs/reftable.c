@@ -0,0 +1,388 @@
+#include "clar_libgit2.h"
+
+#include "fileops.h"
+#include "git2/reflog.h"
+#include "git2/sys/refdb_backend.h"
+#include "git2/transaction.h"
+#include "reflog.h"
+
+#define MASTER_ID "a65fedf39aefe402d3bb6e24df4d4f5fe4547750"
+#define OTHER_ID  "5b5b025afb0b4c913b4c338a42934a3863bf3644"
+#define LIST_PATH "testrepo.git/libgit2-reftable/tables.list"
+
+static git_repository *g_repo;
+static git_signature *g_sig;
+
+void test_refs_reftable__initialize(void)
+{
+	git_config *cfg;
+
+	g_repo = cl_git_sandbox_init("testrepo.git");
+
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_set_string(cfg, "libgit2.refstorage", "reftable"));
+	cl_git_pass(git_config_set_bool(cfg, "core.logallrefupdates", true));
+	git_config_free(cfg);
+
+	g_repo = cl_git_sandbox_reopen();
+
+	cl_git_pass(git_signature_new(&g_sig, "Reftable", "ref@table", 1234567890, 60));
+}
+
+void test_refs_reftable__cleanup(void)
+{
+	git_signature_free(g_sig);
+	cl_git_sandbox_cleanup();
+}
+
+static int count_cb(const char *name, void *payload)
+{
+	GIT_UNUSED(name);
+	(*(int *)payload)++;
+	return 0;
+}
+
+static size_t table_count(void)
+{
+	git_buf list = GIT_BUF_INIT;
+	size_t i, count = 0;
+
+	cl_git_pass(git_futils_readbuffer(&list, LIST_PATH));
+	for (i = 0; i < list.size; ++i)
+		count += (list.ptr[i] == '\n');
+	git_buf_free(&list);
+
+	return count;
+}
+
+static void create_ref(const char *name, const char *id)
+{
+	git_reference *ref;
+	git_oid oid;
+
+	cl_git_pass(git_oid_fromstr(&oid, id));
+	cl_git_pass(git_reference_create(&ref, g_repo, name, &oid, 1, g_sig, NULL));
+	git_reference_free(ref);
+}
+
+static void assert_ref(const char *name, const char *id)
+{
+	git_reference *ref;
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, name));
+	cl_assert_equal_i(0, git_oid_streq(git_reference_target(ref), id));
+	git_reference_free(ref);
+}
+
+void test_refs_reftable__existing_refs_and_logs_are_imported(void)
+{
+	git_repository *files;
+	git_reference *head;
+	git_reflog *log;
+	git_buf content = GIT_BUF_INIT;
+	int count = 0, files_count = 0;
+
+	cl_git_pass(git_repository_open(&files, cl_fixture("testrepo.git")));
+	cl_git_pass(git_reference_foreach_name(files, count_cb, &files_count));
+	git_repository_free(files);
+
+	cl_git_pass(git_reference_foreach_name(g_repo, count_cb, &count));
+	cl_assert_equal_i(files_count, count);
+	cl_assert(git_path_isfile(LIST_PATH));
+
+	/* the imported files are gone, and HEAD leads nowhere without us */
+	cl_assert(!git_path_exists("testrepo.git/packed-refs"));
+	cl_assert(!git_path_exists("testrepo.git/refs/heads/master"));
+	cl_assert(!git_path_exists("testrepo.git/logs/refs/heads/master"));
+	cl_assert(git_path_isdir("testrepo.git/refs"));
+
+	cl_git_pass(git_futils_readbuffer(&content, "testrepo.git/HEAD"));
+	cl_assert_equal_s("ref: refs/heads/.invalid\n", content.ptr);
+	git_buf_free(&content);
+
+	cl_git_pass(git_reference_lookup(&head, g_repo, "HEAD"));
+	cl_assert_equal_s("refs/heads/master", git_reference_symbolic_target(head));
+	git_reference_free(head);
+
+	assert_ref("refs/heads/master", MASTER_ID);
+	assert_ref("refs/heads/packed", "41bc8c69075bbdb46c5c6f0566cc8cc5b46e8bd9");
+	assert_ref("refs/heads/packed-test", "4a202b346bb0fb0db7eff3cffeb3c70babbd2045");
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/master"));
+	cl_assert_equal_i(2, (int)git_reflog_entrycount(log));
+	git_reflog_free(log);
+
+	cl_assert(git_reference_has_log(g_repo, "refs/heads/br2"));
+	cl_assert(!git_reference_has_log(g_repo, "refs/tags/e90810b"));
+}
+
+void test_refs_reftable__git_is_locked_out_of_imported_repositories(void)
+{
+	git_repository *reinit;
+	git_config *cfg;
+	const char *value;
+	int32_t version;
+
+	/* the refs are imported with the first use of the refdb */
+	assert_ref("refs/heads/master", MASTER_ID);
+
+	/* git refuses format 1 repositories with extensions it does not know */
+	cl_git_pass(git_repository_config(&cfg, g_repo));
+	cl_git_pass(git_config_get_int32(
+		&version, cfg, "core.repositoryformatversion"));
+	cl_assert_equal_i(1, version);
+	cl_git_pass(git_config_get_string(
+		&value, cfg, "extensions.libgit2refstorage"));
+	cl_assert_equal_s("reftable", value);
+	git_config_free(cfg);
+
+	/* which libgit2 accepts, keeping the version when reinitializing */
+	cl_git_pass(git_repository_init(&reinit, "testrepo.git", 1));
+	cl_git_pass(git_repository_config(&cfg, reinit));
+	cl_git_pass(git_config_get_int32(
+		&version, cfg, "core.repositoryformatversion"));
+	cl_assert_equal_i(1, version);
+	git_config_free(cfg);
+	git_repository_free(reinit);
+
+	assert_ref("refs/heads/master", MASTER_ID);
+}
+
+void test_refs_reftable__updates_are_kept_across_reopens(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	create_ref("refs/heads/reftable", MASTER_ID);
+	create_ref("refs/heads/reftable", OTHER_ID);
+	cl_git_pass(git_reference_symbolic_create(
+		&ref, g_repo, "refs/heads/symbolic", "refs/heads/reftable", 0, NULL, NULL));
+	git_reference_free(ref);
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/br2"));
+	cl_git_pass(git_reference_delete(ref));
+	git_reference_free(ref);
+
+	g_repo = cl_git_sandbox_reopen();
+
+	assert_ref("refs/heads/reftable", OTHER_ID);
+	cl_git_pass(git_reference_name_to_id(&id, g_repo, "refs/heads/symbolic"));
+	cl_assert_equal_i(0, git_oid_streq(&id, OTHER_ID));
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_lookup(&ref, g_repo, "refs/heads/br2"));
+
+	/* the same rules as for the files apply */
+	cl_git_pass(git_oid_fromstr(&id, MASTER_ID));
+	cl_assert_equal_i(GIT_EEXISTS, git_reference_create(
+		&ref, g_repo, "refs/heads/reftable", &id, 0, NULL, NULL));
+	cl_git_fail(git_reference_create(
+		&ref, g_repo, "refs/heads/reftable/child", &id, 1, NULL, NULL));
+	cl_git_fail(git_reference_create(
+		&ref, g_repo, "refs/heads", &id, 1, NULL, NULL));
+}
+
+void test_refs_reftable__stack_stays_logarithmic(void)
+{
+	char name[64];
+	int i;
+
+	for (i = 0; i < 128; ++i) {
+		p_snprintf(name, sizeof(name), "refs/heads/stack-%03d", i);
+		create_ref(name, i % 2 ? MASTER_ID : OTHER_ID);
+	}
+
+	cl_assert(table_count() <= 8);
+
+	for (i = 0; i < 128; ++i) {
+		p_snprintf(name, sizeof(name), "refs/heads/stack-%03d", i);
+		assert_ref(name, i % 2 ? MASTER_ID : OTHER_ID);
+	}
+}
+
+void test_refs_reftable__iterating_with_a_glob(void)
+{
+	git_reference_iterator *iter;
+	git_reference *ref;
+	const char *name;
+	static const char *expected[] = {
+		"refs/heads/glob-a", "refs/heads/glob-c", NULL
+	};
+	int i = 0, count = 0;
+
+	create_ref("refs/heads/glob-a", MASTER_ID);
+	create_ref("refs/heads/glob-b", MASTER_ID);
+	create_ref("refs/heads/glob-c", MASTER_ID);
+	create_ref("refs/heads/globe", MASTER_ID);
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/glob-b"));
+	cl_git_pass(git_reference_delete(ref));
+	git_reference_free(ref);
+
+	cl_git_pass(git_reference_iterator_glob_new(&iter, g_repo, "refs/heads/glob-*"));
+	while (!git_reference_next_name(&name, iter))
+		cl_assert_equal_s(expected[i++], name);
+	cl_assert_equal_p(NULL, expected[i]);
+	git_reference_iterator_free(iter);
+
+	cl_git_pass(git_reference_foreach_glob(g_repo, "refs/*/glob*", count_cb, &count));
+	cl_assert_equal_i(3, count);
+}
+
+void test_refs_reftable__reflogs(void)
+{
+	git_reference *ref, *renamed;
+	git_reflog *log;
+	const git_reflog_entry *entry;
+	git_oid id;
+
+	create_ref("refs/heads/logged", MASTER_ID);
+	create_ref("refs/heads/logged", OTHER_ID);
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/logged"));
+	cl_assert_equal_i(2, (int)git_reflog_entrycount(log));
+
+	entry = git_reflog_entry_byindex(log, 0);
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_old(entry), MASTER_ID));
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_new(entry), OTHER_ID));
+	cl_assert_equal_s("Reftable", git_reflog_entry_committer(entry)->name);
+	cl_assert_equal_i(60, git_reflog_entry_committer(entry)->when.offset);
+	cl_assert_equal_p(NULL, git_reflog_entry_message(entry));
+
+	/* rewriting the log drops the entries that are gone */
+	cl_git_pass(git_oid_fromstr(&id, MASTER_ID));
+	cl_git_pass(git_reflog_drop(log, 0, 1));
+	cl_git_pass(git_reflog_append(log, &id, g_sig, "appended"));
+	cl_git_pass(git_reflog_write(log));
+	git_reflog_free(log);
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/logged"));
+	cl_assert_equal_i(2, (int)git_reflog_entrycount(log));
+	cl_assert_equal_s("appended",
+		git_reflog_entry_message(git_reflog_entry_byindex(log, 0)));
+	git_reflog_free(log);
+
+	/* the log follows a renamed ref */
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "refs/heads/logged"));
+	cl_git_pass(git_reference_rename(
+		&renamed, ref, "refs/heads/renamed", 0, g_sig, "renamed"));
+	git_reference_free(ref);
+	git_reference_free(renamed);
+
+	cl_assert(!git_reference_has_log(g_repo, "refs/heads/logged"));
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/renamed"));
+	cl_assert_equal_i(3, (int)git_reflog_entrycount(log));
+	git_reflog_free(log);
+
+	cl_git_pass(git_reflog_delete(g_repo, "refs/heads/renamed"));
+	cl_assert(!git_reference_has_log(g_repo, "refs/heads/renamed"));
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/renamed"));
+	cl_assert_equal_i(0, (int)git_reflog_entrycount(log));
+	git_reflog_free(log);
+}
+
+void test_refs_reftable__updating_a_branch_logs_its_head(void)
+{
+	git_reflog *log;
+	size_t before;
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "HEAD"));
+	before = git_reflog_entrycount(log);
+	git_reflog_free(log);
+
+	create_ref("refs/heads/master", OTHER_ID);
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "HEAD"));
+	cl_assert_equal_i((int)before + 1, (int)git_reflog_entrycount(log));
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_new(
+		git_reflog_entry_byindex(log, 0)), OTHER_ID));
+	git_reflog_free(log);
+}
+
+void test_refs_reftable__compress_merges_all_tables(void)
+{
+	git_refdb *refdb;
+	git_reflog *log;
+	char name[64];
+	int i, count = 0;
+
+	/* enough refs for several blocks and an index */
+	for (i = 0; i < 1000; ++i) {
+		p_snprintf(name, sizeof(name), "refs/tags/many/%04d", i);
+		create_ref(name, i % 3 ? MASTER_ID : OTHER_ID);
+	}
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_compress(refdb));
+	git_refdb_free(refdb);
+
+	cl_assert_equal_i(1, (int)table_count());
+
+	for (i = 0; i < 1000; i += 7) {
+		p_snprintf(name, sizeof(name), "refs/tags/many/%04d", i);
+		assert_ref(name, i % 3 ? MASTER_ID : OTHER_ID);
+	}
+
+	cl_git_pass(git_reference_foreach_glob(
+		g_repo, "refs/tags/many/05*", count_cb, &count));
+	cl_assert_equal_i(100, count);
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/master"));
+	cl_assert_equal_i(2, (int)git_reflog_entrycount(log));
+	git_reflog_free(log);
+}
+
+void test_refs_reftable__pseudorefs_stay_files(void)
+{
+	create_ref("ORIG_HEAD", OTHER_ID);
+
+	cl_assert(git_path_isfile("testrepo.git/ORIG_HEAD"));
+	assert_ref("ORIG_HEAD", OTHER_ID);
+}
+
+void test_refs_reftable__writes_fail_while_the_stack_is_locked(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	/* the stack is only set up once the refs are needed */
+	assert_ref("refs/heads/master", MASTER_ID);
+
+	cl_git_mkfile(LIST_PATH ".lock", "");
+	cl_git_pass(git_oid_fromstr(&id, MASTER_ID));
+
+	cl_assert_equal_i(GIT_ELOCKED, git_reference_create(
+		&ref, g_repo, "refs/heads/locked", &id, 0, NULL, NULL));
+
+	assert_ref("refs/heads/master", MASTER_ID);
+}
+
+void test_refs_reftable__transactions_add_a_single_table(void)
+{
+	git_transaction *tx;
+	git_oid id;
+	size_t tables;
+
+	assert_ref("refs/heads/master", MASTER_ID);
+	tables = table_count();
+
+	cl_git_pass(git_oid_fromstr(&id, OTHER_ID));
+	cl_git_pass(git_transaction_new(&tx, g_repo));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_lock_ref(tx, "refs/heads/tx-new"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/master", &id, g_sig, "tx"));
+	cl_git_pass(git_transaction_set_target(tx, "refs/heads/tx-new", &id, g_sig, "tx"));
+	cl_git_pass(git_transaction_remove(tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_commit(tx));
+
+	/* committing again finds the refs changed */
+	cl_git_fail_with(GIT_EMODIFIED, git_transaction_commit(tx));
+	git_transaction_free(tx);
+
+	cl_assert(table_count() <= tables + 1);
+	assert_ref("refs/heads/master", OTHER_ID);
+	assert_ref("refs/heads/tx-new", OTHER_ID);
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_reference_name_to_id(&id, g_repo, "refs/heads/br2"));
+}
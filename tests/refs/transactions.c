@@ -0,0 +1,228 @@
+#include "clar_libgit2.h"
+#include "fileops.h"
+#include "git2/reflog.h"
+#include "git2/sys/refdb_backend.h"
+#include "git2/transaction.h"
+
+static const char *commit_id = "099fabac3a9ea935598528c27f866e34089c2eff";
+static const char *other_commit_id = "a65fedf39aefe402d3bb6e24df4d4f5fe4547750";
+
+static git_repository *g_repo;
+static git_transaction *g_tx;
+
+void test_refs_transactions__initialize(void)
+{
+	g_repo = cl_git_sandbox_init("testrepo");
+	cl_git_pass(git_transaction_new(&g_tx, g_repo));
+}
+
+void test_refs_transactions__cleanup(void)
+{
+	git_transaction_free(g_tx);
+	cl_git_sandbox_cleanup();
+}
+
+static void assert_ref(const char *name, const char *sha)
+{
+	git_oid id, expected;
+
+	git_oid_fromstr(&expected, sha);
+	cl_git_pass(git_reference_name_to_id(&id, g_repo, name));
+	cl_assert(git_oid_equal(&expected, &id));
+}
+
+void test_refs_transactions__updates_several_refs(void)
+{
+	git_oid id;
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/tx-new"));
+
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, "tx"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/packed", &id, NULL, "tx"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/tx-new", &id, NULL, "tx"));
+	cl_git_pass(git_transaction_commit(g_tx));
+
+	assert_ref("refs/heads/master", other_commit_id);
+	assert_ref("refs/heads/packed", other_commit_id);
+	assert_ref("refs/heads/tx-new", other_commit_id);
+
+	/* the direct references went into packed-refs */
+	cl_assert(!git_path_exists("testrepo/.git/refs/heads/master"));
+	cl_assert(!git_path_exists("testrepo/.git/refs/heads/tx-new"));
+}
+
+void test_refs_transactions__nothing_changes_if_a_ref_was_modified(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/packed", &id, NULL, NULL));
+
+	/* somebody else moves one of the locked refs */
+	git_oid_fromstr(&id, commit_id);
+	cl_git_pass(git_reference_create(&ref, g_repo, "refs/heads/packed", &id, 1, NULL, NULL));
+	git_reference_free(ref);
+
+	cl_git_fail_with(GIT_EMODIFIED, git_transaction_commit(g_tx));
+
+	assert_ref("refs/heads/master", commit_id);
+	assert_ref("refs/heads/packed", commit_id);
+}
+
+void test_refs_transactions__a_new_ref_must_not_appear(void)
+{
+	git_reference *ref;
+	git_oid id;
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/tx-new"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/tx-new", &id, NULL, NULL));
+
+	cl_git_pass(git_reference_create(&ref, g_repo, "refs/heads/tx-new", &id, 0, NULL, NULL));
+	git_reference_free(ref);
+
+	cl_git_fail_with(GIT_EMODIFIED, git_transaction_commit(g_tx));
+}
+
+void test_refs_transactions__refs_must_be_locked(void)
+{
+	git_oid id;
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+	cl_git_fail_with(GIT_ENOTFOUND,
+		git_transaction_remove(g_tx, "refs/heads/master"));
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_fail_with(GIT_ELOCKED,
+		git_transaction_lock_ref(g_tx, "refs/heads/master"));
+}
+
+void test_refs_transactions__remove_and_symbolic(void)
+{
+	git_reference *ref;
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "HEAD"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/br2"));
+
+	cl_git_pass(git_transaction_set_symbolic_target(g_tx, "HEAD", "refs/heads/br2", NULL, NULL));
+	cl_git_pass(git_transaction_remove(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_remove(g_tx, "refs/heads/br2"));
+	cl_git_pass(git_transaction_commit(g_tx));
+
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/packed"));
+	cl_git_fail_with(GIT_ENOTFOUND, git_reference_lookup(&ref, g_repo, "refs/heads/br2"));
+
+	cl_git_pass(git_reference_lookup(&ref, g_repo, "HEAD"));
+	cl_assert_equal_s("refs/heads/br2", git_reference_symbolic_target(ref));
+	git_reference_free(ref);
+}
+
+void test_refs_transactions__new_refs_must_not_collide(void)
+{
+	git_oid id;
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/tx"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/tx/nested"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/tx", &id, NULL, NULL));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/tx/nested", &id, NULL, NULL));
+
+	cl_git_fail(git_transaction_commit(g_tx));
+}
+
+void test_refs_transactions__logs_the_old_and_new_values(void)
+{
+	git_reflog *log;
+	const git_reflog_entry *entry;
+	size_t head_entries;
+	git_oid id;
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "HEAD"));
+	head_entries = git_reflog_entrycount(log);
+	git_reflog_free(log);
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, "tx"));
+	cl_git_pass(git_transaction_commit(g_tx));
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/master"));
+	entry = git_reflog_entry_byindex(log, 0);
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_old(entry), commit_id));
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_new(entry), other_commit_id));
+	cl_assert_equal_s("tx", git_reflog_entry_message(entry));
+	git_reflog_free(log);
+
+	/* HEAD points to master, so its log has the entry too */
+	cl_git_pass(git_reflog_read(&log, g_repo, "HEAD"));
+	cl_assert_equal_i((int)head_entries + 1, (int)git_reflog_entrycount(log));
+	entry = git_reflog_entry_byindex(log, 0);
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_old(entry), commit_id));
+	cl_assert_equal_i(0, git_oid_streq(git_reflog_entry_id_new(entry), other_commit_id));
+	git_reflog_free(log);
+}
+
+void test_refs_transactions__failed_commits_are_not_logged(void)
+{
+	git_reference *ref;
+	git_reflog *log;
+	size_t entries;
+	git_oid id;
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/master"));
+	entries = git_reflog_entrycount(log);
+	git_reflog_free(log);
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/packed"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/packed", &id, NULL, NULL));
+
+	cl_git_pass(git_reference_create(&ref, g_repo, "refs/heads/packed", &id, 1, NULL, NULL));
+	git_reference_free(ref);
+
+	cl_git_fail_with(GIT_EMODIFIED, git_transaction_commit(g_tx));
+
+	cl_git_pass(git_reflog_read(&log, g_repo, "refs/heads/master"));
+	cl_assert_equal_i((int)entries, (int)git_reflog_entrycount(log));
+	git_reflog_free(log);
+}
+
+void test_refs_transactions__backends_must_support_them(void)
+{
+	git_refdb *refdb;
+	git_refdb_backend *backend;
+	git_oid id;
+
+	cl_git_pass(git_repository_refdb(&refdb, g_repo));
+	cl_git_pass(git_refdb_backend_fs(&backend, g_repo));
+	backend->transaction = NULL;
+	cl_git_pass(git_refdb_set_backend(refdb, backend));
+	git_refdb_free(refdb);
+
+	git_oid_fromstr(&id, other_commit_id);
+
+	cl_git_pass(git_transaction_lock_ref(g_tx, "refs/heads/master"));
+	cl_git_pass(git_transaction_set_target(g_tx, "refs/heads/master", &id, NULL, NULL));
+	cl_git_fail(git_transaction_commit(g_tx));
+
+	assert_ref("refs/heads/master", commit_id);
+}
@@ -415,6 +415,138 @@ void test_repo_iterator__tree_more(void)
 	git_tree_free(head);
 }
 
+static void set_prefixes(
+	git_iterator *i, git_pathspec_prefixes *pp, const char *a, const char *b)
+{
+	git_vector vspec = GIT_VECTOR_INIT;
+	git_pool pool;
+	char *strings[2];
+	git_strarray paths;
+
+	strings[0] = (char *)a;
+	strings[1] = (char *)b;
+	paths.strings = strings;
+	paths.count = 2;
+
+	cl_git_pass(git_pool_init(&pool, 1, 0));
+	cl_git_pass(git_pathspec__vinit(&vspec, &paths, &pool));
+	cl_git_pass(git_pathspec__prefixes_init(pp, &vspec, false));
+	git_pathspec__vfree(&vspec);
+	git_pool_clear(&pool);
+
+	git_iterator_set_prefixes(i, pp);
+	cl_git_pass(git_iterator_reset(i, NULL, NULL));
+}
+
+void test_repo_iterator__prefixes_skip_unmatched_paths(void)
+{
+	git_iterator *i;
+	git_tree *head;
+	git_index *index;
+	git_pathspec_prefixes pp;
+	static const char *expect_flat[] = {
+		"current_file", "subdir/deleted_file", NULL
+	};
+	static const char *expect_trees[] = {
+		"current_file", "subdir/", "subdir/deleted_file", NULL
+	};
+	static const char *expect_noauto[] = {
+		"current_file", "subdir/", NULL
+	};
+	static const char *expect_root[] = { "current_file", NULL };
+
+	g_repo = cl_git_sandbox_init("status");
+
+	cl_git_pass(git_repository_head_tree(&head, g_repo));
+	cl_git_pass(git_repository_index(&index, g_repo));
+
+	cl_git_pass(git_iterator_for_tree(&i, head, 0, NULL, NULL));
+	set_prefixes(i, &pp, "subdir/d*", "current_file");
+	expect_iterator_items(i, 2, expect_flat, 2, expect_flat);
+	git_iterator_free(i);
+	git_pathspec__prefixes_free(&pp);
+
+	cl_git_pass(git_iterator_for_tree(
+		&i, head, GIT_ITERATOR_INCLUDE_TREES, NULL, NULL));
+	set_prefixes(i, &pp, "subdir/d*", "current_file");
+	expect_iterator_items(i, 3, expect_trees, 3, expect_trees);
+	git_iterator_free(i);
+	git_pathspec__prefixes_free(&pp);
+
+	/* a subtree without any wanted entries cannot be entered */
+	cl_git_pass(git_iterator_for_tree(&i, head, 0, NULL, NULL));
+	set_prefixes(i, &pp, "subdir/z*", "current_file");
+	expect_iterator_items(i, 1, expect_root, 1, expect_root);
+	git_iterator_free(i);
+	git_pathspec__prefixes_free(&pp);
+
+	cl_git_pass(git_iterator_for_tree(
+		&i, head, GIT_ITERATOR_DONT_AUTOEXPAND, NULL, NULL));
+	set_prefixes(i, &pp, "subdir/z*", "current_file");
+	expect_iterator_items(i, 2, expect_noauto, 2, expect_noauto);
+	git_iterator_free(i);
+	git_pathspec__prefixes_free(&pp);
+
+	cl_git_pass(git_iterator_for_index(&i, index, 0, NULL, NULL));
+	set_prefixes(i, &pp, "subdir/d*", "current_file");
+	expect_iterator_items(i, 2, expect_flat, 2, expect_flat);
+	git_iterator_free(i);
+	git_pathspec__prefixes_free(&pp);
+
+	cl_git_pass(git_iterator_for_workdir(&i, g_repo, 0, NULL, NULL));
+	set_prefixes(i, &pp, "subdir/d*", "current_file");
+	expect_iterator_items(i, 1, expect_root, 1, expect_root);
+	git_iterator_free(i);
+	git_pathspec__prefixes_free(&pp);
+
+	git_index_free(index);
+	git_tree_free(head);
+}
+
+void test_repo_iterator__tree_skips_listed_subtrees(void)
+{
+	git_iterator *i;
+	git_object *obj;
+	git_tree *tree;
+	git_vector skipped = GIT_VECTOR_INIT;
+	static const char *expect_nested[] = {
+		"README", "ab/4.txt", "ab/c/3.txt", "branch_file.txt", "new.txt", NULL
+	};
+	static const char *expect_top[] = {
+		"README", "branch_file.txt", "new.txt", NULL
+	};
+
+	g_repo = cl_git_sandbox_init("testrepo");
+
+	cl_git_pass(git_revparse_single(&obj, g_repo, "subtrees^{tree}"));
+	tree = (git_tree *)obj;
+
+	cl_git_pass(git_vector_init(&skipped, 2, git__strcmp_cb));
+	cl_git_pass(git_vector_insert(&skipped, "ab/de"));
+
+	cl_git_pass(git_iterator_for_tree(&i, tree, 0, NULL, NULL));
+	cl_assert(git_iterator_get_tree(i) == tree);
+	git_iterator_skip_trees(i, &skipped);
+	cl_git_pass(git_iterator_reset(i, NULL, NULL));
+	expect_iterator_items(i, 5, expect_nested, 5, expect_nested);
+
+	/* subtrees are matched by their whole path */
+	git_vector_clear(&skipped);
+	cl_git_pass(git_vector_insert(&skipped, "a"));
+	cl_git_pass(git_vector_insert(&skipped, "ab"));
+	git_vector_sort(&skipped);
+	cl_git_pass(git_iterator_reset(i, NULL, NULL));
+	expect_iterator_items(i, 3, expect_top, 3, expect_top);
+
+	git_iterator_skip_trees(i, NULL);
+	cl_git_pass(git_iterator_reset(i, NULL, NULL));
+	expect_iterator_items(i, 7, NULL, 7, NULL);
+	git_iterator_free(i);
+
+	git_vector_free(&skipped);
+	git_tree_free(tree);
+}
+
 /* "b=name,t=name", blob_id, tree_id */
 static void build_test_tree(
 	git_oid *out, git_repository *repo, const char *fmt, ...)
@@ -1,6 +1,7 @@
 #include "clar_libgit2.h"
 #include "fileops.h"
 #include "sysdir.h"
+#include "git2/sys/repository.h"
 #include <ctype.h>
 
 void test_repo_open__cleanup(void)
@@ -377,3 +378,87 @@ void test_repo_open__force_bare(void)
 	cl_assert(git_repository_is_bare(barerepo));
 	git_repository_free(barerepo);
 }
+
+void test_repo_open__lazy_open_defers_config(void)
+{
+	git_repository *repo;
+	git_repository_perfdata perf = GIT_REPOSITORY_PERFDATA_INIT;
+	int unborn;
+
+	cl_git_sandbox_init("empty_standard_repo");
+
+	cl_git_pass(git_repository_open_ext(
+		&repo, "empty_standard_repo", GIT_REPOSITORY_OPEN_LAZY, NULL));
+
+	cl_git_pass(git_repository_get_perfdata(&perf, repo));
+	cl_assert_equal_sz(0, perf.config_loads);
+	cl_assert_equal_sz(0, perf.refdb_loads);
+
+	cl_assert((unborn = git_repository_head_unborn(repo)) >= 0);
+	cl_git_pass(git_repository_get_perfdata(&perf, repo));
+	cl_assert_equal_sz(1, perf.refdb_loads);
+	cl_assert_equal_sz(0, perf.config_loads);
+	cl_assert_equal_sz(0, perf.odb_loads);
+	cl_assert_equal_sz(0, perf.index_loads);
+
+	cl_assert(!git_repository_is_bare(repo));
+	cl_assert(git__suffixcmp(
+		git_repository_workdir(repo), "empty_standard_repo/") == 0);
+
+	cl_git_pass(git_repository_get_perfdata(&perf, repo));
+	cl_assert_equal_sz(1, perf.config_loads);
+
+	git_repository_free(repo);
+}
+
+void test_repo_open__lazy_open_reads_worktree_settings(void)
+{
+	git_repository *repo;
+
+	cl_git_sandbox_init("empty_standard_repo");
+	make_gitlink_dir("alternate", "gitdir: ../empty_standard_repo/.git");
+
+	cl_git_pass(git_repository_open_ext(
+		&repo, "alternate", GIT_REPOSITORY_OPEN_LAZY, NULL));
+	cl_assert(git__suffixcmp(git_repository_workdir(repo), "alternate/") == 0);
+	git_repository_free(repo);
+
+	cl_git_pass(git_repository_open_ext(
+		&repo, cl_fixture("testrepo.git"), GIT_REPOSITORY_OPEN_LAZY, NULL));
+	cl_assert(git_repository_is_bare(repo));
+	cl_assert(git_repository_workdir(repo) == NULL);
+	git_repository_free(repo);
+}
+
+void test_repo_open__exact_gitdir(void)
+{
+	git_repository *repo;
+	git_buf path = GIT_BUF_INIT;
+
+	cl_git_sandbox_init("empty_standard_repo");
+	make_gitlink_dir("alternate", "gitdir: ../empty_standard_repo/.git");
+
+	cl_git_pass(git_repository_open_ext(
+		&repo, "empty_standard_repo/.git", GIT_REPOSITORY_OPEN_GITDIR, NULL));
+	cl_assert(git__suffixcmp(
+		git_repository_path(repo), "empty_standard_repo/.git/") == 0);
+	cl_assert(git__suffixcmp(
+		git_repository_workdir(repo), "empty_standard_repo/") == 0);
+	git_repository_free(repo);
+
+	/* an absolute path is taken as it is */
+	cl_git_pass(git_path_prettify_dir(&path, "empty_standard_repo", NULL));
+	cl_git_pass(git_buf_puts(&path, ".git/../.git"));
+	cl_git_pass(git_repository_open_ext(&repo, path.ptr,
+		GIT_REPOSITORY_OPEN_GITDIR | GIT_REPOSITORY_OPEN_LAZY, NULL));
+	cl_git_pass(git_buf_putc(&path, '/'));
+	cl_assert_equal_s(path.ptr, git_repository_path(repo));
+	git_repository_free(repo);
+	git_buf_free(&path);
+
+	/* no search and no gitlinks */
+	cl_assert_equal_i(GIT_ENOTFOUND, git_repository_open_ext(
+		&repo, "empty_standard_repo", GIT_REPOSITORY_OPEN_GITDIR, NULL));
+	cl_assert_equal_i(GIT_ENOTFOUND, git_repository_open_ext(
+		&repo, "alternate", GIT_REPOSITORY_OPEN_GITDIR, NULL));
+}
@@ -20,6 +20,7 @@ static char *str2[] = { "staged_*" };
 static char *str3[] = { "!subdir", "*_file", "new_file" };
 static char *str4[] = { "*" };
 static char *str5[] = { "S*" };
+static char *str6[] = { "subdir/new_file", "staged_new_file", "subdir/current_file" };
 
 void test_repo_pathspec__workdir0(void)
 {
@@ -383,3 +384,49 @@ void test_repo_pathspec__in_memory(void)
 
 	git_pathspec_free(ps);
 }
+
+void test_repo_pathspec__literal_paths_in_several_directories(void)
+{
+	git_index *idx;
+	git_object *tree;
+	git_strarray s;
+	git_pathspec *ps;
+	git_pathspec_match_list *m;
+
+	/* { "subdir/new_file", "staged_new_file", "subdir/current_file" } */
+	s.strings = str6; s.count = ARRAY_SIZE(str6);
+	cl_git_pass(git_pathspec_new(&ps, &s));
+
+	cl_git_pass(git_pathspec_match_workdir(&m, g_repo,
+		GIT_PATHSPEC_FIND_FAILURES, ps));
+	cl_assert_equal_sz(3, git_pathspec_match_list_entrycount(m));
+	cl_assert_equal_s("staged_new_file", git_pathspec_match_list_entry(m, 0));
+	cl_assert_equal_s("subdir/current_file", git_pathspec_match_list_entry(m, 1));
+	cl_assert_equal_s("subdir/new_file", git_pathspec_match_list_entry(m, 2));
+	cl_assert_equal_sz(0, git_pathspec_match_list_failed_entrycount(m));
+	git_pathspec_match_list_free(m);
+
+	cl_git_pass(git_repository_index(&idx, g_repo));
+	cl_git_pass(git_pathspec_match_index(&m, idx,
+		GIT_PATHSPEC_FIND_FAILURES, ps));
+	cl_assert_equal_sz(2, git_pathspec_match_list_entrycount(m));
+	cl_assert_equal_s("staged_new_file", git_pathspec_match_list_entry(m, 0));
+	cl_assert_equal_s("subdir/current_file", git_pathspec_match_list_entry(m, 1));
+	cl_assert_equal_sz(1, git_pathspec_match_list_failed_entrycount(m));
+	cl_assert_equal_s("subdir/new_file", git_pathspec_match_list_failed_entry(m, 0));
+	git_pathspec_match_list_free(m);
+	git_index_free(idx);
+
+	cl_git_pass(git_revparse_single(&tree, g_repo, "HEAD^{tree}"));
+	cl_git_pass(git_pathspec_match_tree(&m, (git_tree *)tree,
+		GIT_PATHSPEC_FIND_FAILURES, ps));
+	cl_assert_equal_sz(1, git_pathspec_match_list_entrycount(m));
+	cl_assert_equal_s("subdir/current_file", git_pathspec_match_list_entry(m, 0));
+	cl_assert_equal_sz(2, git_pathspec_match_list_failed_entrycount(m));
+	cl_assert_equal_s("subdir/new_file", git_pathspec_match_list_failed_entry(m, 0));
+	cl_assert_equal_s("staged_new_file", git_pathspec_match_list_failed_entry(m, 1));
+	git_pathspec_match_list_free(m);
+	git_object_free(tree);
+
+	git_pathspec_free(ps);
+}
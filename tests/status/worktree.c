@@ -280,6 +280,119 @@ void test_status_worktree__single_folder(void)
 	cl_assert(error != GIT_ENOTFOUND);
 }
 
+void test_status_worktree__file_list(void)
+{
+	int i;
+	unsigned int status_flags[17];
+	const char *paths[17];
+	git_repository *repo = cl_git_sandbox_init("status");
+
+	for (i = 0; i < (int)entry_count0; i++)
+		paths[i] = entry_paths0[i];
+
+	cl_git_pass(git_status_files(status_flags, repo, paths, entry_count0));
+
+	for (i = 0; i < (int)entry_count0; i++)
+		cl_assert_equal_i(entry_statuses0[i], status_flags[i]);
+
+	paths[entry_count0] = "nonexistent";
+	cl_assert_equal_i(GIT_ENOTFOUND,
+		git_status_files(status_flags, repo, paths, entry_count0 + 1));
+}
+
+void test_status_worktree__single_file_leaves_no_error(void)
+{
+	git_repository *repo = cl_git_sandbox_init("status");
+	unsigned int status_flags;
+
+	giterr_clear();
+	cl_git_pass(git_status_file(
+		&status_flags, repo, "staged_new_file_deleted_file"));
+	cl_assert_equal_i(
+		GIT_STATUS_INDEX_NEW | GIT_STATUS_WT_DELETED, status_flags);
+	cl_assert(giterr_last() == NULL);
+}
+
+static void assert_single_file_matches_list(
+	git_repository *repo, const char *path)
+{
+	git_status_list *list;
+	git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+	const git_status_entry *entry;
+	unsigned int status_flags;
+	char *pathspec = (char *)path;
+
+	opts.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED |
+		GIT_STATUS_OPT_INCLUDE_IGNORED |
+		GIT_STATUS_OPT_INCLUDE_UNMODIFIED;
+	opts.pathspec.strings = &pathspec;
+	opts.pathspec.count = 1;
+
+	cl_git_pass(git_status_list_new(&list, repo, &opts));
+	cl_assert_equal_i(1, git_status_list_entrycount(list));
+	entry = git_status_byindex(list, 0);
+
+	cl_git_pass(git_status_file(&status_flags, repo, path));
+	cl_assert_equal_i(entry->status, status_flags);
+
+	git_status_list_free(list);
+}
+
+void test_status_worktree__single_file_matches_full_status(void)
+{
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_index *index;
+	git_buf content = GIT_BUF_INIT;
+
+	/* same content, but the stat data no longer matches the index */
+	cl_git_pass(git_futils_readbuffer(&content, "status/current_file"));
+	cl_git_rewritefile("status/current_file", content.ptr);
+	git_buf_free(&content);
+
+	/* staged, then changed again in the workdir */
+	cl_git_pass(git_repository_index(&index, repo));
+	cl_git_rewritefile("status/subdir/current_file", "staged\n");
+	cl_git_pass(git_index_add_bypath(index, "subdir/current_file"));
+	cl_git_pass(git_index_write(index));
+	git_index_free(index);
+	cl_git_rewritefile("status/subdir/current_file", "changed again\n");
+
+	assert_single_file_matches_list(repo, "current_file");
+	assert_single_file_matches_list(repo, "subdir/current_file");
+	assert_single_file_matches_list(repo, "modified_file");
+	assert_single_file_matches_list(repo, "ignored_file");
+	assert_single_file_matches_list(repo, "staged_delete_modified_file");
+
+#ifndef GIT_WIN32
+	cl_must_pass(p_unlink("status/modified_file"));
+	cl_must_pass(p_symlink("current_file", "status/modified_file"));
+	assert_single_file_matches_list(repo, "modified_file");
+#endif
+}
+
+void test_status_worktree__single_file_matches_full_status_ignoring_case(void)
+{
+	git_repository *repo = cl_git_sandbox_init("status");
+	git_index *index;
+
+	cl_repo_set_bool(repo, "core.ignorecase", true);
+
+	cl_git_pass(git_repository_index(&index, repo));
+	cl_git_pass(git_index_set_caps(index, GIT_INDEXCAP_FROM_OWNER));
+	cl_assert((git_index_caps(index) & GIT_INDEXCAP_IGNORE_CASE) != 0);
+	git_index_free(index);
+
+	cl_git_rewritefile("status/subdir/current_file", "changed\n");
+
+	assert_single_file_matches_list(repo, "current_file");
+	assert_single_file_matches_list(repo, "subdir/current_file");
+	assert_single_file_matches_list(repo, "SUBDIR/Current_File");
+	assert_single_file_matches_list(repo, "modified_file");
+	assert_single_file_matches_list(repo, "Modified_File");
+	assert_single_file_matches_list(repo, "ignored_file");
+	assert_single_file_matches_list(repo, "staged_delete_modified_file");
+}
+
 
 void test_status_worktree__ignores(void)
 {